@@ -0,0 +1,29 @@
+// Shared by the ambient occlusion passes (AmbientOcclusionCpu.h has the CPU version).
+// View depth is clip w throughout.
+cbuffer AmbientOcclusionConstantBuffer : register(b3)
+{
+	matrix projection;
+	matrix inverseProjection;
+	matrix reprojection;	// view space of this frame to clip space of the previous one
+	float4 depthTerms;		// x, y: z / w = y / depth - x; z: depth from which a texel is background
+	float4 params;			// x: radius in world units, y: intensity, z: bias, w: samples skipped between those taken
+	float4 blur;			// xy: texel step along the pass axis, z: relative depth sigma, w: radius in texels
+	float4 temporal;		// x: first sample taken, y: weight of this frame against the history, z: relative depth tolerance, w: clamp margin
+};
+
+struct PixelShaderInput
+{
+	float4 pos : SV_POSITION;
+	float3 color : COLOR0;
+	float3 normal : NORMAL0;
+	float4 surfpos : POSITION0;
+	float2 tex : TEXCOORD0;
+};
+
+// View-space position of texel of a target of the given size at view depth w.
+float3 ViewPosition(float2 texel, float2 size, float w)
+{
+	float2 ndc = float2((texel.x + 0.5f) / size.x * 2 - 1, 1 - (texel.y + 0.5f) / size.y * 2);
+	float4 h = mul(float4(ndc, depthTerms.y / w - depthTerms.x, 1.0f), inverseProjection);
+	return h.xyz / h.w;
+}
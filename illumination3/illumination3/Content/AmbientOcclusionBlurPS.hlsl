@@ -0,0 +1,35 @@
+// One axis of the ambient occlusion blur: Gaussian taps that also fall off with the view
+// depth difference to the centre, so occlusion does not bleed across silhouettes.
+#include "AmbientOcclusion.hlsli"
+
+// must match MaxAmbientOcclusionBlurRadius in AmbientOcclusionCpu.h
+#define MAX_AO_BLUR_RADIUS 8
+
+Texture2D<float> occlusion : register(t0);
+Texture2D<float> halfDepth : register(t1);
+
+float main(PixelShaderInput input) : SV_TARGET
+{
+	int2 size;
+	halfDepth.GetDimensions(size.x, size.y);
+	int2 texel = int2(input.pos.xy);
+	int2 step = int2(blur.xy);
+	int radius = min((int)blur.w, MAX_AO_BLUR_RADIUS);
+	float sigma = max(radius * 0.5f, 0.5f);
+	float inverseTwoSigmaSquared = 1.0f / (2.0f * sigma * sigma);
+	float inverseTwoDepthSigmaSquared = 1.0f / (2.0f * blur.z * blur.z);
+
+	float centre = halfDepth.Load(int3(texel, 0));
+	float sum = 0;
+	float weightSum = 0;
+	[loop]
+	for (int i = -radius; i <= radius; i++)
+	{
+		int3 tap = int3(clamp(texel + i * step, int2(0, 0), size - 1), 0);
+		float d = (halfDepth.Load(tap) - centre) / centre;
+		float weight = exp(-(float)(i * i) * inverseTwoSigmaSquared - d * d * inverseTwoDepthSigmaSquared);
+		sum += occlusion.Load(tap) * weight;
+		weightSum += weight;
+	}
+	return sum / weightSum;
+}
@@ -0,0 +1,702 @@
+#include "AmbientOcclusionCpu.h"
+#include "GBufferPacking.h"
+#include "ScreenEffectsCpu.h"
+#include "../Helpers/ParallelFor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace DirectXGame1;
+using namespace DX;
+
+namespace
+{
+	const float Pi = 3.14159265358979f;
+	const float GoldenAngle = 2.39996323f;
+	const float TilingFactor = 2.0f;
+
+	uint32_t HalfSize(uint32_t size)
+	{
+		return size / 2 < 1 ? 1 : size / 2;
+	}
+
+	// Samples a frame skips between the ones it takes; a temporalFrames that does not divide
+	// the sample count takes them all.
+	unsigned int SampleStep(const AmbientOcclusionSettings& settings)
+	{
+		unsigned int frames = settings.temporalFrames;
+		return frames > 1 && AmbientOcclusionSamples % frames == 0 ? frames : 1;
+	}
+
+	// What the passes need from the projection, as AmbientOcclusionConstantBuffer carries it.
+	struct ProjectionTerms
+	{
+		float projection[4][4];
+		float inverse[4][4];
+		float a, b;				// z / w = b / w - a for view depth w
+		float background;		// view depth from which a texel counts as background
+	};
+
+	ProjectionTerms MakeProjectionTerms(const float projection[4][4])
+	{
+		ProjectionTerms terms;
+		std::copy(&projection[0][0], &projection[0][0] + 16, &terms.projection[0][0]);
+		InvertMatrix(projection, terms.inverse);
+		terms.a = projection[2][2];
+		terms.b = projection[3][2];
+		terms.background = 0.999f * terms.b / (1.0f + terms.a);
+		return terms;
+	}
+
+	float ViewDepth(const ProjectionTerms& terms, float z)
+	{
+		return terms.b / (z + terms.a);
+	}
+
+	void Transform(const float v[4], const float m[4][4], float out[4])
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			out[c] = v[0] * m[0][c] + v[1] * m[1][c] + v[2] * m[2][c] + v[3] * m[3][c];
+		}
+	}
+
+	// View-space position of texel (x, y) of a width x height target at view depth w.
+	void ViewPosition(const ProjectionTerms& terms, unsigned int x, unsigned int y, unsigned int width, unsigned int height, float w, float out[3])
+	{
+		const float ndc[4] = { (x + 0.5f) / width * 2.0f - 1.0f, 1.0f - (y + 0.5f) / height * 2.0f, terms.b / w - terms.a, 1.0f };
+		float h[4];
+		Transform(ndc, terms.inverse, h);
+		for (int c = 0; c < 3; c++)
+		{
+			out[c] = h[c] / h[3];
+		}
+	}
+
+	void Multiply(const float a[4][4], const float b[4][4], float out[4][4])
+	{
+		for (int r = 0; r < 4; r++)
+		{
+			Transform(a[r], b, out[r]);
+		}
+	}
+
+	void Cross(const float a[3], const float b[3], float out[3])
+	{
+		out[0] = a[1] * b[2] - a[2] * b[1];
+		out[1] = a[2] * b[0] - a[0] * b[2];
+		out[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	float Dot(const float a[3], const float b[3])
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	float Saturate(float v)
+	{
+		return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+	}
+
+	// Bilinear read of a plane with wrap addressing, as a sampler with
+	// D3D11_TEXTURE_ADDRESS_WRAP reads an R8 target.
+	float SamplePlaneWrap(const CpuPlane& plane, float u, float v)
+	{
+		float x = u * plane.width - 0.5f;
+		float y = v * plane.height - 0.5f;
+		float fx = std::floor(x);
+		float fy = std::floor(y);
+		int x0 = WrapTexel((int)fx, (int)plane.width);
+		int y0 = WrapTexel((int)fy, (int)plane.height);
+		int x1 = x0 + 1 == (int)plane.width ? 0 : x0 + 1;
+		int y1 = y0 + 1 == (int)plane.height ? 0 : y0 + 1;
+		float tx = x - fx, ty = y - fy;
+		float top = plane.At(x0, y0) + (plane.At(x1, y0) - plane.At(x0, y0)) * tx;
+		float bottom = plane.At(x0, y1) + (plane.At(x1, y1) - plane.At(x0, y1)) * tx;
+		return top + (bottom - top) * ty;
+	}
+
+#if defined(DX_HEADLESS_CHECKS)
+	// Bilinear read with clamp-to-edge addressing, to compare planes of different sizes.
+	float SamplePlaneClamp(const CpuPlane& plane, float u, float v)
+	{
+		float x = u * plane.width - 0.5f;
+		float y = v * plane.height - 0.5f;
+		float fx = std::floor(x);
+		float fy = std::floor(y);
+		int x0 = ClampTexel((int)fx, (int)plane.width);
+		int y0 = ClampTexel((int)fy, (int)plane.height);
+		int x1 = ClampTexel((int)fx + 1, (int)plane.width);
+		int y1 = ClampTexel((int)fy + 1, (int)plane.height);
+		float tx = x - fx, ty = y - fy;
+		float top = plane.At(x0, y0) + (plane.At(x1, y0) - plane.At(x0, y0)) * tx;
+		float bottom = plane.At(x0, y1) + (plane.At(x1, y1) - plane.At(x0, y1)) * tx;
+		return top + (bottom - top) * ty;
+	}
+
+	// Full-resolution view depth, for the comparison against the half-resolution passes.
+	void LinearizeDepthCpu(const CpuPlane& depth, const ProjectionTerms& terms, CpuPlane& viewDepth)
+	{
+		viewDepth.Resize(depth.width, depth.height);
+		for (size_t i = 0; i < depth.values.size(); i++)
+		{
+			viewDepth.values[i] = ViewDepth(terms, depth.values[i]);
+		}
+	}
+#endif
+
+	// One axis of the depth-aware blur.
+	void BlurAxis(const CpuPlane& source, const CpuPlane& halfDepth, const AmbientOcclusionSettings& settings, int stepX, int stepY, CpuPlane& target)
+	{
+		const int radius = (int)std::min(settings.blurRadius, MaxAmbientOcclusionBlurRadius);
+		const float sigma = std::max(radius * 0.5f, 0.5f);
+		const float inverseTwoSigmaSquared = 1.0f / (2.0f * sigma * sigma);
+		const float inverseTwoDepthSigmaSquared = 1.0f / (2.0f * settings.blurDepthSigma * settings.blurDepthSigma);
+		const int width = (int)source.width, height = (int)source.height;
+
+		ParallelFor(source.height, [&](unsigned int y)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				float centre = halfDepth.At(x, y);
+				float sum = 0.0f, weightSum = 0.0f;
+				for (int i = -radius; i <= radius; i++)
+				{
+					int tx = ClampTexel(x + i * stepX, width);
+					int ty = ClampTexel((int)y + i * stepY, height);
+					float d = (halfDepth.At(tx, ty) - centre) / centre;
+					float weight = std::exp(-(float)(i * i) * inverseTwoSigmaSquared - d * d * inverseTwoDepthSigmaSquared);
+					sum += source.At(tx, ty) * weight;
+					weightSum += weight;
+				}
+				target.At(x, y) = sum / weightSum;
+			}
+		});
+	}
+
+#if defined(DX_HEADLESS_CHECKS)
+	// Depth of the plane through point with the given normal (view space), as the depth
+	// buffer would hold it after drawing the plane over the whole target.
+	void RenderPlaneDepth(const ProjectionTerms& terms, const float point[3], const float normal[3], unsigned int width, unsigned int height, CpuPlane& depth)
+	{
+		depth.Resize(width, height, 1.0f);
+		float d = Dot(point, normal);
+		for (unsigned int y = 0; y < height; y++)
+		{
+			for (unsigned int x = 0; x < width; x++)
+			{
+				float ray[3];
+				ViewPosition(terms, x, y, width, height, 1.0f, ray);
+				float t = d / Dot(ray, normal);
+				if (t > 0.0f)
+				{
+					const float p[4] = { ray[0] * t, ray[1] * t, ray[2] * t, 1.0f };
+					float clip[4];
+					Transform(p, terms.projection, clip);
+					depth.At(x, y) = std::min(clip[2] / clip[3], 1.0f);
+				}
+			}
+		}
+	}
+#endif
+}
+
+AmbientOcclusionSettings::AmbientOcclusionSettings() :
+	radius(DefaultAmbientOcclusionRadius),
+	intensity(1.0f),
+	bias(0.005f),
+	blurRadius(4),
+	blurDepthSigma(0.05f),
+	temporalFrames(1),
+	historyDepthTolerance(0.02f),
+	historyClampMargin(0.1f)
+{
+}
+
+void DirectXGame1::DownsampleDepthCpu(const CpuPlane& depth, const float projection[4][4], CpuPlane& halfDepth)
+{
+	ProjectionTerms terms = MakeProjectionTerms(projection);
+	halfDepth.Resize(HalfSize(depth.width), HalfSize(depth.height));
+	const int width = (int)depth.width, height = (int)depth.height;
+	ParallelFor(halfDepth.height, [&](unsigned int y)
+	{
+		for (unsigned int x = 0; x < halfDepth.width; x++)
+		{
+			int x0 = ClampTexel(x * 2, width), x1 = ClampTexel(x * 2 + 1, width);
+			int y0 = ClampTexel(y * 2, height), y1 = ClampTexel(y * 2 + 1, height);
+			float z = std::min(std::min(depth.At(x0, y0), depth.At(x1, y0)), std::min(depth.At(x0, y1), depth.At(x1, y1)));
+			halfDepth.At(x, y) = ViewDepth(terms, z);
+		}
+	});
+}
+
+void DirectXGame1::ComputeAmbientOcclusionCpu(const CpuPlane& halfDepth, const float projection[4][4], const AmbientOcclusionSettings& settings, CpuPlane& ao, uint32_t frame)
+{
+	ProjectionTerms terms = MakeProjectionTerms(projection);
+	ao.Resize(halfDepth.width, halfDepth.height);
+	const unsigned int width = halfDepth.width, height = halfDepth.height;
+	const unsigned int step = SampleStep(settings);
+	const unsigned int first = frame % step;
+	const unsigned int taken = AmbientOcclusionSamples / step;
+
+	ParallelFor(height, [&](unsigned int y)
+	{
+		for (unsigned int x = 0; x < width; x++)
+		{
+			float w = halfDepth.At(x, y);
+			if (w >= terms.background)
+			{
+				ao.At(x, y) = 1.0f;
+				continue;
+			}
+
+			float p[3];
+			ViewPosition(terms, x, y, width, height, w, p);
+
+			// On each axis, the neighbour whose depth is closer to this texel's.
+			float wl = x > 0 ? halfDepth.At(x - 1, y) : 0.0f, wr = x + 1 < width ? halfDepth.At(x + 1, y) : 0.0f;
+			float wu = y > 0 ? halfDepth.At(x, y - 1) : 0.0f, wd = y + 1 < height ? halfDepth.At(x, y + 1) : 0.0f;
+			bool useRight = x == 0 || (x + 1 < width && std::fabs(wr - w) < std::fabs(w - wl));
+			bool useDown = y == 0 || (y + 1 < height && std::fabs(wd - w) < std::fabs(w - wu));
+			float px[3], py[3], dx[3], dy[3];
+			ViewPosition(terms, useRight ? x + 1 : x - 1, y, width, height, useRight ? wr : wl, px);
+			ViewPosition(terms, x, useDown ? y + 1 : y - 1, width, height, useDown ? wd : wu, py);
+			for (int c = 0; c < 3; c++)
+			{
+				dx[c] = useRight ? px[c] - p[c] : p[c] - px[c];
+				dy[c] = useDown ? py[c] - p[c] : p[c] - py[c];
+			}
+
+			// Screen y runs down, so dy x dx faces the camera; turned round if it does not.
+			float n[3];
+			Cross(dy, dx, n);
+			float length = std::sqrt(Dot(n, n));
+			float facing = -Dot(n, p) < 0.0f ? -1.0f : 1.0f;
+			for (int c = 0; c < 3; c++)
+			{
+				n[c] = length > 0.0f ? n[c] * facing / length : (c == 2 ? 1.0f : 0.0f);
+			}
+
+			// Tangent frame without a reference vector (Duff et al. 2017).
+			float sign = n[2] >= 0.0f ? 1.0f : -1.0f;
+			float a = -1.0f / (sign + n[2]);
+			float b = n[0] * n[1] * a;
+			const float t[3] = { 1.0f + sign * n[0] * n[0] * a, sign * b, -sign * n[0] };
+			const float bt[3] = { b, sign + n[1] * n[1] * a, -n[1] };
+
+			float noise = 52.9829189f * (0.06711056f * x + 0.00583715f * y);
+			noise = noise - std::floor(noise);
+			noise = noise - std::floor(noise);
+
+			float occlusion = 0.0f;
+			for (unsigned int i = first; i < AmbientOcclusionSamples; i += step)
+			{
+				// Evenly spread in solid angle over the hemisphere, on a golden-angle spiral,
+				// and packed towards the centre so near occluders count more.
+				float cosTheta = 1.0f - (i + 0.5f) / AmbientOcclusionSamples;
+				float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+				float phi = 2.0f * Pi * noise + GoldenAngle * i;
+				float s = (i + 1.0f) / AmbientOcclusionSamples;
+				float scale = settings.radius * (0.1f + 0.9f * s * s);
+				float cosPhi = std::cos(phi), sinPhi = std::sin(phi);
+
+				float sample[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+				for (int c = 0; c < 3; c++)
+				{
+					float dir = (t[c] * cosPhi + bt[c] * sinPhi) * sinTheta + n[c] * cosTheta;
+					sample[c] = p[c] + dir * scale;
+				}
+				float clip[4];
+				Transform(sample, terms.projection, clip);
+				if (!(clip[3] > 0.0f))
+				{
+					continue;
+				}
+				float su = clip[0] / clip[3] * 0.5f + 0.5f;
+				float sv = 0.5f - clip[1] / clip[3] * 0.5f;
+				if (!(su >= 0.0f && su < 1.0f && sv >= 0.0f && sv < 1.0f))
+				{
+					continue;
+				}
+				float sceneDepth = halfDepth.At((unsigned int)(su * width), (unsigned int)(sv * height));
+				if (sceneDepth < clip[3] - settings.bias)
+				{
+					// an occluder far in front of the surface is something else: it fades out
+					occlusion += Saturate(settings.radius / std::max(std::fabs(w - sceneDepth), 1e-6f));
+				}
+			}
+			ao.At(x, y) = Saturate(1.0f - settings.intensity * occlusion / taken);
+		}
+	});
+}
+
+void DirectXGame1::ComputeReprojectionCpu(const WorldPassCpuConstants& current, const WorldPassCpuConstants& previous, float reprojection[4][4])
+{
+	float inverseView[4][4], inverseModel[4][4], toObject[4][4], toPreviousWorld[4][4], toPreviousView[4][4];
+	InvertMatrix(current.view, inverseView);
+	InvertMatrix(current.model, inverseModel);
+	Multiply(inverseView, inverseModel, toObject);
+	Multiply(toObject, previous.model, toPreviousWorld);
+	Multiply(toPreviousWorld, previous.view, toPreviousView);
+	Multiply(toPreviousView, previous.projection, reprojection);
+}
+
+float DirectXGame1::AmbientOcclusionHistoryBlend(const AmbientOcclusionSettings& settings, uint32_t historyFrames)
+{
+	if (SampleStep(settings) == 1 || historyFrames == 0)
+	{
+		return 1.0f;
+	}
+	return 1.0f / std::min(historyFrames + 1, AmbientOcclusionHistoryLength);
+}
+
+uint32_t DirectXGame1::AccumulateAmbientOcclusionCpu(const CpuPlane& ao, const CpuPlane& halfDepth, const float projection[4][4], const float reprojection[4][4],
+	const CpuPlane& previousAo, const CpuPlane& previousDepth, const AmbientOcclusionSettings& settings, float blend, CpuPlane& accumulated)
+{
+	ProjectionTerms terms = MakeProjectionTerms(projection);
+	accumulated.Resize(ao.width, ao.height);
+	const int width = (int)ao.width, height = (int)ao.height;
+	const bool history = blend < 1.0f && previousAo.width == ao.width && previousAo.height == ao.height &&
+		previousDepth.width == ao.width && previousDepth.height == ao.height;
+
+	std::vector<uint32_t> rejected(height, 0);
+	ParallelFor(ao.height, [&](unsigned int y)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float current = ao.At(x, y);
+			accumulated.At(x, y) = current;
+			float w = halfDepth.At(x, y);
+			if (w >= terms.background)
+			{
+				continue;
+			}
+			rejected[y]++;
+			if (!history)
+			{
+				continue;
+			}
+
+			// where this surface was last frame, and whether the previous depth there agrees
+			float p[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+			ViewPosition(terms, x, y, width, height, w, p);
+			float clip[4];
+			Transform(p, reprojection, clip);
+			if (!(clip[3] > 0.0f))
+			{
+				continue;
+			}
+			float u = clip[0] / clip[3] * 0.5f + 0.5f;
+			float v = 0.5f - clip[1] / clip[3] * 0.5f;
+			if (!(u >= 0.0f && u < 1.0f && v >= 0.0f && v < 1.0f))
+			{
+				continue;
+			}
+			unsigned int px = (unsigned int)(u * width), py = (unsigned int)(v * height);
+			if (std::fabs(previousDepth.At(px, py) - clip[3]) > settings.historyDepthTolerance * clip[3])
+			{
+				continue;
+			}
+
+			float low = current, high = current;
+			for (int j = -1; j <= 1; j++)
+			{
+				for (int i = -1; i <= 1; i++)
+				{
+					float neighbour = ao.At(ClampTexel(x + i, width), ClampTexel((int)y + j, height));
+					low = std::min(low, neighbour);
+					high = std::max(high, neighbour);
+				}
+			}
+			float previous = std::min(std::max(previousAo.At(px, py), low - settings.historyClampMargin), high + settings.historyClampMargin);
+			accumulated.At(x, y) = previous + (current - previous) * blend;
+			rejected[y]--;
+		}
+	});
+
+	uint32_t count = 0;
+	for (uint32_t r : rejected)
+	{
+		count += r;
+	}
+	return count;
+}
+
+void DirectXGame1::BlurAmbientOcclusionCpu(CpuPlane& ao, const CpuPlane& halfDepth, const AmbientOcclusionSettings& settings, CpuPlane& scratch)
+{
+	if (settings.blurRadius == 0)
+	{
+		return;
+	}
+	scratch.Resize(ao.width, ao.height);
+	BlurAxis(ao, halfDepth, settings, 1, 0, scratch);
+	BlurAxis(scratch, halfDepth, settings, 0, 1, ao);
+}
+
+void DirectXGame1::ApplyScreenEffectsWithOcclusionCpu(const CpuCanvas& source, const CpuPlane& ao, CpuCanvas& target, float time)
+{
+	ParallelFor(target.height, [&](unsigned int y)
+	{
+		float v = (y + 0.5f) / target.height;
+		float* out = target.Row(y);
+		for (unsigned int x = 0; x < target.width; x++)
+		{
+			float u = (x + 0.5f) / target.width;
+			float occlusion = SamplePlaneWrap(ao, u * TilingFactor, v * TilingFactor);
+			float texel[4];
+			SimdStore(texel, SampleBilinearWrap(source, u * TilingFactor, v * TilingFactor));
+			ShadeScreenTexel(texel, u, v, time, out + x * 4);
+			SimdStore(out + x * 4, SimdMul(SimdLoad(out + x * 4), SimdSet(occlusion, occlusion, occlusion, 1.0f)));
+		}
+	});
+}
+
+void DirectXGame1::RenderTorusFrameWithOcclusionCpu(const TorusSceneCpu& scene, float seconds, uint32_t frame, const AmbientOcclusionSettings& settings, RasterizerCpu& rasterizer, CpuCanvas& world, CpuPlane& ao, CpuCanvas& screen)
+{
+	WorldPassCpuConstants constants = GetTorusFrameConstants(seconds, frame, float(world.width) / world.height);
+	rasterizer.Render(constants, &scene.vertices[0], (uint32_t)scene.vertices.size(), &scene.indices[0], (uint32_t)scene.indices.size(), world);
+
+	CpuPlane halfDepth, scratch;
+	DownsampleDepthCpu(rasterizer.GetDepth(), constants.projection, halfDepth);
+	ComputeAmbientOcclusionCpu(halfDepth, constants.projection, settings, ao);
+	BlurAmbientOcclusionCpu(ao, halfDepth, settings, scratch);
+
+	if (screen.width != world.width || screen.height != world.height)
+	{
+		screen.Resize(world.width, world.height);
+	}
+	ApplyScreenEffectsWithOcclusionCpu(world, ao, screen, (float)frame);
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+AmbientOcclusionReport DirectXGame1::ValidateAmbientOcclusion()
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	AmbientOcclusionReport report = {};
+	AmbientOcclusionSettings settings;
+	TorusSceneCpu scene;
+	RasterizerCpu rasterizer;
+
+	const unsigned int width = 1920, height = 1080;
+	WorldPassCpuConstants constants = GetTorusFrameConstants(0.0f, 0, (float)width / height);
+	ProjectionTerms terms = MakeProjectionTerms(constants.projection);
+	CpuCanvas world(width, height);
+	rasterizer.Render(constants, &scene.vertices[0], (uint32_t)scene.vertices.size(), &scene.indices[0], (uint32_t)scene.indices.size(), world);
+	const CpuPlane& depth = rasterizer.GetDepth();
+
+	// half resolution, as the renderer runs it, with the unblurred occlusion kept
+	CpuPlane halfDepth, halfRaw, halfAo, scratch;
+	DownsampleDepthCpu(depth, constants.projection, halfDepth);
+	ComputeAmbientOcclusionCpu(halfDepth, constants.projection, settings, halfRaw);
+	halfAo = halfRaw;
+	BlurAmbientOcclusionCpu(halfAo, halfDepth, settings, scratch);
+
+	// full resolution, blurred over the same distance on screen
+	AmbientOcclusionSettings fullSettings = settings;
+	fullSettings.blurRadius = std::min(settings.blurRadius * 2, MaxAmbientOcclusionBlurRadius);
+	CpuPlane fullDepth, fullAo;
+	LinearizeDepthCpu(depth, terms, fullDepth);
+	ComputeAmbientOcclusionCpu(fullDepth, constants.projection, fullSettings, fullAo);
+	BlurAmbientOcclusionCpu(fullAo, fullDepth, fullSettings, scratch);
+
+	report.backgroundMinimum = 1.0f;
+	uint32_t torusTexels = 0, leakTexels = 0;
+	double occlusionSum = 0.0, errorSum = 0.0, leakSum = 0.0;
+	for (unsigned int y = 0; y < halfDepth.height; y++)
+	{
+		for (unsigned int x = 0; x < halfDepth.width; x++)
+		{
+			if (halfDepth.At(x, y) >= terms.background)
+			{
+				report.backgroundMinimum = std::min(report.backgroundMinimum, halfAo.At(x, y));
+				bool besideTorus = false;
+				for (int i = -1; i <= 1; i++)
+				{
+					for (int j = -1; j <= 1; j++)
+					{
+						besideTorus |= halfDepth.At(ClampTexel(x + i, halfDepth.width), ClampTexel(y + j, halfDepth.height)) < terms.background;
+					}
+				}
+				if (besideTorus)
+				{
+					leakSum += halfRaw.At(x, y) - halfAo.At(x, y);
+					leakTexels++;
+				}
+				continue;
+			}
+			torusTexels++;
+			occlusionSum += 1.0 - halfAo.At(x, y);
+		}
+	}
+	report.torusMeanOcclusion = torusTexels ? occlusionSum / torusTexels : 0.0;
+	report.backgroundLeak = leakTexels ? leakSum / leakTexels : 0.0;
+
+	uint32_t fullTorusTexels = 0;
+	for (unsigned int y = 0; y < height; y++)
+	{
+		for (unsigned int x = 0; x < width; x++)
+		{
+			if (fullDepth.At(x, y) >= terms.background)
+			{
+				continue;
+			}
+			float half = SamplePlaneClamp(halfAo, (x + 0.5f) / width, (y + 0.5f) / height);
+			errorSum += std::fabs(half - fullAo.At(x, y));
+			fullTorusTexels++;
+		}
+	}
+	report.halfVersusFullError = fullTorusTexels ? errorSum / fullTorusTexels : 0.0;
+
+	// A wall tilted back from the camera: every sample is above it, so nothing is occluded.
+	const float point[3] = { 0.0f, 0.0f, -2.0f };
+	const float normal[3] = { 0.0f, 0.6f, 0.8f };
+	CpuPlane wallDepth, wallHalf, wallAo;
+	RenderPlaneDepth(terms, point, normal, width, height, wallDepth);
+	DownsampleDepthCpu(wallDepth, constants.projection, wallHalf);
+	ComputeAmbientOcclusionCpu(wallHalf, constants.projection, settings, wallAo);
+	report.flatMinimum = *std::min_element(wallAo.values.begin(), wallAo.values.end());
+
+	// what reaches the back buffer, with and without the occlusion
+	const unsigned int displayWidth = 1280, displayHeight = 720;
+	CpuCanvas displayWorld(displayWidth, displayHeight), plain(displayWidth, displayHeight), occluded(displayWidth, displayHeight);
+	CpuPlane displayAo;
+	uint64_t displayPixels = 0, changedPixels = 0;
+	double darkeningSum = 0.0;
+	for (uint32_t frame = 0; frame < 240; frame += 60)
+	{
+		float seconds = frame / 60.0f;
+		RenderTorusFrameCpu(scene, seconds, frame, rasterizer, displayWorld, plain);
+		RenderTorusFrameWithOcclusionCpu(scene, seconds, frame, settings, rasterizer, displayWorld, displayAo, occluded);
+		for (size_t i = 0; i < plain.texels.size(); i += 4)
+		{
+			double drop = 0.0;
+			for (int c = 0; c < 3; c++)
+			{
+				drop = std::max(drop, (double)DisplayValue(plain.texels[i + c]) - DisplayValue(occluded.texels[i + c]));
+			}
+			if (drop >= 0.5 / 255.0)
+			{
+				changedPixels++;
+				darkeningSum += drop;
+			}
+			displayPixels++;
+		}
+	}
+	report.displayedDifference = (double)changedPixels / displayPixels;
+	report.displayedDarkening = changedPixels ? darkeningSum / changedPixels : 0.0;
+
+	// cost at 4K
+	const unsigned int width4k = 3840, height4k = 2160;
+	WorldPassCpuConstants constants4k = GetTorusFrameConstants(0.0f, 0, (float)width4k / height4k);
+	CpuCanvas world4k(width4k, height4k);
+	rasterizer.Render(constants4k, &scene.vertices[0], (uint32_t)scene.vertices.size(), &scene.indices[0], (uint32_t)scene.indices.size(), world4k);
+
+	auto start = Clock::now();
+	DownsampleDepthCpu(rasterizer.GetDepth(), constants4k.projection, halfDepth);
+	ComputeAmbientOcclusionCpu(halfDepth, constants4k.projection, settings, halfAo);
+	BlurAmbientOcclusionCpu(halfAo, halfDepth, settings, scratch);
+	report.halfMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	start = Clock::now();
+	LinearizeDepthCpu(rasterizer.GetDepth(), MakeProjectionTerms(constants4k.projection), fullDepth);
+	ComputeAmbientOcclusionCpu(fullDepth, constants4k.projection, fullSettings, fullAo);
+	BlurAmbientOcclusionCpu(fullAo, fullDepth, fullSettings, scratch);
+	report.fullMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	return report;
+}
+
+TemporalAmbientOcclusionReport DirectXGame1::ValidateTemporalAmbientOcclusion()
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	TemporalAmbientOcclusionReport report = {};
+	AmbientOcclusionSettings reference;
+	AmbientOcclusionSettings settings;
+	settings.temporalFrames = DefaultAmbientOcclusionTemporalFrames;
+	report.samplesPerFrame = AmbientOcclusionSamples / settings.temporalFrames;
+
+	TorusSceneCpu scene;
+	RasterizerCpu rasterizer;
+	const unsigned int width = 640, height = 360;
+	const uint32_t frames = 48, settled = 16;
+	CpuCanvas world(width, height);
+
+	// Mean blurred error over the settled frames, with the torus spinning or not.
+	auto runSequence = [&](bool spinning, double& subsetError, double& temporalError, double& rejectedFraction)
+	{
+		CpuPlane halfDepth, previousDepth, referenceAo, subsetAo, history, accumulated, blurred, scratch;
+		WorldPassCpuConstants previous = {};
+		double subsetSum = 0.0, temporalSum = 0.0;
+		uint64_t texels = 0, rejected = 0;
+		for (uint32_t frame = 0; frame < frames; frame++)
+		{
+			WorldPassCpuConstants constants = GetTorusFrameConstants(spinning ? frame / 60.0f : 0.0f, frame, (float)width / height);
+			rasterizer.Render(constants, &scene.vertices[0], (uint32_t)scene.vertices.size(), &scene.indices[0], (uint32_t)scene.indices.size(), world);
+			DownsampleDepthCpu(rasterizer.GetDepth(), constants.projection, halfDepth);
+			ProjectionTerms terms = MakeProjectionTerms(constants.projection);
+
+			ComputeAmbientOcclusionCpu(halfDepth, constants.projection, reference, referenceAo);
+			BlurAmbientOcclusionCpu(referenceAo, halfDepth, reference, scratch);
+			ComputeAmbientOcclusionCpu(halfDepth, constants.projection, settings, subsetAo, frame);
+
+			float reprojection[4][4];
+			ComputeReprojectionCpu(constants, frame > 0 ? previous : constants, reprojection);
+			uint32_t dropped = AccumulateAmbientOcclusionCpu(subsetAo, halfDepth, constants.projection, reprojection, history, previousDepth, settings,
+				AmbientOcclusionHistoryBlend(settings, frame), accumulated);
+			history = accumulated;
+			previousDepth = halfDepth;
+			previous = constants;
+
+			if (frame < settled)
+			{
+				continue;
+			}
+			BlurAmbientOcclusionCpu(subsetAo, halfDepth, settings, scratch);
+			blurred = accumulated;
+			BlurAmbientOcclusionCpu(blurred, halfDepth, settings, scratch);
+			for (size_t i = 0; i < halfDepth.values.size(); i++)
+			{
+				if (halfDepth.values[i] >= terms.background)
+				{
+					continue;
+				}
+				subsetSum += std::fabs(subsetAo.values[i] - referenceAo.values[i]);
+				temporalSum += std::fabs(blurred.values[i] - referenceAo.values[i]);
+				texels++;
+			}
+			rejected += dropped;
+		}
+		subsetError = texels ? subsetSum / texels : 0.0;
+		temporalError = texels ? temporalSum / texels : 0.0;
+		rejectedFraction = texels ? (double)rejected / texels : 0.0;
+	};
+
+	double staticSubset, staticRejected;
+	runSequence(false, staticSubset, report.staticError, staticRejected);
+	runSequence(true, report.subsetError, report.movingError, report.rejectedFraction);
+
+	// cost at 4K: every sample, against one frame's share plus the temporal pass
+	const unsigned int width4k = 3840, height4k = 2160;
+	WorldPassCpuConstants constants4k = GetTorusFrameConstants(0.0f, 0, (float)width4k / height4k);
+	CpuCanvas world4k(width4k, height4k);
+	rasterizer.Render(constants4k, &scene.vertices[0], (uint32_t)scene.vertices.size(), &scene.indices[0], (uint32_t)scene.indices.size(), world4k);
+	CpuPlane halfDepth, ao, previousAo, accumulated;
+	DownsampleDepthCpu(rasterizer.GetDepth(), constants4k.projection, halfDepth);
+	ComputeAmbientOcclusionCpu(halfDepth, constants4k.projection, reference, previousAo);
+	float reprojection[4][4];
+	ComputeReprojectionCpu(constants4k, constants4k, reprojection);
+
+	auto start = Clock::now();
+	ComputeAmbientOcclusionCpu(halfDepth, constants4k.projection, reference, ao);
+	report.fullMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	start = Clock::now();
+	ComputeAmbientOcclusionCpu(halfDepth, constants4k.projection, settings, ao, 1);
+	AccumulateAmbientOcclusionCpu(ao, halfDepth, constants4k.projection, reprojection, previousAo, halfDepth, settings,
+		AmbientOcclusionHistoryBlend(settings, AmbientOcclusionHistoryLength), accumulated);
+	report.temporalMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	return report;
+}
+#endif
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "CpuCanvas.h"
+#include "RasterizerCpu.h"
+
+namespace DirectXGame1
+{
+	// Hemisphere samples per pixel; must match AO_SAMPLES in AmbientOcclusionPS.hlsl.
+	static const unsigned int AmbientOcclusionSamples = 12;
+
+	// Largest blur radius AmbientOcclusionBlurPS.hlsl takes, in half-resolution texels.
+	static const unsigned int MaxAmbientOcclusionBlurRadius = 8;
+
+	// A little under the torus's tube radius, so the tube does not occlude itself.
+	static const float DefaultAmbientOcclusionRadius = 0.15f;
+
+	// Frames the renderer spreads the samples over when temporal accumulation is on.
+	static const unsigned int DefaultAmbientOcclusionTemporalFrames = 4;
+
+	// Frames the history is averaged over once it has built up; AmbientOcclusionHistoryBlend.
+	static const unsigned int AmbientOcclusionHistoryLength = 8;
+
+	struct AmbientOcclusionSettings
+	{
+		AmbientOcclusionSettings();
+
+		float radius;				// how far the hemisphere reaches, world units
+		float intensity;			// 1: a fully occluded pixel goes black
+		float bias;					// view depth a sample has to be behind the scene by to count
+		unsigned int blurRadius;	// half-resolution texels each side, at most MaxAmbientOcclusionBlurRadius
+		float blurDepthSigma;		// view depth difference, relative to the centre's, at which a tap's weight falls to exp(-0.5)
+		unsigned int temporalFrames;	// frames the samples are spread over, a divisor of AmbientOcclusionSamples; 1 takes them all every frame
+		float historyDepthTolerance;	// relative view depth difference at which a reprojected history texel belongs to another surface
+		float historyClampMargin;		// how far history may stay outside this frame's neighbourhood range; a few samples rarely span the mean
+	};
+
+	// The passes below as the renderer runs them, for a projection matrix in row-vector form
+	// (mul(v, M)); view depth is clip w. Depth beyond 0.999 of the far plane is background,
+	// which gets no occlusion and casts none past its own depth.
+
+	// AmbientOcclusionDepthPS.hlsl: depth (z / w at full resolution, as the depth buffer holds
+	// it) to view depth at half resolution, each texel the nearest of its 2x2 block so thin
+	// edges in front survive. halfDepth is resized to depth / 2, at least 1x1. The GPU reads a
+	// D24 buffer, whose rounding moves view depth by about 1e-6 at the torus's distance.
+	void DownsampleDepthCpu(const CpuPlane& depth, const float projection[4][4], CpuPlane& halfDepth);
+
+	// AmbientOcclusionPS.hlsl: each texel's view-space position comes back from its depth, the
+	// normal from the neighbours (on each axis the side with the smaller depth step, so
+	// silhouettes do not bend it), and AmbientOcclusionSamples points in the hemisphere
+	// around the normal, turned per pixel by interleaved gradient noise, are tested against
+	// the depth they project to. ao is resized to match and holds 1 - intensity * occluded
+	// fraction, in [0, 1]. With temporalFrames above 1 only every temporalFrames-th sample is
+	// taken, from frame % temporalFrames, so consecutive frames cover the whole set.
+	void ComputeAmbientOcclusionCpu(const CpuPlane& halfDepth, const float projection[4][4], const AmbientOcclusionSettings& settings, CpuPlane& ao, uint32_t frame = 0);
+
+	// Takes a view-space position of the current frame to clip space of the previous one: back
+	// through the current view and model, then forward through the previous model, view and
+	// projection. The torus is the only thing with a model matrix; anything else that moves
+	// reprojects wrong and is left to the neighbourhood clamp.
+	void ComputeReprojectionCpu(const WorldPassCpuConstants& current, const WorldPassCpuConstants& previous, float reprojection[4][4]);
+
+	// Weight of this frame's samples against the history, after historyFrames frames of it: a
+	// running mean at first, then an exponential one over AmbientOcclusionHistoryLength frames.
+	// 1 (no history) when temporalFrames is 1 or the history is new.
+	float AmbientOcclusionHistoryBlend(const AmbientOcclusionSettings& settings, uint32_t historyFrames);
+
+	// AmbientOcclusionTemporalPS.hlsl: each texel is reprojected into the previous frame, and
+	// the occlusion there is kept if the previous depth agrees with where the surface should
+	// have been (historyDepthTolerance). It is clamped to the range of this frame's 3x3
+	// neighbourhood widened by historyClampMargin, so stale values cannot survive, and mixed
+	// in at 1 - blend. Background
+	// and texels without usable history take this frame's value. Returns how many those were
+	// among the texels that are not background.
+	uint32_t AccumulateAmbientOcclusionCpu(const CpuPlane& ao, const CpuPlane& halfDepth, const float projection[4][4], const float reprojection[4][4],
+		const CpuPlane& previousAo, const CpuPlane& previousDepth, const AmbientOcclusionSettings& settings, float blend, CpuPlane& accumulated);
+
+	// AmbientOcclusionBlurPS.hlsl, horizontal then vertical: a Gaussian of sigma blurRadius / 2
+	// whose taps also fall off with the view depth difference to the centre, so occlusion does
+	// not bleed across silhouettes. Clamp-to-edge. scratch is resized as needed.
+	void BlurAmbientOcclusionCpu(CpuPlane& ao, const CpuPlane& halfDepth, const AmbientOcclusionSettings& settings, CpuPlane& scratch);
+
+	// The screen pass with SCREEN_AMBIENT_OCCLUSION: ShadeScreenTexel's colour is multiplied by
+	// the occlusion read at the same tiled uv as the canvas, with wrap addressing and bilinear
+	// filtering, after the threshold, wipe and magnet and before bloom would be added. Same
+	// output as ApplyScreenEffectsCpu for an ao of all ones.
+	void ApplyScreenEffectsWithOcclusionCpu(const CpuCanvas& source, const CpuPlane& ao, CpuCanvas& target, float time);
+
+	// RenderTorusFrameCpu with the occlusion passes in between, for golden images: the world
+	// pass into world, its depth through the three passes into ao, then the screen pass into
+	// screen.
+	void RenderTorusFrameWithOcclusionCpu(const TorusSceneCpu& scene, float seconds, uint32_t frame, const AmbientOcclusionSettings& settings, RasterizerCpu& rasterizer, CpuCanvas& world, CpuPlane& ao, CpuCanvas& screen);
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct AmbientOcclusionReport
+	{
+		float flatMinimum;				// a plane facing the camera occludes nothing: should stay 1
+		float backgroundMinimum;		// texels with nothing drawn: should stay 1
+		double torusMeanOcclusion;		// 1 - ao over the torus's texels
+		double halfVersusFullError;		// mean |ao| difference, half resolution against full
+		double backgroundLeak;			// occlusion the blur spreads onto background beside the torus, mean
+		double displayedDifference;		// fraction of screen-pass pixels the occlusion moves by half an 8-bit step or more
+		double displayedDarkening;		// mean largest channel drop over those pixels
+		double halfMilliseconds;		// downsample, occlusion and blur at 3840x2160
+		double fullMilliseconds;		// occlusion and blur at full 3840x2160 resolution
+	};
+
+	// The torus at the renderer's camera, through the passes at half and at full resolution,
+	// plus a flat wall. The displayed fields compare RenderTorusFrameWithOcclusionCpu against
+	// RenderTorusFrameCpu over a few 1280x720 frames, by the largest channel drop after the
+	// clamp to [0, 1]. Cost is timed at 4K, where the half-resolution passes touch a quarter
+	// of the texels and so take about a quarter of the time.
+	AmbientOcclusionReport ValidateAmbientOcclusion();
+
+	struct TemporalAmbientOcclusionReport
+	{
+		unsigned int samplesPerFrame;	// with DefaultAmbientOcclusionTemporalFrames
+		double subsetError;				// mean |blurred ao - reference|, one frame's samples and no history
+		double staticError;				// the same with history, torus standing still
+		double movingError;				// with history, torus spinning at the renderer's speed
+		double rejectedFraction;		// torus texels whose history was dropped, spinning
+		double fullMilliseconds;		// occlusion with every sample at 3840x2160, half resolution
+		double temporalMilliseconds;	// one frame's samples plus the temporal pass
+	};
+
+	// A 60 Hz sequence at 640x360 with DefaultAmbientOcclusionTemporalFrames, against the occlusion with every
+	// sample in every frame (both blurred, over the torus's texels, once the history has
+	// settled), then the cost of both at 4K.
+	TemporalAmbientOcclusionReport ValidateTemporalAmbientOcclusion();
+#endif
+}
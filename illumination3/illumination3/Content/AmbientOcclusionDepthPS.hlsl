@@ -0,0 +1,18 @@
+// First ambient occlusion pass: the depth buffer at half resolution, as view depth. Each
+// texel keeps the nearest of its 2x2 block so thin edges in front survive.
+#include "AmbientOcclusion.hlsli"
+
+Texture2D<float> sceneDepth : register(t0);
+
+float main(PixelShaderInput input) : SV_TARGET
+{
+	uint width, height;
+	sceneDepth.GetDimensions(width, height);
+	int2 base = int2(input.pos.xy) * 2;
+	int2 last = int2(width, height) - 1;
+
+	float z = min(
+		min(sceneDepth.Load(int3(min(base, last), 0)), sceneDepth.Load(int3(min(base + int2(1, 0), last), 0))),
+		min(sceneDepth.Load(int3(min(base + int2(0, 1), last), 0)), sceneDepth.Load(int3(min(base + int2(1, 1), last), 0))));
+	return depthTerms.y / (z + depthTerms.x);
+}
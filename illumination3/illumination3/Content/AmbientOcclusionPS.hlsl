@@ -0,0 +1,74 @@
+// Hemisphere ambient occlusion at half resolution. The normal comes from the neighbours'
+// depths, on each axis from the side with the smaller step so silhouettes do not bend it, and
+// AO_SAMPLES points around it are tested against the depth they project to, or with temporal
+// accumulation every params.w-th of them from temporal.x, so a few frames cover them all.
+#include "AmbientOcclusion.hlsli"
+
+// must match AmbientOcclusionSamples in AmbientOcclusionCpu.h
+#define AO_SAMPLES 12
+
+Texture2D<float> halfDepth : register(t0);
+
+static const float Pi = 3.14159265f;
+static const float GoldenAngle = 2.39996323f;
+
+float main(PixelShaderInput input) : SV_TARGET
+{
+	float2 size;
+	halfDepth.GetDimensions(size.x, size.y);
+	int2 texel = int2(input.pos.xy);
+	float w = halfDepth.Load(int3(texel, 0));
+	if (w >= depthTerms.z)
+	{
+		return 1.0f;
+	}
+	float3 p = ViewPosition(texel, size, w);
+
+	float wl = texel.x > 0 ? halfDepth.Load(int3(texel - int2(1, 0), 0)) : 0;
+	float wr = texel.x + 1 < size.x ? halfDepth.Load(int3(texel + int2(1, 0), 0)) : 0;
+	float wu = texel.y > 0 ? halfDepth.Load(int3(texel - int2(0, 1), 0)) : 0;
+	float wd = texel.y + 1 < size.y ? halfDepth.Load(int3(texel + int2(0, 1), 0)) : 0;
+	bool useRight = texel.x == 0 || (texel.x + 1 < size.x && abs(wr - w) < abs(w - wl));
+	bool useDown = texel.y == 0 || (texel.y + 1 < size.y && abs(wd - w) < abs(w - wu));
+	float3 px = ViewPosition(texel + int2(useRight ? 1 : -1, 0), size, useRight ? wr : wl);
+	float3 py = ViewPosition(texel + int2(0, useDown ? 1 : -1), size, useDown ? wd : wu);
+	float3 dx = useRight ? px - p : p - px;
+	float3 dy = useDown ? py - p : p - py;
+
+	// screen y runs down, so dy x dx faces the camera; turned round if it does not
+	float3 n = normalize(cross(dy, dx));
+	n = dot(n, -p) < 0 ? -n : n;
+
+	// tangent frame without a reference vector (Duff et al. 2017)
+	float s = n.z >= 0 ? 1.0f : -1.0f;
+	float a = -1.0f / (s + n.z);
+	float b = n.x * n.y * a;
+	float3 t = float3(1.0f + s * n.x * n.x * a, s * b, -s * n.x);
+	float3 bt = float3(b, s + n.y * n.y * a, -n.y);
+
+	float noise = frac(52.9829189f * frac(0.06711056f * texel.x + 0.00583715f * texel.y));
+
+	int step = max((int)params.w, 1);
+	float occlusion = 0;
+	[loop]
+	for (int i = (int)temporal.x; i < AO_SAMPLES; i += step)
+	{
+		// even in solid angle on a golden-angle spiral, packed towards the centre
+		float cosTheta = 1.0f - (i + 0.5f) / AO_SAMPLES;
+		float sinTheta = sqrt(max(0.0f, 1.0f - cosTheta * cosTheta));
+		float phi = 2 * Pi * noise + GoldenAngle * i;
+		float k = (i + 1.0f) / AO_SAMPLES;
+		float scale = params.x * (0.1f + 0.9f * k * k);
+		float3 dir = (t * cos(phi) + bt * sin(phi)) * sinTheta + n * cosTheta;
+
+		float4 clip = mul(float4(p + dir * scale, 1.0f), projection);
+		float2 uv = float2(clip.x / clip.w * 0.5f + 0.5f, 0.5f - clip.y / clip.w * 0.5f);
+		if (clip.w > 0 && all(uv >= 0) && all(uv < 1))
+		{
+			float sceneDepth = halfDepth.Load(int3(uv * size, 0));
+			// an occluder far in front of the surface is something else: it fades out
+			occlusion += sceneDepth < clip.w - params.z ? saturate(params.x / max(abs(w - sceneDepth), 1e-6f)) : 0;
+		}
+	}
+	return saturate(1.0f - params.y * occlusion / (AO_SAMPLES / step));
+}
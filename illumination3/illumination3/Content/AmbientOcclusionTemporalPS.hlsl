@@ -0,0 +1,52 @@
+// Temporal accumulation of the occlusion: this frame's share of the samples blended with the
+// previous frame's result, found by reprojecting each texel through the previous model, view
+// and projection. History whose depth disagrees is another surface and is dropped; what is
+// kept is clamped to this frame's neighbourhood so stale occlusion cannot linger.
+#include "AmbientOcclusion.hlsli"
+
+Texture2D<float> occlusion : register(t0);
+Texture2D<float> halfDepth : register(t1);
+Texture2D<float> previousOcclusion : register(t2);
+Texture2D<float> previousDepth : register(t3);
+
+float main(PixelShaderInput input) : SV_TARGET
+{
+	int2 size;
+	halfDepth.GetDimensions(size.x, size.y);
+	int2 texel = int2(input.pos.xy);
+	float current = occlusion.Load(int3(texel, 0));
+	float w = halfDepth.Load(int3(texel, 0));
+	if (w >= depthTerms.z || temporal.y >= 1.0f)
+	{
+		return current;
+	}
+
+	// where this surface was last frame, and whether the previous depth there agrees
+	float4 clip = mul(float4(ViewPosition(texel, size, w), 1.0f), reprojection);
+	float2 uv = float2(clip.x / clip.w * 0.5f + 0.5f, 0.5f - clip.y / clip.w * 0.5f);
+	if (!(clip.w > 0) || any(uv < 0) || any(uv >= 1))
+	{
+		return current;
+	}
+	int3 previous = int3(uv * size, 0);
+	if (abs(previousDepth.Load(previous) - clip.w) > temporal.z * clip.w)
+	{
+		return current;
+	}
+
+	float low = current;
+	float high = current;
+	[unroll]
+	for (int j = -1; j <= 1; j++)
+	{
+		[unroll]
+		for (int i = -1; i <= 1; i++)
+		{
+			float neighbour = occlusion.Load(int3(clamp(texel + int2(i, j), int2(0, 0), size - 1), 0));
+			low = min(low, neighbour);
+			high = max(high, neighbour);
+		}
+	}
+	float history = clamp(previousOcclusion.Load(previous), low - temporal.w, high + temporal.w);
+	return lerp(history, current, temporal.y);
+}
@@ -0,0 +1,242 @@
+#include "BloomCpu.h"
+#include "BlurCpu.h"
+#include "TiledEffectsCpu.h"
+#include "../Helpers/ParallelFor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace DirectXGame1;
+using namespace DX;
+
+namespace
+{
+	// Offsets, in source texels, of the 13 reads of the downsample. A destination pixel sits on
+	// the corner of four source texels, so every read averages a 2x2 block.
+	const float DownsampleOffsets[13][2] = {
+		{ -2.0f, -2.0f }, { 0.0f, -2.0f }, { 2.0f, -2.0f },
+		{ -1.0f, -1.0f }, { 1.0f, -1.0f },
+		{ -2.0f, 0.0f }, { 0.0f, 0.0f }, { 2.0f, 0.0f },
+		{ -1.0f, 1.0f }, { 1.0f, 1.0f },
+		{ -2.0f, 2.0f }, { 0.0f, 2.0f }, { 2.0f, 2.0f } };
+
+	// Weight of each read: the inner 2x2 group counts 0.5 and each of the four outer groups
+	// 0.125, spread over its four reads; reads shared by two or four groups add up.
+	const float DownsampleWeights[13] = {
+		0.03125f, 0.0625f, 0.03125f,
+		0.125f, 0.125f,
+		0.0625f, 0.125f, 0.0625f,
+		0.125f, 0.125f,
+		0.03125f, 0.0625f, 0.03125f };
+
+	const float TentWeights[3] = { 0.25f, 0.5f, 0.25f };
+
+	uint32_t HalfSize(uint32_t size)
+	{
+		return size / 2 < 1 ? 1 : size / 2;
+	}
+
+	// Visits every pixel of target with its uv, one band of rows per worker.
+	template <typename Func>
+	void ForEachPixel(CpuCanvas& target, const Func& func)
+	{
+		ParallelFor(target.height, [&](unsigned int y)
+		{
+			float v = (y + 0.5f) / target.height;
+			float* out = target.Row(y);
+			for (unsigned int x = 0; x < target.width; x++)
+			{
+				func((x + 0.5f) / target.width, v, out + x * 4);
+			}
+		});
+	}
+}
+
+float DirectXGame1::BloomBrightPass(const float rgb[3], float threshold, float knee)
+{
+	float brightness = rgb[0] + rgb[1] + rgb[2];
+	float soft = std::min(std::max(brightness - threshold + knee, 0.0f), 2.0f * knee);
+	soft = soft * soft / (4.0f * knee + 1e-5f);
+	return std::max(soft, brightness - threshold) / std::max(brightness, 1e-5f);
+}
+
+void DirectXGame1::BloomDownsampleCpu(const CpuCanvas& source, CpuCanvas& target, bool prefilter, float threshold, float knee)
+{
+	if (source.width == 0 || source.height == 0)
+	{
+		return;
+	}
+
+	const float texelU = 1.0f / source.width;
+	const float texelV = 1.0f / source.height;
+	ForEachPixel(target, [&](float u, float v, float* out)
+	{
+		SimdFloat4 sum = SimdZero();
+		for (int i = 0; i < 13; i++)
+		{
+			SimdFloat4 read = SampleBilinearClamp(source, u + DownsampleOffsets[i][0] * texelU, v + DownsampleOffsets[i][1] * texelV);
+			sum = SimdMulAdd(read, SimdSplat(DownsampleWeights[i]), sum);
+		}
+		SimdStore(out, sum);
+		if (prefilter)
+		{
+			float weight = BloomBrightPass(out, threshold, knee);
+			out[0] *= weight;
+			out[1] *= weight;
+			out[2] *= weight;
+		}
+		out[3] = 1.0f;
+	});
+}
+
+void DirectXGame1::BloomUpsampleAddCpu(const CpuCanvas& lowRes, CpuCanvas& target)
+{
+	if (lowRes.width == 0 || lowRes.height == 0)
+	{
+		return;
+	}
+
+	const float texelU = 1.0f / lowRes.width;
+	const float texelV = 1.0f / lowRes.height;
+	ForEachPixel(target, [&](float u, float v, float* out)
+	{
+		SimdFloat4 sum = SimdLoad(out);
+		for (int j = 0; j < 3; j++)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				SimdFloat4 read = SampleBilinearClamp(lowRes, u + (i - 1) * texelU, v + (j - 1) * texelV);
+				sum = SimdMulAdd(read, SimdSplat(TentWeights[i] * TentWeights[j]), sum);
+			}
+		}
+		SimdStore(out, sum);
+		out[3] = 1.0f;
+	});
+}
+
+void DirectXGame1::BuildBloomCpu(const CpuCanvas& source, unsigned int levels, std::vector<CpuCanvas>& chain, float threshold, float knee)
+{
+	levels = std::max(1u, std::min(levels, MaxBloomLevels));
+	chain.resize(levels);
+
+	uint32_t width = source.width;
+	uint32_t height = source.height;
+	for (unsigned int i = 0; i < levels; i++)
+	{
+		width = HalfSize(width);
+		height = HalfSize(height);
+		if (chain[i].width != width || chain[i].height != height)
+		{
+			chain[i].Resize(width, height);
+		}
+		BloomDownsampleCpu(i == 0 ? source : chain[i - 1], chain[i], i == 0, threshold, knee);
+	}
+
+	for (unsigned int i = levels - 1; i > 0; i--)
+	{
+		BloomUpsampleAddCpu(chain[i], chain[i - 1]);
+	}
+}
+
+void DirectXGame1::CompositeBloomCpu(CpuCanvas& screen, const CpuCanvas& bloom, float intensity)
+{
+	if (bloom.width == 0 || bloom.height == 0 || intensity <= 0.0f)
+	{
+		return;
+	}
+
+	const SimdFloat4 scale = SimdSet(intensity, intensity, intensity, 0.0f);
+	ForEachPixel(screen, [&](float u, float v, float* out)
+	{
+		SimdStore(out, SimdMulAdd(SampleBilinearWrap(bloom, u * 2.0f, v * 2.0f), scale, SimdLoad(out)));
+	});
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+BloomReport DirectXGame1::ValidateBloom(unsigned int width, unsigned int height, unsigned int levels)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	BloomReport report;
+	report.width = width;
+	report.height = height;
+	report.levels = std::max(1u, std::min(levels, MaxBloomLevels));
+
+	// Flat bright canvas: every downsample keeps the bright-pass value, and each upsample adds
+	// one more copy of it, so the top level ends up at levels times that value.
+	const float bright[3] = { 0.5f, 0.4f, 0.3f };
+	CpuCanvas source(width, height);
+	for (size_t i = 0; i < source.texels.size(); i += 4)
+	{
+		source.texels[i] = bright[0];
+		source.texels[i + 1] = bright[1];
+		source.texels[i + 2] = bright[2];
+		source.texels[i + 3] = 1.0f;
+	}
+
+	std::vector<CpuCanvas> chain;
+	BuildBloomCpu(source, report.levels, chain);
+	float expected = report.levels * BloomBrightPass(bright, BloomThreshold, DefaultBloomKnee);
+	report.uniformError = 0.0f;
+	for (size_t i = 0; i < chain[0].texels.size(); i += 4)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			report.uniformError = std::max(report.uniformError, std::fabs(chain[0].texels[i + c] - expected * bright[c]));
+		}
+	}
+
+	// Flat dark canvas, just under the soft knee: nothing may get through.
+	for (size_t i = 0; i < source.texels.size(); i += 4)
+	{
+		source.texels[i] = source.texels[i + 1] = source.texels[i + 2] = (BloomThreshold - DefaultBloomKnee) / 3.0f - 0.001f;
+	}
+	BuildBloomCpu(source, report.levels, chain);
+	report.belowThresholdMax = 0.0f;
+	for (size_t i = 0; i < chain[0].texels.size(); i += 4)
+	{
+		report.belowThresholdMax = std::max(report.belowThresholdMax, std::fabs(chain[0].texels[i]));
+	}
+
+	// Reads of the chain per output pixel: 13 per pixel of every level, 9 per pixel of every
+	// level an upsample writes.
+	const double pixels = (double)width * height;
+	double reads = 0.0;
+	for (unsigned int i = 0; i < chain.size(); i++)
+	{
+		double area = (double)chain[i].width * chain[i].height;
+		reads += 13.0 * area + (i + 1 < chain.size() ? 9.0 * area : 0.0);
+	}
+	report.bloomSamplesPerPixel = reads / pixels;
+
+	// Something with edges for the timed runs.
+	for (unsigned int y = 0; y < height; y++)
+	{
+		for (unsigned int x = 0; x < width; x++)
+		{
+			float* texel = source.At(x, y);
+			bool inside = ((x / 97) + (y / 61)) % 3 == 0;
+			texel[0] = inside ? 0.6f : 0.05f;
+			texel[1] = inside ? 0.3f : 0.05f;
+			texel[2] = 0.1f;
+		}
+	}
+
+	auto start = Clock::now();
+	BuildBloomCpu(source, report.levels, chain);
+	report.bloomMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	int radius = std::min(1 << (report.levels + 1), MaxBlurRadius);
+	std::vector<BlurTap> taps = ComputeLinearBlurTaps(radius);
+	report.wideBlurSamplesPerPixel = 2.0 * (1.0 + 2.0 * (taps.size() - 1));
+
+	CpuCanvas temp(width, height), blurred(width, height);
+	start = Clock::now();
+	BlurAxisDirectCpu(source, temp, taps, BlurAxis::Horizontal);
+	BlurAxisDirectCpu(temp, blurred, taps, BlurAxis::Vertical);
+	report.wideBlurMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	return report;
+}
+#endif
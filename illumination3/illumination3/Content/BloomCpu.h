@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include "CpuCanvas.h"
+
+namespace DirectXGame1
+{
+	// screenps.hlsl keeps pixels whose r + g + b is above 0.3; the bloom starts from the same test.
+	static const float BloomThreshold = 0.3f;
+	// Width of the soft ramp around the threshold, so the glow fades in instead of popping.
+	static const float DefaultBloomKnee = 0.1f;
+	// Levels of the mip chain: 1/2 down to 1/32 of the output size.
+	static const unsigned int DefaultBloomLevels = 5;
+	static const unsigned int MaxBloomLevels = 8;
+
+	// How much of a colour passes the threshold, by its r + g + b brightness. Same curve as
+	// the prefilter in BloomDownsamplePS.hlsl.
+	float BloomBrightPass(const float rgb[3], float threshold, float knee);
+
+	// CPU version of BloomDownsamplePS.hlsl: the 13-tap downsample (four overlapping 2x2 box
+	// groups plus a centre one, from 13 bilinear reads) with clamp addressing. With prefilter
+	// the result also goes through BloomBrightPass; the first level uses it.
+	void BloomDownsampleCpu(const CpuCanvas& source, CpuCanvas& target, bool prefilter, float threshold = BloomThreshold, float knee = DefaultBloomKnee);
+
+	// CPU version of BloomUpsamplePS.hlsl: adds a 3x3 tent filtered read of lowRes to every
+	// target pixel, as the additive-blended upsample pass does.
+	void BloomUpsampleAddCpu(const CpuCanvas& lowRes, CpuCanvas& target);
+
+	// Runs the whole chain: chain[0] is 1/2 of source, each next level half the previous one.
+	// After the upsample passes chain[0] holds the bloom the screen pass adds.
+	void BuildBloomCpu(const CpuCanvas& source, unsigned int levels, std::vector<CpuCanvas>& chain, float threshold = BloomThreshold, float knee = DefaultBloomKnee);
+
+	// What the screen pass does with chain[0]: adds intensity times the bloom, read through the
+	// same 2x tiled, wrapping uv as the canvas.
+	void CompositeBloomCpu(CpuCanvas& screen, const CpuCanvas& bloom, float intensity);
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct BloomReport
+	{
+		unsigned int width;
+		unsigned int height;
+		unsigned int levels;
+		float uniformError;				// flat bright canvas: every level should be levels * bright-pass
+		float belowThresholdMax;		// flat canvas under the threshold: should stay 0
+		double bloomSamplesPerPixel;	// bilinear reads of the whole chain, per output pixel
+		double wideBlurSamplesPerPixel;	// separable full-resolution blur with the same reach
+		double bloomMilliseconds;
+		double wideBlurMilliseconds;	// the wide blur done with per-tap reads, as BlurPS.hlsl does
+	};
+
+	// Checks the chain on flat canvases and compares its cost against a full-resolution
+	// separable blur that reaches about as far (radius 2 ^ (levels + 1), capped at MaxBlurRadius).
+	BloomReport ValidateBloom(unsigned int width = 1920, unsigned int height = 1080, unsigned int levels = DefaultBloomLevels);
+#endif
+}
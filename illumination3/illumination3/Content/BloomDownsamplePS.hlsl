@@ -0,0 +1,55 @@
+// One step down the bloom mip chain: the 13-tap downsample. A target pixel sits on the corner
+// of four source texels, so each bilinear read averages a 2x2 block; the reads form a centre
+// group (weight 0.5) and four overlapping corner groups (0.125 each), which keeps thin bright
+// features from flickering as they move. The first level also applies the bright pass.
+// Same weights as BloomDownsampleCpu.
+
+Texture2D source : register(t0);
+SamplerState clampSampler : register(s0);
+
+cbuffer BloomConstantBuffer : register(b3)
+{
+	float4 texelSize;	// xy: one source texel in uv units
+	float4 params;		// x: threshold, y: knee, z: 1 to apply the bright pass
+};
+
+struct PixelShaderInput
+{
+	float4 pos : SV_POSITION;
+	float3 color : COLOR0;
+	float3 normal : NORMAL0;
+	float4 surfpos : POSITION0;
+	float2 tex : TEXCOORD0;
+};
+
+float3 Read(float2 uv, float2 offset)
+{
+	return source.Sample(clampSampler, uv + offset * texelSize.xy).rgb;
+}
+
+// Soft-knee version of screenps.hlsl's r + g + b > threshold test.
+float BrightPass(float3 rgb)
+{
+	float brightness = rgb.r + rgb.g + rgb.b;
+	float soft = clamp(brightness - params.x + params.y, 0.0, 2.0 * params.y);
+	soft = soft * soft / (4.0 * params.y + 1e-5);
+	return max(soft, brightness - params.x) / max(brightness, 1e-5);
+}
+
+float4 main(PixelShaderInput input) : SV_TARGET
+{
+	float2 uv = input.tex;
+
+	float3 inner = Read(uv, float2(-1, -1)) + Read(uv, float2(1, -1)) + Read(uv, float2(-1, 1)) + Read(uv, float2(1, 1));
+	float3 corners = Read(uv, float2(-2, -2)) + Read(uv, float2(2, -2)) + Read(uv, float2(-2, 2)) + Read(uv, float2(2, 2));
+	float3 edges = Read(uv, float2(0, -2)) + Read(uv, float2(-2, 0)) + Read(uv, float2(2, 0)) + Read(uv, float2(0, 2));
+	float3 centre = Read(uv, float2(0, 0));
+
+	float3 colour = inner * 0.125 + corners * 0.03125 + edges * 0.0625 + centre * 0.125;
+	if (params.z > 0.5)
+	{
+		colour *= BrightPass(colour);
+	}
+
+	return float4(colour, 1.0f);
+}
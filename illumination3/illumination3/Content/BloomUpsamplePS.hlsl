@@ -0,0 +1,35 @@
+// One step up the bloom mip chain: a 3x3 tent read of the smaller level, drawn with additive
+// blending onto the next larger one, so each level ends up holding itself plus everything
+// below it. Same weights as BloomUpsampleAddCpu.
+
+Texture2D lowRes : register(t0);
+SamplerState clampSampler : register(s0);
+
+cbuffer BloomConstantBuffer : register(b3)
+{
+	float4 texelSize;	// xy: one low-resolution texel in uv units
+	float4 params;		// unused here
+};
+
+struct PixelShaderInput
+{
+	float4 pos : SV_POSITION;
+	float3 color : COLOR0;
+	float3 normal : NORMAL0;
+	float4 surfpos : POSITION0;
+	float2 tex : TEXCOORD0;
+};
+
+float4 main(PixelShaderInput input) : SV_TARGET
+{
+	float2 uv = input.tex;
+	float2 d = texelSize.xy;
+
+	float3 sum = lowRes.Sample(clampSampler, uv).rgb * 4.0;
+	sum += (lowRes.Sample(clampSampler, uv + float2(-d.x, 0)).rgb + lowRes.Sample(clampSampler, uv + float2(d.x, 0)).rgb +
+		lowRes.Sample(clampSampler, uv + float2(0, -d.y)).rgb + lowRes.Sample(clampSampler, uv + float2(0, d.y)).rgb) * 2.0;
+	sum += lowRes.Sample(clampSampler, uv + float2(-d.x, -d.y)).rgb + lowRes.Sample(clampSampler, uv + float2(d.x, -d.y)).rgb +
+		lowRes.Sample(clampSampler, uv + float2(-d.x, d.y)).rgb + lowRes.Sample(clampSampler, uv + float2(d.x, d.y)).rgb;
+
+	return float4(sum / 16.0, 1.0f);
+}
@@ -0,0 +1,66 @@
+// Compute version of BlurPS.hlsl. A group takes BLUR_GROUP_SIZE pixels of one row (or one
+// column for the vertical axis), loads them plus the apron into shared memory once, and
+// evaluates every tap from there instead of sampling the texture per tap.
+// Dispatch(ceil(length / BLUR_GROUP_SIZE), lines, 1). Same result as BlurAxisTiledCpu.
+
+#define BLUR_GROUP_SIZE 128
+#define BLUR_MAX_APRON 65	// MaxBlurRadius + 1: the last tap's offset plus the second texel it blends
+#define MAX_BLUR_TAPS 33
+
+Texture2D<float4> source : register(t0);
+RWTexture2D<float4> target : register(u0);
+
+cbuffer BlurConstantBuffer : register(b3)
+{
+	float4 texelStep;				// x != 0: horizontal, else vertical; z: tap count; w: apron in texels
+	float4 taps[MAX_BLUR_TAPS];		// x: offset in texels, y: weight. taps[0] is the centre.
+};
+
+groupshared float3 cache[BLUR_GROUP_SIZE + 2 * BLUR_MAX_APRON];
+
+// Linear blend between the two cached texels around centre + offset. The fraction comes from
+// the offset alone, as in BlurAxisTiledCpu.
+float3 Fetch(int centre, float offset)
+{
+	float base = floor(offset);
+	int i = centre + (int)base;
+	return lerp(cache[i], cache[i + 1], offset - base);
+}
+
+[numthreads(BLUR_GROUP_SIZE, 1, 1)]
+void main(uint3 group : SV_GroupID, uint3 thread : SV_GroupThreadID)
+{
+	uint width, height;
+	source.GetDimensions(width, height);
+
+	bool horizontal = texelStep.x != 0.0;
+	int length = horizontal ? (int)width : (int)height;
+	int start = group.x * BLUR_GROUP_SIZE;
+	int apron = min((int)texelStep.w, BLUR_MAX_APRON);
+
+	for (int i = thread.x; i < BLUR_GROUP_SIZE + 2 * apron; i += BLUR_GROUP_SIZE)
+	{
+		int p = clamp(start - apron + i, 0, length - 1);
+		int2 texel = horizontal ? int2(p, group.y) : int2(group.y, p);
+		cache[i] = source.Load(int3(texel, 0)).rgb;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	int position = start + thread.x;
+	if (position >= length)
+	{
+		return;
+	}
+
+	int centre = thread.x + apron;
+	float3 sum = Fetch(centre, 0.0) * taps[0].y;
+
+	int count = (int)texelStep.z;
+	for (int k = 1; k < count; k++)
+	{
+		sum += Fetch(centre, taps[k].x) * taps[k].y;
+		sum += Fetch(centre, -taps[k].x) * taps[k].y;
+	}
+
+	target[horizontal ? int2(position, group.y) : int2(group.y, position)] = float4(sum, 1.0f);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include "CpuCanvas.h"
+
+namespace DirectXGame1
+{
+	// Largest radius, in texels, the GPU blur passes accept.
+	static const int MaxBlurRadius = 64;
+
+	// One tap of a separable blur pass: sample at +/-offset texels along the pass axis.
+	struct BlurTap
+	{
+		float offset;
+		float weight;
+	};
+
+	// Standard deviation used for a blur of the given radius (the kernel is cut at 3 sigma).
+	inline float BlurSigmaForRadius(int radius)
+	{
+		return radius > 0 ? radius / 3.0f : 0.0f;
+	}
+
+	// Gaussian taps for one axis, arranged so every tap after the first sits between two
+	// texels and a single bilinear fetch reads both with the right weights. taps[0] is the
+	// centre texel; each later tap is applied at +offset and -offset. Returns
+	// 1 + ceil(radius / 2) taps instead of 1 + radius.
+	std::vector<BlurTap> ComputeLinearBlurTaps(int radius);
+
+	// Sliding-window box blur, horizontal then vertical, with clamp-to-edge addressing.
+	// Cost per pixel does not depend on the radius. scratch is resized as needed.
+	void BoxBlurCpu(CpuCanvas& canvas, CpuCanvas& scratch, int radius);
+
+	// Gaussian approximation from repeated box blurs whose widths are picked to match
+	// BlurSigmaForRadius(radius). Three passes are within a few percent of the true kernel.
+	void GaussianBlurCpu(CpuCanvas& canvas, CpuCanvas& scratch, int radius, int boxPasses = 3);
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct BlurReport
+	{
+		unsigned int boxCases;			// canvas size and radius pairs checked
+		float boxMaxError;				// BoxBlurCpu against a direct clamp-to-edge 2D box
+		float gaussianMaxSigmaError;	// relative, GaussianBlurCpu's kernel against BlurSigmaForRadius
+		float gaussianMaxMassError;		// an impulse's total after GaussianBlurCpu, against 1
+	};
+
+	// Runs BoxBlurCpu on noise at sizes from 1x1 to 100x3 and radii from 1 to MaxBlurRadius,
+	// and GaussianBlurCpu on an impulse for every radius from 4 to MaxBlurRadius.
+	BlurReport ValidateBlur();
+#endif
+}
@@ -0,0 +1,38 @@
+// One axis of the separable blur. Run once with a horizontal step and once with a
+// vertical step; together they replace the old 25-read diagonal loop in screenps.hlsl.
+
+#define MAX_BLUR_TAPS 33
+
+Texture2D canvas : register(t0);
+SamplerState clampSampler : register(s0);
+
+cbuffer BlurConstantBuffer : register(b3)
+{
+	float4 texelStep;				// xy: one texel along the blur axis in uv units, z: tap count
+	float4 taps[MAX_BLUR_TAPS];		// x: offset in texels, y: weight. taps[0] is the centre.
+};
+
+struct PixelShaderInput
+{
+	float4 pos : SV_POSITION;
+	float3 color : COLOR0;
+	float3 normal : NORMAL0;
+	float4 surfpos : POSITION0;
+	float2 tex : TEXCOORD0;
+};
+
+float4 main(PixelShaderInput input) : SV_TARGET
+{
+	float3 sum = canvas.Sample(clampSampler, input.tex).rgb * taps[0].y;
+
+	// Each offset lies between two texels, so the bilinear filter reads both at once.
+	int count = (int)texelStep.z;
+	for (int i = 1; i < count; i++)
+	{
+		float2 offset = texelStep.xy * taps[i].x;
+		sum += canvas.Sample(clampSampler, input.tex + offset).rgb * taps[i].y;
+		sum += canvas.Sample(clampSampler, input.tex - offset).rgb * taps[i].y;
+	}
+
+	return float4(sum, 1.0f);
+}
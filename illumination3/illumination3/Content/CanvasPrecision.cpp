@@ -0,0 +1,303 @@
+#include "CanvasPrecision.h"
+#include "ScreenEffectsCpu.h"
+#include "../Helpers/ParallelFor.h"
+#include "../Helpers/PixelFormatPack.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace DirectXGame1;
+using namespace DX;
+
+namespace
+{
+	// Rows per work item when converting a whole canvas.
+	const unsigned int RowsPerBand = 16;
+
+	const float HalfMax = 65504.0f;
+	const float R11G11Max = 65024.0f;
+	const float B10Max = 64512.0f;
+
+#if defined(DX_HEADLESS_CHECKS)
+	// Largest rounding error of a format for one channel: half an ulp of the mantissa in the
+	// normal range, half the subnormal step below it.
+	float RoundingBound(CanvasPrecision precision, int channel, float value)
+	{
+		float magnitude = std::fabs(value);
+		switch (precision)
+		{
+		case CanvasPrecision::Float16:
+			return magnitude * std::ldexp(1.0f, -11) + std::ldexp(1.0f, -25);
+		case CanvasPrecision::R11G11B10:
+			return channel == 2 ?
+				magnitude * std::ldexp(1.0f, -6) + std::ldexp(1.0f, -20) :
+				magnitude * std::ldexp(1.0f, -7) + std::ldexp(1.0f, -21);
+		case CanvasPrecision::Unorm8:
+			return 0.5f / 255.0f;
+		default:
+			return 0.0f;
+		}
+	}
+
+	// What the format is meant to hold for value before rounding.
+	float ClampToFormat(CanvasPrecision precision, int channel, float value)
+	{
+		switch (precision)
+		{
+		case CanvasPrecision::Float16:
+			return value < -HalfMax ? -HalfMax : (value > HalfMax ? HalfMax : value);
+		case CanvasPrecision::R11G11B10:
+		{
+			float maxValue = channel == 2 ? B10Max : R11G11Max;
+			return value < 0.0f ? 0.0f : (value > maxValue ? maxValue : value);
+		}
+		case CanvasPrecision::Unorm8:
+			return value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+		default:
+			return value;
+		}
+	}
+
+	// Smallest normal value, below which relative error stops meaning anything.
+	float MinNormal(CanvasPrecision precision)
+	{
+		switch (precision)
+		{
+		case CanvasPrecision::Float16:
+		case CanvasPrecision::R11G11B10:
+			return std::ldexp(1.0f, -14);
+		case CanvasPrecision::Unorm8:
+			return 1.0f / 255.0f;
+		default:
+			return 0.0f;
+		}
+	}
+#endif
+
+	void PackRows(const float* src, uint8_t* dst, size_t pixels, CanvasPrecision precision)
+	{
+		switch (precision)
+		{
+		case CanvasPrecision::Float16:
+			PackHalf4(src, (uint16_t*)dst, pixels);
+			break;
+		case CanvasPrecision::R11G11B10:
+			PackR11G11B10(src, (uint32_t*)dst, pixels);
+			break;
+		case CanvasPrecision::Unorm8:
+			PackRGBA8(src, (uint32_t*)dst, pixels);
+			break;
+		default:
+			std::memcpy(dst, src, pixels * 16);
+			break;
+		}
+	}
+
+	void UnpackRows(const uint8_t* src, float* dst, size_t pixels, CanvasPrecision precision)
+	{
+		switch (precision)
+		{
+		case CanvasPrecision::Float16:
+			UnpackHalf4((const uint16_t*)src, dst, pixels);
+			break;
+		case CanvasPrecision::R11G11B10:
+			UnpackR11G11B10((const uint32_t*)src, dst, pixels);
+			break;
+		case CanvasPrecision::Unorm8:
+			UnpackRGBA8((const uint32_t*)src, dst, pixels);
+			break;
+		default:
+			std::memcpy(dst, src, pixels * 16);
+			break;
+		}
+	}
+
+	unsigned int BandCount(const CpuCanvas& canvas)
+	{
+		return (canvas.height + RowsPerBand - 1) / RowsPerBand;
+	}
+
+	void BandRows(const CpuCanvas& canvas, unsigned int band, uint32_t& y0, uint32_t& y1)
+	{
+		y0 = band * RowsPerBand;
+		y1 = y0 + RowsPerBand < canvas.height ? y0 + RowsPerBand : canvas.height;
+	}
+}
+
+unsigned int DirectXGame1::CanvasBytesPerPixel(CanvasPrecision precision)
+{
+	switch (precision)
+	{
+	case CanvasPrecision::Float16:
+		return 8;
+	case CanvasPrecision::R11G11B10:
+	case CanvasPrecision::Unorm8:
+		return 4;
+	default:
+		return 16;
+	}
+}
+
+const char* DirectXGame1::CanvasPrecisionName(CanvasPrecision precision)
+{
+	switch (precision)
+	{
+	case CanvasPrecision::Float16:
+		return "R16G16B16A16_FLOAT";
+	case CanvasPrecision::R11G11B10:
+		return "R11G11B10_FLOAT";
+	case CanvasPrecision::Unorm8:
+		return "R8G8B8A8_UNORM";
+	default:
+		return "R32G32B32A32_FLOAT";
+	}
+}
+
+void DirectXGame1::QuantizeCanvas(CpuCanvas& canvas, CanvasPrecision precision)
+{
+	if (precision == CanvasPrecision::Float32 || canvas.texels.empty())
+	{
+		return;
+	}
+
+	// Each band packs into its own small buffer and unpacks straight back.
+	size_t bandBytes = (size_t)canvas.width * RowsPerBand * CanvasBytesPerPixel(precision);
+	ParallelFor(BandCount(canvas), [&](unsigned int band)
+	{
+		uint32_t y0, y1;
+		BandRows(canvas, band, y0, y1);
+		size_t pixels = (size_t)canvas.width * (y1 - y0);
+		std::vector<uint8_t> packed(bandBytes);
+		PackRows(canvas.Row(y0), &packed[0], pixels, precision);
+		UnpackRows(&packed[0], canvas.Row(y0), pixels, precision);
+	});
+}
+
+void DirectXGame1::PackCanvas(const CpuCanvas& canvas, CanvasPrecision precision, std::vector<uint8_t>& packed)
+{
+	size_t rowBytes = (size_t)canvas.width * CanvasBytesPerPixel(precision);
+	packed.resize(rowBytes * canvas.height);
+	if (packed.empty())
+	{
+		return;
+	}
+
+	ParallelFor(BandCount(canvas), [&](unsigned int band)
+	{
+		uint32_t y0, y1;
+		BandRows(canvas, band, y0, y1);
+		PackRows(canvas.Row(y0), &packed[rowBytes * y0], (size_t)canvas.width * (y1 - y0), precision);
+	});
+}
+
+void DirectXGame1::UnpackCanvas(const std::vector<uint8_t>& packed, CanvasPrecision precision, CpuCanvas& canvas)
+{
+	size_t rowBytes = (size_t)canvas.width * CanvasBytesPerPixel(precision);
+	if (packed.size() < rowBytes * canvas.height || canvas.texels.empty())
+	{
+		return;
+	}
+
+	ParallelFor(BandCount(canvas), [&](unsigned int band)
+	{
+		uint32_t y0, y1;
+		BandRows(canvas, band, y0, y1);
+		UnpackRows(&packed[rowBytes * y0], canvas.Row(y0), (size_t)canvas.width * (y1 - y0), precision);
+	});
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+CanvasPrecisionReport DirectXGame1::CompareCanvasPrecision(const CpuCanvas& reference, CanvasPrecision precision, float time)
+{
+	CanvasPrecisionReport report;
+	report.precision = precision;
+	report.maxAbsError = 0.0f;
+	report.meanAbsError = 0.0;
+	report.maxRelError = 0.0f;
+	report.withinTolerance = true;
+	report.screenMismatch = 0.0;
+	report.bytesWritten = (uint64_t)reference.width * reference.height * CanvasBytesPerPixel(precision);
+	report.bytesRead = report.bytesWritten;
+
+	CpuCanvas stored = reference;
+	QuantizeCanvas(stored, precision);
+
+	// Only the colour channels reach the screen; R11G11B10 has no alpha to compare anyway.
+	double errorSum = 0.0;
+	float minNormal = MinNormal(precision);
+	for (size_t i = 0; i < reference.texels.size(); i += 4)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			float expected = ClampToFormat(precision, c, reference.texels[i + c]);
+			float actual = ClampToFormat(precision, c, stored.texels[i + c]);
+			float error = std::fabs(actual - expected);
+
+			errorSum += error;
+			if (error > report.maxAbsError)
+			{
+				report.maxAbsError = error;
+			}
+			if (std::fabs(expected) >= minNormal && error / std::fabs(expected) > report.maxRelError)
+			{
+				report.maxRelError = error / std::fabs(expected);
+			}
+			// A few fp32 ulps of slack for the bound computation itself.
+			if (!(error <= RoundingBound(precision, c, expected) * 1.0001f))
+			{
+				report.withinTolerance = false;
+			}
+		}
+	}
+	size_t samples = reference.texels.size() / 4 * 3;
+	report.meanAbsError = samples ? errorSum / samples : 0.0;
+
+	// The screen pass thresholds its input, so what matters there is how many pixels flip.
+	CpuCanvas referenceScreen(reference.width, reference.height);
+	CpuCanvas storedScreen(reference.width, reference.height);
+	ApplyScreenEffectsCpu(reference, referenceScreen, time);
+	ApplyScreenEffectsCpu(stored, storedScreen, time);
+
+	size_t mismatches = 0;
+	for (size_t i = 0; i < referenceScreen.texels.size(); i += 4)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			if (std::fabs(DisplayValue(referenceScreen.texels[i + c]) - DisplayValue(storedScreen.texels[i + c])) > 0.5f / 255.0f)
+			{
+				mismatches++;
+				break;
+			}
+		}
+	}
+	size_t pixels = referenceScreen.texels.size() / 4;
+	report.screenMismatch = pixels ? double(mismatches) / pixels : 0.0;
+
+	return report;
+}
+
+std::vector<CanvasPrecisionReport> DirectXGame1::ValidateCanvasPrecisions(unsigned int width, unsigned int height)
+{
+	// Lit-surface-like values: mostly in [0, 1], with highlights well above 1 and some deep shadow.
+	CpuCanvas reference(width, height);
+	for (unsigned int y = 0; y < height; y++)
+	{
+		for (unsigned int x = 0; x < width; x++)
+		{
+			float* texel = reference.At(x, y);
+			float shade = 0.5f + 0.5f * std::sin(x * 0.011f + y * 0.007f);
+			texel[0] = shade * shade * 4.0f;
+			texel[1] = 0.5f + 0.5f * std::sin(y * 0.019f);
+			texel[2] = std::ldexp(shade, -(int)(x % 16));
+			texel[3] = 1.0f;
+		}
+	}
+
+	std::vector<CanvasPrecisionReport> reports;
+	for (CanvasPrecision precision : AllCanvasPrecisions)
+	{
+		reports.push_back(CompareCanvasPrecision(reference, precision, 0.0f));
+	}
+	return reports;
+}
+#endif
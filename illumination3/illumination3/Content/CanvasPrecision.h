@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "CpuCanvas.h"
+
+namespace DirectXGame1
+{
+	// Storage formats the canvas and the blur targets can use, cheapest last.
+	// Float32 is DXGI_FORMAT_R32G32B32A32_FLOAT, Float16 R16G16B16A16_FLOAT,
+	// R11G11B10 R11G11B10_FLOAT (no alpha, no negatives) and Unorm8 R8G8B8A8_UNORM.
+	enum class CanvasPrecision
+	{
+		Float32,
+		Float16,
+		R11G11B10,
+		Unorm8
+	};
+
+	const CanvasPrecision AllCanvasPrecisions[] = { CanvasPrecision::Float32, CanvasPrecision::Float16, CanvasPrecision::R11G11B10, CanvasPrecision::Unorm8 };
+
+	unsigned int CanvasBytesPerPixel(CanvasPrecision precision);
+	const char* CanvasPrecisionName(CanvasPrecision precision);
+
+	// Rounds every texel to what a texture of the given format would store, in place.
+	// Equivalent to the GPU writing the canvas in that format and the next pass sampling it.
+	void QuantizeCanvas(CpuCanvas& canvas, CanvasPrecision precision);
+
+	// Packed copies of a canvas, laid out as a mapped texture of the matching format.
+	// Float32 just copies the texels.
+	void PackCanvas(const CpuCanvas& canvas, CanvasPrecision precision, std::vector<uint8_t>& packed);
+	void UnpackCanvas(const std::vector<uint8_t>& packed, CanvasPrecision precision, CpuCanvas& canvas);
+
+#if defined(DX_HEADLESS_CHECKS)
+	// How one format compares with keeping the canvas in fp32.
+	struct CanvasPrecisionReport
+	{
+		CanvasPrecision precision;
+		float maxAbsError;			// over the colour channels of the stored canvas
+		double meanAbsError;
+		float maxRelError;			// over texels in the format's normal range
+		bool withinTolerance;		// every texel within the format's rounding bound
+		double screenMismatch;		// fraction of screen-pass pixels that come out different
+		uint64_t bytesWritten;		// canvas traffic per frame: one write by the world pass
+		uint64_t bytesRead;			// and one read by the screen pass
+	};
+
+	// Stores reference in the given format, runs both through ApplyScreenEffectsCpu at time and
+	// compares. The tolerance is the format's own rounding: half an ulp of a 10-bit mantissa for
+	// half floats, of 6 or 5 bits for R11G11B10, half a step of 1/255 for Unorm8. Clamping that the
+	// format does by design (alpha and negatives for R11G11B10, [0, 1] for Unorm8) is not counted.
+	CanvasPrecisionReport CompareCanvasPrecision(const CpuCanvas& reference, CanvasPrecision precision, float time);
+
+	// CompareCanvasPrecision for every format, on a synthetic HDR canvas of the given size.
+	std::vector<CanvasPrecisionReport> ValidateCanvasPrecisions(unsigned int width = 1920, unsigned int height = 1080);
+#endif
+}
@@ -0,0 +1,42 @@
+// SamplePixelShader.hlsl's lighting plus any number of moving point lights. The lights are
+// binned on the CPU into clusters, screen tiles cut into depth slices (LightCulling.h), and
+// each pixel loops over the lights of its own cluster only.
+cbuffer PerFrameConstantBuffer : register(b0)
+{
+	float4 time;
+	float4 lightpos;
+};
+
+cbuffer PerViewConstantBuffer : register(b1)
+{
+	matrix view;
+	matrix projection;
+	float4 eyepos;
+};
+
+#include "WorldLighting.hlsli"
+
+// Per-pixel color data passed through the pixel shader.
+struct PixelShaderInput
+{
+	float4 pos : SV_POSITION;
+	float3 color : COLOR0;
+	float3 normal : NORMAL0;
+	float4 surfpos : POSITION0;
+	float2 tex : TEXCOORD0;
+};
+
+float4 main(PixelShaderInput input) : SV_TARGET
+{
+	float3 N = normalize(input.normal);
+	float3 V = normalize(eyepos.xyz - input.surfpos.xyz);
+	float c = MainLight(N, V, input.surfpos.xyz);
+
+	float3 cr = input.color;
+	cr.b = eyepos.x / 10;
+
+	float depth = mul(mul(float4(input.surfpos.xyz, 1.0f), view), projection).w;
+	float3 lit = PointLights(N, V, input.surfpos.xyz, input.pos.xy, depth);
+
+	return float4(cr*(c + lit), 1.0f);
+}
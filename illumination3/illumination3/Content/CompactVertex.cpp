@@ -0,0 +1,393 @@
+#include "CompactVertex.h"
+#include "../Helpers/SimdFloat4.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace DirectXGame1;
+using namespace DX;
+
+namespace
+{
+	const float SnormMax = 32767.0f;
+	const float UnormMax = 255.0f;
+
+	uint32_t FloatBits(float f)
+	{
+		uint32_t u;
+		std::memcpy(&u, &f, sizeof(u));
+		return u;
+	}
+
+	float BitsFloat(uint32_t u)
+	{
+		float f;
+		std::memcpy(&f, &u, sizeof(f));
+		return f;
+	}
+
+	// A zero range (a flat mesh, a single colour) still needs a usable scale.
+	float RangeScale(float range)
+	{
+		return range > 1e-20f ? range : 1.0f;
+	}
+
+	// Lanes of four vertices, gathered from the array of structures. Past count the last
+	// vertex is repeated; those lanes are never written back.
+	struct VertexLanes
+	{
+		SimdFloat4 pos[3];
+		SimdFloat4 color[3];
+		SimdFloat4 normal[3];
+	};
+
+	VertexLanes Gather(const MeshVertex* vertices, uint32_t first, uint32_t count)
+	{
+		const MeshVertex* v[4];
+		for (uint32_t k = 0; k < 4; k++)
+		{
+			v[k] = &vertices[std::min(first + k, count - 1)];
+		}
+		VertexLanes lanes;
+		for (int c = 0; c < 3; c++)
+		{
+			lanes.pos[c] = SimdSet(v[0]->pos[c], v[1]->pos[c], v[2]->pos[c], v[3]->pos[c]);
+			lanes.color[c] = SimdSet(v[0]->color[c], v[1]->color[c], v[2]->color[c], v[3]->color[c]);
+			lanes.normal[c] = SimdSet(v[0]->normal[c], v[1]->normal[c], v[2]->normal[c], v[3]->normal[c]);
+		}
+		return lanes;
+	}
+
+	SimdFloat4 SignNotZero(SimdFloat4 x)
+	{
+		return SimdSelect(SimdSplat(1.0f), SimdSplat(-1.0f), SimdCmpLt(x, SimdZero()));
+	}
+
+	SimdFloat4 Clamp(SimdFloat4 x, float low, float high)
+	{
+		return SimdMin(SimdMax(x, SimdSplat(low)), SimdSplat(high));
+	}
+}
+
+uint16_t DirectXGame1::FloatToHalf(float value)
+{
+	uint32_t x = FloatBits(value);
+	uint16_t sign = (uint16_t)((x >> 16) & 0x8000);
+	x &= 0x7FFFFFFF;
+
+	if (x >= 0x7F800000)
+	{
+		// Infinity stays infinity, NaN stays a (quiet) NaN.
+		return sign | 0x7C00 | (x > 0x7F800000 ? 0x200 : 0);
+	}
+	if (x >= 0x477FF000)
+	{
+		// 65520 and up round past the largest half.
+		return sign | 0x7C00;
+	}
+	if (x < 0x38800000)
+	{
+		// Below the smallest normal half: a subnormal, in units of 2^-24.
+		if (x < 0x33000000)
+		{
+			return sign;
+		}
+		uint32_t exponent = x >> 23;
+		uint32_t mantissa = (x & 0x7FFFFF) | 0x800000;
+		uint32_t shift = 126 - exponent;
+		uint32_t result = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t half = 1u << (shift - 1);
+		if (remainder > half || (remainder == half && (result & 1)))
+		{
+			result++;
+		}
+		return sign | (uint16_t)result;
+	}
+
+	// Rebias the exponent from 127 to 15 and drop 13 mantissa bits; a carry out of the
+	// mantissa correctly bumps the exponent.
+	uint32_t result = (x - 0x38000000) >> 13;
+	uint32_t remainder = x & 0x1FFF;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (result & 1)))
+	{
+		result++;
+	}
+	return sign | (uint16_t)result;
+}
+
+float DirectXGame1::HalfToFloat(uint16_t value)
+{
+	uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1F;
+	uint32_t mantissa = value & 0x3FF;
+	if (exponent == 0)
+	{
+		float magnitude = mantissa * (1.0f / 16777216.0f);
+		return sign ? -magnitude : magnitude;
+	}
+	if (exponent == 31)
+	{
+		return BitsFloat(sign | 0x7F800000 | (mantissa << 13));
+	}
+	return BitsFloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+CompactVertexBounds DirectXGame1::ComputeCompactVertexBounds(const MeshVertex* vertices, uint32_t count)
+{
+	float low[6], high[6];
+	std::fill(low, low + 6, 0.0f);
+	std::fill(high, high + 6, 0.0f);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			const float values[2] = { vertices[i].pos[c], vertices[i].color[c] };
+			for (int a = 0; a < 2; a++)
+			{
+				int slot = a * 3 + c;
+				low[slot] = i == 0 ? values[a] : std::min(low[slot], values[a]);
+				high[slot] = i == 0 ? values[a] : std::max(high[slot], values[a]);
+			}
+		}
+	}
+
+	CompactVertexBounds bounds;
+	for (int c = 0; c < 3; c++)
+	{
+		// Positions are snorm, centred on the box; colours unorm, from the low end.
+		bounds.positionOffset[c] = 0.5f * (low[c] + high[c]);
+		bounds.positionScale[c] = RangeScale(0.5f * (high[c] - low[c]));
+		bounds.colorOffset[c] = low[3 + c];
+		bounds.colorScale[c] = RangeScale(high[3 + c] - low[3 + c]);
+	}
+	return bounds;
+}
+
+void DirectXGame1::EncodeCompactVertices(const MeshVertex* vertices, uint32_t count, const CompactVertexBounds& bounds, CompactVertex* out)
+{
+	SimdFloat4 positionOffset[3], positionToSnorm[3], colorOffset[3], colorToUnorm[3];
+	for (int c = 0; c < 3; c++)
+	{
+		positionOffset[c] = SimdSplat(bounds.positionOffset[c]);
+		positionToSnorm[c] = SimdSplat(SnormMax / bounds.positionScale[c]);
+		colorOffset[c] = SimdSplat(bounds.colorOffset[c]);
+		colorToUnorm[c] = SimdSplat(UnormMax / bounds.colorScale[c]);
+	}
+
+	for (uint32_t first = 0; first < count; first += 4)
+	{
+		VertexLanes lanes = Gather(vertices, first, count);
+		int32_t pos[3][4], color[3][4], normal[2][4];
+
+		for (int c = 0; c < 3; c++)
+		{
+			SimdFloat4 p = SimdMul(SimdSub(lanes.pos[c], positionOffset[c]), positionToSnorm[c]);
+			SimdStoreRounded(pos[c], Clamp(p, -SnormMax, SnormMax));
+			SimdFloat4 col = SimdMul(SimdSub(lanes.color[c], colorOffset[c]), colorToUnorm[c]);
+			SimdStoreRounded(color[c], Clamp(col, 0.0f, UnormMax));
+		}
+
+		// Octahedral: project onto |x| + |y| + |z| = 1, then fold the lower half over the
+		// diagonals so the whole sphere lands on the [-1, 1] square.
+		SimdFloat4 x = lanes.normal[0], y = lanes.normal[1], z = lanes.normal[2];
+		SimdFloat4 sum = SimdAdd(SimdAbs(x), SimdAdd(SimdAbs(y), SimdAbs(z)));
+		SimdFloat4 inverse = SimdDiv(SimdSplat(1.0f), SimdMax(sum, SimdSplat(1e-20f)));
+		SimdFloat4 u = SimdMul(x, inverse);
+		SimdFloat4 v = SimdMul(y, inverse);
+		SimdFloat4 lower = SimdCmpLt(z, SimdZero());
+		SimdFloat4 foldedU = SimdMul(SimdSub(SimdSplat(1.0f), SimdAbs(v)), SignNotZero(u));
+		SimdFloat4 foldedV = SimdMul(SimdSub(SimdSplat(1.0f), SimdAbs(u)), SignNotZero(v));
+		u = SimdSelect(u, foldedU, lower);
+		v = SimdSelect(v, foldedV, lower);
+		SimdStoreRounded(normal[0], Clamp(SimdMul(u, SimdSplat(SnormMax)), -SnormMax, SnormMax));
+		SimdStoreRounded(normal[1], Clamp(SimdMul(v, SimdSplat(SnormMax)), -SnormMax, SnormMax));
+
+		uint32_t lanesUsed = std::min(4u, count - first);
+		for (uint32_t k = 0; k < lanesUsed; k++)
+		{
+			CompactVertex& vertex = out[first + k];
+			const MeshVertex& source = vertices[first + k];
+			for (int c = 0; c < 3; c++)
+			{
+				vertex.pos[c] = (int16_t)pos[c][k];
+				vertex.color[c] = (uint8_t)color[c][k];
+			}
+			vertex.pos[3] = 0;
+			vertex.color[3] = 255;
+			vertex.normal[0] = (int16_t)normal[0][k];
+			vertex.normal[1] = (int16_t)normal[1][k];
+			vertex.tex[0] = FloatToHalf(source.tex[0]);
+			vertex.tex[1] = FloatToHalf(source.tex[1]);
+		}
+	}
+}
+
+void DirectXGame1::DecodeCompactVertices(const CompactVertex* vertices, uint32_t count, const CompactVertexBounds& bounds, MeshVertex* out)
+{
+	SimdFloat4 positionOffset[3], positionFromSnorm[3], colorOffset[3], colorFromUnorm[3];
+	for (int c = 0; c < 3; c++)
+	{
+		positionOffset[c] = SimdSplat(bounds.positionOffset[c]);
+		positionFromSnorm[c] = SimdSplat(bounds.positionScale[c] / SnormMax);
+		colorOffset[c] = SimdSplat(bounds.colorOffset[c]);
+		colorFromUnorm[c] = SimdSplat(bounds.colorScale[c] / UnormMax);
+	}
+	const SimdFloat4 fromSnorm = SimdSplat(1.0f / SnormMax);
+
+	for (uint32_t first = 0; first < count; first += 4)
+	{
+		int32_t raw[8][4];
+		for (uint32_t k = 0; k < 4; k++)
+		{
+			const CompactVertex& vertex = vertices[std::min(first + k, count - 1)];
+			for (int c = 0; c < 3; c++)
+			{
+				raw[c][k] = vertex.pos[c];
+				raw[3 + c][k] = vertex.color[c];
+			}
+			raw[6][k] = vertex.normal[0];
+			raw[7][k] = vertex.normal[1];
+		}
+
+		float pos[3][4], color[3][4], normal[3][4];
+		for (int c = 0; c < 3; c++)
+		{
+			// snorm: -32768 decodes as -1, like -32767.
+			SimdFloat4 p = SimdMax(SimdLoadInt(raw[c]), SimdSplat(-SnormMax));
+			SimdStore(pos[c], SimdMulAdd(p, positionFromSnorm[c], positionOffset[c]));
+			SimdStore(color[c], SimdMulAdd(SimdLoadInt(raw[3 + c]), colorFromUnorm[c], colorOffset[c]));
+		}
+
+		// Unfold: z = 1 - |u| - |v|; where that is negative, move u and v back across the diagonals.
+		SimdFloat4 u = SimdMul(SimdMax(SimdLoadInt(raw[6]), SimdSplat(-SnormMax)), fromSnorm);
+		SimdFloat4 v = SimdMul(SimdMax(SimdLoadInt(raw[7]), SimdSplat(-SnormMax)), fromSnorm);
+		SimdFloat4 z = SimdSub(SimdSub(SimdSplat(1.0f), SimdAbs(u)), SimdAbs(v));
+		SimdFloat4 t = SimdMax(SimdSub(SimdZero(), z), SimdZero());
+		u = SimdSub(u, SimdMul(t, SignNotZero(u)));
+		v = SimdSub(v, SimdMul(t, SignNotZero(v)));
+		SimdFloat4 length = SimdSqrt(SimdAdd(SimdMul(u, u), SimdAdd(SimdMul(v, v), SimdMul(z, z))));
+		SimdFloat4 inverse = SimdDiv(SimdSplat(1.0f), length);
+		SimdStore(normal[0], SimdMul(u, inverse));
+		SimdStore(normal[1], SimdMul(v, inverse));
+		SimdStore(normal[2], SimdMul(z, inverse));
+
+		uint32_t lanesUsed = std::min(4u, count - first);
+		for (uint32_t k = 0; k < lanesUsed; k++)
+		{
+			MeshVertex& vertex = out[first + k];
+			for (int c = 0; c < 3; c++)
+			{
+				vertex.pos[c] = pos[c][k];
+				vertex.color[c] = color[c][k];
+				vertex.normal[c] = normal[c][k];
+			}
+			vertex.tex[0] = HalfToFloat(vertices[first + k].tex[0]);
+			vertex.tex[1] = HalfToFloat(vertices[first + k].tex[1]);
+		}
+	}
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+CompactVertexReport DirectXGame1::ValidateCompactVertices(uint32_t randomNormals)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// Every shape, side by side, plus a cloud of random unit normals on the plane's vertices
+	// so the octahedral mapping is checked well away from the grid directions.
+	std::vector<MeshShapeDesc> descs;
+	descs.push_back(MeshShapeDesc::Torus(300, 100, 0.6f, 0.2f));
+	descs.push_back(MeshShapeDesc::Sphere(128, 64, 1.0f));
+	descs.push_back(MeshShapeDesc::Cylinder(128, 16, 0.5f, 2.0f));
+	descs.push_back(MeshShapeDesc::Superquadric(128, 64, 0.8f, 0.3f, 1.7f));
+	std::vector<MeshVertex> vertices;
+	for (const MeshShapeDesc& desc : descs)
+	{
+		size_t first = vertices.size();
+		vertices.resize(first + MeshVertexCount(desc));
+		std::vector<uint32_t> indices(MeshIndexCount(desc));
+		GenerateMesh(desc, &vertices[first], &indices[0]);
+	}
+	std::mt19937 random(7);
+	std::normal_distribution<float> gaussian;
+	for (uint32_t i = 0; i < randomNormals; i++)
+	{
+		MeshVertex vertex = vertices[i % vertices.size()];
+		float n[3] = { gaussian(random), gaussian(random), gaussian(random) };
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		for (int c = 0; c < 3; c++)
+		{
+			vertex.normal[c] = n[c] / std::max(length, 1e-20f);
+		}
+		vertices.push_back(vertex);
+	}
+
+	const uint32_t count = (uint32_t)vertices.size();
+	CompactVertexBounds bounds = ComputeCompactVertexBounds(&vertices[0], count);
+	std::vector<CompactVertex> compact(count);
+	std::vector<MeshVertex> decoded(count);
+
+	CompactVertexReport report;
+	report.vertices = count;
+	report.fullBytes = (uint64_t)count * sizeof(MeshVertex);
+	report.compactBytes = (uint64_t)count * sizeof(CompactVertex);
+
+	auto start = Clock::now();
+	EncodeCompactVertices(&vertices[0], count, bounds, &compact[0]);
+	report.encodeMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	start = Clock::now();
+	DecodeCompactVertices(&compact[0], count, bounds, &decoded[0]);
+	report.decodeMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	float positionScale = std::max(bounds.positionScale[0], std::max(bounds.positionScale[1], bounds.positionScale[2]));
+	float colorScale = std::max(bounds.colorScale[0], std::max(bounds.colorScale[1], bounds.colorScale[2]));
+	float texMax = 0.0f;
+
+	report.maxPositionError = 0.0f;
+	report.maxNormalErrorDegrees = 0.0f;
+	report.maxColorError = 0.0f;
+	report.maxTexError = 0.0f;
+	double maxAngle = 0.0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const MeshVertex& a = vertices[i];
+		const MeshVertex& b = decoded[i];
+		double dot = 0.0;
+		for (int c = 0; c < 3; c++)
+		{
+			report.maxPositionError = std::max(report.maxPositionError, std::fabs(a.pos[c] - b.pos[c]) / positionScale);
+			report.maxColorError = std::max(report.maxColorError, std::fabs(a.color[c] - b.color[c]) / colorScale);
+			dot += (double)a.normal[c] * b.normal[c];
+		}
+		// atan2 of the cross and dot products; acos of the dot alone drowns in float rounding this close to 1.
+		double cx = (double)a.normal[1] * b.normal[2] - (double)a.normal[2] * b.normal[1];
+		double cy = (double)a.normal[2] * b.normal[0] - (double)a.normal[0] * b.normal[2];
+		double cz = (double)a.normal[0] * b.normal[1] - (double)a.normal[1] * b.normal[0];
+		maxAngle = std::max(maxAngle, std::atan2(std::sqrt(cx * cx + cy * cy + cz * cz), dot));
+		for (int c = 0; c < 2; c++)
+		{
+			report.maxTexError = std::max(report.maxTexError, std::fabs(a.tex[c] - b.tex[c]));
+			texMax = std::max(texMax, std::fabs(a.tex[c]));
+		}
+	}
+	report.maxNormalErrorDegrees = (float)(maxAngle * 180.0 / 3.14159265358979323846);
+
+	// Half a step of each encoding, plus a little for the float arithmetic around it. For the
+	// normal: rounding moves u and v by at most h = 0.5 / 32767 each, which moves the point
+	// (u, v, 1 - |u| - |v|) by at most sqrt(h^2 + h^2 + (2h)^2) = sqrt(6) h, and normalizing
+	// stretches that by at most sqrt(3) (at the centre of a face): 3 sqrt(2) h radians.
+	report.positionBound = 0.5f / SnormMax + 1e-6f;
+	report.colorBound = 0.5f / UnormMax + 1e-6f;
+	report.normalBoundDegrees = (float)(3.0 * std::sqrt(2.0) * 0.5 / SnormMax * 180.0 / 3.14159265358979323846) + 1e-5f;
+	report.texBound = texMax / 2048.0f;
+	report.withinBounds = report.maxPositionError <= report.positionBound &&
+		report.maxColorError <= report.colorBound &&
+		report.maxNormalErrorDegrees <= report.normalBoundDegrees &&
+		report.maxTexError <= report.texBound;
+	return report;
+}
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include "MeshGenerator.h"
+
+namespace DirectXGame1
+{
+	// 20-byte version of VertexPositionColor (44 bytes), read by CompactVertexShader.hlsl:
+	//   pos     DXGI_FORMAT_R16G16B16A16_SNORM, relative to the mesh's bounds (w unused)
+	//   normal  DXGI_FORMAT_R16G16_SNORM, octahedral
+	//   color   DXGI_FORMAT_R8G8B8A8_UNORM, relative to the mesh's colour range (a unused)
+	//   tex     DXGI_FORMAT_R16G16_FLOAT
+	struct CompactVertex
+	{
+		int16_t pos[4];
+		int16_t normal[2];
+		uint8_t color[4];
+		uint16_t tex[2];
+	};
+
+	static_assert(sizeof(CompactVertex) == 20, "CompactVertex must match the compact input layout");
+
+	// How a mesh's positions and colours map to the normalized ranges:
+	//   pos = positionOffset + snorm * positionScale, color = colorOffset + unorm * colorScale.
+	// The shader gets these through the per-object constants.
+	struct CompactVertexBounds
+	{
+		float positionOffset[3];
+		float positionScale[3];
+		float colorOffset[3];
+		float colorScale[3];
+	};
+
+	CompactVertexBounds ComputeCompactVertexBounds(const MeshVertex* vertices, uint32_t count);
+
+	// Four vertices at a time. Normals must be unit length.
+	void EncodeCompactVertices(const MeshVertex* vertices, uint32_t count, const CompactVertexBounds& bounds, CompactVertex* out);
+	// What the input assembler and CompactVertexShader.hlsl make of them.
+	void DecodeCompactVertices(const CompactVertex* vertices, uint32_t count, const CompactVertexBounds& bounds, MeshVertex* out);
+
+	// IEEE half conversion, rounding to nearest even; out-of-range values become infinity.
+	uint16_t FloatToHalf(float value);
+	float HalfToFloat(uint16_t value);
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct CompactVertexReport
+	{
+		uint32_t vertices;
+		float maxPositionError;			// largest error on any axis, relative to the largest position scale
+		float positionBound;			// half a snorm16 step
+		float maxNormalErrorDegrees;
+		float normalBoundDegrees;		// half an octahedral step, at the map's largest stretch
+		float maxColorError;			// relative to the largest colour scale
+		float colorBound;				// half a unorm8 step
+		float maxTexError;
+		float texBound;					// half a half-float step at the largest coordinate
+		bool withinBounds;
+		uint64_t fullBytes;
+		uint64_t compactBytes;
+		double encodeMilliseconds;
+		double decodeMilliseconds;
+	};
+
+	// Encodes and decodes a mesh of every MeshGenerator shape plus random unit normals and
+	// checks every attribute against its bound.
+	CompactVertexReport ValidateCompactVertices(uint32_t randomNormals = 1000000);
+#endif
+}
@@ -0,0 +1,65 @@
+// Same as SampleVertexShader.hlsl, for the 20-byte CompactVertex layout (see CompactVertex.h).
+// The input assembler turns the snorm/unorm/half attributes into floats; this undoes the
+// per-mesh range mapping and the octahedral normal.
+
+cbuffer PerViewConstantBuffer : register(b1)
+{
+	matrix view;
+	matrix projection;
+	float4 eyepos;
+};
+
+cbuffer PerObjectConstantBuffer : register(b2)
+{
+	matrix model;
+	float4 positionScale;	// pos = positionOffset + snorm * positionScale
+	float4 positionOffset;
+	float4 colorScale;		// color = colorOffset + unorm * colorScale
+	float4 colorOffset;
+};
+
+struct VertexShaderInput
+{
+	float4 pos : POSITION;		// R16G16B16A16_SNORM
+	float2 normal : NORMAL0;	// R16G16_SNORM, octahedral
+	float4 color : COLOR0;		// R8G8B8A8_UNORM
+	float2 tex : TEXCOORD0;		// R16G16_FLOAT
+};
+
+struct PixelShaderInput
+{
+	float4 pos : SV_POSITION;
+	float3 color : COLOR0;
+	float3 normal : NORMAL0;
+	float4 surfpos : POSITION0;
+	float2 tex : TEXCOORD0;
+};
+
+float3 DecodeOctahedral(float2 e)
+{
+	float3 n = float3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+PixelShaderInput main(VertexShaderInput input)
+{
+	PixelShaderInput output;
+	float4 pos = float4(positionOffset.xyz + input.pos.xyz * positionScale.xyz, 1.0f);
+	float4 norm = float4(DecodeOctahedral(input.normal), 0.0f);
+
+	pos = mul(pos, model);
+	output.surfpos = pos;
+
+	pos = mul(pos, view);
+	pos = mul(pos, projection);
+	output.pos = pos;
+
+	output.normal = mul(norm, model);
+	output.color = colorOffset.rgb + input.color.rgb * colorScale.rgb;
+	output.tex = input.tex;
+
+	return output;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "../Helpers/SimdFloat4.h"
+
+namespace DirectXGame1
+{
+	// CPU mirror of the offscreen canvas: RGBA, 32-bit float per channel, rows tightly
+	// packed top to bottom. Same memory layout as a mapped DXGI_FORMAT_R32G32B32A32_FLOAT
+	// texture with RowPitch == width * 16, so it can be uploaded or read back as is.
+	struct CpuCanvas
+	{
+		CpuCanvas() : width(0), height(0) {}
+		CpuCanvas(uint32_t w, uint32_t h) : width(w), height(h), texels(size_t(w) * h * 4, 0.0f) {}
+
+		void Resize(uint32_t w, uint32_t h)
+		{
+			width = w;
+			height = h;
+			texels.assign(size_t(w) * h * 4, 0.0f);
+		}
+
+		float* Row(uint32_t y)					{ return &texels[size_t(y) * width * 4]; }
+		const float* Row(uint32_t y) const		{ return &texels[size_t(y) * width * 4]; }
+		float* At(uint32_t x, uint32_t y)		{ return Row(y) + x * 4; }
+		const float* At(uint32_t x, uint32_t y) const { return Row(y) + x * 4; }
+
+		uint32_t width;
+		uint32_t height;
+		std::vector<float> texels;
+	};
+
+	// One float per texel, the layout of a mapped DXGI_FORMAT_R32_FLOAT texture with
+	// RowPitch == width * 4: depth, or a single-channel target such as ambient occlusion.
+	struct CpuPlane
+	{
+		CpuPlane() : width(0), height(0) {}
+		CpuPlane(uint32_t w, uint32_t h, float value = 0.0f) : width(w), height(h), values(size_t(w) * h, value) {}
+
+		void Resize(uint32_t w, uint32_t h, float value = 0.0f)
+		{
+			width = w;
+			height = h;
+			values.assign(size_t(w) * h, value);
+		}
+
+		float* Row(uint32_t y)					{ return &values[size_t(y) * width]; }
+		const float* Row(uint32_t y) const		{ return &values[size_t(y) * width]; }
+		float& At(uint32_t x, uint32_t y)		{ return values[size_t(y) * width + x]; }
+		float At(uint32_t x, uint32_t y) const	{ return values[size_t(y) * width + x]; }
+
+		uint32_t width;
+		uint32_t height;
+		std::vector<float> values;
+	};
+
+	// What a UNORM back buffer keeps of a shader output: clamped to [0, 1], NaN as 0.
+	// The screen pass divides by zero on black pixels, so its raw output has NaNs in it.
+	inline float DisplayValue(float value)
+	{
+		return value > 0.0f ? (value < 1.0f ? value : 1.0f) : 0.0f;
+	}
+
+	// Wraps a texel coordinate into [0, size), matching D3D11_TEXTURE_ADDRESS_WRAP.
+	inline int WrapTexel(int i, int size)
+	{
+		i %= size;
+		return i < 0 ? i + size : i;
+	}
+
+	// Clamps a texel coordinate into [0, size), matching D3D11_TEXTURE_ADDRESS_CLAMP.
+	inline int ClampTexel(int i, int size)
+	{
+		return i < 0 ? 0 : (i >= size ? size - 1 : i);
+	}
+
+	// Bilinear sample with wrap addressing, the CPU equivalent of the screen pass's
+	// canvas.Sample(mysampler, uv) with D3D11_FILTER_MIN_MAG_MIP_LINEAR.
+	inline DX::SimdFloat4 SampleBilinearWrap(const CpuCanvas& canvas, float u, float v)
+	{
+		float x = u * canvas.width - 0.5f;
+		float y = v * canvas.height - 0.5f;
+		float fx = std::floor(x);
+		float fy = std::floor(y);
+		int x0 = WrapTexel((int)fx, (int)canvas.width);
+		int y0 = WrapTexel((int)fy, (int)canvas.height);
+		int x1 = x0 + 1 == (int)canvas.width ? 0 : x0 + 1;
+		int y1 = y0 + 1 == (int)canvas.height ? 0 : y0 + 1;
+
+		DX::SimdFloat4 tx = DX::SimdSplat(x - fx);
+		DX::SimdFloat4 ty = DX::SimdSplat(y - fy);
+		DX::SimdFloat4 top = DX::SimdLerp(DX::SimdLoad(canvas.At(x0, y0)), DX::SimdLoad(canvas.At(x1, y0)), tx);
+		DX::SimdFloat4 bottom = DX::SimdLerp(DX::SimdLoad(canvas.At(x0, y1)), DX::SimdLoad(canvas.At(x1, y1)), tx);
+		return DX::SimdLerp(top, bottom, ty);
+	}
+
+	// Same with clamp-to-edge addressing (D3D11_TEXTURE_ADDRESS_CLAMP), as the blur and bloom samplers use.
+	inline DX::SimdFloat4 SampleBilinearClamp(const CpuCanvas& canvas, float u, float v)
+	{
+		float x = u * canvas.width - 0.5f;
+		float y = v * canvas.height - 0.5f;
+		float fx = std::floor(x);
+		float fy = std::floor(y);
+		int x0 = ClampTexel((int)fx, (int)canvas.width);
+		int y0 = ClampTexel((int)fy, (int)canvas.height);
+		int x1 = ClampTexel((int)fx + 1, (int)canvas.width);
+		int y1 = ClampTexel((int)fy + 1, (int)canvas.height);
+
+		DX::SimdFloat4 tx = DX::SimdSplat(x - fx);
+		DX::SimdFloat4 ty = DX::SimdSplat(y - fy);
+		DX::SimdFloat4 top = DX::SimdLerp(DX::SimdLoad(canvas.At(x0, y0)), DX::SimdLoad(canvas.At(x1, y0)), tx);
+		DX::SimdFloat4 bottom = DX::SimdLerp(DX::SimdLoad(canvas.At(x0, y1)), DX::SimdLoad(canvas.At(x1, y1)), tx);
+		return DX::SimdLerp(top, bottom, ty);
+	}
+}
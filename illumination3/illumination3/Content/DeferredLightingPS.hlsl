@@ -0,0 +1,86 @@
+// The deferred path's lighting pass, drawn over the G-buffer that GBufferPS.hlsl wrote. Each
+// pixel's world position comes back from its depth through the inverse view * projection,
+// then it gets the same lighting as the forward shaders, point lights included. Where the
+// normal or depth jumps between neighbours an outline can be darkened in, which the forward
+// path could only do with a second pass over the geometry.
+cbuffer PerFrameConstantBuffer : register(b0)
+{
+	float4 time;
+	float4 lightpos;
+};
+
+// The world camera, bound for this shader only: the vertex shader keeps the screen quad's.
+cbuffer PerViewConstantBuffer : register(b1)
+{
+	matrix view;
+	matrix projection;
+	float4 eyepos;
+};
+
+cbuffer DeferredConstantBuffer : register(b2)
+{
+	matrix inverseViewProjection;
+	float4 viewportSize;	// xy: the world pass's viewport in pixels, zw: 1 / size
+	float4 edges;			// x: outline strength (0: off), y: relative depth jump, z: normal cosine
+};
+
+#include "GBuffer.hlsli"
+#include "WorldLighting.hlsli"
+
+Texture2D<float4> albedoTarget : register(t0);
+Texture2D<float2> normalTarget : register(t1);
+Texture2D<float> depthTarget : register(t2);
+
+struct PixelShaderInput
+{
+	float4 pos : SV_POSITION;
+	float3 color : COLOR0;
+	float3 normal : NORMAL0;
+	float4 surfpos : POSITION0;
+	float2 tex : TEXCOORD0;
+};
+
+// World position and view depth (clip w) of the surface at pixel with depth z / w.
+float4 Reconstruct(float2 pixel, float depth)
+{
+	float2 ndc = float2(pixel.x * viewportSize.z * 2 - 1, 1 - pixel.y * viewportSize.w * 2);
+	float4 world = mul(float4(ndc, depth, 1.0f), inverseViewProjection);
+	return float4(world.xyz / world.w, 1.0f / world.w);
+}
+
+float4 main(PixelShaderInput input) : SV_TARGET
+{
+	int3 texel = int3(input.pos.xy, 0);
+	float depth = depthTarget.Load(texel);
+	if (depth >= 1.0f)
+	{
+		// nothing drawn: the canvas's clear colour, as in the forward path
+		return float4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	float4 surface = Reconstruct(input.pos.xy, depth);
+	float3 N = DecodeOctahedral(normalTarget.Load(texel));
+	float3 V = normalize(eyepos.xyz - surface.xyz);
+	float c = MainLight(N, V, surface.xyz);
+	float3 lit = PointLights(N, V, surface.xyz, input.pos.xy, surface.w);
+	float3 color = albedoTarget.Load(texel).rgb * (c + lit);
+
+	if (edges.x > 0)
+	{
+		const int2 offsets[4] = { int2(1, 0), int2(-1, 0), int2(0, 1), int2(0, -1) };
+		float edge = 0;
+		[unroll]
+		for (int i = 0; i < 4; i++)
+		{
+			int3 neighbour = int3(clamp(texel.xy + offsets[i], int2(0, 0), (int2)viewportSize.xy - 1), 0);
+			float neighbourDepth = depthTarget.Load(neighbour);
+			float w = neighbourDepth >= 1.0f ? 1e30f : Reconstruct(neighbour.xy + 0.5f, neighbourDepth).w;
+			bool depthJump = abs(w - surface.w) > edges.y * surface.w;
+			bool crease = dot(N, DecodeOctahedral(normalTarget.Load(neighbour))) < edges.z;
+			edge = (depthJump || crease) ? 1 : edge;
+		}
+		color *= 1 - edges.x * edge;
+	}
+
+	return float4(color, 1.0f);
+}
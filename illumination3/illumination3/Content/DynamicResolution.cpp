@@ -0,0 +1,286 @@
+#include "DynamicResolution.h"
+#include "../Helpers/MappedFile.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+using namespace DirectXGame1;
+
+namespace
+{
+	// However late a frame, one step never drops more than half the pixels, so a single
+	// hitch (a page fault, a window move) does not throw the scale to the floor.
+	const float MaxCut = 0.70710678f;
+}
+
+DynamicResolutionSettings::DynamicResolutionSettings() :
+	targetSeconds(1.0 / 60.0),
+	tolerance(0.05),
+	headroom(0.85),
+	minScale(0.5f),
+	maxScale(1.0f),
+	scaleStep(1.0f / 32.0f),
+	maxRaise(0.125f),
+	settleFrames(10),
+	probeFrames(30),
+	maxProbeFrames(480)
+{
+}
+
+DynamicResolutionController::DynamicResolutionController(const DynamicResolutionSettings& settings) :
+	m_settings(settings)
+{
+	Reset();
+}
+
+void DynamicResolutionController::Reset()
+{
+	m_scale = Quantize(m_settings.maxScale);
+	m_onTimeFrames = 0;
+	m_probeFrames = m_settings.probeFrames;
+	m_probing = false;
+}
+
+float DynamicResolutionController::Quantize(float scale) const
+{
+	const DynamicResolutionSettings& s = m_settings;
+	scale = std::floor(scale / s.scaleStep + 1e-4f) * s.scaleStep;
+	float lowest = std::ceil(s.minScale / s.scaleStep - 1e-4f) * s.scaleStep;
+	return scale < lowest ? lowest : (scale > s.maxScale ? s.maxScale : scale);
+}
+
+float DynamicResolutionController::Update(double frameSeconds)
+{
+	const DynamicResolutionSettings& s = m_settings;
+	if (!(frameSeconds > 0.0))
+	{
+		return m_scale;
+	}
+
+	// What the scale would have to be for that frame to have taken headroom * budget.
+	float fit = m_scale * (float)std::sqrt(s.headroom * s.targetSeconds / frameSeconds);
+
+	if (frameSeconds > s.targetSeconds * (1.0 + s.tolerance))
+	{
+		float cut = fit > m_scale * MaxCut ? fit : m_scale * MaxCut;
+		cut = Quantize(cut < m_scale - s.scaleStep ? cut : m_scale - s.scaleStep);
+		if (m_probing)
+		{
+			m_probeFrames = m_probeFrames * 2 < s.maxProbeFrames ? m_probeFrames * 2 : s.maxProbeFrames;
+			m_probing = false;
+		}
+		m_onTimeFrames = 0;
+		m_scale = cut;
+		return m_scale;
+	}
+
+	m_onTimeFrames++;
+	if (m_probing && m_onTimeFrames >= m_probeFrames)
+	{
+		m_probing = false;
+	}
+	if (m_scale >= s.maxScale || m_onTimeFrames < s.settleFrames)
+	{
+		return m_scale;
+	}
+
+	float raise = m_scale;
+	if (frameSeconds < s.headroom * s.targetSeconds)
+	{
+		raise = Quantize(fit < m_scale + s.maxRaise ? fit : m_scale + s.maxRaise);
+	}
+	if (raise > m_scale)
+	{
+		// the load dropped, so a scale that failed before may fit now
+		m_scale = raise;
+		m_onTimeFrames = 0;
+		m_probeFrames = s.probeFrames;
+		m_probing = false;
+	}
+	else if (!m_probing && m_onTimeFrames >= m_probeFrames)
+	{
+		// no headroom to size a step from (vsync, or just under a step): try one
+		m_scale = Quantize(m_scale + s.scaleStep);
+		m_onTimeFrames = 0;
+		m_probing = true;
+	}
+	return m_scale;
+}
+
+std::vector<float> DirectXGame1::ReplayDynamicResolution(const std::vector<double>& frameSeconds, const DynamicResolutionSettings& settings)
+{
+	DynamicResolutionController controller(settings);
+	std::vector<float> scales;
+	scales.reserve(frameSeconds.size());
+	for (double seconds : frameSeconds)
+	{
+		scales.push_back(controller.Update(seconds));
+	}
+	return scales;
+}
+
+bool DirectXGame1::ReadFrameTimeTrace(const std::wstring& path, std::vector<double>& frameSeconds)
+{
+	frameSeconds.clear();
+	DX::MappedFile file;
+	if (!file.Open(path))
+	{
+		return false;
+	}
+
+	const char* text = static_cast<const char*>(file.GetData());
+	const char* end = text + file.GetSize();
+	while (text < end)
+	{
+		const char* lineEnd = text;
+		while (lineEnd < end && *lineEnd != '\n')
+		{
+			lineEnd++;
+		}
+		std::string line(text, lineEnd);
+		text = lineEnd + 1;
+
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == '#')
+		{
+			continue;
+		}
+		char* parsed = nullptr;
+		double milliseconds = std::strtod(line.c_str() + first, &parsed);
+		if (parsed == line.c_str() + first || line.find_first_not_of(" \t\r", parsed - line.c_str()) != std::string::npos)
+		{
+			frameSeconds.clear();
+			return false;
+		}
+		frameSeconds.push_back(milliseconds / 1000.0);
+	}
+	return true;
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+DynamicResolutionRun DirectXGame1::SimulateDynamicResolution(const FrameCostModel& model, DynamicResolutionController* controller, std::vector<float>* scales)
+{
+	DynamicResolutionRun run = {};
+	run.frames = (uint32_t)model.load.size();
+	run.minScale = 1.0f;
+	double budget = controller ? controller->GetSettings().targetSeconds : 1.0 / 60.0;
+	double tolerance = controller ? controller->GetSettings().tolerance : 0.05;
+
+	float scale = controller ? controller->GetScale() : 1.0f;
+	uint32_t lateRun = 0;
+	int lastDirection = 0;
+	double scaleSum = 0.0;
+	for (uint32_t frame = 0; frame < run.frames; frame++)
+	{
+		double seconds = model.fixedSeconds + model.pixelSeconds * scale * scale * model.load[frame];
+		if (model.vsyncSeconds > 0.0)
+		{
+			seconds = std::ceil(seconds / model.vsyncSeconds - 1e-9) * model.vsyncSeconds;
+		}
+
+		bool late = seconds > budget * (1.0 + tolerance);
+		lateRun = late ? lateRun + 1 : 0;
+		run.lateFrames += late;
+		run.longestLateRun = lateRun > run.longestLateRun ? lateRun : run.longestLateRun;
+		scaleSum += scale;
+		run.minScale = scale < run.minScale ? scale : run.minScale;
+
+		float next = controller ? controller->Update(seconds) : 1.0f;
+		if (next != scale)
+		{
+			int direction = next > scale ? 1 : -1;
+			run.scaleChanges++;
+			run.reversals += lastDirection != 0 && direction != lastDirection;
+			lastDirection = direction;
+		}
+		scale = next;
+		if (scales)
+		{
+			scales->push_back(scale);
+		}
+	}
+	run.meanScale = run.frames ? (float)(scaleSum / run.frames) : 1.0f;
+	return run;
+}
+
+DynamicResolutionReport DirectXGame1::ValidateDynamicResolution()
+{
+	DynamicResolutionReport report = {};
+	DynamicResolutionSettings settings;
+
+	// 4 ms that does not scale plus 10 ms of pixels: 14 ms at full scale, 24 ms once the
+	// load doubles for frames [300, 600), which needs the scale down to about 0.8.
+	const uint32_t frames = 1200, spikeStart = 300, spikeEnd = 600;
+	FrameCostModel spike;
+	spike.fixedSeconds = 0.004;
+	spike.pixelSeconds = 0.010;
+	spike.vsyncSeconds = 0.0;
+	spike.load.assign(frames, 1.0);
+	for (uint32_t frame = spikeStart; frame < spikeEnd; frame++)
+	{
+		spike.load[frame] = 2.0;
+	}
+
+	report.spikeFixed = SimulateDynamicResolution(spike, nullptr);
+
+	DynamicResolutionController controller(settings);
+	std::vector<float> spikeScales;
+	report.spikeControlled = SimulateDynamicResolution(spike, &controller, &spikeScales);
+
+	// Settling and recovery come from the same run's scales: a frame is late when the scale it
+	// ran at (the one chosen after the frame before) is too large for its load.
+	float scale = 1.0f;
+	std::vector<double> spikeSeconds;
+	for (uint32_t frame = 0; frame < frames; frame++)
+	{
+		double seconds = spike.fixedSeconds + spike.pixelSeconds * scale * scale * spike.load[frame];
+		spikeSeconds.push_back(seconds);
+		if (frame >= spikeStart && frame < spikeEnd && seconds > settings.targetSeconds * (1.0 + settings.tolerance))
+		{
+			report.spikeSettleFrames = frame - spikeStart + 1;
+		}
+		scale = spikeScales[frame];
+	}
+	report.recoverFrames = frames - spikeEnd;
+	for (uint32_t frame = spikeEnd; frame < frames; frame++)
+	{
+		if (spikeScales[frame] >= settings.maxScale)
+		{
+			report.recoverFrames = frame - spikeEnd + 1;
+			break;
+		}
+	}
+	report.replayMatches = ReplayDynamicResolution(spikeSeconds, settings) == spikeScales;
+
+	FrameCostModel vsync = spike;
+	vsync.vsyncSeconds = 1.0 / 60.0;
+	controller.Reset();
+	std::vector<float> vsyncScales;
+	report.vsyncControlled = SimulateDynamicResolution(vsync, &controller, &vsyncScales);
+
+	// 4 + 11.5 ms with +-10% on the pixels: the worst frames graze the tolerance at full scale.
+	FrameCostModel noisy = spike;
+	uint32_t random = 12345;
+	for (uint32_t frame = 0; frame < frames; frame++)
+	{
+		random = random * 1664525u + 1013904223u;
+		noisy.load[frame] = 1.15 * (0.9 + 0.2 * (random >> 8) / 16777216.0);
+	}
+	controller.Reset();
+	std::vector<float> noisyScales;
+	report.noisyControlled = SimulateDynamicResolution(noisy, &controller, &noisyScales);
+
+	report.boundsHold = true;
+	const std::vector<float>* runs[] = { &spikeScales, &vsyncScales, &noisyScales };
+	for (const std::vector<float>* run : runs)
+	{
+		for (float s : *run)
+		{
+			float steps = s / settings.scaleStep;
+			report.boundsHold &= s >= settings.minScale && s <= settings.maxScale && steps == std::floor(steps);
+		}
+	}
+	return report;
+}
+#endif
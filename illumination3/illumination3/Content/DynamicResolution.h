@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace DirectXGame1
+{
+	struct DynamicResolutionSettings
+	{
+		DynamicResolutionSettings();
+
+		double targetSeconds;		// the frame budget
+		double tolerance;			// a frame counts as late past targetSeconds * (1 + tolerance)
+		double headroom;			// aim for this fraction of the budget when sizing a step
+		float minScale;
+		float maxScale;
+		float scaleStep;			// scales are multiples of this
+		float maxRaise;				// most the scale grows in one step
+		unsigned int settleFrames;	// on-time frames after any change before growing again
+		unsigned int probeFrames;	// on-time frames at the budget (no visible headroom) before probing up
+		unsigned int maxProbeFrames;
+	};
+
+	// Picks the render scale (fraction of the output width and height) for the next frame
+	// from how long the last one took. Frame time is taken to grow with the pixel count, so
+	// a late frame sizes its cut as scale * sqrt(headroom * budget / time) and the cut
+	// happens at once. Growing is slower: after settleFrames on time, with the same rule
+	// capped at maxRaise when the frame showed headroom; with vsync every frame that makes it
+	// takes exactly the budget, so then the controller probes one step up after probeFrames
+	// instead. A probe that turns a frame late doubles the wait before the next one, up to
+	// maxProbeFrames, so a scale just over the limit is not retried every few frames; the
+	// wait goes back to probeFrames once frames show headroom again.
+	// Pure arithmetic on frame times, so recorded traces replay the same anywhere.
+	class DynamicResolutionController
+	{
+	public:
+		explicit DynamicResolutionController(const DynamicResolutionSettings& settings = DynamicResolutionSettings());
+
+		// Feeds the wall-clock time of the last frame; returns the scale for the next one.
+		float Update(double frameSeconds);
+		float GetScale() const { return m_scale; }
+		// Back to maxScale, with the probe wait and history cleared.
+		void Reset();
+
+		const DynamicResolutionSettings& GetSettings() const { return m_settings; }
+
+	private:
+		float Quantize(float scale) const;
+
+		DynamicResolutionSettings m_settings;
+		float m_scale;
+		unsigned int m_onTimeFrames;	// since the last change or late frame
+		unsigned int m_probeFrames;		// current wait before a probe
+		bool m_probing;					// the last change was a probe that has not yet proven itself
+	};
+
+	// Runs a recorded trace through a fresh controller: the scale chosen after each frame.
+	// The trace is open loop, so this checks the controller's reactions, not their effect.
+	std::vector<float> ReplayDynamicResolution(const std::vector<double>& frameSeconds, const DynamicResolutionSettings& settings = DynamicResolutionSettings());
+
+	// Frame times in milliseconds, one per line, as a text file; blank lines and lines starting
+	// with # are skipped. False if the file cannot be read or a line is not a number.
+	bool ReadFrameTimeTrace(const std::wstring& path, std::vector<double>& frameSeconds);
+
+#if defined(DX_HEADLESS_CHECKS)
+	// A stand-in for the GPU to close the loop: a frame takes fixedSeconds plus
+	// pixelSeconds * scale^2 * load[frame], rounded up to whole vsync intervals if vsync is set.
+	struct FrameCostModel
+	{
+		double fixedSeconds;
+		double pixelSeconds;
+		std::vector<double> load;
+		double vsyncSeconds;		// 0 for no vsync
+	};
+
+	struct DynamicResolutionRun
+	{
+		uint32_t frames;
+		uint32_t lateFrames;
+		uint32_t longestLateRun;
+		uint32_t scaleChanges;
+		uint32_t reversals;			// changes against the direction of the one before
+		float meanScale;
+		float minScale;
+	};
+
+	// Drives the controller with the frame times the model gives for its own choices.
+	// A null controller keeps the scale at 1, the baseline to compare against.
+	DynamicResolutionRun SimulateDynamicResolution(const FrameCostModel& model, DynamicResolutionController* controller, std::vector<float>* scales = nullptr);
+
+	struct DynamicResolutionReport
+	{
+		DynamicResolutionRun spikeFixed;		// load doubles for five seconds, scale held at 1
+		DynamicResolutionRun spikeControlled;
+		uint32_t spikeSettleFrames;				// from the spike to the last late frame
+		uint32_t recoverFrames;					// from the end of the spike back to full scale
+		DynamicResolutionRun vsyncControlled;	// the same spike behind 60 Hz vsync
+		DynamicResolutionRun noisyControlled;	// steady load just under budget with +-10% noise
+		bool replayMatches;						// a closed-loop run replayed from its frame times
+		bool boundsHold;						// every scale a multiple of the step within [min, max]
+	};
+
+	// Closed-loop runs at 60 Hz against FrameCostModel traces, and a replay of one of them as a
+	// recorded trace, which must give back the same scales.
+	DynamicResolutionReport ValidateDynamicResolution();
+#endif
+}
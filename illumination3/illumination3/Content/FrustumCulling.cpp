@@ -0,0 +1,322 @@
+#include "FrustumCulling.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include "../Helpers/ParallelFor.h"
+#include "../Helpers/SimdFloat4.h"
+
+using namespace DirectXGame1;
+using namespace DX;
+
+namespace
+{
+	// Objects per ParallelFor item; a multiple of four.
+	const uint32_t CullBlock = 16384;
+
+	// Lanes of four objects for which every plane leaves them at least partly inside.
+	int SphereMask(const CullingBounds& bounds, const FrustumPlanes& planes, uint32_t i)
+	{
+		SimdFloat4 x = SimdLoad(&bounds.centerX[i]);
+		SimdFloat4 y = SimdLoad(&bounds.centerY[i]);
+		SimdFloat4 z = SimdLoad(&bounds.centerZ[i]);
+		SimdFloat4 negativeRadius = SimdSub(SimdZero(), SimdLoad(&bounds.radius[i]));
+		SimdFloat4 outside = SimdZero();
+		for (int p = 0; p < 6; p++)
+		{
+			SimdFloat4 distance = SimdMulAdd(x, SimdSplat(planes.nx[p]), SimdSplat(planes.d[p]));
+			distance = SimdMulAdd(y, SimdSplat(planes.ny[p]), distance);
+			distance = SimdMulAdd(z, SimdSplat(planes.nz[p]), distance);
+			outside = SimdOr(outside, SimdCmpLt(distance, negativeRadius));
+		}
+		return ~SimdMoveMask(outside) & 15;
+	}
+
+	// The same for the boxes: a box is outside a plane when even its corner furthest along
+	// the normal, centre + |n| . extent, is behind it.
+	int BoxMask(const CullingBounds& bounds, const FrustumPlanes& planes, uint32_t i)
+	{
+		SimdFloat4 x = SimdLoad(&bounds.centerX[i]);
+		SimdFloat4 y = SimdLoad(&bounds.centerY[i]);
+		SimdFloat4 z = SimdLoad(&bounds.centerZ[i]);
+		SimdFloat4 ex = SimdLoad(&bounds.extentX[i]);
+		SimdFloat4 ey = SimdLoad(&bounds.extentY[i]);
+		SimdFloat4 ez = SimdLoad(&bounds.extentZ[i]);
+		SimdFloat4 outside = SimdZero();
+		for (int p = 0; p < 6; p++)
+		{
+			SimdFloat4 distance = SimdMulAdd(x, SimdSplat(planes.nx[p]), SimdSplat(planes.d[p]));
+			distance = SimdMulAdd(y, SimdSplat(planes.ny[p]), distance);
+			distance = SimdMulAdd(z, SimdSplat(planes.nz[p]), distance);
+			SimdFloat4 reach = SimdMul(ex, SimdSplat(std::fabs(planes.nx[p])));
+			reach = SimdMulAdd(ey, SimdSplat(std::fabs(planes.ny[p])), reach);
+			reach = SimdMulAdd(ez, SimdSplat(std::fabs(planes.nz[p])), reach);
+			outside = SimdOr(outside, SimdCmpLt(SimdAdd(distance, reach), SimdZero()));
+		}
+		return ~SimdMoveMask(outside) & 15;
+	}
+
+	// Objects [first, end) into visible, end a multiple of four; returns how many.
+	uint32_t CullRange(const CullingBounds& bounds, const FrustumPlanes& planes, CullVolume volume, uint32_t first, uint32_t end, uint32_t* visible)
+	{
+		uint32_t written = 0;
+		for (uint32_t i = first; i < end; i += 4)
+		{
+			int mask = volume == CullVolume::Box ? BoxMask(bounds, planes, i) : SphereMask(bounds, planes, i);
+			if (mask != 0 && volume == CullVolume::SphereThenBox)
+			{
+				mask &= BoxMask(bounds, planes, i);
+			}
+			if (i + 4 > bounds.count)
+			{
+				// Padding lanes.
+				mask &= (1 << (bounds.count - i)) - 1;
+			}
+			// The common all-out and all-in cases skip the bit loop.
+			if (mask == 15)
+			{
+				visible[written] = i;
+				visible[written + 1] = i + 1;
+				visible[written + 2] = i + 2;
+				visible[written + 3] = i + 3;
+				written += 4;
+				continue;
+			}
+			for (; mask != 0; mask &= mask - 1)
+			{
+				int lane = (mask & 1) ? 0 : (mask & 2) ? 1 : (mask & 4) ? 2 : 3;
+				visible[written++] = i + lane;
+			}
+		}
+		return written;
+	}
+
+	bool SphereVisible(const CullingBounds& bounds, const FrustumPlanes& planes, uint32_t i)
+	{
+		for (int p = 0; p < 6; p++)
+		{
+			float distance = planes.nx[p] * bounds.centerX[i] + planes.ny[p] * bounds.centerY[i] + planes.nz[p] * bounds.centerZ[i] + planes.d[p];
+			if (distance < -bounds.radius[i])
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool BoxVisible(const CullingBounds& bounds, const FrustumPlanes& planes, uint32_t i)
+	{
+		for (int p = 0; p < 6; p++)
+		{
+			float distance = planes.nx[p] * bounds.centerX[i] + planes.ny[p] * bounds.centerY[i] + planes.nz[p] * bounds.centerZ[i] + planes.d[p];
+			float reach = std::fabs(planes.nx[p]) * bounds.extentX[i] + std::fabs(planes.ny[p]) * bounds.extentY[i] + std::fabs(planes.nz[p]) * bounds.extentZ[i];
+			if (distance + reach < 0.0f)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+void CullingBounds::Resize(uint32_t objects)
+{
+	count = objects;
+	uint32_t padded = (objects + 3) & ~3u;
+	std::vector<float>* fields[] = { &centerX, &centerY, &centerZ, &radius, &extentX, &extentY, &extentZ };
+	for (std::vector<float>* field : fields)
+	{
+		field->resize(padded, 0.0f);
+	}
+}
+
+void CullingBounds::Set(uint32_t object, const float center[3], float sphereRadius, const float extent[3])
+{
+	centerX[object] = center[0];
+	centerY[object] = center[1];
+	centerZ[object] = center[2];
+	radius[object] = sphereRadius;
+	extentX[object] = extent[0];
+	extentY[object] = extent[1];
+	extentZ[object] = extent[2];
+}
+
+FrustumPlanes DirectXGame1::ExtractFrustumPlanes(const float m[4][4])
+{
+	// clip = p * m, so each clip coordinate is a column of m (Gribb and Hartmann).
+	const int sign[6] = { 1, -1, 1, -1, 0, -1 };
+	const int column[6] = { 0, 0, 1, 1, 2, 2 };
+	FrustumPlanes planes;
+	for (int p = 0; p < 6; p++)
+	{
+		float plane[4];
+		for (int r = 0; r < 4; r++)
+		{
+			// Near is z >= 0 on its own; the rest are w +- x, y or z.
+			plane[r] = p == 4 ? m[r][2] : m[r][3] + sign[p] * m[r][column[p]];
+		}
+		float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		float scale = length > 0.0f ? 1.0f / length : 0.0f;
+		planes.nx[p] = plane[0] * scale;
+		planes.ny[p] = plane[1] * scale;
+		planes.nz[p] = plane[2] * scale;
+		planes.d[p] = plane[3] * scale;
+	}
+	return planes;
+}
+
+uint32_t DirectXGame1::CullObjects(const CullingBounds& bounds, const FrustumPlanes& planes, CullVolume volume, uint32_t* visible, unsigned int maxWorkers)
+{
+	uint32_t padded = (bounds.count + 3) & ~3u;
+	unsigned int blocks = (padded + CullBlock - 1) / CullBlock;
+	if (blocks <= 1)
+	{
+		return CullRange(bounds, planes, volume, 0, padded, visible);
+	}
+
+	// Each block writes from its own first index, then the blocks are packed down in order.
+	std::vector<uint32_t> counts(blocks);
+	ParallelFor(blocks, [&](unsigned int block)
+	{
+		uint32_t first = block * CullBlock;
+		counts[block] = CullRange(bounds, planes, volume, first, std::min(first + CullBlock, padded), visible + first);
+	}, maxWorkers);
+
+	uint32_t written = counts[0];
+	for (unsigned int block = 1; block < blocks; block++)
+	{
+		const uint32_t* source = visible + block * CullBlock;
+		std::copy(source, source + counts[block], visible + written);
+		written += counts[block];
+	}
+	return written;
+}
+
+uint32_t DirectXGame1::CullObjectsReference(const CullingBounds& bounds, const FrustumPlanes& planes, CullVolume volume, uint32_t* visible)
+{
+	uint32_t written = 0;
+	for (uint32_t i = 0; i < bounds.count; i++)
+	{
+		bool inside = volume == CullVolume::Box ? BoxVisible(bounds, planes, i) : SphereVisible(bounds, planes, i);
+		if (inside && volume == CullVolume::SphereThenBox)
+		{
+			inside = BoxVisible(bounds, planes, i);
+		}
+		if (inside)
+		{
+			visible[written++] = i;
+		}
+	}
+	return written;
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+namespace
+{
+	void MultiplyMatrices(const float a[4][4], const float b[4][4], float out[4][4])
+	{
+		for (int r = 0; r < 4; r++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				out[r][c] = a[r][0] * b[0][c] + a[r][1] * b[1][c] + a[r][2] * b[2][c] + a[r][3] * b[3][c];
+			}
+		}
+	}
+}
+
+CullingBenchmark DirectXGame1::BenchmarkCulling(uint32_t objects, unsigned int passes)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	CullingBenchmark result;
+	result.objects = objects;
+	result.workers = GetWorkerCount();
+
+	// Objects in a 200-unit cube around the eye, sized like the instances and a bit larger.
+	CullingBounds bounds;
+	bounds.Resize(objects);
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> size(0.05f, 2.0f);
+	for (uint32_t i = 0; i < objects; i++)
+	{
+		float center[3] = { position(random), position(random), position(random) };
+		float extent[3] = { size(random), size(random), size(random) };
+		float radius = std::sqrt(extent[0] * extent[0] + extent[1] * extent[1] + extent[2] * extent[2]);
+		bounds.Set(i, center, radius, extent);
+	}
+
+	// The renderer's camera: eye (0, 0, 1.5) looking at (0, -0.1, 0), 70 degrees, 16:9,
+	// near 0.1 and far 100, built the way XMMatrixLookAtRH and XMMatrixPerspectiveFovRH do.
+	const float eye[3] = { 0.0f, 0.0f, 1.5f };
+	float forward[3] = { 0.0f, -0.1f, -1.5f };
+	float length = std::sqrt(forward[0] * forward[0] + forward[1] * forward[1] + forward[2] * forward[2]);
+	float zAxis[3] = { -forward[0] / length, -forward[1] / length, -forward[2] / length };
+	float xAxis[3] = { zAxis[2], 0.0f, -zAxis[0] };		// up (0, 1, 0) x zAxis
+	length = std::sqrt(xAxis[0] * xAxis[0] + xAxis[2] * xAxis[2]);
+	xAxis[0] /= length; xAxis[2] /= length;
+	float yAxis[3] = { zAxis[1] * xAxis[2] - zAxis[2] * xAxis[1], zAxis[2] * xAxis[0] - zAxis[0] * xAxis[2], zAxis[0] * xAxis[1] - zAxis[1] * xAxis[0] };
+	const float view[4][4] = {
+		{ xAxis[0], yAxis[0], zAxis[0], 0.0f },
+		{ xAxis[1], yAxis[1], zAxis[1], 0.0f },
+		{ xAxis[2], yAxis[2], zAxis[2], 0.0f },
+		{ -(xAxis[0] * eye[0] + xAxis[1] * eye[1] + xAxis[2] * eye[2]), -(yAxis[0] * eye[0] + yAxis[1] * eye[1] + yAxis[2] * eye[2]),
+			-(zAxis[0] * eye[0] + zAxis[1] * eye[1] + zAxis[2] * eye[2]), 1.0f } };
+	const float nearZ = 0.1f, farZ = 100.0f;
+	float yScale = 1.0f / std::tan(0.5f * 70.0f * 3.14159265f / 180.0f);
+	float range = farZ / (nearZ - farZ);
+	const float projection[4][4] = {
+		{ yScale * 9.0f / 16.0f, 0.0f, 0.0f, 0.0f },
+		{ 0.0f, yScale, 0.0f, 0.0f },
+		{ 0.0f, 0.0f, range, -1.0f },
+		{ 0.0f, 0.0f, range * nearZ, 0.0f } };
+	float viewProjection[4][4];
+	MultiplyMatrices(view, projection, viewProjection);
+	FrustumPlanes planes = ExtractFrustumPlanes(viewProjection);
+
+	std::vector<uint32_t> reference(objects), visible(objects);
+	const CullVolume volumes[3] = { CullVolume::Sphere, CullVolume::Box, CullVolume::SphereThenBox };
+	result.mismatches = 0;
+	for (CullVolume volume : volumes)
+	{
+		uint32_t expected = CullObjectsReference(bounds, planes, volume, &reference[0]);
+		uint32_t got = CullObjects(bounds, planes, volume, &visible[0]);
+		if (got != expected || !std::equal(reference.begin(), reference.begin() + got, visible.begin()))
+		{
+			result.mismatches++;
+		}
+		if (volume == CullVolume::Sphere)
+		{
+			result.visibleSpheres = expected;
+		}
+		else if (volume == CullVolume::Box)
+		{
+			result.visibleBoxes = expected;
+		}
+	}
+
+	auto time = [&](unsigned int workers, bool useReference)
+	{
+		auto start = Clock::now();
+		for (unsigned int pass = 0; pass < passes; pass++)
+		{
+			if (useReference)
+			{
+				CullObjectsReference(bounds, planes, CullVolume::SphereThenBox, &visible[0]);
+			}
+			else
+			{
+				CullObjects(bounds, planes, CullVolume::SphereThenBox, &visible[0], workers);
+			}
+		}
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / passes;
+	};
+	result.referenceMilliseconds = time(1, true);
+	result.simdMilliseconds = time(1, false);
+	result.parallelMilliseconds = time(0, false);
+	result.objectsPerMillisecond = objects / std::max(result.parallelMilliseconds, 1e-6);
+	return result;
+}
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace DirectXGame1
+{
+	// Bounds of every object, one array per field so four objects load as one SimdFloat4. Each
+	// object has a sphere and an axis-aligned box about the same centre. Arrays are padded to
+	// a multiple of four; padding is never reported visible.
+	struct CullingBounds
+	{
+		CullingBounds() : count(0) {}
+
+		uint32_t count;
+		std::vector<float> centerX, centerY, centerZ;
+		std::vector<float> radius;
+		std::vector<float> extentX, extentY, extentZ;	// half sizes of the box
+
+		void Resize(uint32_t objects);
+		void Set(uint32_t object, const float center[3], float radius, const float extent[3]);
+	};
+
+	// Left, right, bottom, top, near, far, each n.p + d >= 0 inside with unit n.
+	struct FrustumPlanes
+	{
+		float nx[6], ny[6], nz[6], d[6];
+	};
+
+	// From a row-vector view * projection matrix (DirectXMath's order, before the transpose the
+	// constant buffers get) with clip z in [0, w].
+	FrustumPlanes ExtractFrustumPlanes(const float viewProjection[4][4]);
+
+	enum class CullVolume
+	{
+		Sphere,
+		Box,
+		SphereThenBox	// boxes only for the objects whose spheres pass
+	};
+
+	// Writes the indices of the objects that may be visible to visible, in ascending order, and
+	// returns how many. visible must hold bounds.count entries. Objects are split into blocks
+	// of 16k across ParallelFor; each block compacts its own survivors with the lane masks.
+	uint32_t CullObjects(const CullingBounds& bounds, const FrustumPlanes& planes, CullVolume volume, uint32_t* visible, unsigned int maxWorkers = 0);
+
+	// One object and one plane at a time.
+	uint32_t CullObjectsReference(const CullingBounds& bounds, const FrustumPlanes& planes, CullVolume volume, uint32_t* visible);
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct CullingBenchmark
+	{
+		uint32_t objects;
+		uint32_t visibleSpheres;
+		uint32_t visibleBoxes;
+		unsigned int workers;
+		double referenceMilliseconds;		// SphereThenBox, per pass
+		double simdMilliseconds;			// on one thread
+		double parallelMilliseconds;		// on every worker
+		double objectsPerMillisecond;		// parallel
+		uint32_t mismatches;				// visible lists that differ from the reference, of three volumes
+	};
+
+	// objects random spheres and boxes around the renderer's camera, culled passes times.
+	CullingBenchmark BenchmarkCulling(uint32_t objects = 1000000, unsigned int passes = 10);
+#endif
+}
@@ -0,0 +1,19 @@
+// Normal packing for the deferred path's R16G16_SNORM target. GBufferPacking.cpp does the
+// same on the CPU.
+
+// Octahedral mapping: project onto |x| + |y| + |z| = 1 and fold the lower half over the
+// diagonals, so every direction lands in [-1, 1]^2 with the error spread evenly.
+float2 EncodeOctahedral(float3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	float2 signs = float2(n.x >= 0 ? 1.0f : -1.0f, n.y >= 0 ? 1.0f : -1.0f);
+	return n.z >= 0 ? n.xy : (1.0f - abs(n.yx)) * signs;
+}
+
+float3 DecodeOctahedral(float2 f)
+{
+	float3 n = float3(f, 1.0f - abs(f.x) - abs(f.y));
+	float t = saturate(-n.z);
+	n.xy += n.xy >= 0 ? -t : t;
+	return normalize(n);
+}
@@ -0,0 +1,35 @@
+// The deferred path's geometry pass: writes what SamplePixelShader.hlsl would light instead
+// of lighting it. DeferredLightingPS.hlsl does the lighting afterwards, once per pixel.
+cbuffer PerViewConstantBuffer : register(b1)
+{
+	matrix view;
+	matrix projection;
+	float4 eyepos;
+};
+
+#include "GBuffer.hlsli"
+
+struct PixelShaderInput
+{
+	float4 pos : SV_POSITION;
+	float3 color : COLOR0;
+	float3 normal : NORMAL0;
+	float4 surfpos : POSITION0;
+	float2 tex : TEXCOORD0;
+};
+
+struct GBufferOutput
+{
+	float4 albedo : SV_TARGET0;		// R8G8B8A8_UNORM: the colour the forward shader scales by its lighting
+	float2 normal : SV_TARGET1;		// R16G16_SNORM: octahedral
+	float depth : SV_TARGET2;		// R32_FLOAT: z / w, what the depth buffer holds
+};
+
+GBufferOutput main(PixelShaderInput input)
+{
+	GBufferOutput output;
+	output.albedo = float4(input.color.rg, eyepos.x / 10, 1.0f);
+	output.normal = EncodeOctahedral(normalize(input.normal));
+	output.depth = input.pos.z;
+	return output;
+}
@@ -0,0 +1,254 @@
+#include "GBufferPacking.h"
+#include "RasterizerCpu.h"
+
+#include <cmath>
+#include <random>
+
+using namespace DirectXGame1;
+
+namespace
+{
+	const double DegreesPerRadian = 57.29577951308232;
+
+	float SignNotZero(float v)
+	{
+		return v >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	int16_t FloatToSnorm16(float v)
+	{
+		v = v > 1.0f ? 1.0f : (v < -1.0f ? -1.0f : v);
+		return (int16_t)std::lrint(v * 32767.0f);
+	}
+
+	float Snorm16ToFloat(int16_t v)
+	{
+		// both -32768 and -32767 mean -1
+		float f = v / 32767.0f;
+		return f < -1.0f ? -1.0f : f;
+	}
+
+#if defined(DX_HEADLESS_CHECKS)
+	double AngleDegrees(const float a[3], const float b[3])
+	{
+		double dot = (double)a[0] * b[0] + (double)a[1] * b[1] + (double)a[2] * b[2];
+		double la = std::sqrt((double)a[0] * a[0] + (double)a[1] * a[1] + (double)a[2] * a[2]);
+		double lb = std::sqrt((double)b[0] * b[0] + (double)b[1] * b[1] + (double)b[2] * b[2]);
+		double c = dot / (la * lb);
+		return std::acos(c > 1.0 ? 1.0 : (c < -1.0 ? -1.0 : c)) * DegreesPerRadian;
+	}
+#endif
+
+	void Transform(const float v[4], const float m[4][4], float out[4])
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			out[c] = v[0] * m[0][c] + v[1] * m[1][c] + v[2] * m[2][c] + v[3] * m[3][c];
+		}
+	}
+
+#if defined(DX_HEADLESS_CHECKS)
+	void MultiplyMatrices(const float a[4][4], const float b[4][4], float out[4][4])
+	{
+		for (int r = 0; r < 4; r++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				out[r][c] = a[r][0] * b[0][c] + a[r][1] * b[1][c] + a[r][2] * b[2][c] + a[r][3] * b[3][c];
+			}
+		}
+	}
+#endif
+}
+
+void DirectXGame1::EncodeOctahedral(const float normal[3], float encoded[2])
+{
+	float sum = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+	if (!(sum > 0.0f))
+	{
+		encoded[0] = encoded[1] = 0.0f;
+		return;
+	}
+	float x = normal[0] / sum, y = normal[1] / sum;
+	if (normal[2] < 0.0f)
+	{
+		float foldX = (1.0f - std::fabs(y)) * SignNotZero(x);
+		float foldY = (1.0f - std::fabs(x)) * SignNotZero(y);
+		x = foldX;
+		y = foldY;
+	}
+	encoded[0] = x;
+	encoded[1] = y;
+}
+
+void DirectXGame1::DecodeOctahedral(const float encoded[2], float normal[3])
+{
+	float x = encoded[0], y = encoded[1];
+	float z = 1.0f - std::fabs(x) - std::fabs(y);
+	// unfold the lower half: t is how far past the fold the point went
+	float t = -z > 0.0f ? -z : 0.0f;
+	x += x >= 0.0f ? -t : t;
+	y += y >= 0.0f ? -t : t;
+	float length = std::sqrt(x * x + y * y + z * z);
+	normal[0] = x / length;
+	normal[1] = y / length;
+	normal[2] = z / length;
+}
+
+uint32_t DirectXGame1::PackNormalSnorm16(const float normal[3])
+{
+	float encoded[2];
+	EncodeOctahedral(normal, encoded);
+	return (uint32_t)(uint16_t)FloatToSnorm16(encoded[0]) | ((uint32_t)(uint16_t)FloatToSnorm16(encoded[1]) << 16);
+}
+
+void DirectXGame1::UnpackNormalSnorm16(uint32_t packed, float normal[3])
+{
+	const float encoded[2] = { Snorm16ToFloat((int16_t)(packed & 0xffff)), Snorm16ToFloat((int16_t)(packed >> 16)) };
+	DecodeOctahedral(encoded, normal);
+}
+
+bool DirectXGame1::InvertMatrix(const float matrix[4][4], float inverse[4][4])
+{
+	// Gauss-Jordan with partial pivoting, in double so the inverse is as good as a float can hold.
+	double a[4][8];
+	for (int r = 0; r < 4; r++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			a[r][c] = matrix[r][c];
+			a[r][c + 4] = r == c ? 1.0 : 0.0;
+		}
+	}
+	for (int c = 0; c < 4; c++)
+	{
+		int pivot = c;
+		for (int r = c + 1; r < 4; r++)
+		{
+			pivot = std::fabs(a[r][c]) > std::fabs(a[pivot][c]) ? r : pivot;
+		}
+		if (a[pivot][c] == 0.0)
+		{
+			return false;
+		}
+		for (int k = 0; k < 8; k++)
+		{
+			double swap = a[c][k];
+			a[c][k] = a[pivot][k];
+			a[pivot][k] = swap;
+		}
+		double scale = 1.0 / a[c][c];
+		for (int k = 0; k < 8; k++)
+		{
+			a[c][k] *= scale;
+		}
+		for (int r = 0; r < 4; r++)
+		{
+			if (r != c && a[r][c] != 0.0)
+			{
+				double factor = a[r][c];
+				for (int k = 0; k < 8; k++)
+				{
+					a[r][k] -= factor * a[c][k];
+				}
+			}
+		}
+	}
+	for (int r = 0; r < 4; r++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			inverse[r][c] = (float)a[r][c + 4];
+		}
+	}
+	return true;
+}
+
+void DirectXGame1::ReconstructPosition(const float inverseViewProjection[4][4], float x, float y, float depth, unsigned int width, unsigned int height, float position[3])
+{
+	const float ndc[4] = { x / width * 2.0f - 1.0f, 1.0f - y / height * 2.0f, depth, 1.0f };
+	float world[4];
+	Transform(ndc, inverseViewProjection, world);
+	for (int c = 0; c < 3; c++)
+	{
+		position[c] = world[c] / world[3];
+	}
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+GBufferPackingReport DirectXGame1::ValidateGBufferPacking(uint32_t randomNormals)
+{
+	GBufferPackingReport report = {};
+	report.bytesPerPixel = 4 + 4 + 4;	// R8G8B8A8_UNORM albedo, R16G16_SNORM normal, R32_FLOAT depth
+
+	TorusSceneCpu scene;
+	std::vector<float> normals;
+	const float axes[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	for (const float* axis : axes)
+	{
+		normals.insert(normals.end(), axis, axis + 3);
+	}
+	for (const MeshVertex& vertex : scene.vertices)
+	{
+		normals.insert(normals.end(), vertex.normal, vertex.normal + 3);
+	}
+	std::mt19937 random(7);
+	std::normal_distribution<float> gaussian;
+	for (uint32_t i = 0; i < randomNormals; i++)
+	{
+		// a Gaussian vector points every way with equal chance
+		float n[3] = { gaussian(random), gaussian(random), gaussian(random) };
+		normals.insert(normals.end(), n, n + 3);
+	}
+
+	report.normals = (uint32_t)(normals.size() / 3);
+	double sum = 0.0;
+	for (uint32_t i = 0; i < report.normals; i++)
+	{
+		const float* n = &normals[i * 3];
+		float unpacked[3];
+		UnpackNormalSnorm16(PackNormalSnorm16(n), unpacked);
+		double degrees = AngleDegrees(n, unpacked);
+		sum += degrees;
+		report.maxNormalDegrees = degrees > report.maxNormalDegrees ? degrees : report.maxNormalDegrees;
+	}
+	report.meanNormalDegrees = report.normals ? sum / report.normals : 0.0;
+
+	const unsigned int width = 1920, height = 1080;
+	WorldPassCpuConstants constants = GetTorusFrameConstants(0.0f, 0, (float)width / height);
+	float viewProjection[4][4], inverse[4][4];
+	MultiplyMatrices(constants.view, constants.projection, viewProjection);
+	InvertMatrix(viewProjection, inverse);
+
+	for (const MeshVertex& vertex : scene.vertices)
+	{
+		// the model matrix is the identity at time 0, so the vertices are already in world space
+		const float world[4] = { vertex.pos[0], vertex.pos[1], vertex.pos[2], 1.0f };
+		float clip[4];
+		Transform(world, viewProjection, clip);
+		if (!(clip[3] > 0.0f) || std::fabs(clip[0]) > clip[3] || std::fabs(clip[1]) > clip[3] || clip[2] < 0.0f || clip[2] > clip[3])
+		{
+			continue;
+		}
+		float x = (clip[0] / clip[3] * 0.5f + 0.5f) * width;
+		float y = (0.5f - clip[1] / clip[3] * 0.5f) * height;
+		float position[3];
+		ReconstructPosition(inverse, x, y, clip[2] / clip[3], width, height, position);
+
+		double error = 0.0, distance = 0.0;
+		for (int c = 0; c < 3; c++)
+		{
+			double d = (double)position[c] - world[c];
+			double e = (double)world[c] - constants.eyePosition[c];
+			error += d * d;
+			distance += e * e;
+		}
+		error = std::sqrt(error);
+		double relative = error / std::sqrt(distance);
+		report.positions++;
+		report.maxPositionError = error > report.maxPositionError ? error : report.maxPositionError;
+		report.maxRelativePositionError = relative > report.maxRelativePositionError ? relative : report.maxRelativePositionError;
+	}
+	return report;
+}
+#endif
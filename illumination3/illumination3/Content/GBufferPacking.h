@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+namespace DirectXGame1
+{
+	// CPU versions of what GBuffer.hlsli does to the deferred path's normal and depth targets,
+	// for checking how much the packing loses.
+
+	// Octahedral mapping of a unit vector to [-1, 1]^2: project onto the octahedron
+	// |x| + |y| + |z| = 1 and fold the lower half over the diagonals. Any length is accepted;
+	// the zero vector maps to (0, 0), which decodes to +z.
+	void EncodeOctahedral(const float normal[3], float encoded[2]);
+	void DecodeOctahedral(const float encoded[2], float normal[3]);
+
+	// DXGI_FORMAT_R16G16_SNORM, as the normal target stores the encoded pair: x in the low half.
+	uint32_t PackNormalSnorm16(const float normal[3]);
+	void UnpackNormalSnorm16(uint32_t packed, float normal[3]);
+
+	// World position from a pixel of a width x height viewport (x right, y down, pixel centres
+	// at .5) and the depth target's z / w, through the inverse of the row-vector
+	// view * projection, as DeferredLightingPS.hlsl does it. False if the matrix is singular.
+	bool InvertMatrix(const float matrix[4][4], float inverse[4][4]);
+	void ReconstructPosition(const float inverseViewProjection[4][4], float x, float y, float depth, unsigned int width, unsigned int height, float position[3]);
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct GBufferPackingReport
+	{
+		uint32_t normals;				// directions checked
+		double maxNormalDegrees;		// angle between a normal and its packed and unpacked copy
+		double meanNormalDegrees;
+		uint32_t positions;				// torus vertices in view checked
+		double maxPositionError;		// world units, against the vertex
+		double maxRelativePositionError;	// over the distance from the eye
+		unsigned int bytesPerPixel;		// the G-buffer's three targets together
+	};
+
+	// Random directions plus the axes and the torus's own normals through the 16-bit
+	// octahedral packing, and the torus's vertices at the renderer's camera projected to a
+	// 1920x1080 viewport, stored as float depth and reconstructed.
+	GBufferPackingReport ValidateGBufferPacking(uint32_t randomNormals = 100000);
+#endif
+}
@@ -0,0 +1,200 @@
+#include "InstanceAnimation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include "../Helpers/ParallelFor.h"
+#include "../Helpers/SimdFloat4.h"
+
+using namespace DirectXGame1;
+using namespace DX;
+
+static_assert(sizeof(InstanceData) == 64, "InstanceData must match the instanced input layout");
+
+namespace
+{
+	// Instances per ParallelFor item; a multiple of four.
+	const uint32_t InstanceBatch = 1024;
+	const float MaxTilt = 0.5f;
+
+	// Instances [first, first + count) of set into out[0, count), count a multiple of four.
+	// Rows of four instances are computed a field at a time and transposed into each
+	// instance's rows.
+	void UpdateRange(const InstanceSet& set, float time, uint32_t first, uint32_t count, InstanceData* out)
+	{
+		const SimdFloat4 t = SimdSplat(time);
+		const SimdFloat4 zero = SimdZero();
+		for (uint32_t i = first; i < first + count; i += 4)
+		{
+			SimdFloat4 angle = SimdMulAdd(SimdLoad(&set.spin[i]), t, SimdLoad(&set.phase[i]));
+			SimdFloat4 s = SimdSin(angle);
+			SimdFloat4 c = SimdCos(angle);
+			SimdFloat4 k = SimdLoad(&set.scale[i]);
+			SimdFloat4 ks = SimdMul(k, s);
+			SimdFloat4 kc = SimdMul(k, c);
+			SimdFloat4 tiltSin = SimdLoad(&set.tiltSin[i]);
+			SimdFloat4 tiltCos = SimdLoad(&set.tiltCos[i]);
+
+			// rotateX(tilt) * rotateY(a) * scale, then the translation in w.
+			SimdFloat4 row0[4] = { kc, zero, ks, SimdLoad(&set.positionX[i]) };
+			SimdFloat4 row1[4] = { SimdMul(tiltSin, ks), SimdMul(tiltCos, k), SimdSub(zero, SimdMul(tiltSin, kc)),
+				SimdMulAdd(SimdLoad(&set.bob[i]), s, SimdLoad(&set.positionY[i])) };
+			SimdFloat4 row2[4] = { SimdSub(zero, SimdMul(tiltCos, ks)), SimdMul(tiltSin, k), SimdMul(tiltCos, kc), SimdLoad(&set.positionZ[i]) };
+			// Glow peaks once a turn.
+			SimdFloat4 color[4] = { SimdLoad(&set.colorR[i]), SimdLoad(&set.colorG[i]), SimdLoad(&set.colorB[i]),
+				SimdMulAdd(c, SimdSplat(0.5f), SimdSplat(0.5f)) };
+
+			SimdFloat4* rows[4] = { row0, row1, row2, color };
+			for (int r = 0; r < 4; r++)
+			{
+				SimdFloat4* v = rows[r];
+				SimdTranspose4(v[0], v[1], v[2], v[3]);
+				for (int j = 0; j < 4; j++)
+				{
+					SimdStore(&out[i - first + j].world[0][0] + r * 4, v[j]);
+				}
+			}
+		}
+	}
+}
+
+InstanceFieldDesc::InstanceFieldDesc() :
+	minScale(0.04f),
+	maxScale(0.08f),
+	maxSpin(2.0f),
+	maxBob(0.1f),
+	seed(1)
+{
+	// A slab of space behind the torus, as seen from the renderer's camera.
+	center[0] = 0.0f; center[1] = 0.0f; center[2] = -8.0f;
+	halfExtent[0] = 8.0f; halfExtent[1] = 4.5f; halfExtent[2] = 6.0f;
+}
+
+InstanceSet DirectXGame1::CreateInstanceSet(uint32_t count, const InstanceFieldDesc& desc)
+{
+	InstanceSet set;
+	set.count = count;
+	uint32_t padded = (count + 3) & ~3u;
+	std::vector<float>* fields[] = { &set.positionX, &set.positionY, &set.positionZ, &set.scale, &set.spin, &set.phase,
+		&set.bob, &set.tiltSin, &set.tiltCos, &set.colorR, &set.colorG, &set.colorB };
+	for (std::vector<float>* field : fields)
+	{
+		field->assign(padded, 0.0f);
+	}
+
+	std::mt19937 random(desc.seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::uniform_real_distribution<float> signedUnit(-1.0f, 1.0f);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		set.positionX[i] = desc.center[0] + desc.halfExtent[0] * signedUnit(random);
+		set.positionY[i] = desc.center[1] + desc.halfExtent[1] * signedUnit(random);
+		set.positionZ[i] = desc.center[2] + desc.halfExtent[2] * signedUnit(random);
+		set.scale[i] = desc.minScale + (desc.maxScale - desc.minScale) * unit(random);
+		set.spin[i] = desc.maxSpin * signedUnit(random);
+		set.phase[i] = 6.2831853f * unit(random);
+		set.bob[i] = desc.maxBob * unit(random);
+		float tilt = MaxTilt * signedUnit(random);
+		set.tiltSin[i] = std::sin(tilt);
+		set.tiltCos[i] = std::cos(tilt);
+		set.colorR[i] = 0.5f + 0.5f * unit(random);
+		set.colorG[i] = 0.5f + 0.5f * unit(random);
+		set.colorB[i] = 0.5f + 0.5f * unit(random);
+	}
+	return set;
+}
+
+void DirectXGame1::UpdateInstances(const InstanceSet& set, float time, InstanceData* out, unsigned int maxWorkers)
+{
+	uint32_t whole = set.count & ~3u;
+	unsigned int batches = (whole + InstanceBatch - 1) / InstanceBatch;
+	ParallelFor(batches, [&](unsigned int batch)
+	{
+		uint32_t first = batch * InstanceBatch;
+		UpdateRange(set, time, first, std::min(InstanceBatch, whole - first), out + first);
+	}, maxWorkers);
+
+	// The last one to three instances go through a scratch block of four.
+	if (whole < set.count)
+	{
+		InstanceData tail[4];
+		UpdateRange(set, time, whole, 4, tail);
+		std::copy(tail, tail + (set.count - whole), out + whole);
+	}
+}
+
+void DirectXGame1::UpdateInstancesReference(const InstanceSet& set, float time, InstanceData* out)
+{
+	for (uint32_t i = 0; i < set.count; i++)
+	{
+		float angle = set.phase[i] + set.spin[i] * time;
+		float s = std::sin(angle), c = std::cos(angle), k = set.scale[i];
+		float ts = set.tiltSin[i], tc = set.tiltCos[i];
+		const float world[3][4] = {
+			{ k * c, 0.0f, k * s, set.positionX[i] },
+			{ ts * k * s, tc * k, -ts * k * c, set.positionY[i] + set.bob[i] * s },
+			{ -tc * k * s, ts * k, tc * k * c, set.positionZ[i] } };
+		std::copy(&world[0][0], &world[0][0] + 12, &out[i].world[0][0]);
+		out[i].color[0] = set.colorR[i];
+		out[i].color[1] = set.colorG[i];
+		out[i].color[2] = set.colorB[i];
+		out[i].color[3] = 0.5f + 0.5f * c;
+	}
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+InstanceUpdateBenchmark DirectXGame1::BenchmarkInstanceUpdate(uint32_t instances, unsigned int frames)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	InstanceUpdateBenchmark result;
+	result.instances = instances;
+	result.frames = frames;
+	result.workers = GetWorkerCount();
+
+	InstanceSet set = CreateInstanceSet(instances);
+	std::vector<InstanceData> reference(instances), simd(instances);
+
+	auto rate = [&](const Clock::time_point& start)
+	{
+		double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		return (double)instances * frames / std::max(milliseconds, 1e-6);
+	};
+
+	// A minute in, so the angles are well past the first turn.
+	const float StartTime = 60.0f, FrameTime = 1.0f / 60.0f;
+	auto start = Clock::now();
+	for (unsigned int f = 0; f < frames; f++)
+	{
+		UpdateInstancesReference(set, StartTime + f * FrameTime, &reference[0]);
+	}
+	result.referenceInstancesPerMillisecond = rate(start);
+
+	start = Clock::now();
+	for (unsigned int f = 0; f < frames; f++)
+	{
+		UpdateInstances(set, StartTime + f * FrameTime, &simd[0], 1);
+	}
+	result.simdInstancesPerMillisecond = rate(start);
+
+	start = Clock::now();
+	for (unsigned int f = 0; f < frames; f++)
+	{
+		UpdateInstances(set, StartTime + f * FrameTime, &simd[0]);
+	}
+	result.parallelInstancesPerMillisecond = rate(start);
+
+	result.maxError = 0.0f;
+	for (uint32_t i = 0; i < instances; i++)
+	{
+		const float* a = &reference[i].world[0][0];
+		const float* b = &simd[i].world[0][0];
+		for (int j = 0; j < 16; j++)
+		{
+			result.maxError = std::max(result.maxError, std::fabs(a[j] - b[j]));
+		}
+	}
+	return result;
+}
+#endif
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace DirectXGame1
+{
+	// What InstancedVertexShader.hlsl reads per instance, 64 bytes. world holds the first three
+	// rows of the object-to-world matrix (world position = world[r] . (pos, 1)), with a
+	// uniform scale so the same rows carry the normals; color is a tint and its w a 0-1 glow.
+	struct InstanceData
+	{
+		float world[3][4];
+		float color[4];
+	};
+
+	// Where the instances are scattered and how they move.
+	struct InstanceFieldDesc
+	{
+		InstanceFieldDesc();
+
+		float center[3];
+		float halfExtent[3];
+		float minScale, maxScale;
+		float maxSpin;			// radians per second, either way
+		float maxBob;			// height of the up and down motion, in world units
+		uint32_t seed;
+	};
+
+	// Per-instance parameters, one array per field so four instances load as one SimdFloat4.
+	// Every array is padded to a multiple of four with zero-scale instances.
+	struct InstanceSet
+	{
+		uint32_t count;
+		std::vector<float> positionX, positionY, positionZ;
+		std::vector<float> scale;
+		std::vector<float> spin, phase;
+		std::vector<float> bob;
+		std::vector<float> tiltSin, tiltCos;	// fixed lean towards the camera
+		std::vector<float> colorR, colorG, colorB;
+	};
+
+	InstanceSet CreateInstanceSet(uint32_t count, const InstanceFieldDesc& desc = InstanceFieldDesc());
+
+	// Each instance spins about its own up axis at its own rate and bobs with the spin:
+	// world = translate(position + (0, bob sin a, 0)) * rotateX(tilt) * rotateY(a) * scale, with
+	// a = phase + spin * time. Four instances per step, a thousand per ParallelFor item.
+	// out holds set.count entries.
+	void UpdateInstances(const InstanceSet& set, float time, InstanceData* out, unsigned int maxWorkers = 0);
+
+	// The same one instance at a time with the C library's sin and cos.
+	void UpdateInstancesReference(const InstanceSet& set, float time, InstanceData* out);
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct InstanceUpdateBenchmark
+	{
+		uint32_t instances;
+		unsigned int frames;
+		unsigned int workers;
+		double referenceInstancesPerMillisecond;
+		double simdInstancesPerMillisecond;		// UpdateInstances on one thread
+		double parallelInstancesPerMillisecond;	// UpdateInstances on every worker
+		float maxError;							// largest difference from the reference
+	};
+
+	// Animates instances for frames frames each way, on the CPU alone.
+	InstanceUpdateBenchmark BenchmarkInstanceUpdate(uint32_t instances = 100000, unsigned int frames = 20);
+#endif
+}
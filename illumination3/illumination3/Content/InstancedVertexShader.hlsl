@@ -0,0 +1,53 @@
+// Same as SampleVertexShader.hlsl, drawn once per instance with the instance's transform and
+// tint from the second vertex buffer (see InstanceData in InstanceAnimation.h). The model
+// matrix is not used: each instance's rows already take the object to world space.
+
+cbuffer PerViewConstantBuffer : register(b1)
+{
+	matrix view;
+	matrix projection;
+	float4 eyepos;
+};
+
+struct VertexShaderInput
+{
+	float3 pos : POSITION;
+	float3 color : COLOR0;
+	float3 normal : NORMAL0;
+	float2 tex : TEXCOORD0;
+	// per instance
+	float4 world0 : WORLD0;
+	float4 world1 : WORLD1;
+	float4 world2 : WORLD2;
+	float4 tint : COLOR1;		// w: glow, 0-1
+};
+
+struct PixelShaderInput
+{
+	float4 pos : SV_POSITION;
+	float3 color : COLOR0;
+	float3 normal : NORMAL0;
+	float4 surfpos : POSITION0;
+	float2 tex : TEXCOORD0;
+};
+
+PixelShaderInput main(VertexShaderInput input)
+{
+	PixelShaderInput output;
+	float4 pos = float4(input.pos, 1.0f);
+	float4 norm = float4(input.normal, 0.0f);
+
+	pos = float4(dot(input.world0, pos), dot(input.world1, pos), dot(input.world2, pos), 1.0f);
+	output.surfpos = pos;
+
+	pos = mul(pos, view);
+	pos = mul(pos, projection);
+	output.pos = pos;
+
+	// The scale is uniform, so the rows carry the normal too; the pixel shader normalizes it.
+	output.normal = float3(dot(input.world0, norm), dot(input.world1, norm), dot(input.world2, norm));
+	output.color = input.color * input.tint.rgb * (0.75f + 0.5f * input.tint.w);
+	output.tex = input.tex;
+
+	return output;
+}
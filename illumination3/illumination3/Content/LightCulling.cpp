@@ -0,0 +1,505 @@
+#include "LightCulling.h"
+#include "RasterizerCpu.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include "../Helpers/ParallelFor.h"
+#include "../Helpers/SimdFloat4.h"
+
+using namespace DirectXGame1;
+using namespace DX;
+
+static_assert(sizeof(PointLightData) == 32, "PointLightData must match ClusteredLightsPS.hlsl");
+
+namespace
+{
+	// Lights per ParallelFor item when finding their tile rectangles; a multiple of four.
+	const uint32_t LightBlock = 256;
+
+	struct Plane
+	{
+		float nx, ny, nz, d;
+	};
+
+	// clip[column] - a * clip.w >= 0, scaled to a unit normal, times sign.
+	Plane MakePlane(const float m[4][4], int column, float a, float sign)
+	{
+		float p[4];
+		for (int r = 0; r < 4; r++)
+		{
+			p[r] = sign * (m[r][column] - a * m[r][3]);
+		}
+		float length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+		float scale = length > 0.0f ? 1.0f / length : 0.0f;
+		Plane plane = { p[0] * scale, p[1] * scale, p[2] * scale, p[3] * scale };
+		return plane;
+	}
+
+	// What BinLights and BinLightsReference share: the planes on every tile edge, each facing
+	// right or down the screen, and clip w as a plane, which is the depth the slices split.
+	struct GridPlanes
+	{
+		std::vector<Plane> columns;		// tilesX + 1, at pixel x = b * tileSize and the last at width
+		std::vector<Plane> rows;		// tilesY + 1, likewise down the screen
+		Plane depth;					// unnormalized: w = depth . (p, 1)
+		float depthReach;				// how far w changes over a unit distance
+		float farZ;
+	};
+
+	GridPlanes SetUpGrid(const float m[4][4], unsigned int width, unsigned int height, const LightGridDesc& desc, LightGrid& grid)
+	{
+		if (width == 0 || height == 0 || desc.tileSize == 0 || desc.depthSlices == 0 || !(desc.nearZ > 0.0f) || !(desc.farZ > desc.nearZ))
+		{
+			throw std::invalid_argument("BinLights needs a viewport, a tile size, slices and 0 < nearZ < farZ");
+		}
+		grid.width = width;
+		grid.height = height;
+		grid.tileSize = desc.tileSize;
+		grid.tilesX = (width + desc.tileSize - 1) / desc.tileSize;
+		grid.tilesY = (height + desc.tileSize - 1) / desc.tileSize;
+		grid.slices = desc.depthSlices;
+		grid.nearZ = desc.nearZ;
+		grid.sliceScale = desc.depthSlices / std::log(desc.farZ / desc.nearZ);
+
+		GridPlanes planes;
+		for (unsigned int b = 0; b <= grid.tilesX; b++)
+		{
+			unsigned int x = std::min(b * desc.tileSize, width);
+			planes.columns.push_back(MakePlane(m, 0, 2.0f * x / width - 1.0f, 1.0f));
+		}
+		for (unsigned int b = 0; b <= grid.tilesY; b++)
+		{
+			unsigned int y = std::min(b * desc.tileSize, height);
+			planes.rows.push_back(MakePlane(m, 1, 1.0f - 2.0f * y / height, -1.0f));
+		}
+		Plane depth = { m[0][3], m[1][3], m[2][3], m[3][3] };
+		planes.depth = depth;
+		planes.depthReach = std::sqrt(depth.nx * depth.nx + depth.ny * depth.ny + depth.nz * depth.nz);
+		planes.farZ = desc.farZ;
+		return planes;
+	}
+
+	unsigned int SliceOf(const LightGrid& grid, float depth)
+	{
+		float slice = std::floor(std::log(depth / grid.nearZ) * grid.sliceScale);
+		return slice < 0.0f ? 0 : (slice >= (float)grid.slices ? grid.slices - 1 : (unsigned int)slice);
+	}
+
+	// The tiles and slices one light may reach; first > last when it reaches none.
+	struct LightRange
+	{
+		int firstX, lastX, firstY, lastY, firstSlice, lastSlice;
+	};
+
+	// Slices for a sphere whose clip w spans [w - reach, w + reach], with a little slack each
+	// way for the shader's own log. False when it lies wholly outside the slices.
+	bool SliceRange(const LightGrid& grid, const GridPlanes& planes, float w, float reach, LightRange& range)
+	{
+		float nearest = w - reach, furthest = w + reach;
+		if (furthest < grid.nearZ || nearest > planes.farZ)
+		{
+			return false;
+		}
+		range.firstSlice = (int)SliceOf(grid, std::max(nearest, grid.nearZ) * 0.999f);
+		range.lastSlice = (int)SliceOf(grid, std::min(furthest, planes.farZ) * 1.001f);
+		return true;
+	}
+
+	// Signed distances of four points from a plane, in the same order of operations as the
+	// scalar one below so the two agree to the bit.
+	SimdFloat4 Distance(const Plane& p, SimdFloat4 x, SimdFloat4 y, SimdFloat4 z)
+	{
+		SimdFloat4 distance = SimdMulAdd(x, SimdSplat(p.nx), SimdSplat(p.d));
+		distance = SimdMulAdd(y, SimdSplat(p.ny), distance);
+		return SimdMulAdd(z, SimdSplat(p.nz), distance);
+	}
+
+	float Distance(const Plane& p, float x, float y, float z)
+	{
+		float distance = x * p.nx + p.d;
+		distance = y * p.ny + distance;
+		return z * p.nz + distance;
+	}
+
+	// For each band between neighbouring planes, which of four lights overlap it: the sphere
+	// is not wholly behind the first plane nor wholly past the second. The first and last
+	// such bands go into first and last per lane.
+	void BandRange(const std::vector<Plane>& planes, SimdFloat4 x, SimdFloat4 y, SimdFloat4 z, SimdFloat4 r, int first[4], int last[4])
+	{
+		const SimdFloat4 negativeR = SimdSub(SimdZero(), r);
+		SimdFloat4 before = Distance(planes[0], x, y, z);
+		for (size_t band = 0; band + 1 < planes.size(); band++)
+		{
+			SimdFloat4 after = Distance(planes[band + 1], x, y, z);
+			int mask = ~SimdMoveMask(SimdOr(SimdCmpLt(before, negativeR), SimdCmpGt(after, r))) & 15;
+			for (; mask != 0; mask &= mask - 1)
+			{
+				int lane = (mask & 1) ? 0 : (mask & 2) ? 1 : (mask & 4) ? 2 : 3;
+				first[lane] = std::min(first[lane], (int)band);
+				last[lane] = (int)band;
+			}
+			before = after;
+		}
+	}
+
+	// Lights [first, end) into ranges, end a multiple of four.
+	void FindRanges(const CullingBounds& lights, const GridPlanes& planes, const LightGrid& grid, uint32_t first, uint32_t end, LightRange* ranges)
+	{
+		for (uint32_t i = first; i < end; i += 4)
+		{
+			SimdFloat4 x = SimdLoad(&lights.centerX[i]);
+			SimdFloat4 y = SimdLoad(&lights.centerY[i]);
+			SimdFloat4 z = SimdLoad(&lights.centerZ[i]);
+			SimdFloat4 r = SimdLoad(&lights.radius[i]);
+
+			int firstX[4] = { INT32_MAX, INT32_MAX, INT32_MAX, INT32_MAX }, lastX[4] = { -1, -1, -1, -1 };
+			int firstY[4] = { INT32_MAX, INT32_MAX, INT32_MAX, INT32_MAX }, lastY[4] = { -1, -1, -1, -1 };
+			BandRange(planes.columns, x, y, z, r, firstX, lastX);
+			BandRange(planes.rows, x, y, z, r, firstY, lastY);
+
+			float w[4], reach[4];
+			SimdStore(w, Distance(planes.depth, x, y, z));
+			SimdStore(reach, SimdMul(r, SimdSplat(planes.depthReach)));
+			for (uint32_t lane = 0; lane < 4 && i + lane < lights.count; lane++)
+			{
+				LightRange& range = ranges[i + lane];
+				range.firstX = firstX[lane]; range.lastX = lastX[lane];
+				range.firstY = firstY[lane]; range.lastY = lastY[lane];
+				if (!SliceRange(grid, planes, w[lane], reach[lane], range))
+				{
+					range.firstX = 0;
+					range.lastX = -1;
+				}
+			}
+		}
+	}
+}
+
+PointLightFieldDesc::PointLightFieldDesc() :
+	minRadius(0.2f),
+	maxRadius(0.8f),
+	maxOrbit(1.0f),
+	maxSpeed(1.5f),
+	seed(3)
+{
+	// Round the torus and out through the instances behind it.
+	center[0] = 0.0f; center[1] = 0.0f; center[2] = -4.0f;
+	halfExtent[0] = 6.0f; halfExtent[1] = 3.0f; halfExtent[2] = 5.0f;
+}
+
+PointLightSet DirectXGame1::CreatePointLightSet(uint32_t count, const PointLightFieldDesc& desc)
+{
+	PointLightSet set;
+	set.count = count;
+	uint32_t padded = (count + 3) & ~3u;
+	std::vector<float>* fields[] = { &set.originX, &set.originY, &set.originZ, &set.orbit, &set.speed, &set.phase,
+		&set.radius, &set.colorR, &set.colorG, &set.colorB };
+	for (std::vector<float>* field : fields)
+	{
+		field->assign(padded, 0.0f);
+	}
+
+	std::mt19937 random(desc.seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::uniform_real_distribution<float> signedUnit(-1.0f, 1.0f);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		set.originX[i] = desc.center[0] + desc.halfExtent[0] * signedUnit(random);
+		set.originY[i] = desc.center[1] + desc.halfExtent[1] * signedUnit(random);
+		set.originZ[i] = desc.center[2] + desc.halfExtent[2] * signedUnit(random);
+		set.orbit[i] = desc.maxOrbit * unit(random);
+		set.speed[i] = desc.maxSpeed * signedUnit(random);
+		set.phase[i] = 6.28318531f * unit(random);
+		set.radius[i] = desc.minRadius + (desc.maxRadius - desc.minRadius) * unit(random);
+		// Saturated colours, so overlapping lights stay tellable apart.
+		set.colorR[i] = 0.2f + 0.8f * unit(random);
+		set.colorG[i] = 0.2f + 0.8f * unit(random);
+		set.colorB[i] = 0.2f + 0.8f * unit(random);
+	}
+	return set;
+}
+
+void DirectXGame1::UpdatePointLights(const PointLightSet& set, float time, CullingBounds& bounds, PointLightData* out)
+{
+	if (bounds.count != set.count)
+	{
+		bounds.Resize(set.count);
+	}
+
+	const SimdFloat4 t = SimdSplat(time);
+	uint32_t padded = (set.count + 3) & ~3u;
+	for (uint32_t i = 0; i < padded; i += 4)
+	{
+		SimdFloat4 angle = SimdMulAdd(SimdLoad(&set.speed[i]), t, SimdLoad(&set.phase[i]));
+		SimdFloat4 s = SimdSin(angle);
+		SimdFloat4 c = SimdCos(angle);
+		SimdFloat4 orbit = SimdLoad(&set.orbit[i]);
+		// 0.25 sin 2a = 0.5 sin a cos a: a figure-of-eight bob as the light goes round.
+		SimdFloat4 bob = SimdMul(SimdMul(s, c), SimdSplat(0.5f));
+		SimdStore(&bounds.centerX[i], SimdMulAdd(orbit, c, SimdLoad(&set.originX[i])));
+		SimdStore(&bounds.centerY[i], SimdMulAdd(orbit, bob, SimdLoad(&set.originY[i])));
+		SimdStore(&bounds.centerZ[i], SimdMulAdd(orbit, s, SimdLoad(&set.originZ[i])));
+		SimdFloat4 radius = SimdLoad(&set.radius[i]);
+		SimdStore(&bounds.radius[i], radius);
+		SimdStore(&bounds.extentX[i], radius);
+		SimdStore(&bounds.extentY[i], radius);
+		SimdStore(&bounds.extentZ[i], radius);
+	}
+
+	for (uint32_t i = 0; i < set.count; i++)
+	{
+		PointLightData& light = out[i];
+		light.position[0] = bounds.centerX[i];
+		light.position[1] = bounds.centerY[i];
+		light.position[2] = bounds.centerZ[i];
+		light.radius = bounds.radius[i];
+		light.color[0] = set.colorR[i];
+		light.color[1] = set.colorG[i];
+		light.color[2] = set.colorB[i];
+		light.padding = 0.0f;
+	}
+}
+
+LightGridDesc::LightGridDesc() :
+	tileSize(32),
+	depthSlices(16),
+	nearZ(0.1f),
+	farZ(100.0f)
+{
+}
+
+unsigned int LightGrid::FindCluster(float x, float y, float depth) const
+{
+	unsigned int tileX = std::min((unsigned int)std::max(x, 0.0f) / tileSize, tilesX - 1);
+	unsigned int tileY = std::min((unsigned int)std::max(y, 0.0f) / tileSize, tilesY - 1);
+	return (SliceOf(*this, depth) * tilesY + tileY) * tilesX + tileX;
+}
+
+void DirectXGame1::BinLights(const CullingBounds& lights, const float viewProjection[4][4], unsigned int width, unsigned int height, const LightGridDesc& desc, LightGrid& grid, unsigned int maxWorkers)
+{
+	GridPlanes planes = SetUpGrid(viewProjection, width, height, desc, grid);
+
+	std::vector<LightRange> ranges(lights.count);
+	uint32_t padded = (lights.count + 3) & ~3u;
+	unsigned int blocks = (padded + LightBlock - 1) / LightBlock;
+	ParallelFor(blocks, [&](unsigned int block)
+	{
+		uint32_t first = block * LightBlock;
+		FindRanges(lights, planes, grid, first, std::min(first + LightBlock, padded), ranges.empty() ? nullptr : &ranges[0]);
+	}, maxWorkers);
+
+	// Every row of tiles owns its clusters in every slice, so the rows count and then fill
+	// without touching each other's.
+	const unsigned int tilesX = grid.tilesX, tilesY = grid.tilesY;
+	grid.clusters.assign(grid.GetClusterCount() * 2, 0);
+	ParallelFor(tilesY, [&](unsigned int row)
+	{
+		for (const LightRange& range : ranges)
+		{
+			if (range.firstX > range.lastX || (int)row < range.firstY || (int)row > range.lastY)
+			{
+				continue;
+			}
+			for (int slice = range.firstSlice; slice <= range.lastSlice; slice++)
+			{
+				uint32_t* cluster = &grid.clusters[((slice * tilesY + row) * tilesX + range.firstX) * 2];
+				for (int x = range.firstX; x <= range.lastX; x++, cluster += 2)
+				{
+					cluster[1]++;
+				}
+			}
+		}
+	}, maxWorkers);
+
+	uint32_t entries = 0;
+	for (size_t c = 0; c < grid.clusters.size(); c += 2)
+	{
+		grid.clusters[c] = entries;
+		entries += grid.clusters[c + 1];
+	}
+	grid.indices.resize(entries);
+
+	ParallelFor(tilesY, [&](unsigned int row)
+	{
+		for (uint32_t light = 0; light < lights.count; light++)
+		{
+			const LightRange& range = ranges[light];
+			if (range.firstX > range.lastX || (int)row < range.firstY || (int)row > range.lastY)
+			{
+				continue;
+			}
+			for (int slice = range.firstSlice; slice <= range.lastSlice; slice++)
+			{
+				uint32_t* cluster = &grid.clusters[((slice * tilesY + row) * tilesX + range.firstX) * 2];
+				for (int x = range.firstX; x <= range.lastX; x++, cluster += 2)
+				{
+					// cluster[0] walks forward while filling, and is put back below
+					grid.indices[cluster[0]++] = light;
+				}
+			}
+		}
+	}, maxWorkers);
+
+	for (size_t c = 0; c < grid.clusters.size(); c += 2)
+	{
+		grid.clusters[c] -= grid.clusters[c + 1];
+	}
+}
+
+void DirectXGame1::BinLightsReference(const CullingBounds& lights, const float viewProjection[4][4], unsigned int width, unsigned int height, const LightGridDesc& desc, LightGrid& grid)
+{
+	GridPlanes planes = SetUpGrid(viewProjection, width, height, desc, grid);
+	grid.clusters.assign(grid.GetClusterCount() * 2, 0);
+	grid.indices.clear();
+
+	for (unsigned int slice = 0; slice < grid.slices; slice++)
+	{
+		for (unsigned int y = 0; y < grid.tilesY; y++)
+		{
+			for (unsigned int x = 0; x < grid.tilesX; x++)
+			{
+				uint32_t* cluster = &grid.clusters[((slice * grid.tilesY + y) * grid.tilesX + x) * 2];
+				cluster[0] = (uint32_t)grid.indices.size();
+				for (uint32_t i = 0; i < lights.count; i++)
+				{
+					float cx = lights.centerX[i], cy = lights.centerY[i], cz = lights.centerZ[i], r = lights.radius[i];
+					if (Distance(planes.columns[x], cx, cy, cz) < -r || Distance(planes.columns[x + 1], cx, cy, cz) > r ||
+						Distance(planes.rows[y], cx, cy, cz) < -r || Distance(planes.rows[y + 1], cx, cy, cz) > r)
+					{
+						continue;
+					}
+					LightRange range;
+					if (!SliceRange(grid, planes, Distance(planes.depth, cx, cy, cz), r * planes.depthReach, range) ||
+						(int)slice < range.firstSlice || (int)slice > range.lastSlice)
+					{
+						continue;
+					}
+					grid.indices.push_back(i);
+				}
+				cluster[1] = (uint32_t)grid.indices.size() - cluster[0];
+			}
+		}
+	}
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+namespace
+{
+	void MultiplyMatrices(const float a[4][4], const float b[4][4], float out[4][4])
+	{
+		for (int r = 0; r < 4; r++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				out[r][c] = a[r][0] * b[0][c] + a[r][1] * b[1][c] + a[r][2] * b[2][c] + a[r][3] * b[3][c];
+			}
+		}
+	}
+}
+
+LightBinningBenchmark DirectXGame1::BenchmarkLightBinning(uint32_t lights, unsigned int frames)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	LightBinningBenchmark result = {};
+	result.lights = lights;
+	result.width = 1920;
+	result.height = 1080;
+	result.workers = GetWorkerCount();
+
+	WorldPassCpuConstants constants = GetTorusFrameConstants(0.0f, 0, (float)result.width / result.height);
+	float viewProjection[4][4];
+	MultiplyMatrices(constants.view, constants.projection, viewProjection);
+
+	PointLightSet set = CreatePointLightSet(lights);
+	std::vector<PointLightData> data(lights);
+	std::vector<CullingBounds> bounds(frames);
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		UpdatePointLights(set, frame / 60.0f, bounds[frame], data.empty() ? nullptr : &data[0]);
+	}
+
+	LightGridDesc desc;
+	LightGrid grid, reference;
+	std::mt19937 random(11);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	PointLightFieldDesc field;
+	uint64_t touching = 0, listed = 0, samples = 0;
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		const CullingBounds& frameBounds = bounds[frame];
+		BinLights(frameBounds, viewProjection, result.width, result.height, desc, grid);
+		BinLightsReference(frameBounds, viewProjection, result.width, result.height, desc, reference);
+		if (grid.clusters != reference.clusters || grid.indices != reference.indices)
+		{
+			result.mismatches++;
+		}
+		result.entries = (uint32_t)grid.indices.size();
+
+		// Points through the light field that land in view.
+		for (unsigned int attempt = 0; attempt < 20000; attempt++)
+		{
+			float p[3];
+			for (int c = 0; c < 3; c++)
+			{
+				p[c] = field.center[c] + field.halfExtent[c] * (2.0f * unit(random) - 1.0f);
+			}
+			float clip[4];
+			for (int c = 0; c < 4; c++)
+			{
+				clip[c] = p[0] * viewProjection[0][c] + p[1] * viewProjection[1][c] + p[2] * viewProjection[2][c] + viewProjection[3][c];
+			}
+			if (clip[3] < desc.nearZ || clip[3] > desc.farZ || std::fabs(clip[0]) >= clip[3] || std::fabs(clip[1]) >= clip[3])
+			{
+				continue;
+			}
+			float x = (clip[0] / clip[3] + 1.0f) * 0.5f * result.width;
+			float y = (1.0f - clip[1] / clip[3]) * 0.5f * result.height;
+			const uint32_t* cluster = &grid.clusters[grid.FindCluster(x, y, clip[3]) * 2];
+			const uint32_t* list = grid.indices.empty() ? nullptr : &grid.indices[0] + cluster[0];
+			samples++;
+			listed += cluster[1];
+			for (uint32_t i = 0; i < lights; i++)
+			{
+				float dx = p[0] - frameBounds.centerX[i], dy = p[1] - frameBounds.centerY[i], dz = p[2] - frameBounds.centerZ[i];
+				if (dx * dx + dy * dy + dz * dz >= frameBounds.radius[i] * frameBounds.radius[i])
+				{
+					continue;
+				}
+				touching++;
+				if (!std::binary_search(list, list + cluster[1], i))
+				{
+					result.missedLights++;
+				}
+			}
+		}
+	}
+	result.clusters = grid.GetClusterCount();
+	result.meanTouchingLights = samples ? (double)touching / samples : 0.0;
+	result.meanClusterLights = samples ? (double)listed / samples : 0.0;
+
+	auto time = [&](unsigned int workers, bool useReference)
+	{
+		auto start = Clock::now();
+		for (unsigned int frame = 0; frame < frames; frame++)
+		{
+			if (useReference)
+			{
+				BinLightsReference(bounds[frame], viewProjection, result.width, result.height, desc, reference);
+			}
+			else
+			{
+				BinLights(bounds[frame], viewProjection, result.width, result.height, desc, grid, workers);
+			}
+		}
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / std::max(frames, 1u);
+	};
+	result.referenceMilliseconds = time(1, true);
+	result.simdMilliseconds = time(1, false);
+	result.parallelMilliseconds = time(0, false);
+	return result;
+}
+#endif
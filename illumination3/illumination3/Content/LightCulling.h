@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "FrustumCulling.h"
+
+namespace DirectXGame1
+{
+	// What ClusteredLightsPS.hlsl reads per light, 32 bytes. Light falls off to nothing at radius.
+	struct PointLightData
+	{
+		float position[3];
+		float radius;
+		float color[3];
+		float padding;
+	};
+
+	// Where the lights are scattered and how they move.
+	struct PointLightFieldDesc
+	{
+		PointLightFieldDesc();
+
+		float center[3];
+		float halfExtent[3];
+		float minRadius, maxRadius;
+		float maxOrbit;			// radius of the horizontal circle each light runs round, in world units
+		float maxSpeed;			// radians per second, either way
+		uint32_t seed;
+	};
+
+	// Per-light parameters, one array per field like InstanceSet.
+	struct PointLightSet
+	{
+		uint32_t count;
+		std::vector<float> originX, originY, originZ;
+		std::vector<float> orbit, speed, phase;
+		std::vector<float> radius;
+		std::vector<float> colorR, colorG, colorB;
+	};
+
+	PointLightSet CreatePointLightSet(uint32_t count, const PointLightFieldDesc& desc = PointLightFieldDesc());
+
+	// Each light circles its origin: position = origin + orbit (cos a, 0.25 sin 2a, sin a) with
+	// a = phase + speed * time. Writes the spheres the lights reach to bounds (resized to
+	// match; the boxes are the spheres' cubes) and the upload data to out, set.count entries.
+	void UpdatePointLights(const PointLightSet& set, float time, CullingBounds& bounds, PointLightData* out);
+
+	struct LightGridDesc
+	{
+		LightGridDesc();
+
+		unsigned int tileSize;		// pixels
+		unsigned int depthSlices;	// spaced evenly in log(depth) between nearZ and farZ
+		float nearZ, farZ;			// view depth (clip w) the slices cover; lights outside are dropped
+	};
+
+	// Lights binned into clusters: screen tiles of tileSize pixels, each cut into depth slices.
+	// Cluster (x, y, slice) is number (slice * tilesY + y) * tilesX + x and has an offset and a
+	// count into indices, which lists each cluster's lights in ascending order. The same layout
+	// goes to the GPU as two structured buffers.
+	struct LightGrid
+	{
+		LightGrid() : width(0), height(0), tileSize(0), tilesX(0), tilesY(0), slices(0), nearZ(0.0f), sliceScale(0.0f) {}
+
+		unsigned int width, height;
+		unsigned int tileSize, tilesX, tilesY, slices;
+		float nearZ;
+		float sliceScale;				// slice = floor(log(depth / nearZ) * sliceScale)
+		std::vector<uint32_t> clusters;	// offset, count per cluster
+		std::vector<uint32_t> indices;
+
+		unsigned int GetClusterCount() const { return tilesX * tilesY * slices; }
+		// The cluster a point at pixel (x, y) and view depth lands in, as the shader picks it.
+		unsigned int FindCluster(float x, float y, float depth) const;
+	};
+
+	// A light goes in a cluster when its sphere is not wholly behind any of the cluster's
+	// planes: the two tile column planes, the two tile row planes, both through the eye, and
+	// the slice's depth range. The planes come from a row-vector view * projection matrix as
+	// in ExtractFrustumPlanes, for a width x height viewport. Every column and row plane is
+	// tested against four lights at a time to give each light a rectangle of tiles, then rows
+	// of clusters are filled in parallel in light order. Throws std::invalid_argument for an
+	// empty viewport, a zero tile size or slice count, or a bad depth range.
+	void BinLights(const CullingBounds& lights, const float viewProjection[4][4], unsigned int width, unsigned int height, const LightGridDesc& desc, LightGrid& grid, unsigned int maxWorkers = 0);
+
+	// Every light against every cluster, one plane at a time.
+	void BinLightsReference(const CullingBounds& lights, const float viewProjection[4][4], unsigned int width, unsigned int height, const LightGridDesc& desc, LightGrid& grid);
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct LightBinningBenchmark
+	{
+		uint32_t lights;
+		unsigned int width;
+		unsigned int height;
+		unsigned int clusters;
+		uint32_t entries;					// light indices over all clusters
+		unsigned int workers;
+		double referenceMilliseconds;		// per frame
+		double simdMilliseconds;			// on one thread
+		double parallelMilliseconds;		// on every worker
+		uint32_t mismatches;				// frames whose grid differs from the reference
+		uint32_t missedLights;				// lights reaching a sample point but not in its cluster
+		double meanTouchingLights;			// lights that reach a sample point, on average
+		double meanClusterLights;			// lights its cluster lists, which is what it shades
+	};
+
+	// lights moving round the torus, binned for the renderer's camera at 1920x1080 with the
+	// default grid over frames frames. The sample points are random points in view; shading
+	// cost follows meanClusterLights, which stays near meanTouchingLights as lights are added.
+	LightBinningBenchmark BenchmarkLightBinning(uint32_t lights = 1024, unsigned int frames = 20);
+#endif
+}
@@ -0,0 +1,348 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "MeshOptimizer.h"
+
+using namespace DirectXGame1;
+
+namespace
+{
+	const uint32_t MeshCacheMagic = 0x4348534D;	// "MSHC"
+	const uint64_t SectionAlignment = 16;
+
+	// The file: a header, one record per LOD, then each LOD's vertices, indices and chunks,
+	// every section on a 16-byte boundary. Little-endian, as every target is.
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t hash;
+		uint64_t fileSize;
+		uint32_t lodCount;
+		uint32_t reserved;
+		float boundsMin[3];
+		float boundsMax[3];
+		uint32_t padding[2];
+	};
+
+	struct LodRecord
+	{
+		uint32_t vertexCount;
+		uint32_t vertexStride;
+		uint32_t indexCount;
+		uint32_t indexSize;		// 2 or 4
+		uint32_t chunkCount;
+		float errorBound;
+		CompactVertexBounds compactBounds;
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+		uint64_t chunkOffset;
+	};
+
+	static_assert(sizeof(FileHeader) == 64, "the mesh cache header is part of the file format");
+	static_assert(sizeof(LodRecord) == 96, "the mesh cache LOD record is part of the file format");
+	static_assert(sizeof(MeshChunk) == 16, "mesh chunks are stored as they are");
+
+	uint64_t Align(uint64_t offset)
+	{
+		return (offset + SectionAlignment - 1) & ~(SectionAlignment - 1);
+	}
+
+	class Fnv1a
+	{
+	public:
+		Fnv1a() : m_hash(14695981039346656037ull) {}
+
+		template <typename T>
+		void Add(const T& value)
+		{
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+			for (size_t i = 0; i < sizeof(T); i++)
+			{
+				m_hash = (m_hash ^ bytes[i]) * 1099511628211ull;
+			}
+		}
+
+		uint64_t Get() const { return m_hash; }
+
+	private:
+		uint64_t m_hash;
+	};
+
+	// Whether [offset, offset + size) lies inside a file of fileSize bytes, without overflow.
+	bool Fits(uint64_t offset, uint64_t size, uint64_t fileSize)
+	{
+		return offset <= fileSize && size <= fileSize - offset;
+	}
+}
+
+uint64_t DirectXGame1::HashMeshBakeSettings(const MeshBakeSettings& settings)
+{
+	// Field by field, so padding never reaches the hash.
+	Fnv1a hash;
+	hash.Add(MeshCacheVersion);
+	hash.Add((uint32_t)settings.shape.shape);
+	hash.Add(settings.shape.rows);
+	hash.Add(settings.shape.columns);
+	hash.Add(settings.shape.radius);
+	hash.Add(settings.shape.tubeRadius);
+	hash.Add(settings.shape.height);
+	hash.Add(settings.shape.rowExponent);
+	hash.Add(settings.shape.columnExponent);
+	hash.Add(settings.lods.levels);
+	hash.Add(settings.lods.reduction);
+	hash.Add((uint32_t)settings.policy);
+	hash.Add((uint32_t)settings.compact);
+	return hash.Get();
+}
+
+void DirectXGame1::BakeMesh(const MeshBakeSettings& settings, BakedMesh& out)
+{
+	std::vector<MeshVertex> vertices(MeshVertexCount(settings.shape));
+	std::vector<uint32_t> indices(MeshIndexCount(settings.shape));
+	GenerateMesh(settings.shape, &vertices[0], &indices[0]);
+	MeshLodChain chain = BuildMeshLods(&vertices[0], (uint32_t)vertices.size(), &indices[0], (uint32_t)indices.size(), settings.lods);
+
+	for (int c = 0; c < 3; c++)
+	{
+		out.boundsMin[c] = out.boundsMax[c] = vertices[0].pos[c];
+	}
+	for (const MeshVertex& vertex : vertices)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			out.boundsMin[c] = std::min(out.boundsMin[c], vertex.pos[c]);
+			out.boundsMax[c] = std::max(out.boundsMax[c], vertex.pos[c]);
+		}
+	}
+
+	// Every level indexes the full vertex array; each gets its own copy so the fetch reorder
+	// can drop what it does not use.
+	size_t levels = chain.lods.size();
+	out.meshes.assign(levels, IndexedMesh());
+	out.compactVertices.assign(levels, std::vector<CompactVertex>());
+	out.lods.resize(levels);
+	for (size_t l = 0; l < levels; l++)
+	{
+		const MeshLod& level = chain.lods[l];
+		std::vector<MeshVertex> lodVertices(vertices);
+		std::vector<uint32_t> lodIndices(chain.indices.begin() + level.firstIndex, chain.indices.begin() + level.firstIndex + level.indexCount);
+		MeshData lodMesh = { &lodVertices[0], (uint32_t)lodVertices.size(), &lodIndices[0], level.indexCount };
+		OptimizeMesh(lodMesh);
+		IndexedMesh& mesh = out.meshes[l];
+		mesh = BuildIndexedMesh(lodMesh, settings.policy);
+
+		MeshLodView& view = out.lods[l];
+		view.vertexCount = (uint32_t)mesh.vertices.size();
+		view.indices = mesh.GetIndexData();
+		view.indexCount = mesh.GetIndexCount();
+		view.indexFormat = mesh.format;
+		view.chunks = &mesh.chunks[0];
+		view.chunkCount = (uint32_t)mesh.chunks.size();
+		view.errorBound = level.errorBound;
+
+		// Compact vertices carry their ranges in the per-object constants; full ones need none.
+		CompactVertexBounds& bounds = view.compactBounds;
+		if (settings.compact)
+		{
+			bounds = ComputeCompactVertexBounds(&mesh.vertices[0], view.vertexCount);
+			std::vector<CompactVertex>& compact = out.compactVertices[l];
+			compact.resize(view.vertexCount);
+			EncodeCompactVertices(&mesh.vertices[0], view.vertexCount, bounds, &compact[0]);
+			view.vertices = &compact[0];
+			view.vertexStride = sizeof(CompactVertex);
+		}
+		else
+		{
+			bounds = CompactVertexBounds();
+			std::fill(bounds.positionScale, bounds.positionScale + 3, 1.0f);
+			std::fill(bounds.colorScale, bounds.colorScale + 3, 1.0f);
+			view.vertices = &mesh.vertices[0];
+			view.vertexStride = sizeof(MeshVertex);
+		}
+	}
+}
+
+bool DirectXGame1::WriteMeshCache(const std::wstring& path, uint64_t hash, const std::vector<MeshLodView>& lods, const float boundsMin[3], const float boundsMax[3])
+{
+	FileHeader header = {};
+	header.magic = MeshCacheMagic;
+	header.version = MeshCacheVersion;
+	header.hash = hash;
+	header.lodCount = (uint32_t)lods.size();
+	std::copy(boundsMin, boundsMin + 3, header.boundsMin);
+	std::copy(boundsMax, boundsMax + 3, header.boundsMax);
+
+	// Lay the sections out first, then fill one buffer and write it in one go.
+	std::vector<LodRecord> records(lods.size());
+	uint64_t offset = Align(sizeof(FileHeader) + records.size() * sizeof(LodRecord));
+	for (size_t l = 0; l < lods.size(); l++)
+	{
+		const MeshLodView& lod = lods[l];
+		LodRecord& record = records[l];
+		memset(&record, 0, sizeof(record));
+		record.vertexCount = lod.vertexCount;
+		record.vertexStride = lod.vertexStride;
+		record.indexCount = lod.indexCount;
+		record.indexSize = lod.indexFormat == IndexFormat::UInt16 ? 2 : 4;
+		record.chunkCount = lod.chunkCount;
+		record.errorBound = lod.errorBound;
+		record.compactBounds = lod.compactBounds;
+		record.vertexOffset = offset;
+		offset = Align(offset + (uint64_t)lod.vertexCount * lod.vertexStride);
+		record.indexOffset = offset;
+		offset = Align(offset + (uint64_t)lod.indexCount * record.indexSize);
+		record.chunkOffset = offset;
+		offset = Align(offset + (uint64_t)lod.chunkCount * sizeof(MeshChunk));
+	}
+	header.fileSize = offset;
+
+	std::vector<unsigned char> file((size_t)offset, 0);
+	memcpy(&file[0], &header, sizeof(header));
+	if (!records.empty())
+	{
+		memcpy(&file[sizeof(header)], &records[0], records.size() * sizeof(LodRecord));
+	}
+	for (size_t l = 0; l < lods.size(); l++)
+	{
+		const MeshLodView& lod = lods[l];
+		const LodRecord& record = records[l];
+		memcpy(&file[(size_t)record.vertexOffset], lod.vertices, (size_t)lod.vertexCount * lod.vertexStride);
+		memcpy(&file[(size_t)record.indexOffset], lod.indices, (size_t)lod.indexCount * record.indexSize);
+		memcpy(&file[(size_t)record.chunkOffset], lod.chunks, lod.chunkCount * sizeof(MeshChunk));
+	}
+	return DX::WriteFileAtomically(path, &file[0], file.size());
+}
+
+bool MeshCacheFile::Open(const std::wstring& path, uint64_t hash)
+{
+	Close();
+	if (!m_file.Open(path))
+	{
+		return false;
+	}
+
+	const unsigned char* data = static_cast<const unsigned char*>(m_file.GetData());
+	uint64_t size = m_file.GetSize();
+	const FileHeader* header = reinterpret_cast<const FileHeader*>(data);
+	if (size < sizeof(FileHeader) || header->magic != MeshCacheMagic || header->version != MeshCacheVersion ||
+		header->hash != hash || header->fileSize != size || header->lodCount == 0 ||
+		!Fits(sizeof(FileHeader), (uint64_t)header->lodCount * sizeof(LodRecord), size))
+	{
+		Close();
+		return false;
+	}
+
+	const LodRecord* records = reinterpret_cast<const LodRecord*>(data + sizeof(FileHeader));
+	m_lods.resize(header->lodCount);
+	for (uint32_t l = 0; l < header->lodCount; l++)
+	{
+		const LodRecord& record = records[l];
+		if ((record.indexSize != 2 && record.indexSize != 4) || record.chunkCount == 0 ||
+			!Fits(record.vertexOffset, (uint64_t)record.vertexCount * record.vertexStride, size) ||
+			!Fits(record.indexOffset, (uint64_t)record.indexCount * record.indexSize, size) ||
+			!Fits(record.chunkOffset, (uint64_t)record.chunkCount * sizeof(MeshChunk), size) ||
+			record.chunkOffset % SectionAlignment != 0)
+		{
+			Close();
+			return false;
+		}
+
+		MeshLodView& view = m_lods[l];
+		view.vertices = data + record.vertexOffset;
+		view.vertexCount = record.vertexCount;
+		view.vertexStride = record.vertexStride;
+		view.indices = data + record.indexOffset;
+		view.indexCount = record.indexCount;
+		view.indexFormat = record.indexSize == 2 ? IndexFormat::UInt16 : IndexFormat::UInt32;
+		view.chunks = reinterpret_cast<const MeshChunk*>(data + record.chunkOffset);
+		view.chunkCount = record.chunkCount;
+		view.errorBound = record.errorBound;
+		view.compactBounds = record.compactBounds;
+	}
+	std::copy(header->boundsMin, header->boundsMin + 3, m_boundsMin);
+	std::copy(header->boundsMax, header->boundsMax + 3, m_boundsMax);
+	return true;
+}
+
+void MeshCacheFile::Close()
+{
+	m_lods.clear();
+	m_file.Close();
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+MeshCacheReport DirectXGame1::ValidateMeshCache(const std::wstring& path)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	auto milliseconds = [](const Clock::time_point& start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	};
+
+	MeshCacheReport report;
+	MeshBakeSettings settings;
+	settings.shape = MeshShapeDesc::Torus(90, 30, 0.6f, 0.2f);
+	uint64_t hash = HashMeshBakeSettings(settings);
+
+	auto start = Clock::now();
+	BakedMesh baked;
+	BakeMesh(settings, baked);
+	report.bakeMilliseconds = milliseconds(start);
+
+	start = Clock::now();
+	bool written = WriteMeshCache(path, hash, baked.lods, baked.boundsMin, baked.boundsMax);
+	report.writeMilliseconds = milliseconds(start);
+
+	MeshCacheFile cache;
+	start = Clock::now();
+	bool opened = written && cache.Open(path, hash);
+	report.openMilliseconds = milliseconds(start);
+
+	// Reading every byte stands in for the copy CreateBuffer makes out of the mapping.
+	start = Clock::now();
+	report.roundTrip = opened && cache.GetLods().size() == baked.lods.size();
+	report.fileBytes = 0;
+	for (size_t l = 0; report.roundTrip && l < baked.lods.size(); l++)
+	{
+		const MeshLodView& a = baked.lods[l];
+		const MeshLodView& b = cache.GetLods()[l];
+		size_t indexSize = a.indexFormat == IndexFormat::UInt16 ? 2 : 4;
+		report.roundTrip = a.vertexCount == b.vertexCount && a.vertexStride == b.vertexStride && a.indexCount == b.indexCount &&
+			a.indexFormat == b.indexFormat && a.chunkCount == b.chunkCount && a.errorBound == b.errorBound &&
+			memcmp(&a.compactBounds, &b.compactBounds, sizeof(CompactVertexBounds)) == 0 &&
+			memcmp(a.vertices, b.vertices, (size_t)a.vertexCount * a.vertexStride) == 0 &&
+			memcmp(a.indices, b.indices, a.indexCount * indexSize) == 0 &&
+			memcmp(a.chunks, b.chunks, a.chunkCount * sizeof(MeshChunk)) == 0;
+		report.fileBytes += (uint64_t)a.vertexCount * a.vertexStride + a.indexCount * indexSize;
+	}
+	report.touchMilliseconds = report.openMilliseconds + milliseconds(start);
+	cache.Close();
+
+	report.rejectsHash = written && !cache.Open(path, hash + 1);
+
+	// Damaged copies of the file: an older version, then one cut short.
+	DX::MappedFile original;
+	std::vector<unsigned char> bytes;
+	if (original.Open(path))
+	{
+		const unsigned char* data = static_cast<const unsigned char*>(original.GetData());
+		bytes.assign(data, data + original.GetSize());
+		report.fileBytes = bytes.size();
+	}
+	original.Close();
+	std::wstring badPath = path + L".bad";
+	report.rejectsVersion = false;
+	report.rejectsTruncated = false;
+	if (bytes.size() > sizeof(FileHeader))
+	{
+		std::vector<unsigned char> stale(bytes);
+		reinterpret_cast<FileHeader*>(&stale[0])->version = MeshCacheVersion - 1;
+		report.rejectsVersion = DX::WriteFileAtomically(badPath, &stale[0], stale.size()) && !cache.Open(badPath, hash);
+		report.rejectsTruncated = DX::WriteFileAtomically(badPath, &bytes[0], bytes.size() - 1) && !cache.Open(badPath, hash);
+	}
+	return report;
+}
+#endif
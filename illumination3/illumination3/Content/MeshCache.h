@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../Helpers/MappedFile.h"
+#include "CompactVertex.h"
+#include "MeshGenerator.h"
+#include "MeshIndexing.h"
+#include "MeshSimplifier.h"
+
+namespace DirectXGame1
+{
+	// Bump when the file layout changes, or anything that bakes a mesh changes what it makes:
+	// files of another version are misses.
+	static const uint32_t MeshCacheVersion = 1;
+
+	// What one LOD of a baked mesh uploads: vertexCount vertices of vertexStride bytes
+	// (MeshVertex, or CompactVertex decoded with compactBounds), indices in indexFormat, drawn
+	// chunk by chunk. Points into a BakedMesh or a mapped MeshCacheFile.
+	struct MeshLodView
+	{
+		const void* vertices;
+		uint32_t vertexCount;
+		uint32_t vertexStride;
+		const void* indices;
+		uint32_t indexCount;
+		IndexFormat indexFormat;
+		const MeshChunk* chunks;
+		uint32_t chunkCount;
+		float errorBound;
+		CompactVertexBounds compactBounds;	// unit scales for full vertices
+	};
+
+	// Everything that decides what BakeMesh makes.
+	struct MeshBakeSettings
+	{
+		MeshBakeSettings() : policy(IndexPolicy::Automatic), compact(false) {}
+
+		MeshShapeDesc shape;
+		MeshLodSettings lods;
+		IndexPolicy policy;
+		bool compact;
+	};
+
+	// FNV-1a over the settings and MeshCacheVersion.
+	uint64_t HashMeshBakeSettings(const MeshBakeSettings& settings);
+
+	// A mesh through the whole load-time pipeline: generated, simplified into LODs, and each
+	// LOD reordered by OptimizeMesh, indexed by BuildIndexedMesh and, if asked, compacted.
+	// lods points into the other members, so a BakedMesh is filled in place and not copied.
+	struct BakedMesh
+	{
+		std::vector<IndexedMesh> meshes;
+		std::vector<std::vector<CompactVertex>> compactVertices;
+		std::vector<MeshLodView> lods;
+		float boundsMin[3];
+		float boundsMax[3];
+	};
+
+	void BakeMesh(const MeshBakeSettings& settings, BakedMesh& out);
+
+	// Writes the LODs and bounds with hash in the header. False if the file cannot be written.
+	bool WriteMeshCache(const std::wstring& path, uint64_t hash, const std::vector<MeshLodView>& lods, const float boundsMin[3], const float boundsMax[3]);
+
+	// A cache file mapped into memory. The views point straight into the mapping, ready to
+	// be D3D11_SUBRESOURCE_DATA::pSysMem, and stay valid until the file is closed.
+	class MeshCacheFile
+	{
+	public:
+		// False on any miss: no file, another version or hash, or sizes and offsets that do not
+		// fit the file (a truncated write).
+		bool Open(const std::wstring& path, uint64_t hash);
+		void Close();
+
+		const std::vector<MeshLodView>& GetLods() const { return m_lods; }
+		const float* GetBoundsMin() const { return m_boundsMin; }
+		const float* GetBoundsMax() const { return m_boundsMax; }
+
+	private:
+		DX::MappedFile m_file;
+		std::vector<MeshLodView> m_lods;
+		float m_boundsMin[3];
+		float m_boundsMax[3];
+	};
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct MeshCacheReport
+	{
+		double bakeMilliseconds;		// the renderer's torus, every LOD
+		double writeMilliseconds;
+		double openMilliseconds;		// map and check the header
+		double touchMilliseconds;		// open, then read every byte as an upload would
+		uint64_t fileBytes;
+		bool roundTrip;					// every byte of every LOD matches the bake
+		bool rejectsHash;				// a different hash misses
+		bool rejectsVersion;			// a file of another version misses
+		bool rejectsTruncated;			// a file cut short misses
+	};
+
+	// Bakes the renderer's torus into path, reads it back and tries the ways a cache can be
+	// stale. Leaves path (and path + ".bad") behind.
+	MeshCacheReport ValidateMeshCache(const std::wstring& path);
+#endif
+}
@@ -0,0 +1,581 @@
+#include "MeshGenerator.h"
+#include "../Helpers/ParallelFor.h"
+#include "../Helpers/SimdFloat4.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+using namespace DirectXGame1;
+using namespace DX;
+
+namespace
+{
+	const double Pi = 3.14159265358979323846;
+
+	// Rows handed to a worker at a time.
+	const unsigned int BandRows = 16;
+
+	// Per-column tables, one float each, padded to a multiple of four for the SIMD loop.
+	enum ColumnTable
+	{
+		ColumnPositionA,	// scales the row's direction in xy
+		ColumnPositionB,	// z
+		ColumnNormalA,
+		ColumnNormalB,
+		ColumnGreen,
+		ColumnTexV,
+		ColumnTableCount
+	};
+
+	// One row of the grid. Every shape's vertex separates as
+	//   pos    = (offsetX + positionCos * A, offsetY + positionSin * A, B)
+	//   normal = normalize(normalCos * nA, normalSin * nA, nB)
+	// with A, B, nA and nB taken from the column tables.
+	struct RowFactors
+	{
+		float offsetX, offsetY;
+		float positionCos, positionSin;
+		float normalCos, normalSin;
+		float red, texU;
+	};
+
+	// sign(x) * |x| ^ e, the superquadric's building block.
+	double SignedPow(double x, double e)
+	{
+		double p = std::pow(std::fabs(x), e);
+		return x < 0.0 ? -p : p;
+	}
+
+	bool WrapsRows(MeshShape shape)
+	{
+		return shape != MeshShape::Plane;
+	}
+
+	bool WrapsColumns(MeshShape shape)
+	{
+		return shape == MeshShape::Torus;
+	}
+
+	uint32_t VertexRows(const MeshShapeDesc& desc)
+	{
+		return desc.rows + (WrapsRows(desc.shape) ? 0 : 1);
+	}
+
+	uint32_t VertexColumns(const MeshShapeDesc& desc)
+	{
+		return desc.columns + (WrapsColumns(desc.shape) ? 0 : 1);
+	}
+
+	uint32_t PaddedColumns(const MeshShapeDesc& desc)
+	{
+		return (VertexColumns(desc) + 3) & ~3u;
+	}
+
+	uint32_t BandCount(const MeshShapeDesc& desc)
+	{
+		return (VertexRows(desc) + BandRows - 1) / BandRows;
+	}
+
+	void CheckDesc(const MeshShapeDesc& desc)
+	{
+		if (desc.rows == 0 || desc.columns == 0)
+		{
+			throw std::invalid_argument("mesh grid without rows or columns");
+		}
+		if (desc.shape == MeshShape::Superquadric &&
+			!(desc.rowExponent > 0.0f && desc.rowExponent <= 2.0f && desc.columnExponent > 0.0f && desc.columnExponent <= 2.0f))
+		{
+			throw std::invalid_argument("superquadric exponents must be in (0, 2]");
+		}
+		uint64_t vertices = (uint64_t)VertexRows(desc) * VertexColumns(desc);
+		uint64_t indices = (uint64_t)desc.rows * desc.columns * 6;
+		if (vertices > 0xFFFFFFFFull || indices > 0xFFFFFFFFull)
+		{
+			throw std::invalid_argument("mesh grid too large for 32-bit indices");
+		}
+	}
+
+	// Where row i and column j sit along their parameter: the angle around z, and across it.
+	double RowAngle(const MeshShapeDesc& desc, uint32_t i)
+	{
+		return 2.0 * Pi * i / desc.rows;
+	}
+
+	double ColumnAngle(const MeshShapeDesc& desc, uint32_t j)
+	{
+		return (desc.shape == MeshShape::Torus ? 2.0 * Pi : Pi) * j / desc.columns;
+	}
+
+	void FillColumnTables(const MeshShapeDesc& desc, float* tables)
+	{
+		const uint32_t padded = PaddedColumns(desc);
+		const uint32_t columns = VertexColumns(desc);
+		for (uint32_t j = 0; j < padded; j++)
+		{
+			// The padding repeats the last column so it holds finite numbers; it is never stored.
+			uint32_t c = std::min(j, columns - 1);
+			double v = (double)c / desc.columns;
+			double phi = ColumnAngle(desc, c);
+			double a = 0.0, b = 0.0, na = 0.0, nb = 0.0;
+			switch (desc.shape)
+			{
+			case MeshShape::Torus:
+			case MeshShape::Sphere:
+				a = (desc.shape == MeshShape::Torus ? desc.tubeRadius : desc.radius) * std::sin(phi);
+				b = (desc.shape == MeshShape::Torus ? desc.tubeRadius : desc.radius) * std::cos(phi);
+				na = std::sin(phi);
+				nb = std::cos(phi);
+				break;
+			case MeshShape::Cylinder:
+				a = desc.radius;
+				b = desc.height * (0.5 - v);
+				na = 1.0;
+				nb = 0.0;
+				break;
+			case MeshShape::Plane:
+				a = desc.radius * (2.0 * v - 1.0);
+				b = 0.0;
+				na = 0.0;
+				nb = 1.0;
+				break;
+			case MeshShape::Superquadric:
+				a = desc.radius * SignedPow(std::sin(phi), desc.columnExponent);
+				b = desc.radius * SignedPow(std::cos(phi), desc.columnExponent);
+				na = SignedPow(std::sin(phi), 2.0 - desc.columnExponent);
+				nb = SignedPow(std::cos(phi), 2.0 - desc.columnExponent);
+				break;
+			}
+			tables[ColumnPositionA * padded + j] = (float)a;
+			tables[ColumnPositionB * padded + j] = (float)b;
+			tables[ColumnNormalA * padded + j] = (float)na;
+			tables[ColumnNormalB * padded + j] = (float)nb;
+			tables[ColumnGreen * padded + j] = (float)(c / (desc.columns + 0.01));
+			tables[ColumnTexV * padded + j] = (float)v;
+		}
+	}
+
+	RowFactors ComputeRowFactors(const MeshShapeDesc& desc, uint32_t i)
+	{
+		RowFactors f;
+		double theta = RowAngle(desc, i);
+		double c = std::cos(theta), s = std::sin(theta);
+		switch (desc.shape)
+		{
+		case MeshShape::Torus:
+			f.offsetX = (float)(desc.radius * c);
+			f.offsetY = (float)(desc.radius * s);
+			f.positionCos = f.normalCos = (float)c;
+			f.positionSin = f.normalSin = (float)s;
+			break;
+		case MeshShape::Sphere:
+		case MeshShape::Cylinder:
+			f.offsetX = f.offsetY = 0.0f;
+			f.positionCos = f.normalCos = (float)c;
+			f.positionSin = f.normalSin = (float)s;
+			break;
+		case MeshShape::Plane:
+			f.offsetX = 0.0f;
+			f.offsetY = (float)(desc.radius * (2.0 * i / desc.rows - 1.0));
+			f.positionCos = 1.0f;
+			f.positionSin = 0.0f;
+			f.normalCos = f.normalSin = 0.0f;
+			break;
+		case MeshShape::Superquadric:
+			f.offsetX = f.offsetY = 0.0f;
+			f.positionCos = (float)SignedPow(c, desc.rowExponent);
+			f.positionSin = (float)SignedPow(s, desc.rowExponent);
+			f.normalCos = (float)SignedPow(c, 2.0 - desc.rowExponent);
+			f.normalSin = (float)SignedPow(s, 2.0 - desc.rowExponent);
+			break;
+		}
+		// The original torus's colouring: red ramps up over each third of the rows.
+		f.red = (float)(i / (desc.rows / 3.0 + 0.01));
+		f.texU = (float)i / desc.rows;
+		return f;
+	}
+
+	void WriteRow(const MeshShapeDesc& desc, const float* tables, uint32_t i, MeshVertex* row)
+	{
+		const uint32_t padded = PaddedColumns(desc);
+		const uint32_t columns = VertexColumns(desc);
+		const RowFactors f = ComputeRowFactors(desc, i);
+
+		const SimdFloat4 offsetX = SimdSplat(f.offsetX);
+		const SimdFloat4 offsetY = SimdSplat(f.offsetY);
+		const SimdFloat4 positionCos = SimdSplat(f.positionCos);
+		const SimdFloat4 positionSin = SimdSplat(f.positionSin);
+		const SimdFloat4 normalCos = SimdSplat(f.normalCos);
+		const SimdFloat4 normalSin = SimdSplat(f.normalSin);
+		const SimdFloat4 one = SimdSplat(1.0f);
+		const SimdFloat4 tiny = SimdSplat(1e-20f);
+
+		for (uint32_t j = 0; j < columns; j += 4)
+		{
+			SimdFloat4 a = SimdLoad(tables + ColumnPositionA * padded + j);
+			SimdFloat4 na = SimdLoad(tables + ColumnNormalA * padded + j);
+			SimdFloat4 nx = SimdMul(normalCos, na);
+			SimdFloat4 ny = SimdMul(normalSin, na);
+			SimdFloat4 nz = SimdLoad(tables + ColumnNormalB * padded + j);
+			SimdFloat4 length = SimdSqrt(SimdAdd(SimdMul(nx, nx), SimdAdd(SimdMul(ny, ny), SimdMul(nz, nz))));
+			SimdFloat4 scale = SimdDiv(one, SimdMax(length, tiny));
+
+			// Lanes to scatter: px, py, nx, ny, nz; pz, green and v come straight from the tables.
+			float lanes[5][4];
+			SimdStore(lanes[0], SimdMulAdd(positionCos, a, offsetX));
+			SimdStore(lanes[1], SimdMulAdd(positionSin, a, offsetY));
+			SimdStore(lanes[2], SimdMul(nx, scale));
+			SimdStore(lanes[3], SimdMul(ny, scale));
+			SimdStore(lanes[4], SimdMul(nz, scale));
+
+			uint32_t count = std::min(4u, columns - j);
+			for (uint32_t k = 0; k < count; k++)
+			{
+				MeshVertex& vertex = row[j + k];
+				vertex.pos[0] = lanes[0][k];
+				vertex.pos[1] = lanes[1][k];
+				vertex.pos[2] = tables[ColumnPositionB * padded + j + k];
+				vertex.color[0] = f.red;
+				vertex.color[1] = tables[ColumnGreen * padded + j + k];
+				vertex.color[2] = 0.05f;
+				vertex.normal[0] = lanes[2][k];
+				vertex.normal[1] = lanes[3][k];
+				vertex.normal[2] = lanes[4][k];
+				vertex.tex[0] = f.texU;
+				vertex.tex[1] = tables[ColumnTexV * padded + j + k];
+			}
+		}
+	}
+
+	// The vertex rows of one band, and the cells whose top edge is in the band.
+	void WriteBand(const MeshShapeDesc& desc, const float* tables, uint32_t band, MeshVertex* vertices, uint32_t* indices)
+	{
+		const uint32_t rows = VertexRows(desc);
+		const uint32_t columns = VertexColumns(desc);
+		const uint32_t first = band * BandRows;
+		const uint32_t last = std::min(first + BandRows, rows);
+
+		for (uint32_t i = first; i < last; i++)
+		{
+			WriteRow(desc, tables, i, vertices + (size_t)i * columns);
+		}
+
+		uint32_t* out = indices + (size_t)first * desc.columns * 6;
+		for (uint32_t i = first; i < std::min(last, desc.rows); i++)
+		{
+			uint32_t next = i + 1 == rows ? 0 : i + 1;
+			for (uint32_t j = 0; j < desc.columns; j++)
+			{
+				uint32_t right = j + 1 == columns ? 0 : j + 1;
+				*out++ = next * columns + j;
+				*out++ = i * columns + right;
+				*out++ = i * columns + j;
+
+				*out++ = next * columns + j;
+				*out++ = next * columns + right;
+				*out++ = i * columns + right;
+			}
+		}
+	}
+
+#if defined(DX_HEADLESS_CHECKS)
+	// Straight per-vertex evaluation, sin and cos for every vertex, to check the tables against.
+	void ReferenceVertex(const MeshShapeDesc& desc, uint32_t i, uint32_t j, double pos[3], double normal[3])
+	{
+		double theta = RowAngle(desc, i), phi = ColumnAngle(desc, j);
+		double u = (double)i / desc.rows, v = (double)j / desc.columns;
+		double n[3] = { 0.0, 0.0, 1.0 };
+		switch (desc.shape)
+		{
+		case MeshShape::Torus:
+			n[0] = std::cos(theta) * std::sin(phi);
+			n[1] = std::sin(theta) * std::sin(phi);
+			n[2] = std::cos(phi);
+			pos[0] = desc.radius * std::cos(theta) + desc.tubeRadius * n[0];
+			pos[1] = desc.radius * std::sin(theta) + desc.tubeRadius * n[1];
+			pos[2] = desc.tubeRadius * n[2];
+			break;
+		case MeshShape::Sphere:
+			n[0] = std::cos(theta) * std::sin(phi);
+			n[1] = std::sin(theta) * std::sin(phi);
+			n[2] = std::cos(phi);
+			pos[0] = desc.radius * n[0];
+			pos[1] = desc.radius * n[1];
+			pos[2] = desc.radius * n[2];
+			break;
+		case MeshShape::Cylinder:
+			n[0] = std::cos(theta);
+			n[1] = std::sin(theta);
+			n[2] = 0.0;
+			pos[0] = desc.radius * n[0];
+			pos[1] = desc.radius * n[1];
+			pos[2] = desc.height * (0.5 - v);
+			break;
+		case MeshShape::Plane:
+			pos[0] = desc.radius * (2.0 * v - 1.0);
+			pos[1] = desc.radius * (2.0 * u - 1.0);
+			pos[2] = 0.0;
+			break;
+		case MeshShape::Superquadric:
+		{
+			double e1 = desc.columnExponent, e2 = desc.rowExponent;
+			pos[0] = desc.radius * SignedPow(std::sin(phi), e1) * SignedPow(std::cos(theta), e2);
+			pos[1] = desc.radius * SignedPow(std::sin(phi), e1) * SignedPow(std::sin(theta), e2);
+			pos[2] = desc.radius * SignedPow(std::cos(phi), e1);
+			n[0] = SignedPow(std::sin(phi), 2.0 - e1) * SignedPow(std::cos(theta), 2.0 - e2);
+			n[1] = SignedPow(std::sin(phi), 2.0 - e1) * SignedPow(std::sin(theta), 2.0 - e2);
+			n[2] = SignedPow(std::cos(phi), 2.0 - e1);
+			break;
+		}
+		}
+		double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		for (int k = 0; k < 3; k++)
+		{
+			normal[k] = n[k] / std::max(length, 1e-20);
+		}
+	}
+
+	// Largest differences between a generated mesh and the reference, and of the normals' length from 1.
+	void CompareWithReference(const MeshShapeDesc& desc, const MeshVertex* vertices, MeshGeneratorReport& report)
+	{
+		const uint32_t rows = VertexRows(desc), columns = VertexColumns(desc);
+		for (uint32_t i = 0; i < rows; i++)
+		{
+			for (uint32_t j = 0; j < columns; j++)
+			{
+				const MeshVertex& vertex = vertices[(size_t)i * columns + j];
+				double pos[3], normal[3];
+				ReferenceVertex(desc, i, j, pos, normal);
+				double length = 0.0;
+				for (int k = 0; k < 3; k++)
+				{
+					report.maxPositionError = std::max(report.maxPositionError, (float)std::fabs(vertex.pos[k] - pos[k]));
+					report.maxNormalError = std::max(report.maxNormalError, (float)std::fabs(vertex.normal[k] - normal[k]));
+					length += (double)vertex.normal[k] * vertex.normal[k];
+				}
+				report.maxNormalLengthError = std::max(report.maxNormalLengthError, (float)std::fabs(std::sqrt(length) - 1.0));
+			}
+		}
+	}
+#endif
+}
+
+MeshShapeDesc::MeshShapeDesc() :
+	shape(MeshShape::Torus),
+	rows(90),
+	columns(30),
+	radius(0.6f),
+	tubeRadius(0.2f),
+	height(1.0f),
+	rowExponent(1.0f),
+	columnExponent(1.0f)
+{
+}
+
+MeshShapeDesc MeshShapeDesc::Torus(unsigned int rows, unsigned int columns, float radius, float tubeRadius)
+{
+	MeshShapeDesc desc;
+	desc.shape = MeshShape::Torus;
+	desc.rows = rows;
+	desc.columns = columns;
+	desc.radius = radius;
+	desc.tubeRadius = tubeRadius;
+	return desc;
+}
+
+MeshShapeDesc MeshShapeDesc::Sphere(unsigned int rows, unsigned int columns, float radius)
+{
+	MeshShapeDesc desc;
+	desc.shape = MeshShape::Sphere;
+	desc.rows = rows;
+	desc.columns = columns;
+	desc.radius = radius;
+	return desc;
+}
+
+MeshShapeDesc MeshShapeDesc::Cylinder(unsigned int rows, unsigned int columns, float radius, float height)
+{
+	MeshShapeDesc desc;
+	desc.shape = MeshShape::Cylinder;
+	desc.rows = rows;
+	desc.columns = columns;
+	desc.radius = radius;
+	desc.height = height;
+	return desc;
+}
+
+MeshShapeDesc MeshShapeDesc::Plane(unsigned int rows, unsigned int columns, float halfSize)
+{
+	MeshShapeDesc desc;
+	desc.shape = MeshShape::Plane;
+	desc.rows = rows;
+	desc.columns = columns;
+	desc.radius = halfSize;
+	return desc;
+}
+
+MeshShapeDesc MeshShapeDesc::Superquadric(unsigned int rows, unsigned int columns, float radius, float rowExponent, float columnExponent)
+{
+	MeshShapeDesc desc;
+	desc.shape = MeshShape::Superquadric;
+	desc.rows = rows;
+	desc.columns = columns;
+	desc.radius = radius;
+	desc.rowExponent = rowExponent;
+	desc.columnExponent = columnExponent;
+	return desc;
+}
+
+uint32_t DirectXGame1::MeshVertexCount(const MeshShapeDesc& desc)
+{
+	return VertexRows(desc) * VertexColumns(desc);
+}
+
+uint32_t DirectXGame1::MeshIndexCount(const MeshShapeDesc& desc)
+{
+	return desc.rows * desc.columns * 6;
+}
+
+void DirectXGame1::GenerateMesh(const MeshShapeDesc& desc, MeshVertex* vertices, uint32_t* indices, unsigned int maxWorkers)
+{
+	CheckDesc(desc);
+	std::vector<float> tables(PaddedColumns(desc) * ColumnTableCount);
+	FillColumnTables(desc, &tables[0]);
+
+	ParallelFor(BandCount(desc), [&](unsigned int band)
+	{
+		WriteBand(desc, &tables[0], band, vertices, indices);
+	}, maxWorkers);
+}
+
+MeshData DirectXGame1::GenerateMesh(const MeshShapeDesc& desc, LinearArena& arena, unsigned int maxWorkers)
+{
+	CheckDesc(desc);
+	MeshData mesh;
+	mesh.vertexCount = MeshVertexCount(desc);
+	mesh.indexCount = MeshIndexCount(desc);
+	mesh.vertices = arena.Allocate<MeshVertex>(mesh.vertexCount);
+	mesh.indices = arena.Allocate<uint32_t>(mesh.indexCount);
+	GenerateMesh(desc, mesh.vertices, mesh.indices, maxWorkers);
+	return mesh;
+}
+
+void DirectXGame1::GenerateMeshes(const std::vector<MeshShapeDesc>& descs, LinearArena& arena, std::vector<MeshData>& meshes, unsigned int maxWorkers)
+{
+	meshes.resize(descs.size());
+	std::vector<float*> tables(descs.size());
+	// firstBand[m]: the first work item of mesh m; the last entry is the total.
+	std::vector<uint32_t> firstBand(descs.size() + 1, 0);
+
+	for (size_t m = 0; m < descs.size(); m++)
+	{
+		const MeshShapeDesc& desc = descs[m];
+		CheckDesc(desc);
+		MeshData& mesh = meshes[m];
+		mesh.vertexCount = MeshVertexCount(desc);
+		mesh.indexCount = MeshIndexCount(desc);
+		mesh.vertices = arena.Allocate<MeshVertex>(mesh.vertexCount);
+		mesh.indices = arena.Allocate<uint32_t>(mesh.indexCount);
+		tables[m] = arena.Allocate<float>(PaddedColumns(desc) * ColumnTableCount);
+		firstBand[m + 1] = firstBand[m] + BandCount(desc);
+	}
+
+	// The tables are cheap next to the vertices; filling them here keeps the work items uniform.
+	ParallelFor((unsigned int)descs.size(), [&](unsigned int m)
+	{
+		FillColumnTables(descs[m], tables[m]);
+	}, maxWorkers);
+
+	ParallelFor(firstBand.back(), [&](unsigned int item)
+	{
+		size_t m = std::upper_bound(firstBand.begin(), firstBand.end(), item) - firstBand.begin() - 1;
+		WriteBand(descs[m], tables[m], item - firstBand[m], meshes[m].vertices, meshes[m].indices);
+	}, maxWorkers);
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+MeshGeneratorReport DirectXGame1::BenchmarkMeshGenerator(uint32_t targetVertices, uint32_t batchMeshes)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	MeshGeneratorReport report;
+	report.maxPositionError = 0.0f;
+	report.maxNormalError = 0.0f;
+	report.maxNormalLengthError = 0.0f;
+
+	// A torus with the original's 3:1 loop to circle ratio.
+	unsigned int columns = std::max(3u, (unsigned int)std::sqrt(targetVertices / 3.0));
+	MeshShapeDesc torus = MeshShapeDesc::Torus(columns * 3, columns, 0.6f, 0.2f);
+	report.vertices = MeshVertexCount(torus);
+
+	std::vector<MeshVertex> vertices(report.vertices);
+	std::vector<uint32_t> indices(MeshIndexCount(torus));
+
+	// The old inline loop: sin and cos for every vertex, one thread.
+	auto start = Clock::now();
+	for (uint32_t i = 0; i < torus.rows; i++)
+	{
+		for (uint32_t j = 0; j < torus.columns; j++)
+		{
+			double pos[3], normal[3];
+			ReferenceVertex(torus, i, j, pos, normal);
+			MeshVertex& vertex = vertices[(size_t)i * torus.columns + j];
+			for (int k = 0; k < 3; k++)
+			{
+				vertex.pos[k] = (float)pos[k];
+				vertex.normal[k] = (float)normal[k];
+			}
+		}
+	}
+	report.referenceMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	start = Clock::now();
+	GenerateMesh(torus, &vertices[0], &indices[0], 1);
+	report.singleThreadMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	start = Clock::now();
+	GenerateMesh(torus, &vertices[0], &indices[0]);
+	report.parallelMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	CompareWithReference(torus, &vertices[0], report);
+
+	// Thousands of small variants of every shape, as generated at load time.
+	std::vector<MeshShapeDesc> descs;
+	for (uint32_t m = 0; m < batchMeshes; m++)
+	{
+		unsigned int rows = 24 + (m * 7) % 41;
+		unsigned int cols = 12 + (m * 5) % 29;
+		float t = (m % 17) / 16.0f;
+		switch (m % 5)
+		{
+		case 0: descs.push_back(MeshShapeDesc::Torus(rows, cols, 0.5f + 0.2f * t, 0.1f + 0.1f * t)); break;
+		case 1: descs.push_back(MeshShapeDesc::Sphere(rows, cols, 0.3f + 0.5f * t)); break;
+		case 2: descs.push_back(MeshShapeDesc::Cylinder(rows, cols, 0.2f + 0.3f * t, 0.5f + t)); break;
+		case 3: descs.push_back(MeshShapeDesc::Plane(rows, cols, 0.5f + t)); break;
+		default: descs.push_back(MeshShapeDesc::Superquadric(rows, cols, 0.5f, 0.2f + 1.8f * t, 2.0f - 1.8f * t)); break;
+		}
+	}
+
+	LinearArena arena;
+	std::vector<MeshData> meshes;
+	start = Clock::now();
+	GenerateMeshes(descs, arena, meshes);
+	report.batchMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	report.batchMeshes = batchMeshes;
+	report.batchVertices = 0;
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		report.batchVertices += meshes[m].vertexCount;
+		// The first few dozen cover every shape with several grids.
+		if (m < 50)
+		{
+			CompareWithReference(descs[m], meshes[m].vertices, report);
+		}
+	}
+	report.batchArenaBytes = arena.GetBytesAllocated();
+
+	return report;
+}
+#endif
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "../Helpers/LinearArena.h"
+
+namespace DirectXGame1
+{
+	// Same layout as VertexPositionColor in ShaderStructures.h, without DirectXMath, so the
+	// generator also builds off Windows. The renderer uploads these as they are.
+	struct MeshVertex
+	{
+		float pos[3];
+		float color[3];
+		float normal[3];
+		float tex[2];
+	};
+
+	enum class MeshShape
+	{
+		Torus,
+		Sphere,
+		Cylinder,
+		Plane,
+		Superquadric
+	};
+
+	// A shape sampled on a rows x columns grid of its two parameters. Rows go around the z axis
+	// (the torus's large loop, the sphere's longitude); columns run across it (the torus's small
+	// circle, the sphere from +z to -z, the cylinder from top to bottom). The plane lies in z = 0
+	// facing +z, rows along y and columns along x.
+	struct MeshShapeDesc
+	{
+		MeshShapeDesc();
+
+		static MeshShapeDesc Torus(unsigned int rows, unsigned int columns, float radius, float tubeRadius);
+		static MeshShapeDesc Sphere(unsigned int rows, unsigned int columns, float radius);
+		static MeshShapeDesc Cylinder(unsigned int rows, unsigned int columns, float radius, float height);
+		static MeshShapeDesc Plane(unsigned int rows, unsigned int columns, float halfSize);
+		// Superellipsoid: exponent 1 is round, towards 0 boxy, 2 a double cone; both in (0, 2].
+		static MeshShapeDesc Superquadric(unsigned int rows, unsigned int columns, float radius, float rowExponent, float columnExponent);
+
+		MeshShape shape;
+		unsigned int rows;
+		unsigned int columns;
+		float radius;			// torus: the large loop; plane: half the side
+		float tubeRadius;		// torus only
+		float height;			// cylinder only
+		float rowExponent;		// superquadric only, the shape around z
+		float columnExponent;	// superquadric only, the profile from +z to -z
+	};
+
+	// Rows and columns that wrap around reuse the first line of vertices instead of
+	// repeating it: the torus wraps both ways, the sphere, cylinder and superquadric wrap
+	// their rows, the plane wraps neither.
+	uint32_t MeshVertexCount(const MeshShapeDesc& desc);
+	uint32_t MeshIndexCount(const MeshShapeDesc& desc);
+
+	// A generated mesh. The arrays belong to whoever owns the memory they were written into.
+	struct MeshData
+	{
+		MeshVertex* vertices;
+		uint32_t vertexCount;
+		uint32_t* indices;
+		uint32_t indexCount;
+	};
+
+	// Two triangles per grid cell, wound like the original inline torus (clockwise seen from
+	// outside). Normals are the shape's analytic normals, evaluated four vertices at a time;
+	// every parametrization here separates into a per-row and a per-column factor, so the
+	// trigonometry is done once per row and once per column rather than per vertex.
+	// Bands of rows are spread over up to maxWorkers threads (0: all cores).
+	// Throws std::invalid_argument for an empty grid, a bad exponent or more than 2^32 vertices.
+	void GenerateMesh(const MeshShapeDesc& desc, MeshVertex* vertices, uint32_t* indices, unsigned int maxWorkers = 0);
+
+	// As above, with the arrays taken from arena.
+	MeshData GenerateMesh(const MeshShapeDesc& desc, DX::LinearArena& arena, unsigned int maxWorkers = 0);
+
+	// Many meshes in one go: the arrays are all taken from arena first, then the row bands of
+	// every mesh go into one pool of work, so a batch of small variants keeps every core busy.
+	void GenerateMeshes(const std::vector<MeshShapeDesc>& descs, DX::LinearArena& arena, std::vector<MeshData>& meshes, unsigned int maxWorkers = 0);
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct MeshGeneratorReport
+	{
+		uint32_t vertices;					// the large torus
+		double referenceMilliseconds;		// per-vertex sin/cos, one thread, as the old inline loop did
+		double singleThreadMilliseconds;	// GenerateMesh with one worker
+		double parallelMilliseconds;		// GenerateMesh with every core
+		float maxPositionError;				// against the per-vertex reference
+		float maxNormalError;
+		float maxNormalLengthError;			// every shape, including the superquadric
+		uint32_t batchMeshes;				// the batch of small variants
+		uint64_t batchVertices;
+		double batchMilliseconds;
+		size_t batchArenaBytes;
+	};
+
+	// Generates a torus of about targetVertices vertices three ways and compares them, then a
+	// batch of batchMeshes small variants of every shape through GenerateMeshes.
+	MeshGeneratorReport BenchmarkMeshGenerator(uint32_t targetVertices = 4000000, uint32_t batchMeshes = 4096);
+#endif
+}
@@ -0,0 +1,265 @@
+#include "MeshIndexing.h"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace DirectXGame1;
+
+namespace
+{
+	const uint32_t NoChunk = 0xFFFFFFFF;
+
+	void CheckTriangleList(const MeshData& mesh)
+	{
+		if (mesh.indexCount % 3 != 0)
+		{
+			throw std::invalid_argument("index count is not a whole number of triangles");
+		}
+		for (uint32_t i = 0; i < mesh.indexCount; i++)
+		{
+			if (mesh.indices[i] >= mesh.vertexCount)
+			{
+				throw std::invalid_argument("index past the end of the vertices");
+			}
+		}
+	}
+
+	void BuildSingleChunk(const MeshData& mesh, IndexFormat format, IndexedMesh& out)
+	{
+		out.format = format;
+		out.vertices.assign(mesh.vertices, mesh.vertices + mesh.vertexCount);
+		if (format == IndexFormat::UInt16)
+		{
+			out.indices16.assign(mesh.indices, mesh.indices + mesh.indexCount);
+		}
+		else
+		{
+			out.indices32.assign(mesh.indices, mesh.indices + mesh.indexCount);
+		}
+		MeshChunk chunk = { 0, mesh.vertexCount, 0, mesh.indexCount };
+		out.chunks.push_back(chunk);
+	}
+
+	void BuildSplit16(const MeshData& mesh, uint32_t maxChunkVertices, IndexedMesh& out)
+	{
+		out.format = IndexFormat::UInt16;
+		out.vertices.reserve(mesh.vertexCount);
+		out.indices16.reserve(mesh.indexCount);
+
+		// owner[v]: the chunk vertex v was last copied into, and local[v] where it went.
+		std::vector<uint32_t> owner(mesh.vertexCount, NoChunk);
+		std::vector<uint16_t> local(mesh.vertexCount);
+
+		MeshChunk chunk = { 0, 0, 0, 0 };
+		uint32_t chunkIndex = 0;
+		for (uint32_t t = 0; t < mesh.indexCount; t += 3)
+		{
+			const uint32_t* triangle = mesh.indices + t;
+			uint32_t added = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				bool seen = owner[triangle[k]] == chunkIndex || (k > 0 && triangle[k] == triangle[0]) || (k > 1 && triangle[k] == triangle[1]);
+				added += seen ? 0 : 1;
+			}
+
+			if (chunk.vertexCount + added > maxChunkVertices)
+			{
+				out.chunks.push_back(chunk);
+				chunkIndex++;
+				chunk.baseVertex = (uint32_t)out.vertices.size();
+				chunk.vertexCount = 0;
+				chunk.firstIndex = (uint32_t)out.indices16.size();
+				chunk.indexCount = 0;
+			}
+
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t v = triangle[k];
+				if (owner[v] != chunkIndex)
+				{
+					owner[v] = chunkIndex;
+					local[v] = (uint16_t)chunk.vertexCount++;
+					out.vertices.push_back(mesh.vertices[v]);
+				}
+				out.indices16.push_back(local[v]);
+			}
+			chunk.indexCount += 3;
+		}
+
+		if (chunk.indexCount > 0)
+		{
+			out.chunks.push_back(chunk);
+		}
+	}
+
+#if defined(DX_HEADLESS_CHECKS)
+	// Compares every triangle of built, chunk by chunk, with the source triangle list.
+	uint32_t CountMismatchedTriangles(const MeshData& source, const IndexedMesh& built)
+	{
+		uint32_t mismatched = 0;
+		uint32_t t = 0;
+		for (const MeshChunk& chunk : built.chunks)
+		{
+			for (uint32_t i = 0; i < chunk.indexCount; i += 3, t += 3)
+			{
+				bool same = t + 2 < source.indexCount;
+				for (int k = 0; k < 3 && same; k++)
+				{
+					uint32_t index = chunk.firstIndex + i + k;
+					uint32_t v = chunk.baseVertex + (built.format == IndexFormat::UInt16 ? built.indices16[index] : built.indices32[index]);
+					same = v < built.vertices.size() &&
+						std::memcmp(&built.vertices[v], &source.vertices[source.indices[t + k]], sizeof(MeshVertex)) == 0;
+				}
+				mismatched += same ? 0 : 1;
+			}
+		}
+		// Triangles the chunks never drew.
+		if (t < source.indexCount)
+		{
+			mismatched += (source.indexCount - t) / 3;
+		}
+		return mismatched;
+	}
+
+	uint32_t CountChunkViolations(const IndexedMesh& built, uint32_t maxChunkVertices)
+	{
+		uint32_t violations = 0;
+		for (const MeshChunk& chunk : built.chunks)
+		{
+			if (built.format == IndexFormat::UInt16 && chunk.vertexCount > maxChunkVertices)
+			{
+				violations++;
+			}
+			for (uint32_t i = 0; i < chunk.indexCount; i++)
+			{
+				uint32_t index = built.format == IndexFormat::UInt16 ? built.indices16[chunk.firstIndex + i] : built.indices32[chunk.firstIndex + i];
+				if (index >= chunk.vertexCount)
+				{
+					violations++;
+				}
+			}
+		}
+		return violations;
+	}
+
+	uint64_t BufferBytes(const IndexedMesh& built)
+	{
+		return (uint64_t)built.vertices.size() * sizeof(MeshVertex) + (uint64_t)built.GetIndexCount() * built.GetIndexSize();
+	}
+#endif
+}
+
+const void* IndexedMesh::GetIndexData() const
+{
+	if (format == IndexFormat::UInt16)
+	{
+		return indices16.empty() ? nullptr : &indices16[0];
+	}
+	return indices32.empty() ? nullptr : &indices32[0];
+}
+
+IndexedMesh DirectXGame1::BuildIndexedMesh(const MeshData& mesh, IndexPolicy policy, uint32_t maxChunkVertices)
+{
+	if (maxChunkVertices < 3 || maxChunkVertices > MaxVerticesPer16BitChunk)
+	{
+		throw std::invalid_argument("16-bit chunk vertex limit out of range");
+	}
+	CheckTriangleList(mesh);
+
+	IndexedMesh out;
+	switch (policy)
+	{
+	case IndexPolicy::Automatic:
+		BuildSingleChunk(mesh, mesh.vertexCount <= maxChunkVertices ? IndexFormat::UInt16 : IndexFormat::UInt32, out);
+		break;
+	case IndexPolicy::Split16:
+		if (mesh.vertexCount <= maxChunkVertices)
+		{
+			BuildSingleChunk(mesh, IndexFormat::UInt16, out);
+		}
+		else
+		{
+			BuildSplit16(mesh, maxChunkVertices, out);
+		}
+		break;
+	case IndexPolicy::Always32:
+		BuildSingleChunk(mesh, IndexFormat::UInt32, out);
+		break;
+	}
+	return out;
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+MeshIndexingReport DirectXGame1::ValidateMeshIndexing(uint32_t largeVertices)
+{
+	MeshIndexingReport report = {};
+
+	// 3:1 tori around the 16-bit limit (147 x 445 = 65,415 and 148 x 444 = 65,712 vertices),
+	// a plane whose non-wrapping edge lands exactly on it (255 x 257 = 65,535), and the large one.
+	std::vector<MeshShapeDesc> descs;
+	descs.push_back(MeshShapeDesc::Torus(445, 147, 0.6f, 0.2f));
+	descs.push_back(MeshShapeDesc::Torus(444, 148, 0.6f, 0.2f));
+	descs.push_back(MeshShapeDesc::Plane(254, 256, 1.0f));
+	descs.push_back(MeshShapeDesc::Sphere(300, 299, 1.0f));
+	uint32_t columns = 3;
+	while ((columns + 1) * (columns + 1) * 3 <= largeVertices)
+	{
+		columns++;
+	}
+	descs.push_back(MeshShapeDesc::Torus(columns * 3, columns, 0.6f, 0.2f));
+
+	DX::LinearArena arena;
+	for (size_t d = 0; d < descs.size(); d++)
+	{
+		arena.Reset();
+		MeshData mesh = GenerateMesh(descs[d], arena);
+		bool fits = mesh.vertexCount <= MaxVerticesPer16BitChunk;
+
+		const IndexPolicy policies[] = { IndexPolicy::Automatic, IndexPolicy::Split16, IndexPolicy::Always32 };
+		for (IndexPolicy policy : policies)
+		{
+			IndexedMesh built = BuildIndexedMesh(mesh, policy);
+			report.meshesChecked++;
+			report.mismatchedTriangles += CountMismatchedTriangles(mesh, built);
+			report.chunkLimitViolations += CountChunkViolations(built, MaxVerticesPer16BitChunk);
+			if (policy == IndexPolicy::Automatic && (built.format == IndexFormat::UInt16) != fits)
+			{
+				report.wrongFormats++;
+			}
+
+			if (d + 1 == descs.size())
+			{
+				if (policy == IndexPolicy::Split16)
+				{
+					report.largeChunks = (uint32_t)built.chunks.size();
+					report.bytesSplit16 = BufferBytes(built);
+				}
+				else if (policy == IndexPolicy::Always32)
+				{
+					report.bytes32 = BufferBytes(built);
+				}
+			}
+		}
+
+		// A small chunk limit forces many splits, so the seams get exercised on every shape.
+		IndexedMesh small = BuildIndexedMesh(mesh, IndexPolicy::Split16, 1000);
+		report.meshesChecked++;
+		report.mismatchedTriangles += CountMismatchedTriangles(mesh, small);
+		report.chunkLimitViolations += CountChunkViolations(small, 1000);
+
+		if (d + 1 == descs.size())
+		{
+			report.largeVertices = mesh.vertexCount;
+			for (uint32_t t = 0; t < mesh.indexCount; t += 3)
+			{
+				if (mesh.indices[t] > 0xFFFF || mesh.indices[t + 1] > 0xFFFF || mesh.indices[t + 2] > 0xFFFF)
+				{
+					report.truncatedTriangles++;
+				}
+			}
+		}
+	}
+
+	return report;
+}
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "MeshGenerator.h"
+
+namespace DirectXGame1
+{
+	enum class IndexFormat
+	{
+		UInt16,	// DXGI_FORMAT_R16_UINT
+		UInt32	// DXGI_FORMAT_R32_UINT
+	};
+
+	// Vertices a 16-bit chunk may reference. 0xFFFF stays unused: it is the strip cut value,
+	// and feature level 9_1 caps the vertex index below it.
+	static const uint32_t MaxVerticesPer16BitChunk = 0xFFFF;
+
+	enum class IndexPolicy
+	{
+		Automatic,	// 16-bit when every vertex fits, 32-bit otherwise; one chunk either way
+		Split16,	// always 16-bit, split into as many chunks as it takes
+		Always32	// 32-bit, one chunk
+	};
+
+	// One draw: DrawIndexed(indexCount, firstIndex, baseVertex). Indices are relative to
+	// baseVertex, so a 16-bit chunk can sit anywhere in a vertex buffer of any size.
+	struct MeshChunk
+	{
+		uint32_t baseVertex;
+		uint32_t vertexCount;
+		uint32_t firstIndex;
+		uint32_t indexCount;
+	};
+
+	// A mesh laid out for upload: one vertex buffer, one index buffer in format, drawn chunk
+	// by chunk. Only the indices of format are filled.
+	struct IndexedMesh
+	{
+		IndexFormat format;
+		std::vector<MeshVertex> vertices;
+		std::vector<uint16_t> indices16;
+		std::vector<uint32_t> indices32;
+		std::vector<MeshChunk> chunks;
+
+		uint32_t GetIndexCount() const { return (uint32_t)(format == IndexFormat::UInt16 ? indices16.size() : indices32.size()); }
+		uint32_t GetIndexSize() const { return format == IndexFormat::UInt16 ? 2 : 4; }
+		const void* GetIndexData() const;
+	};
+
+	// Picks the index width for a triangle list and, with Split16 (or Automatic on a mesh
+	// that fits), rewrites the indices to 16 bits. Splitting walks the triangles in order and
+	// starts a new chunk when the next triangle would take the chunk past maxChunkVertices;
+	// the vertices a chunk shares with an earlier one are copied into it. On the grids
+	// MeshGenerator writes that is one row of vertices per chunk.
+	// Throws std::invalid_argument if the index count is not a multiple of 3, an index is out
+	// of range, or maxChunkVertices is below 3 or above MaxVerticesPer16BitChunk.
+	IndexedMesh BuildIndexedMesh(const MeshData& mesh, IndexPolicy policy = IndexPolicy::Automatic, uint32_t maxChunkVertices = MaxVerticesPer16BitChunk);
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct MeshIndexingReport
+	{
+		uint32_t meshesChecked;
+		uint32_t mismatchedTriangles;		// triangles that do not come back as the source's, over every build
+		uint32_t chunkLimitViolations;		// chunks over the limit or indices past their chunk
+		uint32_t wrongFormats;				// Automatic not picking 16-bit when it fits, or 32-bit when it does not
+		uint32_t truncatedTriangles;		// large mesh: triangles a plain cast to WORD would have broken
+		uint32_t largeVertices;
+		uint32_t largeChunks;				// Split16 chunks of the large mesh
+		uint64_t bytes32;					// large mesh, one 32-bit chunk: vertices plus indices
+		uint64_t bytesSplit16;				// large mesh, split into 16-bit chunks
+	};
+
+	// Builds tori either side of 65,535 vertices and a large one with every policy and
+	// checks every triangle against the source, the chunk limits and the format picked.
+	MeshIndexingReport ValidateMeshIndexing(uint32_t largeVertices = 1000000);
+#endif
+}
@@ -0,0 +1,599 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+using namespace DirectXGame1;
+
+namespace
+{
+	const uint32_t NoVertex = 0xFFFFFFFF;
+
+	// Forsyth's constants.
+	const float CacheDecayPower = 1.5f;
+	const float LastTriangleScore = 0.75f;
+	const float ValenceBoostScale = 2.0f;
+	const float ValenceBoostPower = 0.5f;
+	const uint32_t MaxValenceScore = 32;
+	const uint32_t MaxCacheSize = 64;
+
+	void CheckIndices(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount)
+	{
+		if (indexCount % 3 != 0)
+		{
+			throw std::invalid_argument("index count is not a whole number of triangles");
+		}
+		for (uint32_t i = 0; i < indexCount; i++)
+		{
+			if (indices[i] >= vertexCount)
+			{
+				throw std::invalid_argument("index past the end of the vertices");
+			}
+		}
+	}
+
+	// Replays triangles one at a time; Add returns the misses of one triangle, and Missed the
+	// vertices that missed.
+	class CacheSimulator
+	{
+	public:
+		CacheSimulator(uint32_t vertexCount, uint32_t cacheSize, VertexCacheModel model) :
+			m_stamp(model == VertexCacheModel::Fifo ? vertexCount : 0, 0),
+			m_cacheSize(cacheSize),
+			m_model(model),
+			m_clock(cacheSize + 1)
+		{
+		}
+
+		// Empties the cache.
+		void Reset()
+		{
+			m_clock += m_cacheSize + 1;
+			m_lru.clear();
+		}
+
+		uint32_t Add(const uint32_t* triangle)
+		{
+			m_missed.clear();
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t v = triangle[k];
+				bool hit;
+				if (m_model == VertexCacheModel::Fifo)
+				{
+					// The clock only moves on a miss, so a vertex stays for cacheSize misses after it came in.
+					hit = m_clock - m_stamp[v] < m_cacheSize;
+					if (!hit)
+					{
+						m_stamp[v] = m_clock++;
+					}
+				}
+				else
+				{
+					// Most recent first; a hit moves the vertex back to the front.
+					auto it = std::find(m_lru.begin(), m_lru.end(), v);
+					hit = it != m_lru.end();
+					if (hit)
+					{
+						m_lru.erase(it);
+					}
+					else if (m_lru.size() == m_cacheSize)
+					{
+						m_lru.pop_back();
+					}
+					m_lru.insert(m_lru.begin(), v);
+				}
+				if (!hit)
+				{
+					m_missed.push_back(v);
+				}
+			}
+			return (uint32_t)m_missed.size();
+		}
+
+		const std::vector<uint32_t>& Missed() const { return m_missed; }
+
+	private:
+		std::vector<uint64_t> m_stamp;
+		std::vector<uint32_t> m_lru;
+		std::vector<uint32_t> m_missed;
+		uint64_t m_cacheSize;
+		VertexCacheModel m_model;
+		uint64_t m_clock;
+	};
+
+	struct ForsythTables
+	{
+		float cache[MaxCacheSize + 3];
+		float valence[MaxValenceScore + 1];
+	};
+
+	ForsythTables MakeForsythTables(uint32_t cacheSize)
+	{
+		ForsythTables tables;
+		for (uint32_t i = 0; i < cacheSize + 3; i++)
+		{
+			if (i < 3)
+			{
+				// The last triangle's vertices get a fixed score, so the next triangle does not
+				// simply pick whichever of them came in last.
+				tables.cache[i] = LastTriangleScore;
+			}
+			else if (i < cacheSize)
+			{
+				tables.cache[i] = std::pow(1.0f - (float)(i - 3) / (cacheSize - 3), CacheDecayPower);
+			}
+			else
+			{
+				tables.cache[i] = 0.0f;
+			}
+		}
+		tables.valence[0] = 0.0f;
+		for (uint32_t i = 1; i <= MaxValenceScore; i++)
+		{
+			tables.valence[i] = ValenceBoostScale * std::pow((float)i, -ValenceBoostPower);
+		}
+		return tables;
+	}
+
+	float VertexScore(const ForsythTables& tables, int cachePosition, uint32_t remaining)
+	{
+		if (remaining == 0)
+		{
+			return -1.0f;
+		}
+		float score = cachePosition >= 0 ? tables.cache[cachePosition] : 0.0f;
+		return score + tables.valence[std::min(remaining, MaxValenceScore)];
+	}
+
+	void Sub(const float* a, const float* b, float* out)
+	{
+		out[0] = a[0] - b[0];
+		out[1] = a[1] - b[1];
+		out[2] = a[2] - b[2];
+	}
+
+	struct Cluster
+	{
+		uint32_t first;
+		uint32_t count;
+		float sortKey;
+	};
+}
+
+VertexCacheStats DirectXGame1::SimulateVertexCache(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize, VertexCacheModel model)
+{
+	CheckIndices(indices, indexCount, vertexCount);
+	if (cacheSize == 0)
+	{
+		throw std::invalid_argument("vertex cache of size zero");
+	}
+
+	VertexCacheStats stats;
+	stats.triangles = indexCount / 3;
+	stats.transforms = 0;
+	stats.vertices = 0;
+
+	CacheSimulator cache(vertexCount, cacheSize, model);
+	std::vector<bool> used(vertexCount, false);
+	for (uint32_t i = 0; i < indexCount; i += 3)
+	{
+		stats.transforms += cache.Add(indices + i);
+		for (int k = 0; k < 3; k++)
+		{
+			if (!used[indices[i + k]])
+			{
+				used[indices[i + k]] = true;
+				stats.vertices++;
+			}
+		}
+	}
+	stats.acmr = stats.triangles ? (double)stats.transforms / stats.triangles : 0.0;
+	stats.atvr = stats.vertices ? (double)stats.transforms / stats.vertices : 0.0;
+	return stats;
+}
+
+void DirectXGame1::OptimizeVertexCache(uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize)
+{
+	CheckIndices(indices, indexCount, vertexCount);
+	if (cacheSize < 4 || cacheSize > MaxCacheSize)
+	{
+		throw std::invalid_argument("vertex cache size out of range");
+	}
+
+	const uint32_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+	const ForsythTables tables = MakeForsythTables(cacheSize);
+
+	// Triangles of every vertex; the first remaining[v] entries of its range are the ones not
+	// emitted yet.
+	std::vector<uint32_t> remaining(vertexCount, 0);
+	for (uint32_t i = 0; i < indexCount; i++)
+	{
+		remaining[indices[i]]++;
+	}
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		offsets[v + 1] = offsets[v] + remaining[v];
+	}
+	std::vector<uint32_t> adjacency(indexCount);
+	{
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (uint32_t i = 0; i < indexCount; i++)
+		{
+			adjacency[fill[indices[i]]++] = i / 3;
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		vertexScore[v] = VertexScore(tables, -1, remaining[v]);
+	}
+	std::vector<float> triangleScore(triangleCount);
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+	}
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> output(indexCount);
+	uint32_t cache[MaxCacheSize + 3];
+	uint32_t cacheUsed = 0;
+	uint32_t scanCursor = 0;
+	int best = -1;
+
+	for (uint32_t out = 0; out < triangleCount; out++)
+	{
+		// Nothing in the cache leads anywhere: carry on with the next triangle in input order.
+		if (best < 0)
+		{
+			while (emitted[scanCursor])
+			{
+				scanCursor++;
+			}
+			best = (int)scanCursor;
+		}
+
+		const uint32_t* triangle = indices + best * 3;
+		std::memcpy(&output[out * 3], triangle, 3 * sizeof(uint32_t));
+		emitted[best] = true;
+
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t v = triangle[k];
+			uint32_t* list = &adjacency[offsets[v]];
+			uint32_t* end = list + remaining[v];
+			*std::find(list, end, (uint32_t)best) = *(end - 1);
+			remaining[v]--;
+		}
+
+		// The triangle's vertices go to the front of the cache, everything else moves back.
+		uint32_t next[MaxCacheSize + 3];
+		uint32_t nextUsed = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			if (std::find(next, next + nextUsed, triangle[k]) == next + nextUsed)
+			{
+				next[nextUsed++] = triangle[k];
+			}
+		}
+		for (uint32_t i = 0; i < cacheUsed; i++)
+		{
+			if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+			{
+				next[nextUsed++] = cache[i];
+			}
+		}
+
+		// Rescore every vertex that was or is in the cache, and the triangles they are in.
+		best = -1;
+		float bestScore = -1.0f;
+		for (uint32_t i = 0; i < nextUsed; i++)
+		{
+			uint32_t v = next[i];
+			int position = i < cacheSize ? (int)i : -1;
+			cachePosition[v] = position;
+			float score = VertexScore(tables, position, remaining[v]);
+			float delta = score - vertexScore[v];
+			vertexScore[v] = score;
+			for (uint32_t a = 0; a < remaining[v]; a++)
+			{
+				uint32_t t = adjacency[offsets[v] + a];
+				triangleScore[t] += delta;
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					best = (int)t;
+				}
+			}
+		}
+
+		cacheUsed = std::min(nextUsed, cacheSize);
+		std::memcpy(cache, next, cacheUsed * sizeof(uint32_t));
+	}
+
+	std::memcpy(indices, &output[0], indexCount * sizeof(uint32_t));
+}
+
+uint32_t DirectXGame1::OptimizeOverdraw(uint32_t* indices, uint32_t indexCount, const MeshVertex* vertices, uint32_t vertexCount, uint32_t cacheSize, float threshold)
+{
+	CheckIndices(indices, indexCount, vertexCount);
+	const uint32_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return 0;
+	}
+
+	// Hard boundaries: triangles that miss on all three vertices, where the cache has
+	// started over anyway and cutting costs nothing.
+	std::vector<uint32_t> hard;
+	{
+		CacheSimulator cache(vertexCount, cacheSize, VertexCacheModel::Fifo);
+		for (uint32_t t = 0; t < triangleCount; t++)
+		{
+			if (cache.Add(indices + t * 3) == 3 || t == 0)
+			{
+				hard.push_back(t);
+			}
+		}
+		hard.push_back(triangleCount);
+	}
+
+	// Soft boundaries inside each hard cluster: cut (and so start the cache over) as soon as
+	// the piece so far is within threshold of the whole cluster's ACMR.
+	std::vector<Cluster> clusters;
+	CacheSimulator cache(vertexCount, cacheSize, VertexCacheModel::Fifo);
+	for (size_t h = 0; h + 1 < hard.size(); h++)
+	{
+		uint32_t start = hard[h], end = hard[h + 1];
+		cache.Reset();
+		uint32_t clusterMisses = 0;
+		for (uint32_t t = start; t < end; t++)
+		{
+			clusterMisses += cache.Add(indices + t * 3);
+		}
+		float limit = threshold * clusterMisses / (end - start);
+
+		cache.Reset();
+		uint32_t misses = 0;
+		for (uint32_t t = start; t < end; t++)
+		{
+			misses += cache.Add(indices + t * 3);
+			bool cut = t + 1 == end || (float)misses / (t + 1 - start) <= limit;
+			if (cut)
+			{
+				Cluster cluster = { start, t + 1 - start, 0.0f };
+				clusters.push_back(cluster);
+				start = t + 1;
+				misses = 0;
+				cache.Reset();
+			}
+		}
+	}
+
+	// Area-weighted centre of the mesh and of every cluster, and the cluster's mean normal.
+	// The vertex normals give the outward side whatever the winding convention.
+	float meshCentre[3] = { 0.0f, 0.0f, 0.0f };
+	float meshArea = 0.0f;
+	std::vector<float> clusterData(clusters.size() * 7, 0.0f);
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		float* data = &clusterData[c * 7];
+		for (uint32_t t = clusters[c].first; t < clusters[c].first + clusters[c].count; t++)
+		{
+			const float* p0 = vertices[indices[t * 3]].pos;
+			const float* p1 = vertices[indices[t * 3 + 1]].pos;
+			const float* p2 = vertices[indices[t * 3 + 2]].pos;
+			float e1[3], e2[3];
+			Sub(p1, p0, e1);
+			Sub(p2, p0, e2);
+			float cx = e1[1] * e2[2] - e1[2] * e2[1];
+			float cy = e1[2] * e2[0] - e1[0] * e2[2];
+			float cz = e1[0] * e2[1] - e1[1] * e2[0];
+			float area = 0.5f * std::sqrt(cx * cx + cy * cy + cz * cz);
+			for (int k = 0; k < 3; k++)
+			{
+				float centroid = (p0[k] + p1[k] + p2[k]) / 3.0f;
+				data[k] += centroid * area;
+				for (int corner = 0; corner < 3; corner++)
+				{
+					data[3 + k] += vertices[indices[t * 3 + corner]].normal[k] * area;
+				}
+			}
+			data[6] += area;
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			meshCentre[k] += data[k];
+		}
+		meshArea += data[6];
+	}
+	for (int k = 0; k < 3; k++)
+	{
+		meshCentre[k] /= std::max(meshArea, 1e-20f);
+	}
+
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		const float* data = &clusterData[c * 7];
+		float area = std::max(data[6], 1e-20f);
+		float normalLength = std::sqrt(data[3] * data[3] + data[4] * data[4] + data[5] * data[5]);
+		float key = 0.0f;
+		for (int k = 0; k < 3; k++)
+		{
+			key += (data[k] / area - meshCentre[k]) * data[3 + k];
+		}
+		clusters[c].sortKey = normalLength > 0.0f ? key / normalLength : 0.0f;
+	}
+
+	// Outermost first.
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b)
+	{
+		return a.sortKey > b.sortKey;
+	});
+
+	std::vector<uint32_t> output;
+	output.reserve(indexCount);
+	for (const Cluster& cluster : clusters)
+	{
+		output.insert(output.end(), indices + cluster.first * 3, indices + (cluster.first + cluster.count) * 3);
+	}
+	std::memcpy(indices, &output[0], indexCount * sizeof(uint32_t));
+	return (uint32_t)clusters.size();
+}
+
+uint32_t DirectXGame1::OptimizeVertexFetch(uint32_t* indices, uint32_t indexCount, MeshVertex* vertices, uint32_t vertexCount)
+{
+	CheckIndices(indices, indexCount, vertexCount);
+
+	std::vector<uint32_t> remap(vertexCount, NoVertex);
+	std::vector<MeshVertex> reordered;
+	reordered.reserve(vertexCount);
+	for (uint32_t i = 0; i < indexCount; i++)
+	{
+		uint32_t& target = remap[indices[i]];
+		if (target == NoVertex)
+		{
+			target = (uint32_t)reordered.size();
+			reordered.push_back(vertices[indices[i]]);
+		}
+		indices[i] = target;
+	}
+
+	if (!reordered.empty())
+	{
+		std::memcpy(vertices, &reordered[0], reordered.size() * sizeof(MeshVertex));
+	}
+	return (uint32_t)reordered.size();
+}
+
+void DirectXGame1::OptimizeMesh(MeshData& mesh, uint32_t cacheSize)
+{
+	OptimizeVertexCache(mesh.indices, mesh.indexCount, mesh.vertexCount, cacheSize);
+	OptimizeOverdraw(mesh.indices, mesh.indexCount, mesh.vertices, mesh.vertexCount, cacheSize);
+	mesh.vertexCount = OptimizeVertexFetch(mesh.indices, mesh.indexCount, mesh.vertices, mesh.vertexCount);
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+namespace
+{
+	// Bytes of vertex data read for the vertices a FIFO post-transform cache misses, through
+	// a small LRU cache of 64-byte lines, over the size of the vertex buffer. 1 means every
+	// line was read once.
+	double VertexFetchOverfetch(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize)
+	{
+		const uint32_t LineSize = 64;
+		const size_t LineCacheSize = 64;
+
+		CacheSimulator cache(vertexCount, cacheSize, VertexCacheModel::Fifo);
+		std::vector<uint64_t> lines;
+		uint64_t fetched = 0;
+		for (uint32_t i = 0; i < indexCount; i += 3)
+		{
+			cache.Add(indices + i);
+			for (uint32_t v : cache.Missed())
+			{
+				uint64_t first = (uint64_t)v * sizeof(MeshVertex) / LineSize;
+				uint64_t last = ((uint64_t)(v + 1) * sizeof(MeshVertex) - 1) / LineSize;
+				for (uint64_t line = first; line <= last; line++)
+				{
+					auto it = std::find(lines.begin(), lines.end(), line);
+					if (it != lines.end())
+					{
+						lines.erase(it);
+					}
+					else
+					{
+						fetched += LineSize;
+						if (lines.size() == LineCacheSize)
+						{
+							lines.pop_back();
+						}
+					}
+					lines.insert(lines.begin(), line);
+				}
+			}
+		}
+		return vertexCount ? (double)fetched / ((uint64_t)vertexCount * sizeof(MeshVertex)) : 0.0;
+	}
+
+	// The triangles of a list, each rotated to start at its smallest index (which keeps the
+	// winding), sorted.
+	std::vector<uint64_t> CanonicalTriangles(const std::vector<uint32_t>& indices)
+	{
+		std::vector<uint64_t> triangles;
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+			while (a > b || a > c)
+			{
+				uint32_t t = a; a = b; b = c; c = t;
+			}
+			// 21 bits each is plenty for the meshes checked here.
+			triangles.push_back(((uint64_t)a << 42) | ((uint64_t)b << 21) | c);
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+}
+
+MeshOptimizationReport DirectXGame1::ReportMeshOptimization(unsigned int rows, unsigned int columns, uint32_t cacheSize)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	MeshOptimizationReport report;
+	MeshShapeDesc desc = MeshShapeDesc::Torus(rows, columns, 0.6f, 0.2f);
+	std::vector<MeshVertex> vertices(MeshVertexCount(desc));
+	std::vector<uint32_t> indices(MeshIndexCount(desc));
+	GenerateMesh(desc, &vertices[0], &indices[0]);
+	if (vertices.size() >= (1u << 21))
+	{
+		throw std::invalid_argument("mesh too large for the triangle comparison");
+	}
+
+	const std::vector<MeshVertex> original = vertices;
+	report.vertices = (uint32_t)vertices.size();
+	report.triangles = (uint32_t)indices.size() / 3;
+	report.fifoBefore = SimulateVertexCache(&indices[0], (uint32_t)indices.size(), report.vertices, cacheSize, VertexCacheModel::Fifo);
+	report.lruBefore = SimulateVertexCache(&indices[0], (uint32_t)indices.size(), report.vertices, cacheSize, VertexCacheModel::Lru);
+	report.overfetchBefore = VertexFetchOverfetch(&indices[0], (uint32_t)indices.size(), report.vertices, cacheSize);
+	const std::vector<uint64_t> before = CanonicalTriangles(indices);
+
+	auto start = Clock::now();
+	OptimizeVertexCache(&indices[0], (uint32_t)indices.size(), report.vertices, cacheSize);
+	double cacheMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	report.fifoAfterCacheOnly = SimulateVertexCache(&indices[0], (uint32_t)indices.size(), report.vertices, cacheSize, VertexCacheModel::Fifo);
+
+	start = Clock::now();
+	report.clusters = OptimizeOverdraw(&indices[0], (uint32_t)indices.size(), &vertices[0], report.vertices, cacheSize);
+	double overdrawMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	report.trianglesPreserved = CanonicalTriangles(indices) == before;
+
+	const std::vector<uint32_t> beforeFetch = indices;
+	report.overfetchUnordered = VertexFetchOverfetch(&indices[0], (uint32_t)indices.size(), report.vertices, cacheSize);
+	start = Clock::now();
+	uint32_t kept = OptimizeVertexFetch(&indices[0], (uint32_t)indices.size(), &vertices[0], report.vertices);
+	report.milliseconds = cacheMilliseconds + overdrawMilliseconds + std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	// The fetch reorder must leave every corner pointing at the same vertex data.
+	for (size_t i = 0; i < indices.size() && report.trianglesPreserved; i++)
+	{
+		report.trianglesPreserved = std::memcmp(&vertices[indices[i]], &original[beforeFetch[i]], sizeof(MeshVertex)) == 0;
+	}
+
+	report.fifoAfter = SimulateVertexCache(&indices[0], (uint32_t)indices.size(), kept, cacheSize, VertexCacheModel::Fifo);
+	report.lruAfter = SimulateVertexCache(&indices[0], (uint32_t)indices.size(), kept, cacheSize, VertexCacheModel::Lru);
+	report.overfetchAfter = VertexFetchOverfetch(&indices[0], (uint32_t)indices.size(), kept, cacheSize);
+	return report;
+}
+#endif
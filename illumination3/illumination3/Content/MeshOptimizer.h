@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include "MeshGenerator.h"
+
+namespace DirectXGame1
+{
+	enum class VertexCacheModel
+	{
+		Fifo,	// what most hardware post-transform caches behave like
+		Lru
+	};
+
+	// A post-transform cache replayed over a triangle list.
+	struct VertexCacheStats
+	{
+		uint32_t triangles;
+		uint32_t transforms;	// cache misses: vertices the vertex shader runs on
+		uint32_t vertices;		// distinct vertices referenced
+		double acmr;			// transforms per triangle: 0.5 is the best a large grid can do, 3 the worst
+		double atvr;			// transforms per vertex: 1 is the best
+	};
+
+	VertexCacheStats SimulateVertexCache(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize, VertexCacheModel model = VertexCacheModel::Fifo);
+
+	// Default cache size the optimizers aim at; small enough to also suit old hardware.
+	static const uint32_t DefaultVertexCacheSize = 16;
+
+	// Forsyth's linear-speed vertex cache optimization: repeatedly emits the triangle with the
+	// best score, scoring vertices by their position in a simulated LRU cache and by how many
+	// triangles still use them. Rewrites indices in place; the triangles keep their winding.
+	void OptimizeVertexCache(uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize = DefaultVertexCacheSize);
+
+	// Cuts a cache-optimized list into clusters wherever the cache starts over (or could be
+	// made to, at a cost of at most threshold times the cluster's ACMR), then puts the clusters
+	// that face away from the mesh's centre first, so they tend to cover the ones drawn after.
+	// Returns the number of clusters.
+	uint32_t OptimizeOverdraw(uint32_t* indices, uint32_t indexCount, const MeshVertex* vertices, uint32_t vertexCount, uint32_t cacheSize = DefaultVertexCacheSize, float threshold = 1.05f);
+
+	// Reorders the vertices into the order the indices first use them, so vertex fetch walks
+	// memory forwards. Unreferenced vertices are dropped; returns the new vertex count.
+	uint32_t OptimizeVertexFetch(uint32_t* indices, uint32_t indexCount, MeshVertex* vertices, uint32_t vertexCount);
+
+	// All three in order. mesh.vertexCount is updated if vertices were dropped.
+	void OptimizeMesh(MeshData& mesh, uint32_t cacheSize = DefaultVertexCacheSize);
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct MeshOptimizationReport
+	{
+		uint32_t vertices;
+		uint32_t triangles;
+		VertexCacheStats fifoBefore;			// row order, as generated
+		VertexCacheStats fifoAfter;
+		VertexCacheStats lruBefore;
+		VertexCacheStats lruAfter;
+		VertexCacheStats fifoAfterCacheOnly;	// after OptimizeVertexCache, before the overdraw reorder
+		uint32_t clusters;
+		double overfetchBefore;					// vertex bytes read through a 4 KB line cache over the buffer size
+		double overfetchUnordered;				// after the cache and overdraw passes, vertices still in grid order
+		double overfetchAfter;
+		bool trianglesPreserved;				// same triangles with the same winding, in any order
+		double milliseconds;					// the three passes
+	};
+
+	// Optimizes a rows x columns torus and replays it through FIFO and LRU caches of cacheSize.
+	MeshOptimizationReport ReportMeshOptimization(unsigned int rows = 300, unsigned int columns = 100, uint32_t cacheSize = DefaultVertexCacheSize);
+#endif
+}
@@ -0,0 +1,632 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+
+using namespace DirectXGame1;
+
+namespace
+{
+	// Open edges weigh this much more than the faces beside them.
+	const double BoundaryWeight = 10.0;
+	// A collapse may not turn a triangle further than this (cosine of the angle).
+	const double MinNormalCosine = 0.2;
+
+	struct Vector3
+	{
+		double x, y, z;
+	};
+
+	Vector3 Load(const float* p)
+	{
+		Vector3 v = { p[0], p[1], p[2] };
+		return v;
+	}
+
+	Vector3 operator-(const Vector3& a, const Vector3& b)	{ Vector3 v = { a.x - b.x, a.y - b.y, a.z - b.z }; return v; }
+	Vector3 operator+(const Vector3& a, const Vector3& b)	{ Vector3 v = { a.x + b.x, a.y + b.y, a.z + b.z }; return v; }
+	Vector3 operator*(const Vector3& a, double s)			{ Vector3 v = { a.x * s, a.y * s, a.z * s }; return v; }
+	double Dot(const Vector3& a, const Vector3& b)			{ return a.x * b.x + a.y * b.y + a.z * b.z; }
+	double Length(const Vector3& a)							{ return std::sqrt(Dot(a, a)); }
+
+	Vector3 Cross(const Vector3& a, const Vector3& b)
+	{
+		Vector3 v = { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+		return v;
+	}
+
+	// Symmetric 4x4 matrix of a sum of squared plane distances.
+	struct Quadric
+	{
+		double a[10];
+
+		Quadric() { std::fill(a, a + 10, 0.0); }
+
+		// Plane n.p + d = 0 with unit n, weighted.
+		void AddPlane(const Vector3& n, double d, double weight)
+		{
+			const double p[4] = { n.x, n.y, n.z, d };
+			int k = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				for (int j = i; j < 4; j++)
+				{
+					a[k++] += weight * p[i] * p[j];
+				}
+			}
+		}
+
+		void Add(const Quadric& q)
+		{
+			for (int i = 0; i < 10; i++)
+			{
+				a[i] += q.a[i];
+			}
+		}
+
+		double Evaluate(const Vector3& v) const
+		{
+			// [x y z 1] Q [x y z 1]^T with Q stored as its upper triangle, row by row.
+			double e = a[0] * v.x * v.x + 2.0 * a[1] * v.x * v.y + 2.0 * a[2] * v.x * v.z + 2.0 * a[3] * v.x
+				+ a[4] * v.y * v.y + 2.0 * a[5] * v.y * v.z + 2.0 * a[6] * v.y
+				+ a[7] * v.z * v.z + 2.0 * a[8] * v.z
+				+ a[9];
+			return std::max(e, 0.0);
+		}
+	};
+
+	// Distance from p to triangle abc (Ericson, Real-Time Collision Detection 5.1.5).
+	double PointTriangleDistance(const Vector3& p, const Vector3& a, const Vector3& b, const Vector3& c)
+	{
+		Vector3 ab = b - a, ac = c - a, ap = p - a;
+		double d1 = Dot(ab, ap), d2 = Dot(ac, ap);
+		if (d1 <= 0.0 && d2 <= 0.0) return Length(p - a);
+		Vector3 bp = p - b;
+		double d3 = Dot(ab, bp), d4 = Dot(ac, bp);
+		if (d3 >= 0.0 && d4 <= d3) return Length(p - b);
+		double vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) return Length(p - (a + ab * (d1 / (d1 - d3))));
+		Vector3 cp = p - c;
+		double d5 = Dot(ab, cp), d6 = Dot(ac, cp);
+		if (d6 >= 0.0 && d5 <= d6) return Length(p - c);
+		double vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) return Length(p - (a + ac * (d2 / (d2 - d6))));
+		double va = d3 * d6 - d5 * d4;
+		if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0)
+		{
+			return Length(p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+		}
+		double denominator = 1.0 / (va + vb + vc);
+		return Length(p - (a + ab * (vb * denominator) + ac * (vc * denominator)));
+	}
+
+	struct Collapse
+	{
+		double cost;
+		uint32_t from, to;
+		uint32_t fromStamp, toStamp;
+
+		bool operator>(const Collapse& other) const { return cost > other.cost; }
+	};
+
+	class Simplifier
+	{
+	public:
+		Simplifier(const MeshVertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount) :
+			m_positions(vertexCount),
+			m_quadrics(vertexCount),
+			m_triangles(indices, indices + indexCount),
+			m_alive(indexCount / 3, true),
+			m_aliveTriangles(indexCount / 3),
+			m_vertexTriangles(vertexCount),
+			m_stamp(vertexCount, 0),
+			m_removed(vertexCount, false),
+			m_parent(vertexCount)
+		{
+			for (uint32_t v = 0; v < vertexCount; v++)
+			{
+				m_parent[v] = v;
+				m_positions[v] = Load(vertices[v].pos);
+			}
+			for (uint32_t t = 0; t < indexCount / 3; t++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					m_vertexTriangles[m_triangles[t * 3 + k]].push_back(t);
+				}
+			}
+			BuildQuadrics();
+			for (uint32_t v = 0; v < vertexCount; v++)
+			{
+				PushEdges(v);
+			}
+		}
+
+		uint32_t AliveTriangles() const { return m_aliveTriangles; }
+
+		// Collapses until at most target triangles are left; false if it had to stop short.
+		bool SimplifyTo(uint32_t target)
+		{
+			while (m_aliveTriangles > target)
+			{
+				if (m_heap.empty())
+				{
+					return false;
+				}
+				Collapse collapse = m_heap.top();
+				m_heap.pop();
+				if (m_removed[collapse.from] || m_removed[collapse.to] ||
+					m_stamp[collapse.from] != collapse.fromStamp || m_stamp[collapse.to] != collapse.toStamp)
+				{
+					continue;
+				}
+				if (!CanCollapse(collapse.from, collapse.to))
+				{
+					continue;
+				}
+				Apply(collapse.from, collapse.to);
+			}
+			return true;
+		}
+
+		void AppendTriangles(std::vector<uint32_t>& out) const
+		{
+			for (uint32_t t = 0; t < m_alive.size(); t++)
+			{
+				if (m_alive[t])
+				{
+					out.insert(out.end(), m_triangles.begin() + t * 3, m_triangles.begin() + t * 3 + 3);
+				}
+			}
+		}
+
+		// Largest distance from an original vertex to the triangles around the vertex it was
+		// collapsed into and that vertex's neighbours. The whole surface can only be closer.
+		double ErrorBound()
+		{
+			double bound = 0.0;
+			std::vector<uint32_t> ring, triangles;
+			for (uint32_t v = 0; v < m_parent.size(); v++)
+			{
+				if (!m_removed[v])
+				{
+					continue;
+				}
+				uint32_t kept = Representative(v);
+				Neighbours(kept, ring);
+				ring.push_back(kept);
+				triangles.clear();
+				for (uint32_t w : ring)
+				{
+					triangles.insert(triangles.end(), m_vertexTriangles[w].begin(), m_vertexTriangles[w].end());
+				}
+				double nearest = 1e30;
+				for (uint32_t t : triangles)
+				{
+					const uint32_t* tri = &m_triangles[t * 3];
+					nearest = std::min(nearest, PointTriangleDistance(m_positions[v], m_positions[tri[0]], m_positions[tri[1]], m_positions[tri[2]]));
+				}
+				bound = std::max(bound, nearest);
+			}
+			return bound;
+		}
+
+	private:
+		uint32_t Representative(uint32_t v)
+		{
+			uint32_t root = v;
+			while (m_parent[root] != root)
+			{
+				root = m_parent[root];
+			}
+			while (m_parent[v] != root)
+			{
+				uint32_t next = m_parent[v];
+				m_parent[v] = root;
+				v = next;
+			}
+			return root;
+		}
+
+		Vector3 TriangleNormal(uint32_t t, Vector3* unnormalized = nullptr) const
+		{
+			const uint32_t* tri = &m_triangles[t * 3];
+			Vector3 n = Cross(m_positions[tri[1]] - m_positions[tri[0]], m_positions[tri[2]] - m_positions[tri[0]]);
+			if (unnormalized)
+			{
+				*unnormalized = n;
+			}
+			double length = Length(n);
+			return length > 0.0 ? n * (1.0 / length) : n;
+		}
+
+		void BuildQuadrics()
+		{
+			// Open edges: the ones only one triangle has. Counted as sorted vertex pairs.
+			std::vector<uint64_t> edges;
+			for (uint32_t t = 0; t < m_alive.size(); t++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					uint32_t a = m_triangles[t * 3 + k], b = m_triangles[t * 3 + (k + 1) % 3];
+					edges.push_back(((uint64_t)std::min(a, b) << 32) | std::max(a, b));
+				}
+			}
+			std::sort(edges.begin(), edges.end());
+
+			for (uint32_t t = 0; t < m_alive.size(); t++)
+			{
+				Vector3 cross;
+				Vector3 n = TriangleNormal(t, &cross);
+				double area = 0.5 * Length(cross);
+				const uint32_t* tri = &m_triangles[t * 3];
+				double d = -Dot(n, m_positions[tri[0]]);
+				for (int k = 0; k < 3; k++)
+				{
+					m_quadrics[tri[k]].AddPlane(n, d, area);
+				}
+
+				for (int k = 0; k < 3; k++)
+				{
+					uint32_t a = tri[k], b = tri[(k + 1) % 3];
+					uint64_t key = ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+					auto range = std::equal_range(edges.begin(), edges.end(), key);
+					if (range.second - range.first != 1)
+					{
+						continue;
+					}
+					// A plane through the edge, square to the face.
+					Vector3 edge = m_positions[b] - m_positions[a];
+					Vector3 side = Cross(edge, n);
+					double length = Length(side);
+					if (length == 0.0)
+					{
+						continue;
+					}
+					side = side * (1.0 / length);
+					double weight = BoundaryWeight * Dot(edge, edge);
+					m_quadrics[a].AddPlane(side, -Dot(side, m_positions[a]), weight);
+					m_quadrics[b].AddPlane(side, -Dot(side, m_positions[a]), weight);
+				}
+			}
+		}
+
+		void Neighbours(uint32_t v, std::vector<uint32_t>& out) const
+		{
+			out.clear();
+			for (uint32_t t : m_vertexTriangles[v])
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					uint32_t w = m_triangles[t * 3 + k];
+					if (w != v)
+					{
+						out.push_back(w);
+					}
+				}
+			}
+			std::sort(out.begin(), out.end());
+			out.erase(std::unique(out.begin(), out.end()), out.end());
+		}
+
+		void PushEdges(uint32_t v)
+		{
+			std::vector<uint32_t> neighbours;
+			Neighbours(v, neighbours);
+			for (uint32_t w : neighbours)
+			{
+				Quadric q = m_quadrics[v];
+				q.Add(m_quadrics[w]);
+				// Both directions; the queue sorts out which is cheaper.
+				Collapse vw = { q.Evaluate(m_positions[w]), v, w, m_stamp[v], m_stamp[w] };
+				Collapse wv = { q.Evaluate(m_positions[v]), w, v, m_stamp[w], m_stamp[v] };
+				m_heap.push(vw);
+				m_heap.push(wv);
+			}
+		}
+
+		bool CanCollapse(uint32_t from, uint32_t to) const
+		{
+			// Link condition: the only vertices next to both ends are the third corners of the
+			// triangles on the edge. Anything else would pinch the surface.
+			std::vector<uint32_t> fromNeighbours, toNeighbours, shared;
+			Neighbours(from, fromNeighbours);
+			Neighbours(to, toNeighbours);
+			std::set_intersection(fromNeighbours.begin(), fromNeighbours.end(), toNeighbours.begin(), toNeighbours.end(), std::back_inserter(shared));
+			uint32_t edgeTriangles = 0;
+			for (uint32_t t : m_vertexTriangles[from])
+			{
+				const uint32_t* tri = &m_triangles[t * 3];
+				if (tri[0] == to || tri[1] == to || tri[2] == to)
+				{
+					edgeTriangles++;
+				}
+			}
+			if (edgeTriangles == 0 || shared.size() != edgeTriangles)
+			{
+				return false;
+			}
+
+			// No triangle that survives may turn over (or close to it).
+			for (uint32_t t : m_vertexTriangles[from])
+			{
+				const uint32_t* tri = &m_triangles[t * 3];
+				if (tri[0] == to || tri[1] == to || tri[2] == to)
+				{
+					continue;
+				}
+				Vector3 before = TriangleNormal(t);
+				Vector3 p[3];
+				for (int k = 0; k < 3; k++)
+				{
+					p[k] = m_positions[tri[k] == from ? to : tri[k]];
+				}
+				Vector3 after = Cross(p[1] - p[0], p[2] - p[0]);
+				double length = Length(after);
+				if (length == 0.0 || Dot(before, after) < MinNormalCosine * length * Length(before))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		void Apply(uint32_t from, uint32_t to)
+		{
+			for (uint32_t t : m_vertexTriangles[from])
+			{
+				uint32_t* tri = &m_triangles[t * 3];
+				if (tri[0] == to || tri[1] == to || tri[2] == to)
+				{
+					m_alive[t] = false;
+					m_aliveTriangles--;
+					std::vector<uint32_t>& list = m_vertexTriangles[to];
+					list.erase(std::find(list.begin(), list.end(), t));
+					// The third corner loses the triangle too.
+					for (int k = 0; k < 3; k++)
+					{
+						if (tri[k] != from && tri[k] != to)
+						{
+							std::vector<uint32_t>& third = m_vertexTriangles[tri[k]];
+							third.erase(std::find(third.begin(), third.end(), t));
+						}
+					}
+				}
+				else
+				{
+					for (int k = 0; k < 3; k++)
+					{
+						if (tri[k] == from)
+						{
+							tri[k] = to;
+						}
+					}
+					m_vertexTriangles[to].push_back(t);
+				}
+			}
+			m_vertexTriangles[from].clear();
+			m_removed[from] = true;
+			m_parent[from] = to;
+			m_quadrics[to].Add(m_quadrics[from]);
+
+			// Everything around the kept vertex has new costs.
+			std::vector<uint32_t> neighbours;
+			Neighbours(to, neighbours);
+			m_stamp[to]++;
+			for (uint32_t w : neighbours)
+			{
+				m_stamp[w]++;
+			}
+			PushEdges(to);
+			for (uint32_t w : neighbours)
+			{
+				PushEdges(w);
+			}
+		}
+
+		std::vector<Vector3> m_positions;
+		std::vector<Quadric> m_quadrics;
+		std::vector<uint32_t> m_triangles;
+		std::vector<bool> m_alive;
+		uint32_t m_aliveTriangles;
+		std::vector<std::vector<uint32_t>> m_vertexTriangles;
+		std::vector<uint32_t> m_stamp;
+		std::vector<bool> m_removed;
+		std::vector<uint32_t> m_parent;		// the vertex a removed one collapsed into
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> m_heap;
+	};
+}
+
+MeshLodChain DirectXGame1::BuildMeshLods(const MeshVertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, const MeshLodSettings& settings)
+{
+	if (indexCount % 3 != 0)
+	{
+		throw std::invalid_argument("index count is not a whole number of triangles");
+	}
+	for (uint32_t i = 0; i < indexCount; i++)
+	{
+		if (indices[i] >= vertexCount)
+		{
+			throw std::invalid_argument("index past the end of the vertices");
+		}
+	}
+	if (!(settings.reduction > 0.0f && settings.reduction < 1.0f))
+	{
+		throw std::invalid_argument("LOD reduction must be in (0, 1)");
+	}
+
+	MeshLodChain chain;
+	chain.indices.assign(indices, indices + indexCount);
+	MeshLod base = { 0, indexCount, 0.0f };
+	chain.lods.push_back(base);
+
+	Simplifier simplifier(vertices, vertexCount, indices, indexCount);
+	double target = indexCount / 3;
+	for (unsigned int level = 1; level <= settings.levels; level++)
+	{
+		target *= settings.reduction;
+		simplifier.SimplifyTo((uint32_t)std::max(target, 1.0));
+
+		MeshLod lod;
+		lod.firstIndex = (uint32_t)chain.indices.size();
+		simplifier.AppendTriangles(chain.indices);
+		lod.indexCount = (uint32_t)chain.indices.size() - lod.firstIndex;
+		lod.errorBound = (float)simplifier.ErrorBound();
+		chain.lods.push_back(lod);
+	}
+	return chain;
+}
+
+float DirectXGame1::PixelsPerUnit(float distance, float fovY, float viewportHeight)
+{
+	return viewportHeight / (2.0f * std::tan(0.5f * fovY) * std::max(distance, 1e-6f));
+}
+
+unsigned int DirectXGame1::SelectMeshLod(const std::vector<MeshLod>& lods, float pixelsPerUnit, unsigned int currentLod, float maxPixelError, float hysteresis)
+{
+	if (lods.empty())
+	{
+		return 0;
+	}
+	currentLod = std::min(currentLod, (unsigned int)lods.size() - 1);
+
+	// Coarsest level under budget. The bounds mostly grow with the level, but not always.
+	auto coarsestUnder = [&](float budget) -> unsigned int
+	{
+		unsigned int level = 0;
+		for (unsigned int i = 1; i < lods.size(); i++)
+		{
+			if (lods[i].errorBound * pixelsPerUnit <= budget)
+			{
+				level = i;
+			}
+		}
+		return level;
+	};
+
+	unsigned int desired = coarsestUnder(maxPixelError);
+	if (desired < currentLod)
+	{
+		// The current level shows: go finer straight away.
+		return desired;
+	}
+	return std::max(currentLod, coarsestUnder(maxPixelError * (1.0f - hysteresis)));
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+namespace
+{
+	std::vector<MeshLodLevelReport> CheckChain(const std::vector<MeshVertex>& vertices, const MeshLodChain& chain, float reduction, bool& boundsHold, bool& reductionsMet)
+	{
+		std::vector<MeshLodLevelReport> levels;
+		const uint32_t baseTriangles = chain.lods[0].indexCount / 3;
+		for (size_t l = 0; l < chain.lods.size(); l++)
+		{
+			const MeshLod& lod = chain.lods[l];
+			MeshLodLevelReport level;
+			level.triangles = lod.indexCount / 3;
+			level.triangleRatio = (float)level.triangles / baseTriangles;
+			level.errorBound = lod.errorBound;
+			level.degenerateTriangles = 0;
+
+			std::vector<Vector3> a, b, c;
+			for (uint32_t i = lod.firstIndex; i < lod.firstIndex + lod.indexCount; i += 3)
+			{
+				uint32_t i0 = chain.indices[i], i1 = chain.indices[i + 1], i2 = chain.indices[i + 2];
+				if (i0 == i1 || i1 == i2 || i0 == i2)
+				{
+					level.degenerateTriangles++;
+				}
+				a.push_back(Load(vertices[i0].pos));
+				b.push_back(Load(vertices[i1].pos));
+				c.push_back(Load(vertices[i2].pos));
+			}
+
+			double measured = 0.0;
+			for (const MeshVertex& vertex : vertices)
+			{
+				Vector3 p = Load(vertex.pos);
+				double nearest = 1e30;
+				for (size_t t = 0; t < a.size() && nearest > measured; t++)
+				{
+					nearest = std::min(nearest, PointTriangleDistance(p, a[t], b[t], c[t]));
+				}
+				measured = std::max(measured, nearest);
+			}
+			level.measuredError = (float)measured;
+
+			// A little slack for the float positions.
+			boundsHold = boundsHold && level.measuredError <= level.errorBound + 1e-6f;
+			double expected = std::pow((double)reduction, (double)l);
+			reductionsMet = reductionsMet && std::fabs(level.triangleRatio - expected) <= 0.1 * expected;
+			levels.push_back(level);
+		}
+		return levels;
+	}
+}
+
+MeshLodReport DirectXGame1::ValidateMeshLods()
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	MeshLodReport report;
+	report.boundsHold = true;
+	report.reductionsMet = true;
+	MeshLodSettings settings;
+
+	const MeshShapeDesc descs[3] = {
+		MeshShapeDesc::Torus(90, 30, 0.6f, 0.2f),
+		MeshShapeDesc::Sphere(64, 32, 0.5f),
+		MeshShapeDesc::Plane(40, 40, 1.0f) };
+	std::vector<MeshLodLevelReport>* outputs[3] = { &report.torus, &report.sphere, &report.plane };
+
+	MeshLodChain torusChain;
+	for (int s = 0; s < 3; s++)
+	{
+		std::vector<MeshVertex> vertices(MeshVertexCount(descs[s]));
+		std::vector<uint32_t> indices(MeshIndexCount(descs[s]));
+		GenerateMesh(descs[s], &vertices[0], &indices[0]);
+		if (descs[s].shape == MeshShape::Plane)
+		{
+			// Give the flat grid something to keep: a gentle bump.
+			for (MeshVertex& vertex : vertices)
+			{
+				vertex.pos[2] = 0.2f * std::exp(-4.0f * (vertex.pos[0] * vertex.pos[0] + vertex.pos[1] * vertex.pos[1]));
+			}
+		}
+
+		auto start = Clock::now();
+		MeshLodChain chain = BuildMeshLods(&vertices[0], (uint32_t)vertices.size(), &indices[0], (uint32_t)indices.size(), settings);
+		if (s == 0)
+		{
+			report.buildMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			torusChain = chain;
+		}
+		*outputs[s] = CheckChain(vertices, chain, settings.reduction, report.boundsHold, report.reductionsMet);
+	}
+
+	// A camera drifting between 0.5 and 20 units with a little jitter, at 1080 lines and the
+	// renderer's 70 degree field of view.
+	report.hysteresisSwitches = 0;
+	report.instantSwitches = 0;
+	unsigned int withHysteresis = 0, without = 0;
+	const float fovY = 70.0f * 3.14159265f / 180.0f;
+	for (int frame = 0; frame < 4000; frame++)
+	{
+		float distance = 10.25f - 9.75f * std::cos(frame * 0.005f) + 0.05f * std::sin(frame * 1.7f);
+		float pixelsPerUnit = PixelsPerUnit(distance, fovY, 1080.0f);
+		unsigned int next = SelectMeshLod(torusChain.lods, pixelsPerUnit, withHysteresis);
+		report.hysteresisSwitches += next != withHysteresis ? 1 : 0;
+		withHysteresis = next;
+		next = SelectMeshLod(torusChain.lods, pixelsPerUnit, without, 1.0f, 0.0f);
+		report.instantSwitches += next != without ? 1 : 0;
+		without = next;
+	}
+
+	return report;
+}
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "MeshGenerator.h"
+
+namespace DirectXGame1
+{
+	// One level of detail: a range of MeshLodChain::indices into the original vertices.
+	struct MeshLod
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		// No original vertex is further than this from the level's surface, in object units.
+		float errorBound;
+	};
+
+	// Level 0 is the mesh as given. The simplified levels only drop vertices, never move
+	// them, so every level indexes the same vertex array.
+	struct MeshLodChain
+	{
+		std::vector<uint32_t> indices;
+		std::vector<MeshLod> lods;
+	};
+
+	struct MeshLodSettings
+	{
+		MeshLodSettings() : levels(4), reduction(0.5f) {}
+
+		unsigned int levels;	// simplified levels after level 0
+		float reduction;		// triangles of each level over the one before
+	};
+
+	// Garland-Heckbert quadric error simplification by half-edge collapses: the edge whose
+	// collapse into one of its ends adds the least quadric error goes first. Collapses that
+	// would flip a triangle or make the surface non-manifold are skipped, and open edges (the
+	// plane's) carry an extra quadric that keeps the outline in place. A level stops early
+	// when no collapse is left that passes those checks. The error bounds are measured from
+	// each removed vertex to the triangles around the vertex it ended up in, which can only
+	// overestimate its distance to the whole level.
+	MeshLodChain BuildMeshLods(const MeshVertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, const MeshLodSettings& settings = MeshLodSettings());
+
+	// Pixels one object-space unit covers at distance from a camera with vertical field of
+	// view fovY rendering to a target viewportHeight pixels tall.
+	float PixelsPerUnit(float distance, float fovY, float viewportHeight);
+
+	// The coarsest level whose error bound stays under maxPixelError pixels. A finer level is
+	// taken as soon as the current one goes over; a coarser one only once it is under
+	// (1 - hysteresis) of the budget, so an object sitting at a threshold does not flicker.
+	unsigned int SelectMeshLod(const std::vector<MeshLod>& lods, float pixelsPerUnit, unsigned int currentLod, float maxPixelError = 1.0f, float hysteresis = 0.25f);
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct MeshLodLevelReport
+	{
+		uint32_t triangles;
+		float triangleRatio;		// over level 0
+		float errorBound;
+		float measuredError;		// largest distance from an original vertex to the level's surface
+		uint32_t degenerateTriangles;
+	};
+
+	struct MeshLodReport
+	{
+		std::vector<MeshLodLevelReport> torus;		// the renderer's 90 x 30 torus
+		std::vector<MeshLodLevelReport> sphere;
+		std::vector<MeshLodLevelReport> plane;		// open edges
+		bool boundsHold;							// measuredError <= errorBound everywhere
+		bool reductionsMet;							// every level within 10% of its triangle target
+		uint32_t hysteresisSwitches;				// LOD changes over a slow back-and-forth dolly
+		uint32_t instantSwitches;					// the same without hysteresis
+		double buildMilliseconds;					// the torus chain
+	};
+
+	// Builds chains for three shapes and checks them by brute force, then replays a camera
+	// drifting back and forth across the switching distances with and without hysteresis.
+	MeshLodReport ValidateMeshLods();
+#endif
+}
@@ -0,0 +1,441 @@
+#include "Meshlets.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include "MeshOptimizer.h"
+
+using namespace DirectXGame1;
+
+namespace
+{
+	struct Vector3
+	{
+		float x, y, z;
+	};
+
+	Vector3 Load(const float* p)								{ Vector3 v = { p[0], p[1], p[2] }; return v; }
+	Vector3 operator-(const Vector3& a, const Vector3& b)		{ Vector3 v = { a.x - b.x, a.y - b.y, a.z - b.z }; return v; }
+	Vector3 operator+(const Vector3& a, const Vector3& b)		{ Vector3 v = { a.x + b.x, a.y + b.y, a.z + b.z }; return v; }
+	Vector3 operator*(const Vector3& a, float s)				{ Vector3 v = { a.x * s, a.y * s, a.z * s }; return v; }
+	float Dot(const Vector3& a, const Vector3& b)				{ return a.x * b.x + a.y * b.y + a.z * b.z; }
+	float Length(const Vector3& a)								{ return std::sqrt(Dot(a, a)); }
+
+	Vector3 Cross(const Vector3& a, const Vector3& b)
+	{
+		Vector3 v = { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+		return v;
+	}
+
+	Vector3 Normalize(const Vector3& a)
+	{
+		float length = Length(a);
+		return length > 0.0f ? a * (1.0f / length) : a;
+	}
+
+	// Unit face normal, turned to agree with the vertex normals.
+	Vector3 FaceNormal(const MeshVertex* vertices, const uint32_t* triangle)
+	{
+		Vector3 p0 = Load(vertices[triangle[0]].pos);
+		Vector3 n = Normalize(Cross(Load(vertices[triangle[1]].pos) - p0, Load(vertices[triangle[2]].pos) - p0));
+		Vector3 outward = Load(vertices[triangle[0]].normal) + Load(vertices[triangle[1]].normal) + Load(vertices[triangle[2]].normal);
+		return Dot(n, outward) < 0.0f ? n * -1.0f : n;
+	}
+
+#if defined(DX_HEADLESS_CHECKS)
+	// Whether eye sees the front of the triangle; the front is where its face normal points.
+	bool FacesEye(const MeshVertex* vertices, const uint32_t* triangle, const Vector3& eye)
+	{
+		return Dot(FaceNormal(vertices, triangle), eye - Load(vertices[triangle[0]].pos)) > 0.0f;
+	}
+#endif
+
+	void FinishMeshlet(const MeshVertex* vertices, const uint32_t* indices, const std::vector<uint32_t>& triangleIds, MeshletMesh& mesh)
+	{
+		Meshlet& meshlet = mesh.meshlets.back();
+
+		// Sphere about the centre of the vertices' box.
+		Vector3 low = Load(vertices[mesh.vertices[meshlet.vertexOffset]].pos), high = low;
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+		{
+			Vector3 p = Load(vertices[mesh.vertices[meshlet.vertexOffset + i]].pos);
+			low.x = std::min(low.x, p.x); low.y = std::min(low.y, p.y); low.z = std::min(low.z, p.z);
+			high.x = std::max(high.x, p.x); high.y = std::max(high.y, p.y); high.z = std::max(high.z, p.z);
+		}
+		Vector3 center = (low + high) * 0.5f;
+		float radius = 0.0f;
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+		{
+			radius = std::max(radius, Length(Load(vertices[mesh.vertices[meshlet.vertexOffset + i]].pos) - center));
+		}
+
+		// Cone about the mean face normal; its half angle reaches the furthest normal.
+		Vector3 axis = { 0.0f, 0.0f, 0.0f };
+		for (uint32_t t : triangleIds)
+		{
+			axis = axis + FaceNormal(vertices, &indices[t * 3]);
+		}
+		axis = Normalize(axis);
+		float minDot = 1.0f;
+		for (uint32_t t : triangleIds)
+		{
+			minDot = std::min(minDot, Dot(axis, FaceNormal(vertices, &indices[t * 3])));
+		}
+		meshlet.coneAxis[0] = axis.x;
+		meshlet.coneAxis[1] = axis.y;
+		meshlet.coneAxis[2] = axis.z;
+		// Past a hemisphere there is no eye position that sees only backs.
+		meshlet.coneCutoff = minDot <= 0.0f ? 2.0f : std::sqrt(std::max(0.0f, 1.0f - minDot * minDot));
+
+		uint32_t index = (uint32_t)mesh.meshlets.size() - 1;
+		// A little slack for the rounding in the distances.
+		float r = radius * 1.0001f + 1e-6f;
+		float centerArray[3] = { center.x, center.y, center.z };
+		float extent[3] = { r, r, r };
+		mesh.bounds.Set(index, centerArray, r, extent);
+	}
+}
+
+MeshletMesh DirectXGame1::BuildMeshlets(const MeshVertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, uint32_t maxVertices, uint32_t maxTriangles)
+{
+	if (indexCount % 3 != 0)
+	{
+		throw std::invalid_argument("index count is not a whole number of triangles");
+	}
+	if (maxVertices < 3 || maxVertices > 256 || maxTriangles < 1)
+	{
+		throw std::invalid_argument("meshlets need 3 to 256 vertices and at least one triangle");
+	}
+	uint32_t triangleCount = indexCount / 3;
+
+	// Triangles around each vertex, packed.
+	std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+	for (uint32_t i = 0; i < indexCount; i++)
+	{
+		if (indices[i] >= vertexCount)
+		{
+			throw std::invalid_argument("index past the end of the vertices");
+		}
+		firstTriangle[indices[i] + 1]++;
+	}
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		firstTriangle[v + 1] += firstTriangle[v];
+	}
+	std::vector<uint32_t> vertexTriangles(indexCount);
+	{
+		std::vector<uint32_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+		for (uint32_t i = 0; i < indexCount; i++)
+		{
+			vertexTriangles[fill[indices[i]]++] = i / 3;
+		}
+	}
+
+	MeshletMesh mesh;
+	std::vector<bool> emitted(triangleCount, false);
+	// Local index of each mesh vertex in the open meshlet, or 0xFF.
+	std::vector<uint8_t> local(vertexCount, 0xFF);
+	std::vector<uint32_t> triangleIds;
+	uint32_t seed = 0;
+	Vector3 normalSum = { 0.0f, 0.0f, 0.0f };
+
+	auto close = [&]()
+	{
+		Meshlet& meshlet = mesh.meshlets.back();
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+		{
+			local[mesh.vertices[meshlet.vertexOffset + i]] = 0xFF;
+		}
+		mesh.bounds.Resize((uint32_t)mesh.meshlets.size());
+		FinishMeshlet(vertices, indices, triangleIds, mesh);
+		triangleIds.clear();
+	};
+
+	for (uint32_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		// The neighbour adding the fewest vertices, or the next unused triangle for a new meshlet.
+		uint32_t best = UINT32_MAX;
+		if (!mesh.meshlets.empty() && !triangleIds.empty())
+		{
+			const Meshlet& meshlet = mesh.meshlets.back();
+			Vector3 axis = Normalize(normalSum);
+			int bestNew = 4;
+			float bestDot = -2.0f;
+			for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+			{
+				uint32_t v = mesh.vertices[meshlet.vertexOffset + i];
+				for (uint32_t k = firstTriangle[v]; k < firstTriangle[v + 1]; k++)
+				{
+					uint32_t t = vertexTriangles[k];
+					if (emitted[t])
+					{
+						continue;
+					}
+					int added = (local[indices[t * 3]] == 0xFF) + (local[indices[t * 3 + 1]] == 0xFF) + (local[indices[t * 3 + 2]] == 0xFF);
+					float facing = Dot(axis, FaceNormal(vertices, &indices[t * 3]));
+					if (added < bestNew || (added == bestNew && facing > bestDot))
+					{
+						best = t;
+						bestNew = added;
+						bestDot = facing;
+					}
+				}
+			}
+			if (best != UINT32_MAX && (meshlet.vertexCount + bestNew > maxVertices || meshlet.triangleCount == maxTriangles))
+			{
+				best = UINT32_MAX;
+			}
+		}
+		if (best == UINT32_MAX)
+		{
+			if (!triangleIds.empty())
+			{
+				// Carry on next to the meshlet just closed, so no strays are left behind.
+				const Meshlet& last = mesh.meshlets.back();
+				for (uint32_t i = 0; i < last.vertexCount && best == UINT32_MAX; i++)
+				{
+					uint32_t v = mesh.vertices[last.vertexOffset + i];
+					for (uint32_t k = firstTriangle[v]; k < firstTriangle[v + 1]; k++)
+					{
+						if (!emitted[vertexTriangles[k]])
+						{
+							best = vertexTriangles[k];
+							break;
+						}
+					}
+				}
+				close();
+			}
+			if (best == UINT32_MAX)
+			{
+				while (emitted[seed])
+				{
+					seed++;
+				}
+				best = seed;
+			}
+			normalSum = Vector3();
+			Meshlet meshlet = { (uint32_t)mesh.vertices.size(), 0, (uint32_t)mesh.triangles.size() / 3, 0, { 0.0f, 0.0f, 0.0f }, 2.0f };
+			mesh.meshlets.push_back(meshlet);
+		}
+
+		Meshlet& meshlet = mesh.meshlets.back();
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t v = indices[best * 3 + k];
+			if (local[v] == 0xFF)
+			{
+				local[v] = (uint8_t)meshlet.vertexCount++;
+				mesh.vertices.push_back(v);
+			}
+			mesh.triangles.push_back(local[v]);
+		}
+		meshlet.triangleCount++;
+		normalSum = normalSum + FaceNormal(vertices, &indices[best * 3]);
+		emitted[best] = true;
+		triangleIds.push_back(best);
+	}
+	if (!triangleIds.empty())
+	{
+		close();
+	}
+	return mesh;
+}
+
+uint32_t DirectXGame1::CullMeshlets(const MeshletMesh& mesh, const FrustumPlanes& planes, const float eye[3], uint32_t* visible)
+{
+	// Spheres against the frustum four at a time, then the cones of the survivors:
+	// every face is turned away when the eye lies inside the cone's back side, which the
+	// sphere makes conservative as dot(c - e, axis) >= cutoff * |c - e| + radius.
+	uint32_t count = CullObjects(mesh.bounds, planes, CullVolume::Sphere, visible, 1);
+	const CullingBounds& bounds = mesh.bounds;
+	uint32_t written = 0;
+	for (uint32_t v = 0; v < count; v++)
+	{
+		uint32_t i = visible[v];
+		const Meshlet& meshlet = mesh.meshlets[i];
+		float dx = bounds.centerX[i] - eye[0], dy = bounds.centerY[i] - eye[1], dz = bounds.centerZ[i] - eye[2];
+		float along = dx * meshlet.coneAxis[0] + dy * meshlet.coneAxis[1] + dz * meshlet.coneAxis[2];
+		if (along >= meshlet.coneCutoff * std::sqrt(dx * dx + dy * dy + dz * dz) + bounds.radius[i])
+		{
+			continue;
+		}
+		visible[written++] = i;
+	}
+	return written;
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+namespace
+{
+	// Row-vector look-at from eye to the origin and a 70 degree, 16:9 perspective, like
+	// BenchmarkCulling's camera.
+	FrustumPlanes CameraPlanes(const Vector3& eye)
+	{
+		Vector3 zAxis = Normalize(eye);
+		Vector3 up = { 0.0f, 1.0f, 0.0f };
+		if (std::fabs(zAxis.y) > 0.99f)
+		{
+			up.y = 0.0f;
+			up.z = 1.0f;
+		}
+		Vector3 xAxis = Normalize(Cross(up, zAxis));
+		Vector3 yAxis = Cross(zAxis, xAxis);
+		const float view[4][4] = {
+			{ xAxis.x, yAxis.x, zAxis.x, 0.0f },
+			{ xAxis.y, yAxis.y, zAxis.y, 0.0f },
+			{ xAxis.z, yAxis.z, zAxis.z, 0.0f },
+			{ -Dot(xAxis, eye), -Dot(yAxis, eye), -Dot(zAxis, eye), 1.0f } };
+		const float nearZ = 0.1f, farZ = 100.0f;
+		float yScale = 1.0f / std::tan(0.5f * 70.0f * 3.14159265f / 180.0f);
+		float range = farZ / (nearZ - farZ);
+		const float projection[4][4] = {
+			{ yScale * 9.0f / 16.0f, 0.0f, 0.0f, 0.0f },
+			{ 0.0f, yScale, 0.0f, 0.0f },
+			{ 0.0f, 0.0f, range, -1.0f },
+			{ 0.0f, 0.0f, range * nearZ, 0.0f } };
+		float viewProjection[4][4];
+		for (int r = 0; r < 4; r++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				viewProjection[r][c] = view[r][0] * projection[0][c] + view[r][1] * projection[1][c] + view[r][2] * projection[2][c] + view[r][3] * projection[3][c];
+			}
+		}
+		return ExtractFrustumPlanes(viewProjection);
+	}
+
+	bool InsideFrustum(const FrustumPlanes& planes, const Vector3& p)
+	{
+		for (int k = 0; k < 6; k++)
+		{
+			if (planes.nx[k] * p.x + planes.ny[k] * p.y + planes.nz[k] * p.z + planes.d[k] < 0.0f)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+MeshletReport DirectXGame1::ValidateMeshlets()
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	MeshletReport report;
+	MeshShapeDesc desc = MeshShapeDesc::Torus(90, 30, 0.6f, 0.2f);
+	std::vector<MeshVertex> vertices(MeshVertexCount(desc));
+	std::vector<uint32_t> indices(MeshIndexCount(desc));
+	GenerateMesh(desc, &vertices[0], &indices[0]);
+	MeshData data = { &vertices[0], (uint32_t)vertices.size(), &indices[0], (uint32_t)indices.size() };
+	OptimizeMesh(data);
+	uint32_t triangleCount = data.indexCount / 3;
+
+	auto start = Clock::now();
+	MeshletMesh mesh = BuildMeshlets(&vertices[0], data.vertexCount, &indices[0], data.indexCount);
+	report.buildMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	report.meshlets = (uint32_t)mesh.meshlets.size();
+	report.averageVertices = (float)mesh.vertices.size() / report.meshlets;
+	report.averageTriangles = (float)triangleCount / report.meshlets;
+
+	// Each triangle of the mesh, as a sorted triple, exactly once across the meshlets.
+	std::vector<uint64_t> expected, got;
+	auto key = [](uint32_t a, uint32_t b, uint32_t c)
+	{
+		uint32_t v[3] = { a, b, c };
+		std::sort(v, v + 3);
+		return ((uint64_t)v[0] << 42) | ((uint64_t)v[1] << 21) | v[2];
+	};
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		expected.push_back(key(indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2]));
+	}
+	report.boundsHold = true;
+	for (uint32_t m = 0; m < report.meshlets; m++)
+	{
+		const Meshlet& meshlet = mesh.meshlets[m];
+		report.boundsHold = report.boundsHold && meshlet.vertexCount <= DefaultMeshletVertices && meshlet.triangleCount <= DefaultMeshletTriangles;
+		Vector3 center = { mesh.bounds.centerX[m], mesh.bounds.centerY[m], mesh.bounds.centerZ[m] };
+		Vector3 axis = Load(meshlet.coneAxis);
+		float minDot = std::sqrt(std::max(0.0f, 1.0f - meshlet.coneCutoff * meshlet.coneCutoff));
+		for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+		{
+			uint32_t triangle[3];
+			for (int k = 0; k < 3; k++)
+			{
+				triangle[k] = mesh.vertices[meshlet.vertexOffset + mesh.triangles[(meshlet.triangleOffset + t) * 3 + k]];
+				report.boundsHold = report.boundsHold && Length(Load(vertices[triangle[k]].pos) - center) <= mesh.bounds.radius[m];
+			}
+			got.push_back(key(triangle[0], triangle[1], triangle[2]));
+			if (meshlet.coneCutoff <= 1.0f)
+			{
+				report.boundsHold = report.boundsHold && Dot(axis, FaceNormal(&vertices[0], triangle)) >= minDot - 1e-4f;
+			}
+		}
+	}
+	std::sort(expected.begin(), expected.end());
+	std::sort(got.begin(), got.end());
+	report.everyTriangleOnce = expected == got;
+
+	// Eyes on a ring around the torus and above it; a culled meshlet may not have a triangle
+	// that faces the eye with a corner in the frustum.
+	report.cullingConservative = true;
+	std::vector<uint32_t> visible(report.meshlets);
+	std::vector<uint32_t> drawIndices(report.meshlets * DefaultMeshletTriangles * 3);
+	for (int e = 0; e < 24; e++)
+	{
+		float angle = e * 3.14159265f / 12.0f;
+		Vector3 eye = { 1.5f * std::sin(angle), 0.8f * std::cos(angle * 2.0f), 1.5f * std::cos(angle) };
+		FrustumPlanes planes = CameraPlanes(eye);
+		float eyeArray[3] = { eye.x, eye.y, eye.z };
+		uint32_t count = CullMeshlets(mesh, planes, eyeArray, &visible[0]);
+		std::vector<bool> kept(report.meshlets, false);
+		for (uint32_t v = 0; v < count; v++)
+		{
+			kept[visible[v]] = true;
+		}
+		for (uint32_t m = 0; m < report.meshlets && report.cullingConservative; m++)
+		{
+			if (kept[m])
+			{
+				continue;
+			}
+			const Meshlet& meshlet = mesh.meshlets[m];
+			for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+			{
+				uint32_t triangle[3];
+				bool inside = false;
+				for (int k = 0; k < 3; k++)
+				{
+					triangle[k] = mesh.vertices[meshlet.vertexOffset + mesh.triangles[(meshlet.triangleOffset + t) * 3 + k]];
+					inside = inside || InsideFrustum(planes, Load(vertices[triangle[k]].pos));
+				}
+				if (inside && FacesEye(&vertices[0], triangle, eye))
+				{
+					report.cullingConservative = false;
+				}
+			}
+		}
+	}
+
+	// The side view: looking along the large loop's axis from the front, like the renderer.
+	Vector3 eye = { 0.0f, 0.0f, 1.5f };
+	FrustumPlanes planes = CameraPlanes(eye);
+	float eyeArray[3] = { eye.x, eye.y, eye.z };
+	start = Clock::now();
+	uint32_t count = CullMeshlets(mesh, planes, eyeArray, &visible[0]);
+	uint32_t drawn = WriteMeshletIndices(mesh, &visible[0], count, &drawIndices[0]) / 3;
+	report.cullMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	report.sideViewCulledMeshlets = 1.0f - (float)count / report.meshlets;
+	report.sideViewCulledTriangles = 1.0f - (float)drawn / triangleCount;
+	uint32_t backFacing = 0;
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		backFacing += FacesEye(&vertices[0], &indices[t * 3], eye) ? 0 : 1;
+	}
+	report.backFacingTriangles = (float)backFacing / triangleCount;
+	return report;
+}
+#endif
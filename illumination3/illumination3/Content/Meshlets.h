@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "FrustumCulling.h"
+#include "MeshGenerator.h"
+
+namespace DirectXGame1
+{
+	static const uint32_t DefaultMeshletVertices = 64;
+	static const uint32_t DefaultMeshletTriangles = 124;
+
+	// A cluster of up to DefaultMeshletVertices vertices and DefaultMeshletTriangles triangles.
+	// Its triangles are triangleCount triples of local indices at
+	// MeshletMesh::triangles[triangleOffset * 3]; a local index i means mesh vertex
+	// MeshletMesh::vertices[vertexOffset + i].
+	struct Meshlet
+	{
+		uint32_t vertexOffset;
+		uint32_t vertexCount;
+		uint32_t triangleOffset;
+		uint32_t triangleCount;
+		// Every face normal is within the cone about axis whose half angle has sine coneCutoff.
+		// A cutoff above 1 means the normals spread too far to cull the cluster by facing.
+		float coneAxis[3];
+		float coneCutoff;
+	};
+
+	struct MeshletMesh
+	{
+		std::vector<Meshlet> meshlets;
+		std::vector<uint32_t> vertices;
+		std::vector<uint8_t> triangles;
+		// A sphere per meshlet (boxes of the same radius), for CullObjects.
+		CullingBounds bounds;
+	};
+
+	// Greedy clustering: a meshlet grows by the triangle next to it that brings the fewest new
+	// vertices, ties going to the one facing most like the meshlet so far (narrow cones cull
+	// better). Once nothing fits, the next meshlet starts beside the one just closed. Face
+	// orientation comes from the vertex normals, so the cones point out of the surface
+	// whatever the winding. Throws std::invalid_argument on a bad index or limit.
+	MeshletMesh BuildMeshlets(const MeshVertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount,
+		uint32_t maxVertices = DefaultMeshletVertices, uint32_t maxTriangles = DefaultMeshletTriangles);
+
+	// Meshlets that are inside the frustum and have some triangle facing eye, both in the
+	// space the mesh was built in. visible must hold meshlets.size() entries; returns the count.
+	uint32_t CullMeshlets(const MeshletMesh& mesh, const FrustumPlanes& planes, const float eye[3], uint32_t* visible);
+
+	// The triangles of the visible meshlets as a plain index list into the mesh's vertices.
+	// Returns the number of indices written; out must hold 3 * 124 per meshlet listed.
+	template <typename Index>
+	uint32_t WriteMeshletIndices(const MeshletMesh& mesh, const uint32_t* visible, uint32_t visibleCount, Index* out)
+	{
+		uint32_t written = 0;
+		for (uint32_t v = 0; v < visibleCount; v++)
+		{
+			const Meshlet& meshlet = mesh.meshlets[visible[v]];
+			const uint32_t* vertices = &mesh.vertices[meshlet.vertexOffset];
+			const uint8_t* triangles = &mesh.triangles[meshlet.triangleOffset * 3];
+			for (uint32_t i = 0; i < meshlet.triangleCount * 3; i++)
+			{
+				out[written++] = (Index)vertices[triangles[i]];
+			}
+		}
+		return written;
+	}
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct MeshletReport
+	{
+		uint32_t meshlets;
+		float averageVertices;
+		float averageTriangles;
+		bool everyTriangleOnce;			// the meshlets cover the mesh exactly
+		bool boundsHold;				// every vertex in its sphere, every face normal in its cone
+		bool cullingConservative;		// no culled meshlet had a triangle facing the eye inside the frustum
+		float sideViewCulledMeshlets;	// fraction culled looking at the torus from one side
+		float sideViewCulledTriangles;
+		float backFacingTriangles;		// fraction truly facing away in that view, for comparison
+		double buildMilliseconds;
+		double cullMilliseconds;		// cull and write the indices for the side view
+	};
+
+	// The renderer's 90 x 30 torus after OptimizeMesh, split and checked by brute force, then
+	// culled from a ring of eyes around it.
+	MeshletReport ValidateMeshlets();
+#endif
+}
@@ -0,0 +1,399 @@
+#include "pch.h"
+#include "PostProcessChain.h"
+#include "PostProcessPlan.h"
+
+#include "..\Helpers\DirectXHelper.h"
+#include <stdexcept>
+
+using namespace DirectXGame1;
+
+using namespace Microsoft::WRL;
+using namespace Windows::Foundation;
+
+namespace
+{
+	// Enough slots to cover any pass's inputs when unbinding between passes.
+	const UINT MaxPassInputs = 8;
+
+	// The swap chain is created as DXGI_FORMAT_B8G8R8A8_UNORM.
+	const uint64 BackBufferBytesPerPixel = 4;
+}
+
+PostProcessChain::PostProcessChain(const std::shared_ptr<DX::DeviceResources>& deviceResources, const std::shared_ptr<DX::RenderTargetPool>& pool) :
+	m_deviceResources(deviceResources),
+	m_pool(pool),
+	m_historyParity(0),
+	m_historyFrames(0),
+	m_compiled(false)
+{
+}
+
+void PostProcessChain::Clear()
+{
+	m_targets.clear();
+	m_physical.clear();
+	m_passes.clear();
+	m_histories.clear();
+	m_historyFrames = 0;
+	m_compiled = false;
+}
+
+PostProcessChain::TargetHandle PostProcessChain::CreateTarget(const std::string& name, const PostProcessTargetDesc& desc)
+{
+	VirtualTarget target;
+	target.name = name;
+	target.desc = desc;
+	target.physical = -1;
+	target.history = -1;
+	m_targets.push_back(target);
+	m_compiled = false;
+	return (TargetHandle)m_targets.size() - 1;
+}
+
+// Two virtual targets over one pair of textures: the handle returned is written this frame,
+// the one after it reads last frame's texture. Neither takes part in aliasing.
+PostProcessChain::TargetHandle PostProcessChain::CreateHistoryTarget(const std::string& name, const PostProcessTargetDesc& desc)
+{
+	HistoryTarget history;
+	history.current = CreateTarget(name, desc);
+	history.previous = CreateTarget(name + " (previous frame)", desc);
+	m_targets[history.current].history = (int)m_histories.size();
+	m_targets[history.previous].history = (int)m_histories.size();
+	m_histories.push_back(history);
+	return history.current;
+}
+
+PostProcessChain::TargetHandle PostProcessChain::GetPreviousFrame(TargetHandle history) const
+{
+	if (history < 0 || history >= (TargetHandle)m_targets.size() || m_targets[history].history < 0)
+	{
+		throw ref new Platform::InvalidArgumentException();
+	}
+	return m_histories[m_targets[history].history].previous;
+}
+
+void PostProcessChain::AddPass(const std::string& name, const std::vector<TargetHandle>& reads, const std::vector<TargetHandle>& writes, bool useDepth, PassFunction execute)
+{
+	Pass pass;
+	pass.name = name;
+	pass.reads = reads;
+	pass.writes = writes;
+	pass.useDepth = useDepth;
+	pass.compute = false;
+	pass.execute = execute;
+	m_passes.push_back(pass);
+	m_compiled = false;
+}
+
+void PostProcessChain::AddComputePass(const std::string& name, const std::vector<TargetHandle>& reads, const std::vector<TargetHandle>& writes, PassFunction execute)
+{
+	for (TargetHandle write : writes)
+	{
+		if (write < 0 || write >= (TargetHandle)m_targets.size())
+		{
+			throw ref new Platform::InvalidArgumentException();
+		}
+		// Only targets with the same desc share a texture, so UAV targets alias among themselves.
+		m_targets[write].desc.unorderedAccess = true;
+	}
+
+	AddPass(name, reads, writes, false, execute);
+	m_passes.back().compute = true;
+}
+
+void PostProcessChain::Compile()
+{
+	PlanTargets();
+	CreatePhysicalTargets();
+	m_compiled = true;
+}
+
+// Hands the passes' reads and writes to PlanPostProcessTargets, which works out lifetimes and
+// which targets share a texture; equal descs are the only ones that may.
+void PostProcessChain::PlanTargets()
+{
+	std::vector<PostProcessTargetDesc> descs;
+	for (const auto& target : m_targets)
+	{
+		descs.push_back(target.desc);
+	}
+	std::vector<unsigned int> classes = ClassifyDescs(descs);
+
+	std::vector<PostProcessPlanTarget> targets(m_targets.size());
+	for (size_t i = 0; i < m_targets.size(); i++)
+	{
+		const VirtualTarget& target = m_targets[i];
+		targets[i].descClass = classes[i];
+		targets[i].role = PostProcessTargetRole::Transient;
+		if (target.history >= 0)
+		{
+			bool previous = m_histories[target.history].previous == (TargetHandle)i;
+			targets[i].role = previous ? PostProcessTargetRole::PreviousFrame : PostProcessTargetRole::History;
+		}
+	}
+
+	std::vector<PostProcessPlanPass> passes(m_passes.size());
+	for (size_t p = 0; p < m_passes.size(); p++)
+	{
+		if (m_passes[p].reads.size() > MaxPassInputs)
+		{
+			throw ref new Platform::InvalidArgumentException();
+		}
+		passes[p].reads = m_passes[p].reads;
+		passes[p].writes = m_passes[p].writes;
+	}
+
+	PostProcessPlan plan;
+	try
+	{
+		plan = PlanPostProcessTargets(targets, passes);
+	}
+	catch (const std::invalid_argument&)
+	{
+		// a broken chain: a read of something nothing wrote, a pass reading its own output, ...
+		throw ref new Platform::InvalidArgumentException();
+	}
+
+	m_physical.clear();
+	m_physical.resize(plan.physicalClass.size());
+	for (size_t i = 0; i < m_targets.size(); i++)
+	{
+		m_targets[i].physical = plan.physical[i];
+		if (plan.physical[i] >= 0)
+		{
+			m_physical[plan.physical[i]].desc = m_targets[i].desc;
+		}
+	}
+}
+
+DX::RenderTargetKey PostProcessChain::KeyFor(const PostProcessTargetDesc& desc) const
+{
+	UINT width = desc.fixedWidth;
+	UINT height = desc.fixedHeight;
+	if (width == 0 || height == 0)
+	{
+		Size outputSize = m_deviceResources->GetOutputSize();
+		width = (UINT)(outputSize.Width * desc.scale);
+		height = (UINT)(outputSize.Height * desc.scale);
+	}
+	UINT bindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	if (desc.unorderedAccess)
+	{
+		bindFlags |= D3D11_BIND_UNORDERED_ACCESS;
+	}
+	return DX::RenderTargetKey(width < 1 ? 1 : width, height < 1 ? 1 : height, desc.format, bindFlags);
+}
+
+void PostProcessChain::CreatePhysicalTargets()
+{
+	// The pool keeps the textures that still fit and hands the rest back before refilling, so
+	// one slot can pick up what another let go. The slots own the only references meanwhile.
+	std::vector<DX::RenderTargetHandle> textures;
+	std::vector<DX::RenderTargetKey> keys;
+	for (auto& physical : m_physical)
+	{
+		textures.push_back(std::move(physical.target));
+		keys.push_back(KeyFor(physical.desc));
+	}
+	m_pool->Refill(textures, keys);
+	for (size_t i = 0; i < m_physical.size(); i++)
+	{
+		m_physical[i].target = std::move(textures[i]);
+	}
+
+	// A replaced history texture holds nothing from the previous frame.
+	for (auto& history : m_histories)
+	{
+		std::vector<DX::RenderTargetHandle> pair;
+		pair.push_back(std::move(history.textures[0]));
+		pair.push_back(std::move(history.textures[1]));
+		if (m_pool->Refill(pair, std::vector<DX::RenderTargetKey>(2, KeyFor(m_targets[history.current].desc))) > 0)
+		{
+			m_historyFrames = 0;
+		}
+		history.textures[0] = std::move(pair[0]);
+		history.textures[1] = std::move(pair[1]);
+	}
+}
+
+const DX::PooledRenderTarget& PostProcessChain::TextureFor(TargetHandle handle) const
+{
+	const VirtualTarget& target = m_targets[handle];
+	if (target.history >= 0)
+	{
+		const HistoryTarget& history = m_histories[target.history];
+		return *history.textures[handle == history.current ? m_historyParity : 1 - m_historyParity];
+	}
+	return *m_physical[target.physical].target;
+}
+
+void PostProcessChain::Execute()
+{
+	if (!m_compiled)
+	{
+		Compile();
+	}
+
+	auto context = m_deviceResources->GetD3DDeviceContext();
+	ID3D11ShaderResourceView* const nullSRVs[MaxPassInputs] = {};
+	ID3D11UnorderedAccessView* const nullUAVs[MaxPassInputs] = {};
+
+	for (const Pass& pass : m_passes)
+	{
+		// Anything read by an earlier pass may be a render target now.
+		context->PSSetShaderResources(0, MaxPassInputs, nullSRVs);
+
+		PostProcessPassContext passContext;
+		passContext.context = context;
+		passContext.viewport = m_deviceResources->GetScreenViewport();
+
+		bool viewportSet = false;
+		for (TargetHandle write : pass.writes)
+		{
+			if (write == BackBuffer)
+			{
+				passContext.outputs.push_back(m_deviceResources->GetBackBufferRenderTargetView());
+				continue;
+			}
+
+			const DX::PooledRenderTarget& physical = TextureFor(write);
+			if (pass.compute)
+			{
+				passContext.unorderedOutputs.push_back(physical.uav.Get());
+			}
+			else
+			{
+				passContext.outputs.push_back(physical.rtv.Get());
+			}
+			if (!viewportSet)
+			{
+				passContext.viewport = CD3D11_VIEWPORT(0.0f, 0.0f, (float)physical.key.width, (float)physical.key.height);
+				viewportSet = true;
+			}
+		}
+
+		for (TargetHandle read : pass.reads)
+		{
+			const DX::PooledRenderTarget& physical = TextureFor(read);
+			passContext.inputs.push_back(physical.srv.Get());
+			passContext.inputSizes.push_back(Size((float)physical.key.width, (float)physical.key.height));
+		}
+
+		context->OMSetRenderTargets(
+			(UINT)passContext.outputs.size(),
+			passContext.outputs.empty() ? nullptr : &passContext.outputs[0],
+			pass.useDepth ? m_deviceResources->GetDepthStencilView() : nullptr
+			);
+		context->RSSetViewports(1, &passContext.viewport);
+
+		pass.execute(passContext);
+
+		if (pass.compute)
+		{
+			// A texture cannot be read by the next pass while it is still bound as a UAV.
+			context->CSSetShaderResources(0, MaxPassInputs, nullSRVs);
+			context->CSSetUnorderedAccessViews(0, (UINT)passContext.unorderedOutputs.size(), nullUAVs, nullptr);
+		}
+	}
+
+	context->PSSetShaderResources(0, MaxPassInputs, nullSRVs);
+
+	// this frame's history becomes the next frame's previous
+	if (!m_histories.empty())
+	{
+		m_historyParity = 1 - m_historyParity;
+		m_historyFrames++;
+	}
+}
+
+void PostProcessChain::CreateWindowSizeDependentResources()
+{
+	if (m_compiled)
+	{
+		CreatePhysicalTargets();
+	}
+}
+
+void PostProcessChain::ReleaseDeviceDependentResources()
+{
+	for (auto& physical : m_physical)
+	{
+		physical.target.reset();
+	}
+	for (auto& history : m_histories)
+	{
+		history.textures[0].reset();
+		history.textures[1].reset();
+	}
+	m_historyFrames = 0;
+	m_compiled = false;
+}
+
+uint64 PostProcessChain::GetAllocatedBytes() const
+{
+	uint64 bytes = 0;
+	for (const auto& physical : m_physical)
+	{
+		DX::RenderTargetKey key = KeyFor(physical.desc);
+		bytes += (uint64)key.width * key.height * DX::RenderTargetPool::BytesPerPixel(key.format);
+	}
+	for (const auto& history : m_histories)
+	{
+		DX::RenderTargetKey key = KeyFor(m_targets[history.current].desc);
+		bytes += 2 * (uint64)key.width * key.height * DX::RenderTargetPool::BytesPerPixel(key.format);
+	}
+	return bytes;
+}
+
+uint64 PostProcessChain::GetUnaliasedBytes() const
+{
+	uint64 bytes = 0;
+	for (const auto& target : m_targets)
+	{
+		DX::RenderTargetKey key = KeyFor(target.desc);
+		bytes += (uint64)key.width * key.height * DX::RenderTargetPool::BytesPerPixel(key.format);
+	}
+	return bytes;
+}
+
+PostProcessFrameTraffic PostProcessChain::GetFrameTraffic(DXGI_FORMAT formatOverride) const
+{
+	PostProcessFrameTraffic traffic;
+	traffic.bytesRead = 0;
+	traffic.bytesWritten = 0;
+
+	auto targetBytes = [&](TargetHandle handle) -> uint64
+	{
+		if (handle == BackBuffer)
+		{
+			Size outputSize = m_deviceResources->GetOutputSize();
+			return (uint64)outputSize.Width * (uint64)outputSize.Height * BackBufferBytesPerPixel;
+		}
+		DX::RenderTargetKey key = KeyFor(m_targets[handle].desc);
+		DXGI_FORMAT format = formatOverride != DXGI_FORMAT_UNKNOWN ? formatOverride : key.format;
+		return (uint64)key.width * key.height * DX::RenderTargetPool::BytesPerPixel(format);
+	};
+
+	for (const Pass& pass : m_passes)
+	{
+		PostProcessPassTraffic passTraffic;
+		passTraffic.name = pass.name;
+		passTraffic.bytesRead = 0;
+		passTraffic.bytesWritten = 0;
+
+		for (TargetHandle read : pass.reads)
+		{
+			passTraffic.bytesRead += targetBytes(read);
+		}
+		for (TargetHandle write : pass.writes)
+		{
+			passTraffic.bytesWritten += targetBytes(write);
+		}
+
+		traffic.bytesRead += passTraffic.bytesRead;
+		traffic.bytesWritten += passTraffic.bytesWritten;
+		traffic.passes.push_back(passTraffic);
+	}
+
+	return traffic;
+}
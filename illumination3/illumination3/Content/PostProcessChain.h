@@ -0,0 +1,166 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "..\Helpers\DeviceResources.h"
+#include "..\Helpers\RenderTargetPool.h"
+
+namespace DirectXGame1
+{
+	// Size and format of an intermediate target. The size is a fraction of the output size,
+	// so the chain can rebuild it when the window changes, unless fixedWidth/fixedHeight are set.
+	struct PostProcessTargetDesc
+	{
+		PostProcessTargetDesc() : format(DXGI_FORMAT_R32G32B32A32_FLOAT), scale(1.0f), fixedWidth(0), fixedHeight(0), unorderedAccess(false) {}
+		PostProcessTargetDesc(DXGI_FORMAT targetFormat, float targetScale = 1.0f) :
+			format(targetFormat), scale(targetScale), fixedWidth(0), fixedHeight(0), unorderedAccess(false) {}
+
+		static PostProcessTargetDesc Fixed(DXGI_FORMAT targetFormat, UINT width, UINT height)
+		{
+			PostProcessTargetDesc desc(targetFormat);
+			desc.fixedWidth = width;
+			desc.fixedHeight = height;
+			return desc;
+		}
+
+		bool operator==(const PostProcessTargetDesc& other) const
+		{
+			return format == other.format && scale == other.scale && fixedWidth == other.fixedWidth && fixedHeight == other.fixedHeight &&
+				unorderedAccess == other.unorderedAccess;
+		}
+
+		DXGI_FORMAT format;
+		float scale;
+		UINT fixedWidth;
+		UINT fixedHeight;
+		bool unorderedAccess;	// set by AddComputePass for the targets a compute pass writes
+	};
+
+	// What a pass gets when it runs. Render targets, depth and viewport are already bound;
+	// the pass binds its own shaders, inputs and samplers and draws. A compute pass gets its
+	// writes as UAVs instead, with nothing bound to the output merger; viewport still holds the
+	// size of its first output.
+	struct PostProcessPassContext
+	{
+		ID3D11DeviceContext2* context;
+		std::vector<ID3D11ShaderResourceView*> inputs;		// one per declared read, in order
+		std::vector<Windows::Foundation::Size> inputSizes;	// in texels, one per declared read
+		std::vector<ID3D11RenderTargetView*> outputs;		// one per declared write, in order
+		std::vector<ID3D11UnorderedAccessView*> unorderedOutputs;	// compute passes: one per declared write
+		D3D11_VIEWPORT viewport;
+	};
+
+	// Colour-target traffic of one pass, assuming every input texel is fetched once and every
+	// output texel written once. Depth and texture-cache effects are not counted.
+	struct PostProcessPassTraffic
+	{
+		std::string name;
+		uint64 bytesRead;
+		uint64 bytesWritten;
+	};
+
+	struct PostProcessFrameTraffic
+	{
+		std::vector<PostProcessPassTraffic> passes;
+		uint64 bytesRead;
+		uint64 bytesWritten;
+	};
+
+	// A frame described as a list of passes that declare which targets they read and write.
+	// Compile() works out when each intermediate is first written and last read, and targets
+	// whose lifetimes do not overlap share one texture. Passes run in the order they were added.
+	// Textures come from a RenderTargetPool, so a resize only replaces the ones whose size changed.
+	// History targets are the exception: they keep two textures of their own and swap them
+	// after every frame, so a pass can read what the previous frame left there.
+	class PostProcessChain
+	{
+	public:
+		typedef int TargetHandle;
+		typedef std::function<void(const PostProcessPassContext&)> PassFunction;
+
+		// The swap chain's back buffer; may be written, never read.
+		static const TargetHandle BackBuffer = -1;
+
+		PostProcessChain(const std::shared_ptr<DX::DeviceResources>& deviceResources, const std::shared_ptr<DX::RenderTargetPool>& pool);
+
+		// Declaring the chain.
+		void Clear();
+		TargetHandle CreateTarget(const std::string& name, const PostProcessTargetDesc& desc);
+		// A target passes write as usual, whose contents at the end of the frame stay readable
+		// through GetPreviousFrame during the next one.
+		TargetHandle CreateHistoryTarget(const std::string& name, const PostProcessTargetDesc& desc);
+		TargetHandle GetPreviousFrame(TargetHandle history) const;
+		void AddPass(const std::string& name, const std::vector<TargetHandle>& reads, const std::vector<TargetHandle>& writes, bool useDepth, PassFunction execute);
+		// A pass that dispatches a compute shader. Its writes get UAVs, so they cannot be the back buffer.
+		void AddComputePass(const std::string& name, const std::vector<TargetHandle>& reads, const std::vector<TargetHandle>& writes, PassFunction execute);
+
+		// Works out lifetimes and aliasing, then takes the textures from the pool.
+		void Compile();
+		bool IsCompiled() const { return m_compiled; }
+		void Execute();
+
+		void CreateWindowSizeDependentResources();
+		void ReleaseDeviceDependentResources();
+
+		// Texture memory with aliasing, and what it would be with one texture per target.
+		uint64 GetAllocatedBytes() const;
+		uint64 GetUnaliasedBytes() const;
+		size_t GetPhysicalTargetCount() const { return m_physical.size(); }
+
+		// Frames the history textures have been kept for. 0 on a frame whose previous-frame
+		// reads are undefined: the first after Compile, a resize or a lost device.
+		uint32 GetHistoryFrames() const { return m_historyFrames; }
+
+		// Bytes each pass reads and writes per frame with the declared formats. Passing a format
+		// reports what the same chain would move with every intermediate target in that format.
+		PostProcessFrameTraffic GetFrameTraffic(DXGI_FORMAT formatOverride = DXGI_FORMAT_UNKNOWN) const;
+
+	private:
+		struct VirtualTarget
+		{
+			std::string name;
+			PostProcessTargetDesc desc;
+			int physical;		// index into m_physical, -1 for history and unused targets
+			int history;		// index into m_histories, -1 for an ordinary target
+		};
+
+		struct HistoryTarget
+		{
+			TargetHandle current;
+			TargetHandle previous;
+			DX::RenderTargetHandle textures[2];		// current is textures[m_historyParity]
+		};
+
+		struct PhysicalTarget
+		{
+			PostProcessTargetDesc desc;
+			DX::RenderTargetHandle target;
+		};
+
+		struct Pass
+		{
+			std::string name;
+			std::vector<TargetHandle> reads;
+			std::vector<TargetHandle> writes;
+			bool useDepth;
+			bool compute;
+			PassFunction execute;
+		};
+
+		void PlanTargets();
+		void CreatePhysicalTargets();
+		DX::RenderTargetKey KeyFor(const PostProcessTargetDesc& desc) const;
+		const DX::PooledRenderTarget& TextureFor(TargetHandle handle) const;
+
+		std::shared_ptr<DX::DeviceResources> m_deviceResources;
+		std::shared_ptr<DX::RenderTargetPool> m_pool;
+		std::vector<VirtualTarget> m_targets;
+		std::vector<PhysicalTarget> m_physical;
+		std::vector<Pass> m_passes;
+		std::vector<HistoryTarget> m_histories;
+		unsigned int m_historyParity;
+		uint32 m_historyFrames;
+		bool m_compiled;
+	};
+}
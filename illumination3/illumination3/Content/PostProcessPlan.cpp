@@ -0,0 +1,206 @@
+#include "PostProcessPlan.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace DirectXGame1;
+
+PostProcessPlan DirectXGame1::PlanPostProcessTargets(const std::vector<PostProcessPlanTarget>& targets, const std::vector<PostProcessPlanPass>& passes)
+{
+	const int targetCount = (int)targets.size();
+	PostProcessPlan plan;
+	plan.firstWrite.assign(targets.size(), -1);
+	plan.lastUse.assign(targets.size(), -1);
+	plan.physical.assign(targets.size(), -1);
+
+	for (int p = 0; p < (int)passes.size(); p++)
+	{
+		const PostProcessPlanPass& pass = passes[p];
+		for (int read : pass.reads)
+		{
+			// The previous frame of a history target was written last frame.
+			if (read < 0 || read >= targetCount)
+			{
+				throw std::invalid_argument("a pass reads the back buffer or an unknown target");
+			}
+			if (plan.firstWrite[read] < 0 && targets[read].role != PostProcessTargetRole::PreviousFrame)
+			{
+				throw std::invalid_argument("a pass reads a target no earlier pass wrote");
+			}
+			if (std::find(pass.writes.begin(), pass.writes.end(), read) != pass.writes.end())
+			{
+				throw std::invalid_argument("a pass reads a target it writes");
+			}
+			plan.lastUse[read] = p;
+		}
+
+		for (int write : pass.writes)
+		{
+			if (write == PlanBackBuffer)
+			{
+				continue;
+			}
+			if (write < 0 || write >= targetCount || targets[write].role == PostProcessTargetRole::PreviousFrame)
+			{
+				throw std::invalid_argument("a pass writes an unknown or previous-frame target");
+			}
+			if (plan.firstWrite[write] < 0)
+			{
+				plan.firstWrite[write] = p;
+			}
+			plan.lastUse[write] = p;
+		}
+	}
+
+	std::vector<int> order;
+	for (int i = 0; i < targetCount; i++)
+	{
+		if (plan.firstWrite[i] >= 0 && targets[i].role == PostProcessTargetRole::Transient)
+		{
+			order.push_back(i);
+		}
+	}
+	std::stable_sort(order.begin(), order.end(), [&plan](int a, int b)
+	{
+		return plan.firstWrite[a] < plan.firstWrite[b];
+	});
+
+	std::vector<int> busyUntil;		// per texture: last pass that uses its current occupant
+	for (int index : order)
+	{
+		for (int t = 0; t < (int)busyUntil.size(); t++)
+		{
+			if (busyUntil[t] < plan.firstWrite[index] && plan.physicalClass[t] == targets[index].descClass)
+			{
+				plan.physical[index] = t;
+				busyUntil[t] = plan.lastUse[index];
+				break;
+			}
+		}
+
+		if (plan.physical[index] < 0)
+		{
+			plan.physical[index] = (int)busyUntil.size();
+			plan.physicalClass.push_back(targets[index].descClass);
+			busyUntil.push_back(plan.lastUse[index]);
+		}
+	}
+
+	return plan;
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+namespace
+{
+	// The parts of PostProcessTargetDesc that make two targets different.
+	struct CheckDesc
+	{
+		unsigned int format;
+		float scale;
+
+		bool operator==(const CheckDesc& other) const { return format == other.format && scale == other.scale; }
+	};
+
+	const unsigned int Float16 = 10;	// DXGI_FORMAT_R16G16B16A16_FLOAT
+	const unsigned int Unorm8 = 28;		// DXGI_FORMAT_R8G8B8A8_UNORM
+
+	// The blur chain as Sample3DSceneRenderer::BuildPostProcessChain declares it: world into
+	// canvas, a horizontal pass into a temporary, a vertical pass into blurred, then the
+	// screen pass to the back buffer.
+	PostProcessPlan PlanBlurChain(const CheckDesc& canvas, const CheckDesc& temporary, const CheckDesc& blurred)
+	{
+		std::vector<CheckDesc> descs;
+		descs.push_back(canvas);
+		descs.push_back(temporary);
+		descs.push_back(blurred);
+		std::vector<unsigned int> classes = ClassifyDescs(descs);
+
+		std::vector<PostProcessPlanTarget> targets;
+		for (unsigned int c : classes)
+		{
+			PostProcessPlanTarget target = { c, PostProcessTargetRole::Transient };
+			targets.push_back(target);
+		}
+
+		std::vector<PostProcessPlanPass> passes(4);
+		passes[0].writes.push_back(0);
+		passes[1].reads.push_back(0);
+		passes[1].writes.push_back(1);
+		passes[2].reads.push_back(1);
+		passes[2].writes.push_back(2);
+		passes[3].reads.push_back(2);
+		passes[3].writes.push_back(PlanBackBuffer);
+		return PlanPostProcessTargets(targets, passes);
+	}
+
+	bool Rejects(const std::vector<PostProcessPlanTarget>& targets, const std::vector<PostProcessPlanPass>& passes)
+	{
+		try
+		{
+			PlanPostProcessTargets(targets, passes);
+		}
+		catch (const std::invalid_argument&)
+		{
+			return true;
+		}
+		return false;
+	}
+}
+
+PostProcessPlanReport DirectXGame1::ValidatePostProcessPlan()
+{
+	PostProcessPlanReport report = {};
+	const CheckDesc full = { Float16, 1.0f }, half = { Float16, 0.5f }, narrow = { Unorm8, 1.0f };
+
+	PostProcessPlan blur = PlanBlurChain(full, full, full);
+	report.sharesEqualDescs = blur.physical[0] == blur.physical[2] && blur.physicalClass.size() == 2;
+	report.separatesReadAndWrite = blur.physical[0] != blur.physical[1] && blur.physical[1] != blur.physical[2];
+
+	PostProcessPlan otherFormat = PlanBlurChain(full, full, narrow);
+	PostProcessPlan otherScale = PlanBlurChain(full, half, half);
+	report.separatesOtherDescs = otherFormat.physical[0] != otherFormat.physical[2] && otherFormat.physicalClass.size() == 3 &&
+		otherScale.physical[0] != otherScale.physical[1] && otherScale.physical[0] != otherScale.physical[2] &&
+		otherScale.physical[1] != otherScale.physical[2];
+
+	std::vector<PostProcessPlanTarget> two(2);
+	two[0].descClass = two[1].descClass = 0;
+	two[0].role = two[1].role = PostProcessTargetRole::Transient;
+	std::vector<PostProcessPlanPass> readFirst(2);
+	readFirst[0].reads.push_back(1);
+	readFirst[0].writes.push_back(0);
+	readFirst[1].writes.push_back(1);
+	report.rejectsReadBeforeWrite = Rejects(two, readFirst);
+
+	std::vector<PostProcessPlanPass> readOwn(2);
+	readOwn[0].writes.push_back(0);
+	readOwn[1].reads.push_back(0);
+	readOwn[1].writes.push_back(0);
+	report.rejectsReadOfOwnWrite = Rejects(two, readOwn);
+
+	// Temporal occlusion: a history target whose previous frame is read before this frame's
+	// is written, next to transients of the same class that would otherwise fit around them.
+	std::vector<PostProcessPlanTarget> temporal(4);
+	for (auto& target : temporal)
+	{
+		target.descClass = 0;
+		target.role = PostProcessTargetRole::Transient;
+	}
+	temporal[1].role = PostProcessTargetRole::History;
+	temporal[2].role = PostProcessTargetRole::PreviousFrame;
+	std::vector<PostProcessPlanPass> temporalPasses(4);
+	temporalPasses[0].writes.push_back(0);
+	temporalPasses[1].reads.push_back(0);
+	temporalPasses[1].reads.push_back(2);
+	temporalPasses[1].writes.push_back(1);
+	temporalPasses[2].reads.push_back(1);
+	temporalPasses[2].writes.push_back(3);
+	temporalPasses[3].reads.push_back(3);
+	temporalPasses[3].writes.push_back(PlanBackBuffer);
+	PostProcessPlan history = PlanPostProcessTargets(temporal, temporalPasses);
+	report.keepsHistoryApart = history.physical[1] < 0 && history.physical[2] < 0 && history.physical[0] == history.physical[3] &&
+		history.physicalClass.size() == 1 && !Rejects(temporal, temporalPasses);
+
+	report.blurTextures = (unsigned int)blur.physicalClass.size();
+	return report;
+}
+#endif
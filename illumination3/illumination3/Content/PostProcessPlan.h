@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace DirectXGame1
+{
+	// The back buffer in a pass's writes; may be written, never read.
+	static const int PlanBackBuffer = -1;
+
+	enum class PostProcessTargetRole
+	{
+		Transient,		// written and read within the frame; may share a texture
+		History,		// written this frame and kept for the next; never shares
+		PreviousFrame	// what the History target before it held last frame; read only
+	};
+
+	struct PostProcessPlanTarget
+	{
+		unsigned int descClass;		// targets share a texture only within a class, see ClassifyDescs
+		PostProcessTargetRole role;
+	};
+
+	struct PostProcessPlanPass
+	{
+		std::vector<int> reads;		// target indices
+		std::vector<int> writes;	// target indices or PlanBackBuffer
+	};
+
+	struct PostProcessPlan
+	{
+		std::vector<int> firstWrite;		// per target: first pass writing it, -1 if none
+		std::vector<int> lastUse;			// per target: last pass reading or writing it
+		std::vector<int> physical;			// per target: shared texture, -1 for history and unused targets
+		std::vector<unsigned int> physicalClass;	// per shared texture: the desc class it holds
+	};
+
+	// Numbers descs so equal ones get the same class and different ones (another format,
+	// scale or size) never do. Desc only needs operator==.
+	template <typename Desc>
+	std::vector<unsigned int> ClassifyDescs(const std::vector<Desc>& descs)
+	{
+		std::vector<unsigned int> classes(descs.size());
+		for (size_t i = 0; i < descs.size(); i++)
+		{
+			classes[i] = (unsigned int)i;
+			for (size_t j = 0; j < i; j++)
+			{
+				if (descs[j] == descs[i])
+				{
+					classes[i] = classes[j];
+					break;
+				}
+			}
+		}
+		return classes;
+	}
+
+	// Works out when each target is first written and last used, then packs the transient
+	// targets greedily: in the order they come alive, each goes into the first texture of
+	// its class whose previous occupant's last use is an earlier pass. A target read and one
+	// written by the same pass are both alive in that pass, so they never share.
+	// Throws std::invalid_argument for a read of an unknown target, of the back buffer, or of
+	// a target no earlier pass wrote (a PreviousFrame target counts as written), for a pass
+	// that reads what it writes, and for a write to a PreviousFrame target.
+	PostProcessPlan PlanPostProcessTargets(const std::vector<PostProcessPlanTarget>& targets, const std::vector<PostProcessPlanPass>& passes);
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct PostProcessPlanReport
+	{
+		bool sharesEqualDescs;			// canvas and blurred share once the blur's temporary is written
+		bool separatesOtherDescs;		// another format or scale gets its own texture
+		bool separatesReadAndWrite;		// a pass's last read and its first write do not share
+		bool rejectsReadBeforeWrite;
+		bool rejectsReadOfOwnWrite;
+		bool keepsHistoryApart;			// history and previous-frame targets get no shared texture
+		unsigned int blurTextures;		// for the canvas, temporary and blurred targets
+	};
+
+	// Plans small chains shaped like the renderer's and checks what got shared.
+	PostProcessPlanReport ValidatePostProcessPlan();
+#endif
+}
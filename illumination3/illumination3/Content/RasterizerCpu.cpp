@@ -0,0 +1,999 @@
+#include "RasterizerCpu.h"
+#include "MeshOptimizer.h"
+#include "ScreenEffectsCpu.h"
+#include "../Helpers/MappedFile.h"
+#include "../Helpers/ParallelFor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+using namespace DirectXGame1;
+using namespace DX;
+
+namespace
+{
+	typedef RasterizerCpu::ShadedVertex ShadedVertex;
+	typedef RasterizerCpu::TriangleSetup TriangleSetup;
+	const int Interpolants = RasterizerCpu::Interpolants;
+
+	const uint32_t VertexBatch = 4096;		// vertices per vertex-shader task
+	const uint32_t ChunkTriangles = 4096;	// triangles per setup and binning task
+	const float SubpixelScale = 256.0f;
+	const float ClearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };	// DirectX::Colors::Black
+	const float Ambient = 0.1f * 0.1f;
+	const float DegreesPerSecond = 45.0f;
+	const float Pi = 3.14159265358979f;
+
+	// mul(v, m) for a row vector.
+	void Transform(const float v[4], const float m[4][4], float out[4])
+	{
+		SimdFloat4 r = SimdMul(SimdSplat(v[0]), SimdLoad(m[0]));
+		r = SimdMulAdd(SimdSplat(v[1]), SimdLoad(m[1]), r);
+		r = SimdMulAdd(SimdSplat(v[2]), SimdLoad(m[2]), r);
+		r = SimdMulAdd(SimdSplat(v[3]), SimdLoad(m[3]), r);
+		SimdStore(out, r);
+	}
+
+	// SampleVertexShader.hlsl main().
+	void ShadeVertex(const MeshVertex& input, const WorldPassCpuConstants& constants, ShadedVertex& output)
+	{
+		const float pos[4] = { input.pos[0], input.pos[1], input.pos[2], 1.0f };
+		const float norm[4] = { input.normal[0], input.normal[1], input.normal[2], 0.0f };
+		float surfpos[4], viewPos[4], normal[4];
+		Transform(pos, constants.model, surfpos);
+		Transform(surfpos, constants.view, viewPos);
+		Transform(viewPos, constants.projection, output.clip);
+		Transform(norm, constants.model, normal);
+		for (int c = 0; c < 3; c++)
+		{
+			output.color[c] = input.color[c];
+			output.normal[c] = normal[c];
+			output.surfpos[c] = surfpos[c];
+		}
+	}
+
+	const int ShadedFloats = sizeof(ShadedVertex) / sizeof(float);
+
+	ShadedVertex LerpVertex(const ShadedVertex& a, const ShadedVertex& b, float t)
+	{
+		ShadedVertex out;
+		const float* pa = a.clip;
+		const float* pb = b.clip;
+		float* po = out.clip;
+		for (int i = 0; i < ShadedFloats; i++)
+		{
+			po[i] = pa[i] + (pb[i] - pa[i]) * t;
+		}
+		return out;
+	}
+
+	// Sutherland-Hodgman against z >= 0; the far plane is left to the depth test, which
+	// rejects everything past it against a depth cleared to 1. Returns the vertex count.
+	int ClipNear(const ShadedVertex* const in[3], ShadedVertex out[4])
+	{
+		int count = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			const ShadedVertex& a = *in[i];
+			const ShadedVertex& b = *in[(i + 1) % 3];
+			float da = a.clip[2];
+			float db = b.clip[2];
+			if (da >= 0.0f)
+			{
+				out[count++] = a;
+			}
+			if ((da >= 0.0f) != (db >= 0.0f))
+			{
+				out[count++] = LerpVertex(a, b, da / (da - db));
+			}
+		}
+		return count;
+	}
+
+	struct ScreenVertex
+	{
+		float x, y;
+		float values[Interpolants];
+	};
+
+	float Snap(float v)
+	{
+		return std::floor(v * SubpixelScale + 0.5f) / SubpixelScale;
+	}
+
+	void Project(const ShadedVertex& v, float width, float height, ScreenVertex& out)
+	{
+		float invW = 1.0f / v.clip[3];
+		out.x = Snap((v.clip[0] * invW * 0.5f + 0.5f) * width);
+		out.y = Snap((0.5f - v.clip[1] * invW * 0.5f) * height);
+		out.values[0] = v.clip[2] * invW;
+		out.values[1] = invW;
+		for (int c = 0; c < 3; c++)
+		{
+			out.values[2 + c] = v.color[c] * invW;
+			out.values[5 + c] = v.normal[c] * invW;
+			out.values[8 + c] = v.surfpos[c] * invW;
+		}
+	}
+
+	int ClampToInt(float v, int lo, int hi)
+	{
+		return v > (float)lo ? (v < (float)hi ? (int)v : hi) : lo;
+	}
+
+	enum class SetupResult
+	{
+		Ready,
+		Culled,
+		Outside
+	};
+
+	SetupResult SetUpTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2, int width, int height, TriangleSetup& s)
+	{
+		// Clockwise on the target (y down) is a positive area and front facing.
+		double area = (double(v1.x) - v0.x) * (double(v2.y) - v0.y) - (double(v2.x) - v0.x) * (double(v1.y) - v0.y);
+		if (!(area > 0.0))
+		{
+			return SetupResult::Culled;
+		}
+
+		// Pixels whose centres can be inside.
+		float minX = std::min(v0.x, std::min(v1.x, v2.x));
+		float maxX = std::max(v0.x, std::max(v1.x, v2.x));
+		float minY = std::min(v0.y, std::min(v1.y, v2.y));
+		float maxY = std::max(v0.y, std::max(v1.y, v2.y));
+		s.minX = ClampToInt(std::ceil(minX - 0.5f), 0, width - 1);
+		s.maxX = ClampToInt(std::floor(maxX - 0.5f), -1, width - 1);
+		s.minY = ClampToInt(std::ceil(minY - 0.5f), 0, height - 1);
+		s.maxY = ClampToInt(std::floor(maxY - 0.5f), -1, height - 1);
+		if (s.minX > s.maxX || s.minY > s.maxY)
+		{
+			return SetupResult::Outside;
+		}
+
+		// Edge i is opposite vertex i and runs from vertex i + 1 to vertex i + 2.
+		const ScreenVertex* v[3] = { &v0, &v1, &v2 };
+		for (int i = 0; i < 3; i++)
+		{
+			const ScreenVertex& a = *v[(i + 1) % 3];
+			const ScreenVertex& b = *v[(i + 2) % 3];
+			float dx = b.x - a.x;
+			float dy = b.y - a.y;
+			// With clockwise winding and y down, left edges go up and top edges go right.
+			s.topLeft[i] = dy < 0.0f || (dy == 0.0f && dx > 0.0f);
+
+			bool forward = a.x < b.x || (a.x == b.x && a.y < b.y);
+			const ScreenVertex& first = forward ? a : b;
+			const ScreenVertex& second = forward ? b : a;
+			s.edgeX[i] = first.x;
+			s.edgeY[i] = first.y;
+			s.edgeDx[i] = second.x - first.x;
+			s.edgeDy[i] = second.y - first.y;
+			s.edgeSign[i] = forward ? 1.0f : -1.0f;
+		}
+
+		// Barycentrics of vertices 1 and 2 are their opposite edge functions over the area.
+		double a1 = double(v2.y) - v0.y, b1 = double(v0.x) - v2.x;
+		double a2 = double(v0.y) - v1.y, b2 = double(v1.x) - v0.x;
+		s.x0 = v0.x;
+		s.y0 = v0.y;
+		for (int n = 0; n < Interpolants; n++)
+		{
+			double d1 = double(v1.values[n]) - v0.values[n];
+			double d2 = double(v2.values[n]) - v0.values[n];
+			s.planes[n][0] = v0.values[n];
+			s.planes[n][1] = (float)((d1 * a1 + d2 * a2) / area);
+			s.planes[n][2] = (float)((d1 * b1 + d2 * b2) / area);
+		}
+		return SetupResult::Ready;
+	}
+
+	// Clips, projects, culls and sets up triangles [first, first + count), appending to out.
+	void SetUpTriangles(const ShadedVertex* vertices, const uint32_t* indices, uint32_t first, uint32_t count, int width, int height, std::vector<TriangleSetup>& out, uint32_t& clipped, uint32_t& culled)
+	{
+		for (uint32_t t = first; t < first + count; t++)
+		{
+			const ShadedVertex* in[3] = { &vertices[indices[t * 3]], &vertices[indices[t * 3 + 1]], &vertices[indices[t * 3 + 2]] };
+			ShadedVertex polygon[4];
+			int polygonCount = 3;
+			if (in[0]->clip[2] < 0.0f || in[1]->clip[2] < 0.0f || in[2]->clip[2] < 0.0f)
+			{
+				clipped++;
+				polygonCount = ClipNear(in, polygon);
+			}
+			else
+			{
+				for (int i = 0; i < 3; i++)
+				{
+					polygon[i] = *in[i];
+				}
+			}
+
+			ScreenVertex screen[4];
+			for (int i = 0; i < polygonCount; i++)
+			{
+				Project(polygon[i], (float)width, (float)height, screen[i]);
+			}
+			for (int i = 2; i < polygonCount; i++)
+			{
+				TriangleSetup setup;
+				SetupResult result = SetUpTriangle(screen[0], screen[i - 1], screen[i], width, height, setup);
+				if (result == SetupResult::Ready)
+				{
+					out.push_back(setup);
+				}
+				else if (result == SetupResult::Culled)
+				{
+					culled++;
+				}
+			}
+		}
+	}
+
+	// x^275 as 256 + 16 + 2 + 1, the same products in both versions.
+	template <typename T, typename Mul>
+	T Pow275(T x, Mul mul)
+	{
+		T x2 = mul(x, x);
+		T x4 = mul(x2, x2);
+		T x8 = mul(x4, x4);
+		T x16 = mul(x8, x8);
+		T x32 = mul(x16, x16);
+		T x64 = mul(x32, x32);
+		T x128 = mul(x64, x64);
+		T x256 = mul(x128, x128);
+		return mul(mul(mul(x256, x16), x2), x);
+	}
+
+	// SamplePixelShader.hlsl main(), four pixels at a time. values are the interpolants at
+	// the pixels; rgb receives the output colour, whose alpha is always 1.
+	void ShadeQuad(const SimdFloat4 values[Interpolants], const WorldPassCpuConstants& constants, SimdFloat4 rgb[3])
+	{
+		auto mul = [](SimdFloat4 a, SimdFloat4 b) { return SimdMul(a, b); };
+		auto dot = [](const SimdFloat4 a[3], const SimdFloat4 b[3]) { return SimdAdd(SimdAdd(SimdMul(a[0], b[0]), SimdMul(a[1], b[1])), SimdMul(a[2], b[2])); };
+		auto normalize = [&](SimdFloat4 v[3])
+		{
+			SimdFloat4 length = SimdSqrt(dot(v, v));
+			for (int c = 0; c < 3; c++)
+			{
+				v[c] = SimdDiv(v[c], length);
+			}
+		};
+
+		SimdFloat4 w = SimdDiv(SimdSplat(1.0f), values[1]);
+		SimdFloat4 N[3], V[3], L[3], H[3];
+		for (int c = 0; c < 3; c++)
+		{
+			N[c] = SimdMul(values[5 + c], w);
+			SimdFloat4 surfpos = SimdMul(values[8 + c], w);
+			V[c] = SimdSub(SimdSplat(constants.eyePosition[c]), surfpos);
+			L[c] = SimdSub(SimdSplat(constants.lightPosition[c]), surfpos);
+		}
+		normalize(N);
+		normalize(V);
+		normalize(L);
+		SimdFloat4 diffuse = dot(N, L);
+		for (int c = 0; c < 3; c++)
+		{
+			H[c] = SimdMul(SimdSplat(0.5f), SimdAdd(V[c], L[c]));
+		}
+		normalize(H);
+
+		// pow() goes through log2, so a negative base gives NaN.
+		SimdFloat4 spec = dot(N, H);
+		SimdFloat4 negative = SimdCmpLt(spec, SimdZero());
+		spec = SimdSelect(Pow275(spec, mul), SimdSplat(std::numeric_limits<float>::quiet_NaN()), negative);
+
+		SimdFloat4 c = SimdAdd(SimdAdd(SimdMul(SimdSplat(0.5f), diffuse), SimdMul(SimdSplat(1.3f), spec)), SimdSplat(Ambient));
+		rgb[0] = SimdMul(SimdMul(values[2], w), c);
+		rgb[1] = SimdMul(SimdMul(values[3], w), c);
+		rgb[2] = SimdMul(SimdSplat(constants.eyePosition[0] / 10.0f), c);
+	}
+
+	// The same one pixel at a time, operation for operation.
+	void ShadePixel(const float values[Interpolants], const WorldPassCpuConstants& constants, float rgb[3])
+	{
+		auto mul = [](float a, float b) { return a * b; };
+		auto dot = [](const float a[3], const float b[3]) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; };
+		auto normalize = [&](float v[3])
+		{
+			float length = std::sqrt(dot(v, v));
+			for (int c = 0; c < 3; c++)
+			{
+				v[c] = v[c] / length;
+			}
+		};
+
+		float w = 1.0f / values[1];
+		float N[3], V[3], L[3], H[3];
+		for (int c = 0; c < 3; c++)
+		{
+			N[c] = values[5 + c] * w;
+			float surfpos = values[8 + c] * w;
+			V[c] = constants.eyePosition[c] - surfpos;
+			L[c] = constants.lightPosition[c] - surfpos;
+		}
+		normalize(N);
+		normalize(V);
+		normalize(L);
+		float diffuse = dot(N, L);
+		for (int c = 0; c < 3; c++)
+		{
+			H[c] = 0.5f * (V[c] + L[c]);
+		}
+		normalize(H);
+
+		float spec = dot(N, H);
+		spec = spec < 0.0f ? std::numeric_limits<float>::quiet_NaN() : Pow275(spec, mul);
+
+		float c = 0.5f * diffuse + 1.3f * spec + Ambient;
+		rgb[0] = values[2] * w * c;
+		rgb[1] = values[3] * w * c;
+		rgb[2] = constants.eyePosition[0] / 10.0f * c;
+	}
+
+	// Pixel centres of a 2x2 quad relative to its top-left pixel, in lane order.
+	const float QuadX[4] = { 0.5f, 1.5f, 0.5f, 1.5f };
+	const float QuadY[4] = { 0.5f, 0.5f, 1.5f, 1.5f };
+
+	// Coverage of the quad at (x, y) as a lane mask.
+	int CoverQuad(const TriangleSetup& s, SimdFloat4 X, SimdFloat4 Y)
+	{
+		int mask = 15;
+		for (int i = 0; i < 3 && mask; i++)
+		{
+			SimdFloat4 e = SimdMul(SimdSplat(s.edgeSign[i]), SimdSub(
+				SimdMul(SimdSplat(s.edgeDx[i]), SimdSub(Y, SimdSplat(s.edgeY[i]))),
+				SimdMul(SimdSplat(s.edgeDy[i]), SimdSub(X, SimdSplat(s.edgeX[i])))));
+			mask &= s.topLeft[i] ? ~SimdMoveMask(SimdCmpLt(e, SimdZero())) : SimdMoveMask(SimdCmpGt(e, SimdZero()));
+		}
+		return mask & 15;
+	}
+
+	bool CoverPixel(const TriangleSetup& s, float x, float y)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			float e = s.edgeSign[i] * (s.edgeDx[i] * (y - s.edgeY[i]) - s.edgeDy[i] * (x - s.edgeX[i]));
+			if (s.topLeft[i] ? e < 0.0f : !(e > 0.0f))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	SimdFloat4 EvaluatePlane(const float plane[3], SimdFloat4 dx, SimdFloat4 dy)
+	{
+		return SimdAdd(SimdAdd(SimdSplat(plane[0]), SimdMul(SimdSplat(plane[1]), dx)), SimdMul(SimdSplat(plane[2]), dy));
+	}
+
+	float EvaluatePlane(const float plane[3], float dx, float dy)
+	{
+		return plane[0] + plane[1] * dx + plane[2] * dy;
+	}
+
+	// One triangle into one tile. depth holds the tile's quads, four floats each, row-major.
+	uint64_t RasterizeInTile(const TriangleSetup& s, const Tile& tile, const WorldPassCpuConstants& constants, float* depth, unsigned int quadsX, CpuCanvas& target)
+	{
+		int x0 = std::max(s.minX, (int)tile.x0) & ~1;
+		int x1 = std::min(s.maxX, (int)tile.x1 - 1);
+		int y0 = std::max(s.minY, (int)tile.y0) & ~1;
+		int y1 = std::min(s.maxY, (int)tile.y1 - 1);
+		uint64_t written = 0;
+
+		for (int y = y0; y <= y1; y += 2)
+		{
+			SimdFloat4 Y = SimdAdd(SimdSplat((float)y), SimdLoad(QuadY));
+			SimdFloat4 dy = SimdSub(Y, SimdSplat(s.y0));
+			// Lanes past the bottom or right of the tile (an odd target size) stay off.
+			int rowMask = y + 1 < (int)tile.y1 ? 15 : 3;
+			float* depthRow = depth + size_t((y - tile.y0) / 2) * quadsX * 4;
+
+			for (int x = x0; x <= x1; x += 2)
+			{
+				SimdFloat4 X = SimdAdd(SimdSplat((float)x), SimdLoad(QuadX));
+				int mask = rowMask & (x + 1 < (int)tile.x1 ? 15 : 5);
+				mask &= CoverQuad(s, X, Y);
+				if (!mask)
+				{
+					continue;
+				}
+
+				SimdFloat4 dx = SimdSub(X, SimdSplat(s.x0));
+				SimdFloat4 z = EvaluatePlane(s.planes[0], dx, dy);
+				float* depthQuad = depthRow + (x - tile.x0) / 2 * 4;
+				mask &= SimdMoveMask(SimdCmpLt(z, SimdLoad(depthQuad)));
+				if (!mask)
+				{
+					continue;
+				}
+
+				SimdFloat4 values[Interpolants];
+				values[0] = z;
+				for (int n = 1; n < Interpolants; n++)
+				{
+					values[n] = EvaluatePlane(s.planes[n], dx, dy);
+				}
+				SimdFloat4 rgba[4];
+				ShadeQuad(values, constants, rgba);
+				rgba[3] = SimdSplat(1.0f);
+				SimdTranspose4(rgba[0], rgba[1], rgba[2], rgba[3]);
+
+				float zs[4];
+				SimdStore(zs, z);
+				for (int lane = 0; lane < 4; lane++)
+				{
+					if (mask & (1 << lane))
+					{
+						depthQuad[lane] = zs[lane];
+						SimdStore(target.At(x + (lane & 1), y + (lane >> 1)), rgba[lane]);
+						written++;
+					}
+				}
+			}
+		}
+		return written;
+	}
+
+	void ShadeVertices(const WorldPassCpuConstants& constants, const MeshVertex* vertices, uint32_t vertexCount, ShadedVertex* out, unsigned int maxWorkers)
+	{
+		ParallelFor((vertexCount + VertexBatch - 1) / VertexBatch, [&](unsigned int batch)
+		{
+			uint32_t end = std::min(vertexCount, (batch + 1) * VertexBatch);
+			for (uint32_t v = batch * VertexBatch; v < end; v++)
+			{
+				ShadeVertex(vertices[v], constants, out[v]);
+			}
+		}, maxWorkers);
+	}
+
+	void CheckTarget(const CpuCanvas& target)
+	{
+		if (target.width == 0 || target.height == 0)
+		{
+			throw std::invalid_argument("RasterizerCpu: the target is empty");
+		}
+	}
+
+	// Row-vector versions of the DirectXMath matrices the renderer builds.
+	void SetIdentity(float m[4][4])
+	{
+		for (int r = 0; r < 4; r++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				m[r][c] = r == c ? 1.0f : 0.0f;
+			}
+		}
+	}
+
+	void Cross(const float a[3], const float b[3], float out[3])
+	{
+		out[0] = a[1] * b[2] - a[2] * b[1];
+		out[1] = a[2] * b[0] - a[0] * b[2];
+		out[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	void Normalize3(float v[3])
+	{
+		float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		for (int c = 0; c < 3; c++)
+		{
+			v[c] /= length;
+		}
+	}
+
+	// XMMatrixLookAtRH.
+	void LookAtRH(const float eye[3], const float at[3], const float up[3], float m[4][4])
+	{
+		float zAxis[3] = { eye[0] - at[0], eye[1] - at[1], eye[2] - at[2] };
+		Normalize3(zAxis);
+		float xAxis[3];
+		Cross(up, zAxis, xAxis);
+		Normalize3(xAxis);
+		float yAxis[3];
+		Cross(zAxis, xAxis, yAxis);
+		const float* axes[3] = { xAxis, yAxis, zAxis };
+		for (int c = 0; c < 3; c++)
+		{
+			for (int r = 0; r < 3; r++)
+			{
+				m[r][c] = axes[c][r];
+			}
+			m[3][c] = -(axes[c][0] * eye[0] + axes[c][1] * eye[1] + axes[c][2] * eye[2]);
+			m[c][3] = 0.0f;
+		}
+		m[3][3] = 1.0f;
+	}
+
+	// XMMatrixPerspectiveFovRH.
+	void PerspectiveFovRH(float fovY, float aspectRatio, float nearZ, float farZ, float m[4][4])
+	{
+		float h = 1.0f / std::tan(fovY * 0.5f);
+		float range = farZ / (nearZ - farZ);
+		std::memset(m, 0, sizeof(float) * 16);
+		m[0][0] = h / aspectRatio;
+		m[1][1] = h;
+		m[2][2] = range;
+		m[2][3] = -1.0f;
+		m[3][2] = range * nearZ;
+	}
+
+	// XMMatrixRotationY.
+	void RotationY(float radians, float m[4][4])
+	{
+		SetIdentity(m);
+		m[0][0] = std::cos(radians);
+		m[0][2] = -std::sin(radians);
+		m[2][0] = std::sin(radians);
+		m[2][2] = std::cos(radians);
+	}
+}
+
+RasterizerCpu::RasterizerCpu(unsigned int tileSize, unsigned int maxWorkers) :
+	m_tileSize(tileSize),
+	m_maxWorkers(maxWorkers)
+{
+	if (tileSize == 0 || tileSize % 2 != 0)
+	{
+		throw std::invalid_argument("RasterizerCpu: the tile size must be even and not zero");
+	}
+	std::memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void RasterizerCpu::Render(const WorldPassCpuConstants& constants, const MeshVertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, CpuCanvas& target)
+{
+	CheckTarget(target);
+	const int width = (int)target.width;
+	const int height = (int)target.height;
+	const std::vector<Tile> tiles = MakeTiles(target.width, target.height, m_tileSize);
+	const unsigned int tilesX = (target.width + m_tileSize - 1) / m_tileSize;
+
+	m_vertices.resize(vertexCount);
+	if (vertexCount)
+	{
+		ShadeVertices(constants, vertices, vertexCount, &m_vertices[0], m_maxWorkers);
+	}
+
+	// Set up and bin each chunk of triangles on its own; every chunk keeps its own bins, so
+	// walking the chunks in order keeps the submission order.
+	uint32_t triangleCount = indexCount / 3;
+	unsigned int chunks = (triangleCount + ChunkTriangles - 1) / ChunkTriangles;
+	m_setups.resize(chunks);
+	m_bins.resize(chunks);
+	std::vector<uint32_t> clipped(chunks, 0);
+	std::vector<uint32_t> culled(chunks, 0);
+	ParallelFor(chunks, [&](unsigned int c)
+	{
+		std::vector<TriangleSetup>& setups = m_setups[c];
+		std::vector<std::vector<uint32_t>>& bins = m_bins[c];
+		setups.clear();
+		bins.resize(tiles.size());
+		for (auto& bin : bins)
+		{
+			bin.clear();
+		}
+
+		uint32_t first = c * ChunkTriangles;
+		SetUpTriangles(&m_vertices[0], indices, first, std::min(ChunkTriangles, triangleCount - first), width, height, setups, clipped[c], culled[c]);
+		for (uint32_t i = 0; i < (uint32_t)setups.size(); i++)
+		{
+			const TriangleSetup& s = setups[i];
+			for (unsigned int ty = s.minY / m_tileSize; ty <= s.maxY / m_tileSize; ty++)
+			{
+				for (unsigned int tx = s.minX / m_tileSize; tx <= s.maxX / m_tileSize; tx++)
+				{
+					bins[ty * tilesX + tx].push_back(i);
+				}
+			}
+		}
+	}, m_maxWorkers);
+
+	// One task per tile: clear it, then draw its bins with a depth buffer of its own, which
+	// is copied out to the full-size one at the end.
+	m_tilePixels.assign(tiles.size(), 0);
+	if (m_depth.width != target.width || m_depth.height != target.height)
+	{
+		m_depth.Resize(target.width, target.height);
+	}
+	ParallelFor((unsigned int)tiles.size(), [&](unsigned int t)
+	{
+		const Tile& tile = tiles[t];
+		unsigned int quadsX = (tile.x1 - tile.x0 + 1) / 2;
+		unsigned int quadsY = (tile.y1 - tile.y0 + 1) / 2;
+		std::vector<float> depth(size_t(quadsX) * quadsY * 4, 1.0f);
+		for (unsigned int y = tile.y0; y < tile.y1; y++)
+		{
+			for (unsigned int x = tile.x0; x < tile.x1; x++)
+			{
+				std::memcpy(target.At(x, y), ClearColor, sizeof(ClearColor));
+			}
+		}
+
+		uint64_t written = 0;
+		for (unsigned int c = 0; c < chunks; c++)
+		{
+			const std::vector<TriangleSetup>& setups = m_setups[c];
+			for (uint32_t i : m_bins[c][t])
+			{
+				written += RasterizeInTile(setups[i], tile, constants, &depth[0], quadsX, target);
+			}
+		}
+		m_tilePixels[t] = written;
+
+		for (unsigned int y = tile.y0; y < tile.y1; y++)
+		{
+			const float* depthRow = &depth[size_t((y - tile.y0) / 2) * quadsX * 4 + ((y - tile.y0) & 1) * 2];
+			float* out = m_depth.Row(y);
+			for (unsigned int x = tile.x0; x < tile.x1; x++)
+			{
+				out[x] = depthRow[(x - tile.x0) / 2 * 4 + ((x - tile.x0) & 1)];
+			}
+		}
+	}, m_maxWorkers);
+
+	std::memset(&m_stats, 0, sizeof(m_stats));
+	m_stats.trianglesSubmitted = triangleCount;
+	for (unsigned int c = 0; c < chunks; c++)
+	{
+		m_stats.trianglesClipped += clipped[c];
+		m_stats.trianglesCulled += culled[c];
+		m_stats.trianglesSetUp += (uint32_t)m_setups[c].size();
+		for (const auto& bin : m_bins[c])
+		{
+			m_stats.tileTriangles += bin.size();
+		}
+	}
+	for (uint64_t written : m_tilePixels)
+	{
+		m_stats.pixelsWritten += written;
+	}
+}
+
+void DirectXGame1::RenderWorldPassCpuReference(const WorldPassCpuConstants& constants, const MeshVertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, CpuCanvas& target)
+{
+	CheckTarget(target);
+	const int width = (int)target.width;
+	const int height = (int)target.height;
+
+	std::vector<ShadedVertex> shaded(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		ShadeVertex(vertices[v], constants, shaded[v]);
+	}
+	std::vector<TriangleSetup> setups;
+	uint32_t clipped = 0, culled = 0;
+	if (vertexCount)
+	{
+		SetUpTriangles(&shaded[0], indices, 0, indexCount / 3, width, height, setups, clipped, culled);
+	}
+
+	std::vector<float> depth(size_t(width) * height, 1.0f);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			std::memcpy(target.At(x, y), ClearColor, sizeof(ClearColor));
+		}
+	}
+
+	for (const TriangleSetup& s : setups)
+	{
+		for (int y = s.minY; y <= s.maxY; y++)
+		{
+			for (int x = s.minX; x <= s.maxX; x++)
+			{
+				float px = (float)x + 0.5f;
+				float py = (float)y + 0.5f;
+				if (!CoverPixel(s, px, py))
+				{
+					continue;
+				}
+				float dx = px - s.x0;
+				float dy = py - s.y0;
+				float z = EvaluatePlane(s.planes[0], dx, dy);
+				float& stored = depth[size_t(y) * width + x];
+				if (!(z < stored))
+				{
+					continue;
+				}
+				stored = z;
+
+				float values[Interpolants];
+				values[0] = z;
+				for (int n = 1; n < Interpolants; n++)
+				{
+					values[n] = EvaluatePlane(s.planes[n], dx, dy);
+				}
+				float* texel = target.At(x, y);
+				ShadePixel(values, constants, texel);
+				texel[3] = 1.0f;
+			}
+		}
+	}
+}
+
+TorusSceneCpu::TorusSceneCpu()
+{
+	MeshShapeDesc desc = MeshShapeDesc::Torus(90, 30, 0.6f, 0.2f);
+	vertices.resize(MeshVertexCount(desc));
+	indices.resize(MeshIndexCount(desc));
+	GenerateMesh(desc, &vertices[0], &indices[0]);
+	MeshData mesh = { &vertices[0], (uint32_t)vertices.size(), &indices[0], (uint32_t)indices.size() };
+	OptimizeMesh(mesh);
+	vertices.resize(mesh.vertexCount);
+}
+
+WorldPassCpuConstants DirectXGame1::GetTorusFrameConstants(float seconds, uint32_t frame, float aspectRatio)
+{
+	WorldPassCpuConstants constants;
+
+	float fovAngleY = 70.0f * Pi / 180.0f;
+	if (aspectRatio < 1.0f)
+	{
+		fovAngleY *= 2.0f;
+	}
+	PerspectiveFovRH(fovAngleY, aspectRatio, 0.1f, 100.0f, constants.projection);
+
+	const float eye[3] = { 0.0f, 0.0f, 1.5f };
+	const float at[3] = { 0.0f, -0.1f, 0.0f };
+	const float up[3] = { 0.0f, 1.0f, 0.0f };
+	LookAtRH(eye, at, up, constants.view);
+
+	double totalRotation = seconds * (DegreesPerSecond * Pi / 180.0f);
+	RotationY(static_cast<float>(std::fmod(totalRotation, 2.0 * Pi)), constants.model);
+
+	for (int c = 0; c < 3; c++)
+	{
+		constants.eyePosition[c] = eye[c];
+	}
+	constants.lightPosition[0] = 5 * std::sin(frame / 25.0f);
+	constants.lightPosition[1] = 2.0f;
+	constants.lightPosition[2] = 2.0f;
+	return constants;
+}
+
+void DirectXGame1::RenderTorusFrameCpu(const TorusSceneCpu& scene, float seconds, uint32_t frame, RasterizerCpu& rasterizer, CpuCanvas& world, CpuCanvas& screen)
+{
+	CheckTarget(world);
+	WorldPassCpuConstants constants = GetTorusFrameConstants(seconds, frame, float(world.width) / world.height);
+	rasterizer.Render(constants, &scene.vertices[0], (uint32_t)scene.vertices.size(), &scene.indices[0], (uint32_t)scene.indices.size(), world);
+
+	if (screen.width != world.width || screen.height != world.height)
+	{
+		screen.Resize(world.width, world.height);
+	}
+	ApplyScreenEffectsCpu(world, screen, (float)frame);
+}
+
+bool DirectXGame1::WriteCanvasPfm(const std::wstring& path, const CpuCanvas& canvas)
+{
+	char header[64];
+	int headerSize = std::snprintf(header, sizeof(header), "PF\n%u %u\n-1.0\n", canvas.width, canvas.height);
+	std::vector<char> file(header, header + headerSize);
+	file.resize(headerSize + size_t(canvas.width) * canvas.height * 3 * sizeof(float));
+
+	// Negative scale: little-endian floats, which is every platform this builds for.
+	char* out = &file[headerSize];
+	for (uint32_t row = 0; row < canvas.height; row++)
+	{
+		const float* texels = canvas.Row(canvas.height - 1 - row);
+		for (uint32_t x = 0; x < canvas.width; x++)
+		{
+			const float rgb[3] = { DisplayValue(texels[x * 4]), DisplayValue(texels[x * 4 + 1]), DisplayValue(texels[x * 4 + 2]) };
+			std::memcpy(out, rgb, sizeof(rgb));
+			out += sizeof(rgb);
+		}
+	}
+	return WriteFileAtomically(path, &file[0], file.size());
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+namespace
+{
+	// Counts how often each pixel is covered by the front-facing triangles of a mesh given
+	// straight in clip space (identity matrices), and adds the misses and repeats to report.
+	void CheckCoverage(const std::vector<MeshVertex>& vertices, const std::vector<uint32_t>& indices, int width, int height, RasterizerCpuReport& report)
+	{
+		WorldPassCpuConstants constants;
+		SetIdentity(constants.model);
+		SetIdentity(constants.view);
+		SetIdentity(constants.projection);
+
+		std::vector<ShadedVertex> shaded(vertices.size());
+		for (size_t v = 0; v < vertices.size(); v++)
+		{
+			ShadeVertex(vertices[v], constants, shaded[v]);
+		}
+		std::vector<TriangleSetup> setups;
+		uint32_t clipped = 0, culled = 0;
+		SetUpTriangles(&shaded[0], &indices[0], 0, (uint32_t)indices.size() / 3, width, height, setups, clipped, culled);
+
+		std::vector<uint32_t> counts(size_t(width) * height, 0);
+		for (const TriangleSetup& s : setups)
+		{
+			for (int y = s.minY; y <= s.maxY; y++)
+			{
+				for (int x = s.minX; x <= s.maxX; x++)
+				{
+					if (CoverPixel(s, x + 0.5f, y + 0.5f))
+					{
+						counts[size_t(y) * width + x]++;
+					}
+				}
+			}
+		}
+		for (uint32_t count : counts)
+		{
+			report.gapPixels += count == 0;
+			report.overlapPixels += count > 1;
+		}
+	}
+
+	MeshVertex ClipVertex(float x, float y)
+	{
+		MeshVertex v;
+		std::memset(&v, 0, sizeof(v));
+		v.pos[0] = x;
+		v.pos[1] = y;
+		v.pos[2] = 0.5f;
+		v.normal[2] = 1.0f;
+		return v;
+	}
+
+	// An n x n grid turned by angle, big enough to cover clip space whatever the angle.
+	// Clockwise as seen on the target.
+	void MakeGrid(unsigned int n, float angle, std::vector<MeshVertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		const float halfSize = 1.5f;
+		float c = std::cos(angle), s = std::sin(angle);
+		for (unsigned int j = 0; j <= n; j++)
+		{
+			for (unsigned int i = 0; i <= n; i++)
+			{
+				float u = (2.0f * i / n - 1.0f) * halfSize;
+				float v = (2.0f * j / n - 1.0f) * halfSize;
+				vertices.push_back(ClipVertex(u * c - v * s, u * s + v * c));
+			}
+		}
+		for (unsigned int j = 0; j < n; j++)
+		{
+			for (unsigned int i = 0; i < n; i++)
+			{
+				uint32_t a = j * (n + 1) + i, b = a + 1, d = a + n + 1, e = d + 1;
+				const uint32_t quad[6] = { a, d, b, b, d, e };
+				indices.insert(indices.end(), quad, quad + 6);
+			}
+		}
+	}
+
+	// sides triangles around (x, y) in pixels, out to a circle around the whole target.
+	void MakeFan(float x, float y, int width, int height, unsigned int sides, std::vector<MeshVertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		vertices.push_back(ClipVertex(x / width * 2.0f - 1.0f, 1.0f - y / height * 2.0f));
+		for (unsigned int i = 0; i < sides; i++)
+		{
+			float angle = 2.0f * Pi * i / sides + 0.1f;
+			vertices.push_back(ClipVertex(4.0f * std::cos(angle), 4.0f * std::sin(angle)));
+		}
+		// Counter-clockwise in clip space (y up) is clockwise on the target, so go the other way.
+		for (unsigned int i = 0; i < sides; i++)
+		{
+			uint32_t next = (i + 1) % sides;
+			const uint32_t triangle[3] = { 0, next + 1, i + 1 };
+			indices.insert(indices.end(), triangle, triangle + 3);
+		}
+	}
+
+	bool SameBits(float a, float b)
+	{
+		return std::memcmp(&a, &b, sizeof(float)) == 0;
+	}
+}
+
+RasterizerCpuReport DirectXGame1::ValidateRasterizerCpu()
+{
+	RasterizerCpuReport report;
+	std::memset(&report, 0, sizeof(report));
+
+	TorusSceneCpu scene;
+	static const unsigned int sizes[][2] = { { 320, 200 }, { 333, 187 } };
+	for (auto& size : sizes)
+	{
+		CpuCanvas tiled(size[0], size[1]);
+		CpuCanvas reference(size[0], size[1]);
+		RasterizerCpu rasterizer(16);
+		for (uint32_t frame = 1; frame <= 90; frame += 11)
+		{
+			WorldPassCpuConstants constants = GetTorusFrameConstants(frame * 0.37f, frame, float(size[0]) / size[1]);
+			rasterizer.Render(constants, &scene.vertices[0], (uint32_t)scene.vertices.size(), &scene.indices[0], (uint32_t)scene.indices.size(), tiled);
+			RenderWorldPassCpuReference(constants, &scene.vertices[0], (uint32_t)scene.vertices.size(), &scene.indices[0], (uint32_t)scene.indices.size(), reference);
+
+			for (size_t i = 0; i < tiled.texels.size(); i += 4)
+			{
+				bool same = true;
+				for (int c = 0; c < 4; c++)
+				{
+					float a = tiled.texels[i + c], b = reference.texels[i + c];
+					if (!SameBits(a, b))
+					{
+						same = false;
+						float difference = (std::isnan(a) || std::isnan(b)) ? 1.0f : std::fabs(a - b);
+						report.maxDifference = std::max(report.maxDifference, difference);
+					}
+				}
+				report.mismatchedPixels += !same;
+			}
+		}
+	}
+
+	const int width = 256, height = 160;
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+	MakeGrid(37, 0.3f, vertices, indices);
+	CheckCoverage(vertices, indices, width, height, report);
+
+	const float centres[][2] = { { 128.5f, 80.5f }, { 128.0f, 80.0f }, { 101.3f, 47.9f } };
+	for (auto& centre : centres)
+	{
+		vertices.clear();
+		indices.clear();
+		MakeFan(centre[0], centre[1], width, height, 40, vertices, indices);
+		CheckCoverage(vertices, indices, width, height, report);
+	}
+	return report;
+}
+
+RasterizerCpuBenchmark DirectXGame1::BenchmarkRasterizerCpu(unsigned int frames)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	RasterizerCpuBenchmark result;
+	result.width = 1920;
+	result.height = 1080;
+	result.workers = GetWorkerCount();
+
+	TorusSceneCpu scene;
+	result.triangles = (uint32_t)scene.indices.size() / 3;
+	CpuCanvas world(result.width, result.height);
+	CpuCanvas screen(result.width, result.height);
+	float aspectRatio = float(result.width) / result.height;
+
+	auto timeWorldPass = [&](RasterizerCpu& rasterizer)
+	{
+		// One untimed frame to fault in the pages and grow the scratch memory.
+		WorldPassCpuConstants constants = GetTorusFrameConstants(0.0f, 1, aspectRatio);
+		rasterizer.Render(constants, &scene.vertices[0], (uint32_t)scene.vertices.size(), &scene.indices[0], (uint32_t)scene.indices.size(), world);
+
+		auto start = Clock::now();
+		for (unsigned int frame = 0; frame < frames; frame++)
+		{
+			constants = GetTorusFrameConstants(frame / 60.0f, frame + 1, aspectRatio);
+			rasterizer.Render(constants, &scene.vertices[0], (uint32_t)scene.vertices.size(), &scene.indices[0], (uint32_t)scene.indices.size(), world);
+		}
+		double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		return frames ? milliseconds / frames : 0.0;
+	};
+
+	RasterizerCpu single(64, 1);
+	RasterizerCpu parallel;
+	result.singleMilliseconds = timeWorldPass(single);
+	result.parallelMilliseconds = timeWorldPass(parallel);
+	result.trianglesPerMillisecond = result.parallelMilliseconds > 0.0 ? result.triangles / result.parallelMilliseconds : 0.0;
+	result.megapixelsPerSecond = result.parallelMilliseconds > 0.0 ? double(result.width) * result.height / result.parallelMilliseconds / 1000.0 : 0.0;
+
+	auto start = Clock::now();
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		ApplyScreenEffectsCpu(world, screen, (float)frame);
+	}
+	double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	result.screenMilliseconds = frames ? milliseconds / frames : 0.0;
+	return result;
+}
+#endif
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CpuCanvas.h"
+#include "MeshGenerator.h"
+
+namespace DirectXGame1
+{
+	// What the world pass's constant buffers hold, untransposed: row-vector matrices as the
+	// shaders see them (mul(v, M)).
+	struct WorldPassCpuConstants
+	{
+		float model[4][4];
+		float view[4][4];
+		float projection[4][4];
+		float eyePosition[3];
+		float lightPosition[3];
+	};
+
+	struct RasterizerCpuStats
+	{
+		uint32_t trianglesSubmitted;
+		uint32_t trianglesClipped;		// cut by the near plane, whole or in part
+		uint32_t trianglesCulled;		// back-facing or degenerate after snapping
+		uint32_t trianglesSetUp;		// what was left to bin
+		uint64_t tileTriangles;			// bin entries over all tiles
+		uint64_t pixelsWritten;			// passed the depth test; shading runs after it
+	};
+
+	// CPU version of the world pass: SampleVertexShader.hlsl and the Blinn-Phong
+	// SamplePixelShader.hlsl, with the D3D11 defaults the renderer relies on (clockwise front
+	// faces, back faces culled, depth test LESS against a depth cleared to 1, clipping at
+	// z = 0). The target is cleared to black like the canvas and gets the pixel shader's
+	// output unclamped, NaNs included: pow(spec, 275) is NaN where dot(N, H) < 0, as on the GPU.
+	//
+	// Triangles are set up and binned into tileSize x tileSize tiles in chunks spread over
+	// the workers, then every tile is one task that keeps its own depth and walks its bins
+	// in submission order. Coverage is tested a 2x2 quad at a time with edge functions on
+	// vertices snapped to 1/256 pixel, and the top-left rule keeps shared edges watertight.
+	// The scratch memory is kept between frames, and so is the depth buffer of the last
+	// frame, which is what the depth-stencil view would hold (z / w, 1 where nothing was drawn).
+	class RasterizerCpu
+	{
+	public:
+		// Throws std::invalid_argument for an odd or zero tileSize.
+		explicit RasterizerCpu(unsigned int tileSize = 64, unsigned int maxWorkers = 0);
+
+		// Throws std::invalid_argument for an empty target.
+		void Render(const WorldPassCpuConstants& constants, const MeshVertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, CpuCanvas& target);
+
+		const RasterizerCpuStats& GetStats() const { return m_stats; }
+		const CpuPlane& GetDepth() const { return m_depth; }
+
+		// The vertex shader's output.
+		struct ShadedVertex
+		{
+			float clip[4];
+			float color[3];
+			float normal[3];
+			float surfpos[3];
+		};
+
+		// Interpolated values: depth, 1 / w, then colour, normal and surfpos over w.
+		static const int Interpolants = 11;
+
+		// A triangle ready for coverage tests. Each edge is stored from whichever of its ends
+		// sorts first and turned inward by sign, so the two triangles sharing it evaluate the
+		// same function bit for bit. Planes are value, d/dx and d/dy, anchored at vertex 0.
+		struct TriangleSetup
+		{
+			float x0, y0;
+			float edgeX[3], edgeY[3], edgeDx[3], edgeDy[3], edgeSign[3];
+			bool topLeft[3];
+			int minX, minY, maxX, maxY;		// pixels, inclusive, inside the target
+			float planes[Interpolants][3];
+		};
+
+	private:
+		unsigned int m_tileSize;
+		unsigned int m_maxWorkers;
+		std::vector<ShadedVertex> m_vertices;
+		std::vector<std::vector<TriangleSetup>> m_setups;				// per chunk
+		std::vector<std::vector<std::vector<uint32_t>>> m_bins;			// per chunk, per tile
+		std::vector<uint64_t> m_tilePixels;								// written, per tile
+		CpuPlane m_depth;
+		RasterizerCpuStats m_stats;
+	};
+
+	// Same output one triangle and one pixel at a time, with a full-target depth buffer and
+	// scalar shading. The reference the tiled path is checked against.
+	void RenderWorldPassCpuReference(const WorldPassCpuConstants& constants, const MeshVertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, CpuCanvas& target);
+
+	// The renderer's scene: the 90 x 30 torus after OptimizeMesh, the camera from
+	// CreateWindowSizeDependentResources, and for a frame the model and light from Rotate.
+	struct TorusSceneCpu
+	{
+		TorusSceneCpu();
+
+		std::vector<MeshVertex> vertices;
+		std::vector<uint32_t> indices;
+	};
+
+	// frame is Rotate's counter, which also drives the screen pass's time.
+	WorldPassCpuConstants GetTorusFrameConstants(float seconds, uint32_t frame, float aspectRatio);
+
+	// Both passes without a GPU: the world pass into world, then ApplyScreenEffectsCpu from it
+	// into screen, which is resized to match.
+	void RenderTorusFrameCpu(const TorusSceneCpu& scene, float seconds, uint32_t frame, RasterizerCpu& rasterizer, CpuCanvas& world, CpuCanvas& screen);
+
+	// Writes canvas as a colour PFM (rows bottom to top, 32-bit float RGB) for golden images,
+	// each channel through DisplayValue so NaNs compare equal. False if it cannot be written.
+	bool WriteCanvasPfm(const std::wstring& path, const CpuCanvas& canvas);
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct RasterizerCpuReport
+	{
+		uint32_t mismatchedPixels;		// tiled against reference, torus frames, bitwise
+		float maxDifference;			// over the mismatched pixels, NaN against a number as 1
+		uint32_t gapPixels;				// pixels left uncovered by a screen-filling mesh
+		uint32_t overlapPixels;			// pixels covered more than once by one
+	};
+
+	// Renders torus frames at 320x200 and an odd 333x187 both ways, then rasterizes meshes that
+	// should cover a 256x160 target exactly once: a rotated grid, and triangle fans around a
+	// pixel centre, a pixel corner and an arbitrary point.
+	RasterizerCpuReport ValidateRasterizerCpu();
+
+	struct RasterizerCpuBenchmark
+	{
+		unsigned int width;
+		unsigned int height;
+		uint32_t triangles;
+		unsigned int workers;
+		double singleMilliseconds;		// world pass on one worker
+		double parallelMilliseconds;	// on every worker
+		double trianglesPerMillisecond;	// parallel
+		double megapixelsPerSecond;		// parallel
+		double screenMilliseconds;		// the screen pass after it
+	};
+
+	// Times the torus world pass at 1920x1080 over the given number of frames.
+	RasterizerCpuBenchmark BenchmarkRasterizerCpu(unsigned int frames = 20);
+#endif
+}
@@ -8,21 +8,107 @@
 #include "pch.h"
 #include "Sample3DSceneRenderer.h"
 
+#include <chrono>
+
 #include "..\Helpers\DirectXHelper.h"
+#include "BlurCpu.h"
+#include "CompactVertex.h"
+#include "MeshCache.h"
+#include "TiledEffectsCpu.h"
 
 using namespace DirectXGame1;
 
 using namespace DirectX;
 using namespace Windows::Foundation;
 
+static_assert(sizeof(MeshVertex) == sizeof(VertexPositionColor), "MeshVertex must match the vertex shader's input layout");
+
+namespace
+{
+	// screenps.hlsl samples the canvas at tex * 2 (the 2x2 tiling), so that is where the
+	// upsample pass has to look for the edges the screen pass saw.
+	const float ScreenTiling = 2.0f;
+
+	unsigned int ClampResolutionDivisor(unsigned int divisor)
+	{
+		return divisor >= 4 ? 4 : (divisor >= 2 ? 2 : 1);
+	}
+
+	UINT DispatchGroups(float size, unsigned int groupSize)
+	{
+		return ((UINT)size + groupSize - 1) / groupSize;
+	}
+
+	// A structured buffer the CPU rewrites every frame, and the view the pixel shader reads it through.
+	void CreateDynamicStructuredBuffer(ID3D11Device* device, UINT stride, UINT count, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& view)
+	{
+		CD3D11_BUFFER_DESC bufferDesc(stride * count, D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE, D3D11_RESOURCE_MISC_BUFFER_STRUCTURED, stride);
+		DX::ThrowIfFailed(device->CreateBuffer(&bufferDesc, nullptr, buffer.ReleaseAndGetAddressOf()));
+		CD3D11_SHADER_RESOURCE_VIEW_DESC viewDesc(buffer.Get(), DXGI_FORMAT_UNKNOWN, 0, count);
+		DX::ThrowIfFailed(device->CreateShaderResourceView(buffer.Get(), &viewDesc, view.ReleaseAndGetAddressOf()));
+	}
+
+	void UploadBuffer(ID3D11DeviceContext* context, ID3D11Buffer* buffer, const void* data, size_t bytes)
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		DX::ThrowIfFailed(context->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+		memcpy(mapped.pData, data, bytes);
+		context->Unmap(buffer, 0);
+	}
+}
+
 // Loads vertex and pixel shaders from files and instantiates the cube geometry.
 Sample3DSceneRenderer::Sample3DSceneRenderer(const std::shared_ptr<DX::DeviceResources>& deviceResources) :
     m_loadingComplete(false),
     m_degreesPerSecond(45),
-    m_indexCount(0),
+    m_meshRows(90),
+    m_meshColumns(30),
+    m_indexPolicy(IndexPolicy::Automatic),
+    m_currentLod(0),
+    m_instanceLod(0),
+    m_worldMeshCached(false),
+    m_clusterCulling(false),
+    m_visibleMeshletCount(0),
+    m_clusterLod(0),
+    m_worldTrianglesDrawn(0),
+    m_worldMeshMilliseconds(0.0),
+    m_visibleInstanceCount(0),
+    m_lodPixelError(1.0f),
+    m_meshRadius(0.8f),
+    m_fovAngleY(70.0f * XM_PI / 180.0f),
+    m_compactVertices(false),
+    m_vertexStride_world(sizeof(VertexPositionColor)),
     m_tracking(false),
+    m_blurRadius(0),
+    m_blurDivisor(1),
+    m_screenDivisor(1),
+    m_upsampleFilter(UpsampleFilter::Bilateral),
+    m_postProcessDirty(true),
+    m_canvasFormat(DXGI_FORMAT_R16G16B16A16_FLOAT),
+    m_blurFormat(DXGI_FORMAT_R16G16B16A16_FLOAT),
+    m_screenEffectsPath(ScreenEffectsPath::PixelShader),
+    m_worldShadingPath(WorldShadingPath::Forward),
+    m_edgeOutline(0.0f),
+    m_screenFeatures(DefaultScreenFeatures),
+    m_dynamicResolutionEnabled(false),
+    m_renderScale(1.0f),
+    m_frameSeconds(0.0),
+    m_lightClusterCapacity(0),
+    m_lightIndexCapacity(0),
+    m_lightBinningMilliseconds(0.0),
+    m_bloomIntensity(0.0f),
+    m_bloomLevels(DefaultBloomLevels),
     m_deviceResources(deviceResources)
 {
+    m_renderTargetPool = std::make_shared<DX::RenderTargetPool>(m_deviceResources);
+    m_postProcess = std::unique_ptr<PostProcessChain>(new PostProcessChain(m_deviceResources, m_renderTargetPool));
+    m_constants = std::unique_ptr<DX::ConstantBufferRing>(new DX::ConstantBufferRing(m_deviceResources));
+    m_instances.count = 0;
+    m_pointLights.count = 0;
+    m_ambientOcclusion.intensity = 0.0f;
+    XMStoreFloat4x4(&m_previousModel, XMMatrixIdentity());
+    XMStoreFloat4x4(&m_previousView, XMMatrixIdentity());
+    XMStoreFloat4x4(&m_previousProjection, XMMatrixIdentity());
     CreateDeviceDependentResources();
     CreateWindowSizeDependentResources();
 }
@@ -40,6 +126,7 @@ void Sample3DSceneRenderer::CreateWindowSizeDependentResources()
 	{
 		fovAngleY *= 2.0f;
 	}
+	m_fovAngleY = fovAngleY;
 
 	// Note that the OrientationTransform3D matrix is post-multiplied here
 	// in order to correctly orient the scene to match the display orientation.
@@ -74,12 +161,19 @@ void Sample3DSceneRenderer::CreateWindowSizeDependentResources()
 
 	XMStoreFloat4x4(&m_constantBufferData_world.view, XMMatrixTranspose(XMMatrixLookAtRH(eye, at, up)));
 	XMStoreFloat4(&m_constantBufferData_world.eyepos, eye);
-	XMStoreFloat4(&m_constantBufferData_world.lightpos, light);
+	XMStoreFloat4(&m_constantBufferData_frame.lightpos, light);
+
+	// intermediate targets follow the output size; only the ones whose size changed are replaced
+	m_postProcess->CreateWindowSizeDependentResources();
 }
 
 // Called once per frame, rotates the cube and calculates the model and view matrices.
 void Sample3DSceneRenderer::Update(DX::StepTimer const& timer)
 {
+	m_constantBufferData_frame.time = XMFLOAT4((float)timer.GetTotalSeconds(), (float)timer.GetFrameCount(), 0.0f, 0.0f);
+	// the fixed timestep hides how long frames really take; Render sizes the world pass from this
+	m_frameSeconds = timer.GetFrameSeconds();
+
     if (!m_tracking)
     {
         // Convert degrees to radians, then convert seconds to rotation angle
@@ -89,6 +183,64 @@ void Sample3DSceneRenderer::Update(DX::StepTimer const& timer)
 
         Rotate(radians);
     }
+
+	// Pick the torus LOD from how large its error would look at the nearest point of its
+	// bounding sphere.
+	if (!m_meshLodLevels.empty())
+	{
+		XMVECTOR eye = XMLoadFloat4(&m_constantBufferData_world.eyepos);
+		float distance = XMVectorGetX(XMVector3Length(eye)) - m_meshRadius;
+		distance = distance > 0.1f ? distance : 0.1f;
+		float pixelsPerUnit = PixelsPerUnit(distance, m_fovAngleY, m_deviceResources->GetOutputSize().Height * m_renderScale);
+		m_currentLod = m_lodPixelError > 0.0f ? SelectMeshLod(m_meshLodLevels, pixelsPerUnit, m_currentLod, m_lodPixelError) : 0;
+	}
+
+	// Meshlets are culled in the torus's own space: the eye goes through the inverse model
+	// matrix and the planes come from model * view * projection.
+	if (UseClusterCulling())
+	{
+		XMMATRIX model = XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData_object.model));
+		XMMATRIX view = XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData_world.view));
+		XMMATRIX projection = XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData_world.projection));
+		XMFLOAT4X4 modelViewProjection;
+		XMStoreFloat4x4(&modelViewProjection, model * view * projection);
+		XMFLOAT3 eye;
+		XMStoreFloat3(&eye, XMVector3Transform(XMLoadFloat4(&m_constantBufferData_world.eyepos), XMMatrixInverse(nullptr, model)));
+		const float eyeArray[3] = { eye.x, eye.y, eye.z };
+
+		m_clusterLod = m_currentLod < m_meshletLods.size() ? m_currentLod : (unsigned int)m_meshletLods.size() - 1;
+		const MeshletMesh& meshlets = m_meshletLods[m_clusterLod];
+		m_visibleMeshlets.resize(meshlets.meshlets.size());
+		m_visibleMeshletCount = CullMeshlets(meshlets, ExtractFrustumPlanes(modelViewProjection.m), eyeArray, &m_visibleMeshlets[0]);
+	}
+
+	// The instances move on their own clock. They share one LOD, picked for the middle of
+	// their field at the largest instance scale.
+	if (UseInstancing())
+	{
+		UpdateInstances(m_instances, (float)timer.GetTotalSeconds(), &m_instanceData[0]);
+
+		// The constant buffers hold the transposes.
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(
+			XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData_world.view)),
+			XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData_world.projection))));
+		FrustumPlanes planes = ExtractFrustumPlanes(viewProjection.m);
+		m_visibleInstanceCount = CullObjects(m_instanceBounds, planes, CullVolume::SphereThenBox, &m_visibleInstances[0]);
+
+		InstanceFieldDesc field;
+		XMVECTOR center = XMVectorSet(field.center[0], field.center[1], field.center[2], 0.0f);
+		float distance = XMVectorGetX(XMVector3Length(XMLoadFloat4(&m_constantBufferData_world.eyepos) - center));
+		distance = distance > 0.1f ? distance : 0.1f;
+		float pixelsPerUnit = field.maxScale * PixelsPerUnit(distance, m_fovAngleY, m_deviceResources->GetOutputSize().Height * m_renderScale);
+		m_instanceLod = m_lodPixelError > 0.0f ? SelectMeshLod(m_meshLodLevels, pixelsPerUnit, m_instanceLod, m_lodPixelError) : 0;
+	}
+
+	// The point lights move on the same clock; RenderWorld bins them once the viewport is known.
+	if (m_pointLights.count > 0)
+	{
+		UpdatePointLights(m_pointLights, (float)timer.GetTotalSeconds(), m_pointLightBounds, &m_pointLightData[0]);
+	}
 }
 
 // Rotate the 3D cube model a set amount of radians.
@@ -101,9 +253,9 @@ void Sample3DSceneRenderer::Rotate(float radians)
 	FXMVECTOR eye = { 0.0, 0.6, 1.0, 1.0 };
 	FXMVECTOR light = { t, 2, 2, 1 }; // moves back and forth in x
 
-	XMStoreFloat4x4(&m_constantBufferData_world.model, XMMatrixTranspose(XMMatrixRotationY(radians)));
+	XMStoreFloat4x4(&m_constantBufferData_object.model, XMMatrixTranspose(XMMatrixRotationY(radians)));
 	//XMStoreFloat4(&m_constantBufferData.eyepos, eye); // eye didn't move, don't worry about it
-	XMStoreFloat4(&m_constantBufferData_world.lightpos, light);
+	XMStoreFloat4(&m_constantBufferData_frame.lightpos, light);
 	
 }
 
@@ -127,7 +279,7 @@ void Sample3DSceneRenderer::StopTracking()
     m_tracking = false;
 }
 /*--------------------------------------------------------------------------------------------------------------------*/
-// Renders one frame using the vertex and pixel shaders.
+// Renders one frame: runs every pass of the post-process chain in order.
 void Sample3DSceneRenderer::Render()
 {
 	// Loading is asynchronous. Only draw geometry after it's loaded.
@@ -136,129 +288,547 @@ void Sample3DSceneRenderer::Render()
 		return;
 	}
 
-	auto context = m_deviceResources->GetD3DDeviceContext();
+	if (m_postProcessDirty)
+	{
+		BuildPostProcessChain();
+	}
+
+	// Size this frame's world pass from how long the last frame took.
+	if (UseDynamicResolution())
+	{
+		m_renderScale = m_dynamicResolution.Update(m_frameSeconds);
+	}
+	else
+	{
+		m_renderScale = 1.0f;
+		m_dynamicResolution.Reset();
+	}
+
+	// per-frame constants stay bound for every pass; each pass sets its own view, object and effect blocks
+	m_constants->Set(PerFrameSlot, DX::ConstantStageVertex | DX::ConstantStagePixel, m_constantBufferData_frame);
+
+	m_postProcess->Execute();
+	m_renderTargetPool->EndFrame();
+	m_constants->EndFrame();
+
+	// next frame's temporal pass reprojects into this one
+	m_previousModel = m_constantBufferData_object.model;
+	m_previousView = m_constantBufferData_world.view;
+	m_previousProjection = m_constantBufferData_world.projection;
+}
+/*--------------------------------------------------------------------------------------------------------------------*/
+// Declares the frame: which passes run, what each reads and writes. The chain works out
+// the intermediate targets; canvas and blurred never live at the same time, so they share memory
+// when they have the same format.
+void Sample3DSceneRenderer::BuildPostProcessChain()
+{
+	typedef PostProcessChain::TargetHandle Target;
+	m_postProcess->Clear();
+
+	PostProcessTargetDesc canvasDesc(m_canvasFormat);
+	PostProcessTargetDesc blurDesc(m_blurFormat, 1.0f / m_blurDivisor);
+	Target canvas = m_postProcess->CreateTarget("canvas", canvasDesc);
+
+	if (UseDeferredShading())
+	{
+		// Deferred: the world pass fills the G-buffer instead of the canvas, and the lighting
+		// pass turns it into the canvas the effects below read. The depth target keeps z / w
+		// as the depth buffer has it; that one cannot be read while it is bound for the test.
+		std::vector<Target> gbuffer;
+		gbuffer.push_back(m_postProcess->CreateTarget("gbuffer albedo", PostProcessTargetDesc(DXGI_FORMAT_R8G8B8A8_UNORM)));
+		gbuffer.push_back(m_postProcess->CreateTarget("gbuffer normal", PostProcessTargetDesc(DXGI_FORMAT_R16G16_SNORM)));
+		gbuffer.push_back(m_postProcess->CreateTarget("gbuffer depth", PostProcessTargetDesc(DXGI_FORMAT_R32_FLOAT)));
+
+		m_postProcess->AddPass("geometry", std::vector<Target>(), gbuffer, true,
+			[this](const PostProcessPassContext& pass) { RenderWorld(pass); });
+		m_postProcess->AddPass("lighting", gbuffer, std::vector<Target>(1, canvas), false,
+			[this](const PostProcessPassContext& pass) { RenderDeferredLighting(pass); });
+	}
+	else
+	{
+		m_postProcess->AddPass("world", std::vector<Target>(), std::vector<Target>(1, canvas), true,
+			[this](const PostProcessPassContext& pass) { RenderWorld(pass); });
+	}
+
+	// Bloom: bright pass and 13-tap downsamples to 1/2 .. 1/2^levels of the output, then tent
+	// upsamples added back up the chain. The levels are ordinary chain targets, so they come
+	// from the render-target pool and survive resizes like the rest.
+	std::vector<Target> bloomLevels;
+	if (m_bloomIntensity > 0.0f)
+	{
+		DXGI_FORMAT bloomFormat = SupportedTargetFormat(DXGI_FORMAT_R11G11B10_FLOAT);
+		for (unsigned int i = 0; i < m_bloomLevels; i++)
+		{
+			PostProcessTargetDesc levelDesc(bloomFormat, 1.0f / (float)(2u << i));
+			bloomLevels.push_back(m_postProcess->CreateTarget("bloom " + std::to_string(i), levelDesc));
+		}
+
+		m_postProcess->AddPass("bloom extract", std::vector<Target>(1, canvas), std::vector<Target>(1, bloomLevels[0]), false,
+			[this](const PostProcessPassContext& pass) { RenderBloomDownsample(pass, true); });
+		for (unsigned int i = 1; i < m_bloomLevels; i++)
+		{
+			m_postProcess->AddPass("bloom down " + std::to_string(i), std::vector<Target>(1, bloomLevels[i - 1]), std::vector<Target>(1, bloomLevels[i]), false,
+				[this](const PostProcessPassContext& pass) { RenderBloomDownsample(pass, false); });
+		}
+		for (unsigned int i = m_bloomLevels - 1; i > 0; i--)
+		{
+			m_postProcess->AddPass("bloom up " + std::to_string(i - 1), std::vector<Target>(1, bloomLevels[i]), std::vector<Target>(1, bloomLevels[i - 1]), false,
+				[this](const PostProcessPassContext& pass) { RenderBloomUpsample(pass); });
+		}
+	}
+
+	// Ambient occlusion from the depth buffer, all at half resolution: view depth first, then
+	// the hemisphere samples, then a blur along each axis that stops at depth edges. None of
+	// these passes binds the depth-stencil view, so the first one can read it. With temporal
+	// accumulation the depth and the accumulated occlusion are history targets, and a pass
+	// between the samples and the blur blends in what the previous frame left there.
+	bool ambientOcclusion = UseAmbientOcclusion();
+	Target occlusion = canvas;
+	if (ambientOcclusion)
+	{
+		bool temporal = UseTemporalAccumulation();
+		PostProcessTargetDesc aoDepthDesc(DXGI_FORMAT_R32_FLOAT, 0.5f);
+		PostProcessTargetDesc aoDesc(SupportedTargetFormat(DXGI_FORMAT_R8_UNORM), 0.5f);
+		Target aoDepth = temporal ? m_postProcess->CreateHistoryTarget("ao depth", aoDepthDesc) : m_postProcess->CreateTarget("ao depth", aoDepthDesc);
+		Target ao = m_postProcess->CreateTarget("ao", aoDesc);
+		Target aoTemp = m_postProcess->CreateTarget("ao blur horizontal", aoDesc);
+		occlusion = m_postProcess->CreateTarget("ao blurred", aoDesc);
+
+		m_postProcess->AddPass("ao depth", std::vector<Target>(), std::vector<Target>(1, aoDepth), false,
+			[this](const PostProcessPassContext& pass) { RenderAmbientOcclusionDepth(pass); });
+		m_postProcess->AddPass("ao", std::vector<Target>(1, aoDepth), std::vector<Target>(1, ao), false,
+			[this](const PostProcessPassContext& pass) { RenderAmbientOcclusion(pass); });
+
+		if (temporal)
+		{
+			// The history moves by 1 / (history length) of the difference a frame, which 8 bits
+			// would round away.
+			PostProcessTargetDesc accumulatedDesc(SupportedTargetFormat(DXGI_FORMAT_R16_UNORM), 0.5f);
+			Target accumulated = m_postProcess->CreateHistoryTarget("ao accumulated", accumulatedDesc);
+
+			std::vector<Target> temporalReads;
+			temporalReads.push_back(ao);
+			temporalReads.push_back(aoDepth);
+			temporalReads.push_back(m_postProcess->GetPreviousFrame(accumulated));
+			temporalReads.push_back(m_postProcess->GetPreviousFrame(aoDepth));
+			m_postProcess->AddPass("ao temporal", temporalReads, std::vector<Target>(1, accumulated), false,
+				[this](const PostProcessPassContext& pass) { RenderAmbientOcclusionTemporal(pass); });
+			ao = accumulated;
+		}
+
+		std::vector<Target> horizontalReads;
+		horizontalReads.push_back(ao);
+		horizontalReads.push_back(aoDepth);
+		std::vector<Target> verticalReads;
+		verticalReads.push_back(aoTemp);
+		verticalReads.push_back(aoDepth);
+
+		m_postProcess->AddPass("ao blur horizontal", horizontalReads, std::vector<Target>(1, aoTemp), false,
+			[this](const PostProcessPassContext& pass) { RenderAmbientOcclusionBlur(pass, 1.0f, 0.0f); });
+		m_postProcess->AddPass("ao blur vertical", verticalReads, std::vector<Target>(1, occlusion), false,
+			[this](const PostProcessPassContext& pass) { RenderAmbientOcclusionBlur(pass, 0.0f, 1.0f); });
+	}
+
+	// Compute passes are declared per pass: each one needs UAV support for its target format,
+	// and the blur and screen shaders have their own limits on the input size (see below).
+	bool compute = m_screenEffectsPath == ScreenEffectsPath::Compute;
+	bool computeBlur = compute && m_renderTargetPool->IsUnorderedAccessSupported(m_blurFormat);
+
+	Target screenInput = canvas;
+	if (m_blurRadius > 0)
+	{
+		Target blurTemp = m_postProcess->CreateTarget("blur horizontal", blurDesc);
+		Target blurred = m_postProcess->CreateTarget("blurred", blurDesc);
+
+		PostProcessChain::PassFunction horizontal = [this](const PostProcessPassContext& pass) { RenderBlurPass(pass, 1.0f / pass.viewport.Width, 0.0f); };
+		PostProcessChain::PassFunction vertical = [this](const PostProcessPassContext& pass) { RenderBlurPass(pass, 0.0f, 1.0f / pass.viewport.Height); };
+
+		// BlurCS.hlsl reads one texel per output pixel, so a reduced-resolution blur keeps the
+		// pixel shader for the horizontal pass, which also does the downsampling.
+		if (computeBlur && m_blurDivisor == 1)
+		{
+			m_postProcess->AddComputePass("blur horizontal", std::vector<Target>(1, canvas), std::vector<Target>(1, blurTemp), horizontal);
+		}
+		else
+		{
+			m_postProcess->AddPass("blur horizontal", std::vector<Target>(1, canvas), std::vector<Target>(1, blurTemp), false, horizontal);
+		}
+
+		if (computeBlur)
+		{
+			m_postProcess->AddComputePass("blur vertical", std::vector<Target>(1, blurTemp), std::vector<Target>(1, blurred), vertical);
+		}
+		else
+		{
+			m_postProcess->AddPass("blur vertical", std::vector<Target>(1, blurTemp), std::vector<Target>(1, blurred), false, vertical);
+		}
+		screenInput = blurred;
+	}
+
+	// the screen pass adds the top bloom level and the occlusion as further inputs, and the
+	// permutation that reads them
+	std::vector<Target> screenReads(1, screenInput);
+	uint32_t screenFeatures = m_screenFeatures;
+	if (!bloomLevels.empty())
+	{
+		screenReads.push_back(bloomLevels[0]);
+		screenFeatures |= ScreenFeatureBloom;
+	}
+	if (ambientOcclusion)
+	{
+		screenReads.push_back(occlusion);
+		screenFeatures |= ScreenFeatureAmbientOcclusion;
+	}
+
+	if (m_screenDivisor > 1)
+	{
+		// Only the canvas read (with the static and the diagonal blur) runs at reduced
+		// resolution. The transmission lines, threshold and wipe are hard edges at output
+		// resolution, so the upsample pass applies them, with the occlusion and the bloom, after
+		// its filter. The read is still ahead of the threshold, so it keeps the input's precision.
+		PostProcessTargetDesc effectsDesc(screenInput == canvas ? m_canvasFormat : m_blurFormat, 1.0f / m_screenDivisor);
+		Target effects = m_postProcess->CreateTarget("effects", effectsDesc);
+		uint32_t sampleFeatures = m_screenFeatures;
+
+		// ScreenCS.hlsl writes a UAV, so it is only used here where the screen pass has its own
+		// target, and only when each group's part of the canvas fits its shared cache.
+		Size outputSize = m_deviceResources->GetOutputSize();
+		float inputScale = screenInput == canvas ? 1.0f : 1.0f / m_blurDivisor;
+		bool computeScreen = compute && (m_screenFeatures & (ScreenFeatureTvStatic | ScreenFeatureBlur)) == 0 &&
+			m_renderTargetPool->IsUnorderedAccessSupported(effectsDesc.format) && ScreenTilesFitCache(
+			(unsigned int)(outputSize.Width * inputScale), (unsigned int)(outputSize.Height * inputScale),
+			(unsigned int)(outputSize.Width / m_screenDivisor), (unsigned int)(outputSize.Height / m_screenDivisor));
+
+		PostProcessChain::PassFunction screen = [this, sampleFeatures](const PostProcessPassContext& pass) { RenderScreen(pass, sampleFeatures, true); };
+		if (computeScreen)
+		{
+			m_postProcess->AddComputePass("screen", std::vector<Target>(1, screenInput), std::vector<Target>(1, effects), screen);
+		}
+		else
+		{
+			m_postProcess->AddPass("screen", std::vector<Target>(1, screenInput), std::vector<Target>(1, effects), false, screen);
+		}
+
+		std::vector<Target> upsampleReads;
+		upsampleReads.push_back(effects);
+		upsampleReads.insert(upsampleReads.end(), screenReads.begin(), screenReads.end());
+		m_postProcess->AddPass("upsample", upsampleReads, std::vector<Target>(1, PostProcessChain::BackBuffer), false,
+			[this, screenFeatures](const PostProcessPassContext& pass) { RenderUpsample(pass, ScreenTiling, screenFeatures); });
+	}
+	else
+	{
+		m_postProcess->AddPass("screen", screenReads, std::vector<Target>(1, PostProcessChain::BackBuffer), true,
+			[this, screenFeatures](const PostProcessPassContext& pass) { RenderScreen(pass, screenFeatures, false); });
+	}
 
-	// Set render targets to the screen.
-	ID3D11RenderTargetView *const targets[1] = { RTV_canvas };
-//	ID3D11RenderTargetView *const targets[1] = { m_deviceResources->GetBackBufferRenderTargetView() };
+	m_postProcess->Compile();
+	m_postProcessDirty = false;
+}
+/*--------------------------------------------------------------------------------------------------------------------*/
+// World pass: draws the torus into the canvas, or into the G-buffer's three targets on the
+// deferred path.
+void Sample3DSceneRenderer::RenderWorld(const PostProcessPassContext& pass)
+{
+	auto context = pass.context;
 
 	static int pk = 0;
 	pk++;
 
-	context->OMSetRenderTargets(1, targets, m_deviceResources->GetDepthStencilView());
-	
-	context->ClearRenderTargetView(RTV_canvas, DirectX::Colors::Black);
+	// The lighting pass reads albedo and normal only where something was drawn, so the
+	// G-buffer just needs its depth cleared to the far plane.
+	bool deferred = pass.outputs.size() > 1;
+	if (deferred)
+	{
+		const float farDepth[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		context->ClearRenderTargetView(pass.outputs[2], farDepth);
+	}
+	else
+	{
+		context->ClearRenderTargetView(pass.outputs[0], DirectX::Colors::Black);
+	}
 		
 	context->ClearDepthStencilView(m_deviceResources->GetDepthStencilView(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 
-	// Prepare the constant buffer to send it to the graphics device.
-	context->UpdateSubresource(
-		m_constantBuffer.Get(),
-		0,
-		NULL,
-		&m_constantBufferData_world,
-		0,
-		0
-		);
+	// Dynamic resolution: draw into the top-left part of the canvas at the same aspect, and
+	// tell the screen pass how much of it holds this frame.
+	D3D11_VIEWPORT viewport = pass.viewport;
+	if (m_renderScale < 1.0f)
+	{
+		viewport.Width = floorf(pass.viewport.Width * m_renderScale);
+		viewport.Height = floorf(pass.viewport.Height * m_renderScale);
+		context->RSSetViewports(1, &viewport);
+	}
+	m_constantBufferData_screenEffect.canvasRect = XMFLOAT4(
+		viewport.Width / pass.viewport.Width, viewport.Height / pass.viewport.Height,
+		0.5f / pass.viewport.Width, 0.5f / pass.viewport.Height);
 
-	// Each vertex is one instance of the VertexPositionColor struct.
-	UINT stride = sizeof(VertexPositionColor);
+	// the deferred path bins the lights in its lighting pass instead
+	bool clustered = !deferred && UseClusteredLights();
+	if (clustered)
+	{
+		BindLightGrid(context, viewport);
+	}
+
+	unsigned int lodIndex = m_currentLod < m_meshLods.size() ? m_currentLod : (unsigned int)m_meshLods.size() - 1;
+	const WorldMeshLod& lod = m_meshLods[lodIndex];
+
+	// Send the camera and the torus's model matrix to the graphics device. Each LOD has its
+	// own compact vertex ranges.
+	const CompactVertexBounds& bounds = lod.bounds;
+	m_constantBufferData_object.positionScale = XMFLOAT4(bounds.positionScale[0], bounds.positionScale[1], bounds.positionScale[2], 0.0f);
+	m_constantBufferData_object.positionOffset = XMFLOAT4(bounds.positionOffset[0], bounds.positionOffset[1], bounds.positionOffset[2], 0.0f);
+	m_constantBufferData_object.colorScale = XMFLOAT4(bounds.colorScale[0], bounds.colorScale[1], bounds.colorScale[2], 0.0f);
+	m_constantBufferData_object.colorOffset = XMFLOAT4(bounds.colorOffset[0], bounds.colorOffset[1], bounds.colorOffset[2], 0.0f);
+	m_constants->Set(PerViewSlot, DX::ConstantStageVertex | DX::ConstantStagePixel, m_constantBufferData_world);
+	m_constants->Set(PerObjectSlot, DX::ConstantStageVertex, m_constantBufferData_object);
+
+	// Each vertex is a VertexPositionColor, or a CompactVertex when those are in use.
+	bool compact = UseCompactVertices();
+	UINT stride = m_vertexStride_world;
 	UINT offset = 0;
 	context->IASetVertexBuffers(
 		0,
 		1,
-		m_vertexBuffer_world.GetAddressOf(),
+		lod.vertexBuffer.GetAddressOf(),
 		&stride,
 		&offset
 		);
 
 	context->IASetIndexBuffer(
-		m_indexBuffer_world.Get(),
-		DXGI_FORMAT_R16_UINT, // Each index is one 16-bit unsigned integer (short).
+		lod.indexBuffer.Get(),
+		lod.indexFormat, // 16-bit whenever the mesh (or each chunk of it) allows
 		0
 		);
 
 	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-	context->IASetInputLayout(m_inputLayout.Get());
+	context->IASetInputLayout(compact ? m_inputLayout_compact.Get() : m_inputLayout.Get());
 
 	// Attach our vertex shader.
 	context->VSSetShader(
-		m_vertexShader_world.Get(),
+		compact ? m_vertexShader_compact.Get() : m_vertexShader_world.Get(),
 		nullptr,
 		0
 		);
 
-	// Send the constant buffer to the graphics device.
-	context->VSSetConstantBuffers(
-		0,
-		1,
-		m_constantBuffer.GetAddressOf()
+	// Attach our pixel shader: the G-buffer writer, or the one that adds the binned lights
+	// when there are any.
+	context->PSSetShader(
+		deferred ? m_pixelShader_gbuffer.Get() : (clustered ? m_pixelShader_clustered.Get() : m_pixelShader_world.Get()),
+		nullptr,
+		0
 		);
 
-	// Attach our pixel shader.
+	// Draw the objects: the meshlets Update kept, as one list written straight into the
+	// cluster index buffer, or the whole mesh one call per chunk.
+	if (UseClusterCulling() && lodIndex == m_clusterLod)
+	{
+		const MeshletMesh& meshlets = m_meshletLods[m_clusterLod];
+		bool wide = lod.vertexCount > 0xFFFF;
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		DX::ThrowIfFailed(context->Map(m_indexBuffer_clusters.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+		uint32_t indexCount = wide ?
+			WriteMeshletIndices(meshlets, &m_visibleMeshlets[0], m_visibleMeshletCount, static_cast<uint32_t*>(mapped.pData)) :
+			WriteMeshletIndices(meshlets, &m_visibleMeshlets[0], m_visibleMeshletCount, static_cast<uint16_t*>(mapped.pData));
+		context->Unmap(m_indexBuffer_clusters.Get(), 0);
+
+		context->IASetIndexBuffer(m_indexBuffer_clusters.Get(), wide ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT, 0);
+		context->DrawIndexed(indexCount, 0, 0);
+		m_worldTrianglesDrawn = indexCount / 3;
+	}
+	else
+	{
+		m_worldTrianglesDrawn = 0;
+		for (const MeshChunk& chunk : lod.chunks)
+		{
+			context->DrawIndexed(
+				chunk.indexCount,
+				chunk.firstIndex,
+				chunk.baseVertex
+				);
+			m_worldTrianglesDrawn += chunk.indexCount / 3;
+		}
+	}
+
+	if (!UseInstancing() || m_visibleInstanceCount == 0)
+	{
+		return;
+	}
+
+	// Upload this frame's visible transforms, then draw them from the second vertex buffer.
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	DX::ThrowIfFailed(context->Map(m_instanceBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+	InstanceData* instances = static_cast<InstanceData*>(mapped.pData);
+	for (uint32_t i = 0; i < m_visibleInstanceCount; i++)
+	{
+		instances[i] = m_instanceData[m_visibleInstances[i]];
+	}
+	context->Unmap(m_instanceBuffer.Get(), 0);
+
+	const WorldMeshLod& instanceLod = m_meshLods[m_instanceLod < m_meshLods.size() ? m_instanceLod : m_meshLods.size() - 1];
+	ID3D11Buffer* buffers[2] = { instanceLod.vertexBuffer.Get(), m_instanceBuffer.Get() };
+	UINT strides[2] = { m_vertexStride_world, sizeof(InstanceData) };
+	UINT offsets[2] = { 0, 0 };
+	context->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	context->IASetIndexBuffer(instanceLod.indexBuffer.Get(), instanceLod.indexFormat, 0);
+	context->IASetInputLayout(m_inputLayout_instanced.Get());
+	context->VSSetShader(m_vertexShader_instanced.Get(), nullptr, 0);
+
+	for (const MeshChunk& chunk : instanceLod.chunks)
+	{
+		context->DrawIndexedInstanced(
+			chunk.indexCount,
+			m_visibleInstanceCount,
+			chunk.firstIndex,
+			chunk.baseVertex,
+			0
+			);
+	}
+
+	// Leave slot 1 empty for the passes that follow.
+	ID3D11Buffer* nullBuffer = nullptr;
+	UINT zero = 0;
+	context->IASetVertexBuffers(1, 1, &nullBuffer, &zero, &zero);
+}
+/*----------------------------------------------------------------------------------------------------------*/
+// Deferred lighting pass: one quad over the part of the canvas the geometry pass drew, lit
+// from the G-buffer with the world camera. The quad's view and object blocks stay with the
+// vertex shader; the pixel shader gets the world's view and the deferred block instead.
+void Sample3DSceneRenderer::RenderDeferredLighting(const PostProcessPassContext& pass)
+{
+	auto context = pass.context;
+
+	context->ClearRenderTargetView(pass.outputs[0], DirectX::Colors::Black);
+
+	D3D11_VIEWPORT viewport = pass.viewport;
+	if (m_renderScale < 1.0f)
+	{
+		viewport.Width = floorf(pass.viewport.Width * m_renderScale);
+		viewport.Height = floorf(pass.viewport.Height * m_renderScale);
+		context->RSSetViewports(1, &viewport);
+	}
+
+	BindScreenQuad();
+
 	context->PSSetShader(
-		m_pixelShader_world.Get(),
+		m_pixelShader_deferredLighting.Get(),
 		nullptr,
 		0
 		);
 
-	context->PSSetConstantBuffers(
-		0,
-		1,
-		m_constantBuffer.GetAddressOf()
-		);
+	// The constant buffers hold the transposes.
+	XMMATRIX viewProjection = XMMatrixMultiply(
+		XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData_world.view)),
+		XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData_world.projection)));
+	XMStoreFloat4x4(&m_constantBufferData_deferred.inverseViewProjection, XMMatrixTranspose(XMMatrixInverse(nullptr, viewProjection)));
+	m_constantBufferData_deferred.viewportSize = XMFLOAT4(viewport.Width, viewport.Height, 1.0f / viewport.Width, 1.0f / viewport.Height);
+	// a step of 5% in view depth or about 37 degrees between normals counts as an edge
+	m_constantBufferData_deferred.edges = XMFLOAT4(m_edgeOutline, 0.05f, 0.8f, 0.0f);
+
+	m_constants->Set(PerViewSlot, DX::ConstantStagePixel, m_constantBufferData_world);
+	m_constants->Set(PerObjectSlot, DX::ConstantStagePixel, m_constantBufferData_deferred);
+
+	if (UseClusteredLights())
+	{
+		BindLightGrid(context, viewport);
+	}
+	else
+	{
+		m_constantBufferData_lightGrid.grid = XMUINT4(0, 0, 0, 0);
+		m_constants->Set(PerEffectSlot, DX::ConstantStagePixel, m_constantBufferData_lightGrid);
+	}
+
+	context->PSSetShaderResources(0, (UINT)pass.inputs.size(), &pass.inputs[0]);
 
-	// Draw the objects.
 	context->DrawIndexed(
-		m_indexCount,
+		6,
 		0,
 		0
 		);
 }
 /*----------------------------------------------------------------------------------------------------------*/
-void Sample3DSceneRenderer::RenderScreen()
+void Sample3DSceneRenderer::RenderScreen(const PostProcessPassContext& pass, uint32_t features, bool canvasReadOnly)
 {
 	// copied from ::Render
-	// the plan: set render target to screen
+	// the plan: render target is the screen, or the reduced-resolution effects target (bound by the chain)
 	// then, render quad geometry
 	// note, constant buffer should contain ortho projection
 	static int pk = 0;
 	pk++;
-	// Loading is asynchronous. Only draw geometry after it's loaded.
-	if (!m_loadingComplete)
+
+	auto context = pass.context;
+
+	// the effects animate with their own frame counter, in the screen pass's effect block
+	m_constantBufferData_screenEffect.time = XMFLOAT4((float)pk, canvasReadOnly ? 1.0f : 0.0f, 0.0f, 0.0f);
+	m_constantBufferData_screenEffect.bloom = XMFLOAT4((features & ScreenFeatureBloom) ? m_bloomIntensity : 0.0f, 0.0f, 0.0f, 0.0f);
+
+	if (!pass.unorderedOutputs.empty())
 	{
+		// compute path: ScreenCS.hlsl writes every pixel, so there is nothing to clear
+		context->CSSetShader(m_computeShader_screen.Get(), nullptr, 0);
+		m_constants->Set(PerEffectSlot, DX::ConstantStageCompute, m_constantBufferData_screenEffect);
+		context->CSSetShaderResources(0, (UINT)pass.inputs.size(), &pass.inputs[0]);
+		context->CSSetSamplers(0, 1, m_sampler_screen.GetAddressOf());
+		context->CSSetUnorderedAccessViews(0, 1, &pass.unorderedOutputs[0], nullptr);
+		context->Dispatch(DispatchGroups(pass.viewport.Width, ScreenGroupSize), DispatchGroups(pass.viewport.Height, ScreenGroupSize), 1);
 		return;
 	}
 
-	auto context = m_deviceResources->GetD3DDeviceContext();
+	context->ClearRenderTargetView(pass.outputs[0], DirectX::Colors::Cornsilk);
+	context->ClearDepthStencilView(m_deviceResources->GetDepthStencilView(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 
-	// Set render targets to the screen.
+	BindScreenQuad();
+
+	// Attach the permutation with exactly the features in use.
+	context->PSSetShader(
+		m_pixelShaders_screen[features].Get(),
+		nullptr,
+		0
+		);
+
+	m_constants->Set(PerEffectSlot, DX::ConstantStagePixel, m_constantBufferData_screenEffect);
 	
-	ID3D11RenderTargetView *const targets[1] = { m_deviceResources->GetBackBufferRenderTargetView() };
+	// set sampler and textures for pixel shader: the canvas at t0, then the bloom level at t1
+	// and the occlusion at t2 when the permutation reads them
+	ID3D11ShaderResourceView* inputs[3] = { pass.inputs[0], nullptr, nullptr };
+	size_t next = 1;
+	if (features & ScreenFeatureBloom)
+	{
+		inputs[1] = pass.inputs[next++];
+	}
+	if (features & ScreenFeatureAmbientOcclusion)
+	{
+		inputs[2] = pass.inputs[next++];
+	}
+	context->PSSetShaderResources(0, 3, inputs);
+	context->PSSetSamplers(0, 1, m_sampler_screen.GetAddressOf());
 
-	context->OMSetRenderTargets(1, targets, m_deviceResources->GetDepthStencilView());
-	context->ClearRenderTargetView(m_deviceResources->GetBackBufferRenderTargetView(), DirectX::Colors::Cornsilk);
-	context->ClearDepthStencilView(m_deviceResources->GetDepthStencilView(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 
-	XMStoreFloat4x4(&m_constantBufferData_screen.model, XMMatrixIdentity());
-//	XMStoreFloat4x4(&m_constantBufferData_screen.model, XMMatrixTranspose(XMMatrixRotationY(pk / 200.0f)));
+	// Draw the objects, i.e., the quad
+	context->DrawIndexed(
+		6,
+		0,
+		0
+		);
+}
+/*----------------------------------------------------------------------------------------------------------*/
+// Sets up the full-screen quad: ortho view and identity model blocks, quad geometry and the vertex shader.
+// The caller binds its own pixel shader, inputs and render target.
+void Sample3DSceneRenderer::BindScreenQuad()
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	XMStoreFloat4x4(&m_constantBufferData_quad.model, XMMatrixIdentity());
+//	XMStoreFloat4x4(&m_constantBufferData_quad.model, XMMatrixTranspose(XMMatrixRotationY(pk / 200.0f)));
 	static const XMVECTORF32 eye = { 0.0f, 0.0f, -100.5f, 1.0f };
 	static const XMVECTORF32 gaze = { 0.0f, 0.0f, 1.0f, 0.0f };
 	static const XMVECTORF32 up = { 0.0f, 1.0f, 0.0f, 0.0f };
-	XMVECTORF32 timer = { pk, 0.0f, 0.0f, 0.0f };
 	XMStoreFloat4x4(&m_constantBufferData_screen.view, XMMatrixTranspose(XMMatrixLookToRH(eye, gaze, up)));
-	XMStoreFloat4(&m_constantBufferData_screen.lightpos, timer);
-	XMStoreFloat4x4(&m_constantBufferData_screen.projection, XMMatrixTranspose(XMMatrixOrthographicRH(m_deviceResources->GetOutputSize().Width, m_deviceResources->GetOutputSize().Height, 1, 500)));
-	// Prepare the constant buffer to send it to the graphics device.
-	context->UpdateSubresource(
-		m_constantBuffer.Get(),
-		0,
-		NULL,
-		&m_constantBufferData_screen,
-		0,
-		0
-		);
+	// the quad is 2x2 units whatever the window size, so it still covers the target after a resize
+	XMStoreFloat4x4(&m_constantBufferData_screen.projection, XMMatrixTranspose(XMMatrixOrthographicRH(2, 2, 1, 500)));
+	// Send the ortho camera and the quad's model matrix to the graphics device.
+	m_constants->Set(PerViewSlot, DX::ConstantStageVertex | DX::ConstantStagePixel, m_constantBufferData_screen);
+	m_constants->Set(PerObjectSlot, DX::ConstantStageVertex, m_constantBufferData_quad);
 	
 	// Each vertex is one instance of the VertexPositionColor struct.
 	UINT stride = sizeof(VertexPositionColor);
@@ -287,57 +857,875 @@ void Sample3DSceneRenderer::RenderScreen()
 		nullptr,
 		0
 		);
+}
+/*----------------------------------------------------------------------------------------------------------*/
+void Sample3DSceneRenderer::SetBlurRadius(int radius)
+{
+	radius = radius < 0 ? 0 : (radius > MaxBlurRadius ? MaxBlurRadius : radius);
+	if ((radius > 0) != (m_blurRadius > 0))
+	{
+		// the blur passes come and go with the radius, so the chain has to be redeclared
+		m_postProcessDirty = true;
+	}
+	m_blurRadius = radius;
+}
 
-	// Send the constant buffer to the graphics device.
-	context->VSSetConstantBuffers(
-		0,
-		1,
-		m_constantBuffer.GetAddressOf()
-		);
+void Sample3DSceneRenderer::SetScreenResolution(unsigned int divisor, UpsampleFilter filter)
+{
+	divisor = ClampResolutionDivisor(divisor);
+	if (divisor != m_screenDivisor)
+	{
+		// going to or from full resolution adds or removes the upsample pass
+		m_screenDivisor = divisor;
+		m_postProcessDirty = true;
+	}
+	m_upsampleFilter = filter;
+}
 
-	// Attach our pixel shader.
-	context->PSSetShader(
-		m_pixelShader_screen.Get(),
-		nullptr,
-		0
-		);
+void Sample3DSceneRenderer::SetBlurResolution(unsigned int divisor)
+{
+	divisor = ClampResolutionDivisor(divisor);
+	if (divisor != m_blurDivisor)
+	{
+		m_blurDivisor = divisor;
+		m_postProcessDirty = true;
+	}
+}
 
-	context->PSSetConstantBuffers(
-		0,
-		1,
-		m_constantBuffer.GetAddressOf()
-		);
-	
-	// set sampler and texture for pixel shader
+void Sample3DSceneRenderer::SetBloom(float intensity, unsigned int levels)
+{
+	intensity = intensity < 0.0f ? 0.0f : intensity;
+	levels = levels < 1 ? 1 : (levels > MaxBloomLevels ? MaxBloomLevels : levels);
+	if ((intensity > 0.0f) != (m_bloomIntensity > 0.0f) || levels != m_bloomLevels)
+	{
+		// the bloom passes come and go with the intensity, and there is one pair per level
+		m_postProcessDirty = true;
+	}
+	m_bloomIntensity = intensity;
+	m_bloomLevels = levels;
+}
 
-	context->PSSetShaderResources(0, 1, &SRV_canvas);
-	context->PSSetSamplers(0, 1, &m_sampler_screen);
+void Sample3DSceneRenderer::SetScreenEffectsPath(ScreenEffectsPath path)
+{
+	// cs_5_0 and typed UAV stores need feature level 11; older devices stay on the pixel shaders.
+	if (path == ScreenEffectsPath::Compute && m_deviceResources->GetDeviceFeatureLevel() < D3D_FEATURE_LEVEL_11_0)
+	{
+		path = ScreenEffectsPath::PixelShader;
+	}
+	if (path != m_screenEffectsPath)
+	{
+		m_screenEffectsPath = path;
+		m_postProcessDirty = true;
+	}
+}
 
+void Sample3DSceneRenderer::SetWorldShadingPath(WorldShadingPath path)
+{
+	// the lighting pass is ps_5_0 and shares ClusteredLightsPS.hlsl's structured buffers
+	if (path == WorldShadingPath::Deferred && m_deviceResources->GetDeviceFeatureLevel() < D3D_FEATURE_LEVEL_11_0)
+	{
+		path = WorldShadingPath::Forward;
+	}
+	if (path != m_worldShadingPath)
+	{
+		m_worldShadingPath = path;
+		m_postProcessDirty = true;
+	}
+}
 
-	// Draw the objects, i.e., the quad
-	context->DrawIndexed(
-		6,
-		0,
-		0
-		);
+void Sample3DSceneRenderer::SetDynamicResolution(bool enable, double targetFramesPerSecond)
+{
+	DynamicResolutionSettings settings;
+	settings.targetSeconds = 1.0 / targetFramesPerSecond;
+	m_dynamicResolution = DynamicResolutionController(settings);
+	m_dynamicResolutionEnabled = enable;
+	m_renderScale = 1.0f;
 }
 
-void Sample3DSceneRenderer::CreateDeviceDependentResources()
+// Blur, bloom, ambient occlusion and the reduced-resolution screen pass read the canvas (or
+// the depth buffer) as a whole texture, so dynamic resolution waits until they are off.
+bool Sample3DSceneRenderer::UseDynamicResolution() const
 {
-    // Load shaders asynchronously.
-    auto loadVSTask = DX::ReadDataAsync(L"SampleVertexShader.cso");
-	auto loadPSTask = DX::ReadDataAsync(L"SamplePixelShader.cso");
-	auto loadPS2Task = DX::ReadDataAsync(L"screenps.cso");
+	return m_dynamicResolutionEnabled && m_blurRadius == 0 && m_bloomIntensity <= 0.0f && m_ambientOcclusion.intensity <= 0.0f && m_screenDivisor == 1;
+}
 
-    // After the vertex shader file is loaded, create the shader and input layout.
-    auto createVSTask = loadVSTask.then([this](const std::vector<byte>& fileData) {
-        DX::ThrowIfFailed(
-            m_deviceResources->GetD3DDevice()->CreateVertexShader(
-                &fileData[0],
-                fileData.size(),
-                nullptr,
-                &m_vertexShader_world
-                )
+void Sample3DSceneRenderer::SetAmbientOcclusion(float intensity, float radius)
+{
+	intensity = intensity < 0.0f ? 0.0f : intensity;
+	if ((intensity > 0.0f) != (m_ambientOcclusion.intensity > 0.0f))
+	{
+		// the occlusion passes come and go with the intensity
+		m_postProcessDirty = true;
+	}
+	m_ambientOcclusion.intensity = intensity;
+	m_ambientOcclusion.radius = radius > 0.0f ? radius : DefaultAmbientOcclusionRadius;
+}
+
+bool Sample3DSceneRenderer::UseAmbientOcclusion() const
+{
+	return m_ambientOcclusion.intensity > 0.0f && m_pixelShader_aoDepth && m_pixelShader_ao && m_pixelShader_aoBlur &&
+		m_deviceResources->GetDepthShaderResourceView() != nullptr;
+}
+
+// Frames that do not divide the sample count would leave some samples out of the rotation.
+void Sample3DSceneRenderer::SetTemporalAccumulation(unsigned int frames)
+{
+	frames = frames > 1 && AmbientOcclusionSamples % frames == 0 ? frames : 1;
+	if ((frames > 1) != (m_ambientOcclusion.temporalFrames > 1))
+	{
+		// the temporal pass and the history targets come and go with it
+		m_postProcessDirty = true;
+	}
+	m_ambientOcclusion.temporalFrames = frames;
+}
+
+bool Sample3DSceneRenderer::UseTemporalAccumulation() const
+{
+	return m_ambientOcclusion.temporalFrames > 1 && m_pixelShader_aoTemporal;
+}
+
+void Sample3DSceneRenderer::SetScreenFeatures(uint32_t features)
+{
+	// bloom and occlusion follow SetBloom and SetAmbientOcclusion, since only then is there a
+	// target to read
+	features &= (ScreenPermutationCount - 1) & ~RendererScreenFeatures;
+	if (features != m_screenFeatures)
+	{
+		// the compute screen pass may have to give way to the pixel shader, or may come back
+		m_screenFeatures = features;
+		m_postProcessDirty = true;
+	}
+}
+
+void Sample3DSceneRenderer::SetCanvasFormat(DXGI_FORMAT format)
+{
+	format = SupportedTargetFormat(format);
+	if (format != m_canvasFormat)
+	{
+		m_canvasFormat = format;
+		m_postProcessDirty = true;
+	}
+}
+
+void Sample3DSceneRenderer::SetBlurFormat(DXGI_FORMAT format)
+{
+	format = SupportedTargetFormat(format);
+	if (format != m_blurFormat)
+	{
+		m_blurFormat = format;
+		m_postProcessDirty = true;
+	}
+}
+
+// Rebuilds the world mesh right away once the device resources exist; before that,
+// CreateDeviceDependentResources picks the settings up.
+void Sample3DSceneRenderer::SetMeshResolution(unsigned int rows, unsigned int columns, IndexPolicy policy)
+{
+	m_meshRows = rows;
+	m_meshColumns = columns;
+	m_indexPolicy = policy;
+	if (m_loadingComplete)
+	{
+		CreateWorldMesh();
+	}
+}
+
+void Sample3DSceneRenderer::SetCompactVertices(bool compact)
+{
+	if (compact == m_compactVertices)
+	{
+		return;
+	}
+	m_compactVertices = compact;
+	if (m_loadingComplete)
+	{
+		CreateWorldMesh();
+	}
+}
+
+// Compact vertices need CompactVertexShader.cso and a device that can fetch every format of
+// the compact layout, and InstancedVertexShader.hlsl only reads full vertices.
+bool Sample3DSceneRenderer::UseCompactVertices() const
+{
+	return m_compactVertices && m_inputLayout_compact && !UseInstancing();
+}
+
+void Sample3DSceneRenderer::SetInstanceCount(uint32_t count)
+{
+	if (count == m_instances.count)
+	{
+		return;
+	}
+	bool compact = UseCompactVertices();
+	m_instances = CreateInstanceSet(count);
+	m_instanceData.resize(count);
+
+	// A sphere and a box each instance stays inside however it spins and bobs: the torus
+	// reaches 0.8 from its centre.
+	m_instanceBounds.Resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		float reach = 0.8f * m_instances.scale[i];
+		float center[3] = { m_instances.positionX[i], m_instances.positionY[i], m_instances.positionZ[i] };
+		float extent[3] = { reach, reach + m_instances.bob[i], reach };
+		m_instanceBounds.Set(i, center, reach + m_instances.bob[i], extent);
+	}
+	m_visibleInstances.resize(count);
+	m_visibleInstanceCount = 0;
+	if (m_loadingComplete)
+	{
+		CreateInstanceBuffer();
+		if (compact != UseCompactVertices())
+		{
+			CreateWorldMesh();
+		}
+	}
+}
+
+void Sample3DSceneRenderer::SetClusterCulling(bool enable)
+{
+	if (enable == m_clusterCulling)
+	{
+		return;
+	}
+	m_clusterCulling = enable;
+	if (m_loadingComplete)
+	{
+		CreateWorldMesh();
+	}
+}
+
+bool Sample3DSceneRenderer::UseClusterCulling() const
+{
+	return m_clusterCulling && m_indexBuffer_clusters && !m_meshletLods.empty();
+}
+
+// Meshlets for every LOD, from the vertices and indices as uploaded, plus one dynamic index
+// buffer big enough for all of LOD 0.
+void Sample3DSceneRenderer::CreateMeshlets(const std::vector<MeshLodView>& lods)
+{
+	m_meshletLods.clear();
+	m_indexBuffer_clusters.Reset();
+	m_visibleMeshletCount = 0;
+	if (!m_clusterCulling)
+	{
+		return;
+	}
+
+	uint32_t maxIndices = 0;
+	UINT indexSize = 2;
+	for (const MeshLodView& view : lods)
+	{
+		// The builder wants full vertices and one plain index list.
+		std::vector<MeshVertex> vertices(view.vertexCount);
+		if (view.vertexStride == sizeof(CompactVertex))
+		{
+			DecodeCompactVertices(static_cast<const CompactVertex*>(view.vertices), view.vertexCount, view.compactBounds, &vertices[0]);
+		}
+		else
+		{
+			memcpy(&vertices[0], view.vertices, view.vertexCount * sizeof(MeshVertex));
+		}
+		std::vector<uint32_t> indices(view.indexCount);
+		for (uint32_t c = 0; c < view.chunkCount; c++)
+		{
+			const MeshChunk& chunk = view.chunks[c];
+			for (uint32_t i = chunk.firstIndex; i < chunk.firstIndex + chunk.indexCount; i++)
+			{
+				uint32_t index = view.indexFormat == IndexFormat::UInt16 ? static_cast<const uint16_t*>(view.indices)[i] : static_cast<const uint32_t*>(view.indices)[i];
+				indices[i] = chunk.baseVertex + index;
+			}
+		}
+		m_meshletLods.push_back(BuildMeshlets(&vertices[0], view.vertexCount, &indices[0], view.indexCount));
+
+		maxIndices = maxIndices > view.indexCount ? maxIndices : view.indexCount;
+		if (view.vertexCount > 0xFFFF)
+		{
+			indexSize = 4;
+		}
+	}
+
+	// Feature level 9_1 cannot take the 32-bit list a big mesh needs; draw it whole there.
+	if (indexSize == 4 && m_deviceResources->GetDeviceFeatureLevel() < D3D_FEATURE_LEVEL_9_2)
+	{
+		m_meshletLods.clear();
+		return;
+	}
+	CD3D11_BUFFER_DESC indexBufferDesc(maxIndices * indexSize, D3D11_BIND_INDEX_BUFFER, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateBuffer(
+		&indexBufferDesc,
+		nullptr,
+		&m_indexBuffer_clusters
+		)
+		);
+}
+
+bool Sample3DSceneRenderer::UseInstancing() const
+{
+	return m_instances.count > 0 && m_inputLayout_instanced;
+}
+
+// One dynamic vertex buffer of InstanceData, rewritten every frame by RenderWorld.
+void Sample3DSceneRenderer::CreateInstanceBuffer()
+{
+	m_instanceBuffer.Reset();
+	if (m_instances.count == 0 || !m_inputLayout_instanced)
+	{
+		return;
+	}
+	CD3D11_BUFFER_DESC instanceBufferDesc(m_instances.count * sizeof(InstanceData), D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+	DX::ThrowIfFailed(
+		m_deviceResources->GetD3DDevice()->CreateBuffer(
+		&instanceBufferDesc,
+		nullptr,
+		&m_instanceBuffer
+		)
+		);
+}
+
+void Sample3DSceneRenderer::SetPointLightCount(uint32_t count)
+{
+	if (count == m_pointLights.count)
+	{
+		return;
+	}
+	m_pointLights = CreatePointLightSet(count);
+	m_pointLightData.resize(count);
+	m_pointLightBounds.Resize(count);
+	m_lightGrid.indices.clear();
+	if (m_loadingComplete)
+	{
+		CreateLightBuffer();
+	}
+}
+
+bool Sample3DSceneRenderer::UseClusteredLights() const
+{
+	return m_pointLights.count > 0 && m_pixelShader_clustered && m_lightBuffer;
+}
+
+bool Sample3DSceneRenderer::UseDeferredShading() const
+{
+	return m_worldShadingPath == WorldShadingPath::Deferred && m_pixelShader_gbuffer && m_pixelShader_deferredLighting;
+}
+
+// One dynamic structured buffer of PointLightData, rewritten every frame by BindLightGrid.
+void Sample3DSceneRenderer::CreateLightBuffer()
+{
+	m_lightBuffer.Reset();
+	m_lightView.Reset();
+	if (m_pointLights.count == 0 || !m_pixelShader_clustered)
+	{
+		return;
+	}
+	CreateDynamicStructuredBuffer(m_deviceResources->GetD3DDevice(), sizeof(PointLightData), m_pointLights.count, m_lightBuffer, m_lightView);
+}
+
+// Bins this frame's lights for the viewport the world pass draws into, uploads the lights and
+// the grid, and binds them with the grid's constants at t3..t5, after the G-buffer's inputs.
+void Sample3DSceneRenderer::BindLightGrid(ID3D11DeviceContext* context, const D3D11_VIEWPORT& viewport)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	// The constant buffers hold the transposes.
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(
+		XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData_world.view)),
+		XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData_world.projection))));
+	BinLights(m_pointLightBounds, viewProjection.m, (unsigned int)viewport.Width, (unsigned int)viewport.Height, m_lightGridDesc, m_lightGrid);
+	m_lightBinningMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	// The grid's buffers only grow: the cluster count follows the viewport, and the index
+	// count how the lights fall, which changes every frame.
+	auto device = m_deviceResources->GetD3DDevice();
+	uint32_t clusterCount = m_lightGrid.GetClusterCount();
+	if (clusterCount > m_lightClusterCapacity)
+	{
+		CreateDynamicStructuredBuffer(device, 2 * sizeof(uint32_t), clusterCount, m_lightClusterBuffer, m_lightClusterView);
+		m_lightClusterCapacity = clusterCount;
+	}
+	uint32_t indexCount = (uint32_t)m_lightGrid.indices.size();
+	if (indexCount > m_lightIndexCapacity || !m_lightIndexBuffer)
+	{
+		uint32_t capacity = m_lightIndexCapacity > 1024 ? m_lightIndexCapacity : 1024;
+		while (capacity < indexCount)
+		{
+			capacity *= 2;
+		}
+		CreateDynamicStructuredBuffer(device, sizeof(uint32_t), capacity, m_lightIndexBuffer, m_lightIndexView);
+		m_lightIndexCapacity = capacity;
+	}
+
+	UploadBuffer(context, m_lightBuffer.Get(), &m_pointLightData[0], m_pointLightData.size() * sizeof(PointLightData));
+	UploadBuffer(context, m_lightClusterBuffer.Get(), &m_lightGrid.clusters[0], m_lightGrid.clusters.size() * sizeof(uint32_t));
+	if (indexCount > 0)
+	{
+		UploadBuffer(context, m_lightIndexBuffer.Get(), &m_lightGrid.indices[0], indexCount * sizeof(uint32_t));
+	}
+
+	m_constantBufferData_lightGrid.grid = XMUINT4(m_lightGrid.tileSize, m_lightGrid.tilesX, m_lightGrid.tilesY, m_lightGrid.slices);
+	m_constantBufferData_lightGrid.slicing = XMFLOAT4(m_lightGrid.nearZ, m_lightGrid.sliceScale, 0.0f, 0.0f);
+	m_constants->Set(PerEffectSlot, DX::ConstantStagePixel, m_constantBufferData_lightGrid);
+
+	ID3D11ShaderResourceView* views[3] = { m_lightView.Get(), m_lightClusterView.Get(), m_lightIndexView.Get() };
+	context->PSSetShaderResources(3, 3, views);
+}
+
+// Maps the baked torus for the current settings from the temporary folder, or bakes it
+// (generate, simplify into LODs, optimise, index, compact) and caches it on a miss, then
+// uploads each LOD with the narrowest indices the policy allows.
+void Sample3DSceneRenderer::CreateWorldMesh()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	MeshBakeSettings settings;
+	settings.shape = MeshShapeDesc::Torus(m_meshRows, m_meshColumns, 0.6f, 0.2f);
+	settings.policy = m_indexPolicy;
+	// Feature level 9_1 has no 32-bit indices, so big meshes are always split there.
+	if (m_deviceResources->GetDeviceFeatureLevel() < D3D_FEATURE_LEVEL_9_2)
+	{
+		settings.policy = IndexPolicy::Split16;
+	}
+	settings.compact = UseCompactVertices();
+	m_meshRadius = 0.6f + 0.2f;
+
+	// One file per set of settings, so switching back and forth stays cached.
+	uint64_t hash = HashMeshBakeSettings(settings);
+	wchar_t fileName[64];
+	swprintf_s(fileName, L"\\WorldMesh_%016llx.mesh", (unsigned long long)hash);
+	// LocalCacheFolder is Windows Phone 8.1 and Windows 10 only; on Windows 8.1 the temporary
+	// folder is the one the system may clear, which a cache can live with.
+	std::wstring path;
+	try
+	{
+		path = std::wstring(Windows::Storage::ApplicationData::Current->TemporaryFolder->Path->Data()) + fileName;
+	}
+	catch (Platform::Exception^)
+	{
+		// No folder means no cache, which only costs a bake.
+		path.clear();
+	}
+
+	MeshCacheFile cache;
+	BakedMesh baked;
+	m_worldMeshCached = !path.empty() && cache.Open(path, hash);
+	if (!m_worldMeshCached)
+	{
+		BakeMesh(settings, baked);
+		// A cache that cannot be written only costs the next launch a bake.
+		if (!path.empty())
+		{
+			WriteMeshCache(path, hash, baked.lods, baked.boundsMin, baked.boundsMax);
+		}
+	}
+	const std::vector<MeshLodView>& views = m_worldMeshCached ? cache.GetLods() : baked.lods;
+
+	m_meshLods.clear();
+	m_meshLodLevels.clear();
+	m_vertexStride_world = views[0].vertexStride;
+	for (const MeshLodView& view : views)
+	{
+		// Straight from the mapping (or the bake) into the buffers.
+		WorldMeshLod lod;
+		lod.bounds = view.compactBounds;
+
+		D3D11_SUBRESOURCE_DATA vertexBufferData = { 0 };
+		vertexBufferData.pSysMem = view.vertices;
+		vertexBufferData.SysMemPitch = 0;
+		vertexBufferData.SysMemSlicePitch = 0;
+		CD3D11_BUFFER_DESC vertexBufferDesc(view.vertexCount*view.vertexStride, D3D11_BIND_VERTEX_BUFFER);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateBuffer(
+			&vertexBufferDesc,
+			&vertexBufferData,
+			&lod.vertexBuffer
+			)
+			);
+
+		D3D11_SUBRESOURCE_DATA indexBufferData = { 0 };
+		indexBufferData.pSysMem = view.indices;
+		indexBufferData.SysMemPitch = 0;
+		indexBufferData.SysMemSlicePitch = 0;
+		UINT indexSize = view.indexFormat == IndexFormat::UInt16 ? 2 : 4;
+		CD3D11_BUFFER_DESC indexBufferDesc(view.indexCount*indexSize, D3D11_BIND_INDEX_BUFFER);
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateBuffer(
+			&indexBufferDesc,
+			&indexBufferData,
+			&lod.indexBuffer
+			)
+			);
+
+		lod.indexFormat = view.indexFormat == IndexFormat::UInt16 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+		lod.vertexCount = view.vertexCount;
+		lod.chunks.assign(view.chunks, view.chunks + view.chunkCount);
+		m_meshLods.push_back(lod);
+
+		MeshLod level = { 0, view.indexCount, view.errorBound };
+		m_meshLodLevels.push_back(level);
+	}
+	if (m_currentLod >= m_meshLods.size())
+	{
+		m_currentLod = 0;
+	}
+	CreateMeshlets(views);
+
+	m_worldMeshMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// The screen pass only reads rgb, so R11G11B10_FLOAT losing alpha is fine for every target here.
+// The pool only creates formats it can count bytes for, so one the device supports but the
+// pool does not list falls back too.
+DXGI_FORMAT Sample3DSceneRenderer::SupportedTargetFormat(DXGI_FORMAT format) const
+{
+	return DX::RenderTargetPool::IsAccountedFormat(format) && m_renderTargetPool->IsFormatSupported(format) ? format : DXGI_FORMAT_R8G8B8A8_UNORM;
+}
+
+PostProcessFrameTraffic Sample3DSceneRenderer::GetPostProcessTraffic(DXGI_FORMAT formatOverride) const
+{
+	if (formatOverride != DXGI_FORMAT_UNKNOWN)
+	{
+		formatOverride = SupportedTargetFormat(formatOverride);
+	}
+	return m_postProcess->GetFrameTraffic(formatOverride);
+}
+
+// One axis of the separable blur. The chain runs it twice: horizontal into a temporary, then
+// vertical into the blurred target. Each pass takes 1 + radius/2 bilinear reads per pixel, so a
+// radius-r blur costs about r + 2 reads instead of the (2r + 1)^2 of a direct 2D kernel.
+void Sample3DSceneRenderer::RenderBlurPass(const PostProcessPassContext& pass, float stepX, float stepY)
+{
+	auto context = pass.context;
+
+	// The radius is in output pixels; a reduced-resolution blur covers the same area with fewer texels.
+	int radius = (m_blurRadius + (int)m_blurDivisor - 1) / (int)m_blurDivisor;
+	std::vector<BlurTap> taps = ComputeLinearBlurTaps(radius);
+	int tapCount = (int)taps.size() < MaxBlurTaps ? (int)taps.size() : MaxBlurTaps;
+	for (int i = 0; i < tapCount; i++)
+	{
+		m_constantBufferData_blur.taps[i] = XMFLOAT4(taps[i].offset, taps[i].weight, 0.0f, 0.0f);
+	}
+	m_constantBufferData_blur.texelStep = XMFLOAT4(stepX, stepY, (float)tapCount, 0.0f);
+
+	if (!pass.unorderedOutputs.empty())
+	{
+		// compute path: one group per BlurGroupSize pixels of a row (or column), taps read from shared memory
+		m_constantBufferData_blur.texelStep.w = (float)BlurApron(taps);
+		bool horizontal = stepX != 0.0f;
+		float length = horizontal ? pass.viewport.Width : pass.viewport.Height;
+		float lines = horizontal ? pass.viewport.Height : pass.viewport.Width;
+
+		context->CSSetShader(m_computeShader_blur.Get(), nullptr, 0);
+		m_constants->Set(PerEffectSlot, DX::ConstantStageCompute, m_constantBufferData_blur);
+		context->CSSetShaderResources(0, 1, &pass.inputs[0]);
+		context->CSSetUnorderedAccessViews(0, 1, &pass.unorderedOutputs[0], nullptr);
+		context->Dispatch(DispatchGroups(length, BlurGroupSize), (UINT)lines, 1);
+		return;
+	}
+
+	BindScreenQuad();
+
+	context->PSSetShader(
+		m_pixelShader_blur.Get(),
+		nullptr,
+		0
+		);
+
+	m_constants->Set(PerEffectSlot, DX::ConstantStagePixel, m_constantBufferData_blur);
+
+	context->PSSetShaderResources(0, 1, &pass.inputs[0]);
+	context->PSSetSamplers(0, 1, m_sampler_blur.GetAddressOf());
+
+	context->DrawIndexed(
+		6,
+		0,
+		0
+		);
+}
+
+// One bloom downsample: 13 bilinear reads of inputs[0] per pixel of the half-size target.
+// The first level (prefilter) also keeps only what passes the screen pass's threshold.
+void Sample3DSceneRenderer::RenderBloomDownsample(const PostProcessPassContext& pass, bool prefilter)
+{
+	auto context = pass.context;
+
+	Size sourceSize = pass.inputSizes[0];
+	m_constantBufferData_bloom.texelSize = XMFLOAT4(1.0f / sourceSize.Width, 1.0f / sourceSize.Height, 0.0f, 0.0f);
+	m_constantBufferData_bloom.params = XMFLOAT4(BloomThreshold, DefaultBloomKnee, prefilter ? 1.0f : 0.0f, 0.0f);
+
+	BindScreenQuad();
+
+	context->PSSetShader(
+		m_pixelShader_bloomDownsample.Get(),
+		nullptr,
+		0
+		);
+
+	m_constants->Set(PerEffectSlot, DX::ConstantStagePixel, m_constantBufferData_bloom);
+
+	context->PSSetShaderResources(0, 1, &pass.inputs[0]);
+	context->PSSetSamplers(0, 1, m_sampler_blur.GetAddressOf());
+
+	context->DrawIndexed(
+		6,
+		0,
+		0
+		);
+}
+
+// One bloom upsample: a tent read of the smaller level, added onto the larger one with an
+// additive blend, so nothing needs clearing and no extra target is used.
+void Sample3DSceneRenderer::RenderBloomUpsample(const PostProcessPassContext& pass)
+{
+	auto context = pass.context;
+
+	Size sourceSize = pass.inputSizes[0];
+	m_constantBufferData_bloom.texelSize = XMFLOAT4(1.0f / sourceSize.Width, 1.0f / sourceSize.Height, 0.0f, 0.0f);
+	m_constantBufferData_bloom.params = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+
+	BindScreenQuad();
+
+	context->PSSetShader(
+		m_pixelShader_bloomUpsample.Get(),
+		nullptr,
+		0
+		);
+
+	m_constants->Set(PerEffectSlot, DX::ConstantStagePixel, m_constantBufferData_bloom);
+
+	context->PSSetShaderResources(0, 1, &pass.inputs[0]);
+	context->PSSetSamplers(0, 1, m_sampler_blur.GetAddressOf());
+	context->OMSetBlendState(m_blendState_additive.Get(), nullptr, 0xffffffff);
+
+	context->DrawIndexed(
+		6,
+		0,
+		0
+		);
+
+	context->OMSetBlendState(nullptr, nullptr, 0xffffffff);
+}
+
+// Constants for the ambient occlusion passes: the world camera's projection (the constant
+// buffer holds the transpose) and its inverse, the blur axis in texels, and for temporal
+// accumulation which samples this frame takes and how it reprojects into the last one.
+void Sample3DSceneRenderer::SetAmbientOcclusionConstants(float stepX, float stepY)
+{
+	const XMFLOAT4X4& projection = m_constantBufferData_world.projection;
+	XMMATRIX inverse = XMMatrixInverse(nullptr, XMMatrixTranspose(XMLoadFloat4x4(&projection)));
+	float a = projection._33, b = projection._34;
+
+	// back through this frame's view and model, forward through the previous frame's model,
+	// view and projection; same as ComputeReprojectionCpu
+	XMMATRIX view = XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData_world.view));
+	XMMATRIX model = XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData_object.model));
+	XMMATRIX reprojection = XMMatrixInverse(nullptr, view) * XMMatrixInverse(nullptr, model) *
+		XMMatrixTranspose(XMLoadFloat4x4(&m_previousModel)) * XMMatrixTranspose(XMLoadFloat4x4(&m_previousView)) *
+		XMMatrixTranspose(XMLoadFloat4x4(&m_previousProjection));
+
+	bool temporal = UseTemporalAccumulation();
+	uint32_t historyFrames = m_postProcess->GetHistoryFrames();
+	unsigned int step = temporal ? m_ambientOcclusion.temporalFrames : 1;
+	float blend = temporal ? AmbientOcclusionHistoryBlend(m_ambientOcclusion, historyFrames) : 1.0f;
+
+	m_constantBufferData_ambientOcclusion.projection = projection;
+	XMStoreFloat4x4(&m_constantBufferData_ambientOcclusion.inverseProjection, XMMatrixTranspose(inverse));
+	XMStoreFloat4x4(&m_constantBufferData_ambientOcclusion.reprojection, XMMatrixTranspose(reprojection));
+	m_constantBufferData_ambientOcclusion.depthTerms = XMFLOAT4(a, b, 0.999f * b / (1.0f + a), 0.0f);
+	m_constantBufferData_ambientOcclusion.params = XMFLOAT4(m_ambientOcclusion.radius, m_ambientOcclusion.intensity, m_ambientOcclusion.bias, (float)step);
+	m_constantBufferData_ambientOcclusion.blur = XMFLOAT4(stepX, stepY, m_ambientOcclusion.blurDepthSigma, (float)m_ambientOcclusion.blurRadius);
+	m_constantBufferData_ambientOcclusion.temporal = XMFLOAT4((float)(historyFrames % step), blend,
+		m_ambientOcclusion.historyDepthTolerance, m_ambientOcclusion.historyClampMargin);
+	m_constants->Set(PerEffectSlot, DX::ConstantStagePixel, m_constantBufferData_ambientOcclusion);
+}
+
+// First occlusion pass: reads the depth buffer itself, which is not a chain target.
+void Sample3DSceneRenderer::RenderAmbientOcclusionDepth(const PostProcessPassContext& pass)
+{
+	auto context = pass.context;
+
+	BindScreenQuad();
+
+	context->PSSetShader(
+		m_pixelShader_aoDepth.Get(),
+		nullptr,
+		0
+		);
+
+	SetAmbientOcclusionConstants(0.0f, 0.0f);
+
+	ID3D11ShaderResourceView* depth = m_deviceResources->GetDepthShaderResourceView();
+	context->PSSetShaderResources(0, 1, &depth);
+
+	context->DrawIndexed(
+		6,
+		0,
+		0
+		);
+}
+
+// Hemisphere samples against the half-resolution depth; same as ComputeAmbientOcclusionCpu.
+void Sample3DSceneRenderer::RenderAmbientOcclusion(const PostProcessPassContext& pass)
+{
+	auto context = pass.context;
+
+	BindScreenQuad();
+
+	context->PSSetShader(
+		m_pixelShader_ao.Get(),
+		nullptr,
+		0
+		);
+
+	SetAmbientOcclusionConstants(0.0f, 0.0f);
+	context->PSSetShaderResources(0, 1, &pass.inputs[0]);
+
+	context->DrawIndexed(
+		6,
+		0,
+		0
+		);
+}
+
+// This frame's samples blended with the reprojected history; same as
+// AccumulateAmbientOcclusionCpu. Inputs: this frame's occlusion and depth, then the previous
+// frame's accumulated occlusion and depth, all read with Load.
+void Sample3DSceneRenderer::RenderAmbientOcclusionTemporal(const PostProcessPassContext& pass)
+{
+	auto context = pass.context;
+
+	BindScreenQuad();
+
+	context->PSSetShader(
+		m_pixelShader_aoTemporal.Get(),
+		nullptr,
+		0
+		);
+
+	SetAmbientOcclusionConstants(0.0f, 0.0f);
+	context->PSSetShaderResources(0, 4, &pass.inputs[0]);
+
+	context->DrawIndexed(
+		6,
+		0,
+		0
+		);
+}
+
+// One axis of the depth-aware blur: inputs[0] is the occlusion, inputs[1] the half-resolution
+// depth. Both are read with Load, so no sampler is needed.
+void Sample3DSceneRenderer::RenderAmbientOcclusionBlur(const PostProcessPassContext& pass, float stepX, float stepY)
+{
+	auto context = pass.context;
+
+	BindScreenQuad();
+
+	context->PSSetShader(
+		m_pixelShader_aoBlur.Get(),
+		nullptr,
+		0
+		);
+
+	SetAmbientOcclusionConstants(stepX, stepY);
+	context->PSSetShaderResources(0, 2, &pass.inputs[0]);
+
+	context->DrawIndexed(
+		6,
+		0,
+		0
+		);
+}
+
+// Draws the reduced-resolution canvas read (inputs[0]) into the full-size target and finishes
+// the screen effects there. inputs[1] is the full-resolution guide for the bilateral filter,
+// read at uv * guideScale; the bloom level and the occlusion follow when features has them, as
+// for RenderScreen. Same weights as UpsampleBilinearCpu / UpsampleBilateralCpu.
+void Sample3DSceneRenderer::RenderUpsample(const PostProcessPassContext& pass, float guideScale, uint32_t features)
+{
+	auto context = pass.context;
+
+	Size lowResSize = pass.inputSizes[0];
+	m_constantBufferData_upsample.lowResSize = XMFLOAT4(lowResSize.Width, lowResSize.Height, 1.0f / lowResSize.Width, 1.0f / lowResSize.Height);
+	m_constantBufferData_upsample.params = XMFLOAT4(
+		m_upsampleFilter == UpsampleFilter::Bilateral ? 1.0f : 0.0f,
+		DefaultUpsampleLuminanceSigma,
+		guideScale,
+		(features & ScreenFeatureAmbientOcclusion) ? 1.0f : 0.0f
+		);
+	// the same frame counter the canvas read was drawn with
+	m_constantBufferData_upsample.screen = XMFLOAT4(
+		m_constantBufferData_screenEffect.time.x,
+		(features & ScreenFeatureWipe) ? 1.0f : 0.0f,
+		(features & ScreenFeatureMagnet) ? 1.0f : 0.0f,
+		(features & ScreenFeatureBloom) ? m_bloomIntensity : 0.0f
+		);
+
+	BindScreenQuad();
+
+	context->PSSetShader(
+		m_pixelShader_upsample.Get(),
+		nullptr,
+		0
+		);
+
+	m_constants->Set(PerEffectSlot, DX::ConstantStagePixel, m_constantBufferData_upsample);
+
+	// s0 clamps the low-resolution read at the edges; s1 wraps the guide, the bloom and the
+	// occlusion like the screen pass does.
+	ID3D11SamplerState* samplers[] = { m_sampler_blur.Get(), m_sampler_screen.Get() };
+	ID3D11ShaderResourceView* inputs[4] = { pass.inputs[0], pass.inputs[1], nullptr, nullptr };
+	size_t next = 2;
+	if (features & ScreenFeatureBloom)
+	{
+		inputs[2] = pass.inputs[next++];
+	}
+	if (features & ScreenFeatureAmbientOcclusion)
+	{
+		inputs[3] = pass.inputs[next++];
+	}
+	context->PSSetShaderResources(0, 4, inputs);
+	context->PSSetSamplers(0, 2, samplers);
+
+	context->DrawIndexed(
+		6,
+		0,
+		0
+		);
+}
+
+void Sample3DSceneRenderer::CreateDeviceDependentResources()
+{
+	// The constant ring only needs the device, so it is ready before any shader loads.
+	m_constants->CreateDeviceDependentResources();
+
+    // Load shaders asynchronously.
+    auto loadVSTask = DX::ReadDataAsync(L"SampleVertexShader.cso");
+	auto loadPSTask = DX::ReadDataAsync(L"SamplePixelShader.cso");
+	auto loadBlurPSTask = DX::ReadDataAsync(L"BlurPS.cso");
+	auto loadUpsamplePSTask = DX::ReadDataAsync(L"UpsamplePS.cso");
+	auto loadBlurCSTask = DX::ReadDataAsync(L"BlurCS.cso");
+	auto loadBloomDownsamplePSTask = DX::ReadDataAsync(L"BloomDownsamplePS.cso");
+	auto loadBloomUpsamplePSTask = DX::ReadDataAsync(L"BloomUpsamplePS.cso");
+	auto loadAoDepthPSTask = DX::ReadDataAsync(L"AmbientOcclusionDepthPS.cso");
+	auto loadAoPSTask = DX::ReadDataAsync(L"AmbientOcclusionPS.cso");
+	auto loadAoBlurPSTask = DX::ReadDataAsync(L"AmbientOcclusionBlurPS.cso");
+	auto loadAoTemporalPSTask = DX::ReadDataAsync(L"AmbientOcclusionTemporalPS.cso");
+	auto loadScreenCSTask = DX::ReadDataAsync(L"ScreenCS.cso");
+	auto loadCompactVSTask = DX::ReadDataAsync(L"CompactVertexShader.cso");
+	auto loadInstancedVSTask = DX::ReadDataAsync(L"InstancedVertexShader.cso");
+	auto loadClusteredPSTask = DX::ReadDataAsync(L"ClusteredLightsPS.cso");
+	auto loadGBufferPSTask = DX::ReadDataAsync(L"GBufferPS.cso");
+	auto loadDeferredLightingPSTask = DX::ReadDataAsync(L"DeferredLightingPS.cso");
+
+    // After the vertex shader file is loaded, create the shader and input layout.
+    auto createVSTask = loadVSTask.then([this](const std::vector<byte>& fileData) {
+        DX::ThrowIfFailed(
+            m_deviceResources->GetD3DDevice()->CreateVertexShader(
+                &fileData[0],
+                fileData.size(),
+                nullptr,
+                &m_vertexShader_world
+                )
             );
 
         static const D3D11_INPUT_ELEMENT_DESC vertexDesc [] =
@@ -359,7 +1747,88 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources()
             );
     });
 
-	// After the pixel shader file is loaded, create the shader and constant buffer.
+	// The compact layout's formats are optional on feature level 9_x; without them the world
+	// pass keeps the full vertices.
+	auto createCompactVSTask = loadCompactVSTask.then([this](const std::vector<byte>& fileData) {
+		static const D3D11_INPUT_ELEMENT_DESC compactDesc [] =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 16, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		};
+
+		auto device = m_deviceResources->GetD3DDevice();
+		for (const auto& element : compactDesc)
+		{
+			UINT support = 0;
+			if (FAILED(device->CheckFormatSupport(element.Format, &support)) || !(support & D3D11_FORMAT_SUPPORT_IA_VERTEX_BUFFER))
+			{
+				return;
+			}
+		}
+
+		DX::ThrowIfFailed(
+			device->CreateVertexShader(
+			&fileData[0],
+			fileData.size(),
+			nullptr,
+			&m_vertexShader_compact
+			)
+			);
+
+		DX::ThrowIfFailed(
+			device->CreateInputLayout(
+			compactDesc,
+			ARRAYSIZE(compactDesc),
+			&fileData[0],
+			fileData.size(),
+			&m_inputLayout_compact
+			)
+			);
+	});
+
+	// Instancing starts at feature level 9_3; below that SetInstanceCount has no effect.
+	auto createInstancedVSTask = loadInstancedVSTask.then([this](const std::vector<byte>& fileData) {
+		if (m_deviceResources->GetDeviceFeatureLevel() < D3D_FEATURE_LEVEL_9_3)
+		{
+			return;
+		}
+
+		static const D3D11_INPUT_ELEMENT_DESC instancedDesc [] =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "COLOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 36, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+			{ "WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+			{ "WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+			{ "COLOR", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		};
+
+		auto device = m_deviceResources->GetD3DDevice();
+		DX::ThrowIfFailed(
+			device->CreateVertexShader(
+			&fileData[0],
+			fileData.size(),
+			nullptr,
+			&m_vertexShader_instanced
+			)
+			);
+
+		DX::ThrowIfFailed(
+			device->CreateInputLayout(
+			instancedDesc,
+			ARRAYSIZE(instancedDesc),
+			&fileData[0],
+			fileData.size(),
+			&m_inputLayout_instanced
+			)
+			);
+	});
+
+	// After the pixel shader file is loaded, create the shader.
 	auto createPSTask = loadPSTask.then([this](const std::vector<byte>& fileData) {
 		DX::ThrowIfFailed(
 			m_deviceResources->GetD3DDevice()->CreatePixelShader(
@@ -369,34 +1838,198 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources()
 			&m_pixelShader_world
 			)
 			);
+	});
+
+
+	// Every screen pass permutation is loaded up front, so switching features never waits.
+	std::vector<Concurrency::task<void>> createScreenPSTasks;
+	for (uint32_t features = 0; features < ScreenPermutationCount; features++)
+	{
+		createScreenPSTasks.push_back(DX::ReadDataAsync(ScreenPermutationFileName(features)).then([this, features](const std::vector<byte>& fileData) {
+			DX::ThrowIfFailed(
+				m_deviceResources->GetD3DDevice()->CreatePixelShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_pixelShaders_screen[features]
+				)
+				);
+		}));
+	}
+	auto createScreenPSTask = Concurrency::when_all(createScreenPSTasks.begin(), createScreenPSTasks.end());
 
-		CD3D11_BUFFER_DESC constantBufferDesc(sizeof(ModelViewProjectionConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
+	// After the blur pixel shader file is loaded, create the shader.
+	auto createBlurPSTask = loadBlurPSTask.then([this](const std::vector<byte>& fileData) {
 		DX::ThrowIfFailed(
-			m_deviceResources->GetD3DDevice()->CreateBuffer(
-			&constantBufferDesc,
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+			&fileData[0],
+			fileData.size(),
 			nullptr,
-			&m_constantBuffer
+			&m_pixelShader_blur
 			)
 			);
 	});
 
+	// Same for the upsample pixel shader.
+	auto createUpsamplePSTask = loadUpsamplePSTask.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+			&fileData[0],
+			fileData.size(),
+			nullptr,
+			&m_pixelShader_upsample
+			)
+			);
+	});
 
-	// After the pixel shader file is loaded, create the shader and constant buffer.
-	
-	auto createPS2Task = loadPS2Task.then([this](const std::vector<byte>& fileData) {
+	// And the two bloom pixel shaders.
+	auto createBloomDownsamplePSTask = loadBloomDownsamplePSTask.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+			&fileData[0],
+			fileData.size(),
+			nullptr,
+			&m_pixelShader_bloomDownsample
+			)
+			);
+	});
+
+	auto createBloomUpsamplePSTask = loadBloomUpsamplePSTask.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+			&fileData[0],
+			fileData.size(),
+			nullptr,
+			&m_pixelShader_bloomUpsample
+			)
+			);
+	});
+
+	// And the ambient occlusion passes.
+	auto createAoDepthPSTask = loadAoDepthPSTask.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+			&fileData[0],
+			fileData.size(),
+			nullptr,
+			&m_pixelShader_aoDepth
+			)
+			);
+	});
+
+	auto createAoPSTask = loadAoPSTask.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+			&fileData[0],
+			fileData.size(),
+			nullptr,
+			&m_pixelShader_ao
+			)
+			);
+	});
+
+	auto createAoBlurPSTask = loadAoBlurPSTask.then([this](const std::vector<byte>& fileData) {
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreatePixelShader(
+			&fileData[0],
+			fileData.size(),
+			nullptr,
+			&m_pixelShader_aoBlur
+			)
+			);
+	});
+
+	auto createAoTemporalPSTask = loadAoTemporalPSTask.then([this](const std::vector<byte>& fileData) {
 		DX::ThrowIfFailed(
 			m_deviceResources->GetD3DDevice()->CreatePixelShader(
 			&fileData[0],
 			fileData.size(),
 			nullptr,
-			&m_pixelShader_screen
+			&m_pixelShader_aoTemporal
 			)
 			);
+	});
+
+	// The compute shaders are cs_5_0; below feature level 11 they are not created and
+	// SetScreenEffectsPath keeps the pixel shader path.
+	bool computeShaders = m_deviceResources->GetDeviceFeatureLevel() >= D3D_FEATURE_LEVEL_11_0;
+	auto createBlurCSTask = loadBlurCSTask.then([this, computeShaders](const std::vector<byte>& fileData) {
+		if (computeShaders)
+		{
+			DX::ThrowIfFailed(
+				m_deviceResources->GetD3DDevice()->CreateComputeShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_computeShader_blur
+				)
+				);
+		}
+	});
+
+	auto createScreenCSTask = loadScreenCSTask.then([this, computeShaders](const std::vector<byte>& fileData) {
+		if (computeShaders)
+		{
+			DX::ThrowIfFailed(
+				m_deviceResources->GetD3DDevice()->CreateComputeShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_computeShader_screen
+				)
+				);
+		}
+	});
+
+	// ps_5_0 too, for its structured buffers; without it SetPointLightCount draws nothing.
+	auto createClusteredPSTask = loadClusteredPSTask.then([this, computeShaders](const std::vector<byte>& fileData) {
+		if (computeShaders)
+		{
+			DX::ThrowIfFailed(
+				m_deviceResources->GetD3DDevice()->CreatePixelShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_pixelShader_clustered
+				)
+				);
+		}
+	});
+
+	// The deferred path's two shaders; without them SetWorldShadingPath keeps the forward path.
+	auto createGBufferPSTask = loadGBufferPSTask.then([this, computeShaders](const std::vector<byte>& fileData) {
+		if (computeShaders)
+		{
+			DX::ThrowIfFailed(
+				m_deviceResources->GetD3DDevice()->CreatePixelShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_pixelShader_gbuffer
+				)
+				);
+		}
+	});
 
+	auto createDeferredLightingPSTask = loadDeferredLightingPSTask.then([this, computeShaders](const std::vector<byte>& fileData) {
+		if (computeShaders)
+		{
+			DX::ThrowIfFailed(
+				m_deviceResources->GetD3DDevice()->CreatePixelShader(
+				&fileData[0],
+				fileData.size(),
+				nullptr,
+				&m_pixelShader_deferredLighting
+				)
+				);
+		}
 	});
 
     // Once both shaders are loaded, create the mesh.
-    auto createCubeTask = (createPSTask && createVSTask && createPS2Task).then([this] () {
+    auto createCubeTask = (createPSTask && createVSTask && createScreenPSTask && createBlurPSTask && createUpsamplePSTask &&
+		createBlurCSTask && createScreenCSTask && createBloomDownsamplePSTask && createBloomUpsamplePSTask && createCompactVSTask && createInstancedVSTask &&
+		createAoDepthPSTask && createAoPSTask && createAoBlurPSTask && createAoTemporalPSTask &&
+		createClusteredPSTask && createGBufferPSTask && createDeferredLightingPSTask).then([this] () {
 
         // Load mesh vertices. Each vertex has a position and a color.
         static const VertexPositionColor cubeVertices[] = 
@@ -438,111 +2071,18 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources()
             1,7,5,
         };
 
-		int circle = 30;
-		float theta, phi;
-		XMFLOAT3 ccen;
-		float trad = 0.6;
-		float crad = 0.2;
-		int loop;
-		int segment = 30;
-		loop = 3 * segment;
-		int numvertices = circle*loop;
-		int numindices = circle*loop * 6;
-		VertexPositionColor *vertices;
-		VertexPositionColor thisone;
-		XMFLOAT3 thisnor;
-		vertices = (VertexPositionColor *)malloc(numvertices*sizeof(VertexPositionColor));
-
-		// torus:
-		for (int i = 0; i < loop; i++)
-		{
-			
-			theta = 2*i*3.1416/loop; // large loop
-			//crad = 0.3 + 0.08*sin(7*theta); // vary small circle radius, 7 lobes
-			ccen = XMFLOAT3(trad*cos(theta),trad*sin(theta),0); // centre of this small circle
-
-			for (int j = 0; j < circle; j++) // small circle
-			{
-				
-				phi = 2*j*3.1416 / circle; // from 0 to 2PI
-				
-				thisnor = // normal direction
-					XMFLOAT3(cos(theta)*sin(phi), sin(theta)*sin(phi), cos(phi));
-				thisone = // position + color of this vertex
-				{
-					XMFLOAT3(ccen.x+thisnor.x*crad, ccen.y+thisnor.y*crad, ccen.z+thisnor.z*crad),
-					XMFLOAT3(i / (segment + 0.01), j / (circle + 0.01), 0.05),
-					XMFLOAT3(thisnor.x, thisnor.y, thisnor.z)
-				};
-				vertices[i*circle + j] = thisone; // add to vertex array
-			}
-		}
-
-		WORD *indices;
-		indices = (WORD *)malloc(sizeof(WORD)*numindices);
-		int count = 0;
-		for (int i = 0; i < loop; i++)
-		{
-			for (int j = 0; j < circle; j++)
-			{
-				// two triangles per quad
-
-				// proper order:
-
-				indices[count++] = WORD(((i + 1) % loop)*circle + j);
-				indices[count++] = WORD(i*circle + ((j + 1) % circle));
-				indices[count++] = WORD((i*circle + j));
-				
-				// reversed:
-				
-				
-				//indices[count++] = WORD((i*circle + j));	
-				//indices[count++] = WORD(i*circle + ((j + 1) % circle));
-			
-				//indices[count++] = WORD(((i + 1) % loop)*circle + j);
-				
-				indices[count++] = WORD(((i + 1) % loop)*circle + j);
-				indices[count++] = WORD(((i + 1) % loop)*circle + ((j + 1) % circle));
-				indices[count++] = WORD(i*circle + ((j + 1) % circle));
-			}
-		}
-
+		CreateWorldMesh();
+		CreateInstanceBuffer();
+		CreateLightBuffer();
 
 		D3D11_SUBRESOURCE_DATA vertexBufferData = { 0 };
-		vertexBufferData.pSysMem = vertices;
-		vertexBufferData.SysMemPitch = 0;
-		vertexBufferData.SysMemSlicePitch = 0;
-		CD3D11_BUFFER_DESC vertexBufferDesc(numvertices*sizeof(VertexPositionColor), D3D11_BIND_VERTEX_BUFFER);
-		DX::ThrowIfFailed(
-			m_deviceResources->GetD3DDevice()->CreateBuffer(
-			&vertexBufferDesc,
-			&vertexBufferData,
-			&m_vertexBuffer_world
-			)
-			);
-
-		m_indexCount = numindices; // ARRAYSIZE(cubeIndices);
-
 		D3D11_SUBRESOURCE_DATA indexBufferData = { 0 };
-		indexBufferData.pSysMem = indices;
-		indexBufferData.SysMemPitch = 0;
-		indexBufferData.SysMemSlicePitch = 0;
-		CD3D11_BUFFER_DESC indexBufferDesc(numindices*sizeof(WORD), D3D11_BIND_INDEX_BUFFER);
-		DX::ThrowIfFailed(
-			m_deviceResources->GetD3DDevice()->CreateBuffer(
-			&indexBufferDesc,
-			&indexBufferData,
-			&m_indexBuffer_world
-			)
-			);
-    
-		VertexPositionColor* fvertices;
-		fvertices = (VertexPositionColor *)malloc(4 * sizeof(VertexPositionColor));
-		int width = m_deviceResources->GetOutputSize().Width;
-		int height = m_deviceResources->GetOutputSize().Height;
-		float SZx = width / 2 ;
-		float SZy = height / 2;
 
+		// unit quad; BindScreenQuad's ortho projection stretches it over whatever target is bound
+		float SZx = 1;
+		float SZy = 1;
+
+		VertexPositionColor fvertices[4] = {};
 		fvertices[0].pos = XMFLOAT3(-SZx, -SZy, 0);
 		fvertices[0].tex = XMFLOAT2(1, 1);
 
@@ -555,20 +2095,12 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources()
 		fvertices[3].pos = XMFLOAT3(SZx, SZy, 0);
 		fvertices[3].tex = XMFLOAT2(0, 0);
 		
-		WORD *findices;
-		findices = (WORD *)malloc(sizeof(WORD)*6);
-		findices[0] = 3;
-		findices[1] = 1;
-		findices[2] = 0;
-		findices[3] = 2;
-		findices[4] = 3;
-		findices[5] = 0;
-
-//		D3D11_SUBRESOURCE_DATA vertexBufferData = { 0 };
+		static const WORD findices[] = { 3, 1, 0, 2, 3, 0 };
+
 		vertexBufferData.pSysMem = fvertices;
 		vertexBufferData.SysMemPitch = 0;
 		vertexBufferData.SysMemSlicePitch = 0;
-		CD3D11_BUFFER_DESC fvertexBufferDesc(4*sizeof(VertexPositionColor), D3D11_BIND_VERTEX_BUFFER);
+		CD3D11_BUFFER_DESC fvertexBufferDesc(sizeof(fvertices), D3D11_BIND_VERTEX_BUFFER);
 		DX::ThrowIfFailed(
 			m_deviceResources->GetD3DDevice()->CreateBuffer(
 			&fvertexBufferDesc,
@@ -577,11 +2109,10 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources()
 			)
 			);
 
-	//	D3D11_SUBRESOURCE_DATA indexBufferData = { 0 };
 		indexBufferData.pSysMem = findices;
 		indexBufferData.SysMemPitch = 0;
 		indexBufferData.SysMemSlicePitch = 0;
-		CD3D11_BUFFER_DESC findexBufferDesc(numindices*sizeof(WORD), D3D11_BIND_INDEX_BUFFER);
+		CD3D11_BUFFER_DESC findexBufferDesc(sizeof(findices), D3D11_BIND_INDEX_BUFFER);
 		DX::ThrowIfFailed(
 			m_deviceResources->GetD3DDevice()->CreateBuffer(
 			&findexBufferDesc,
@@ -590,41 +2121,9 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources()
 			)
 			);
 
-		// adding creation of canvas here: texture itself, render target view, and shader resource view
-
-
-		D3D11_TEXTURE2D_DESC td;
-		ZeroMemory(&td, sizeof(td));
-		td.Width = m_deviceResources->GetOutputSize().Width;
-		td.Height = m_deviceResources->GetOutputSize().Height;
-		td.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-		td.SampleDesc.Count = 1;
-		td.ArraySize = 1;
-		td.MipLevels = 1;
-		td.SampleDesc.Count = 1;
-		td.Usage = D3D11_USAGE_DEFAULT;
-		td.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE; // note, will be used as both RT and SR
-		td.CPUAccessFlags = 0;
-		td.MiscFlags = 0;
-
-		m_deviceResources->GetD3DDevice()->CreateTexture2D(&td, NULL, &canvas);
-
-		// render target view: render scene to canvas
-		D3D11_RENDER_TARGET_VIEW_DESC rtvd;
-		ZeroMemory(&rtvd, sizeof(rtvd));
-		rtvd.Format = td.Format;
-		rtvd.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
-		rtvd.Texture2D.MipSlice = 0;
-		m_deviceResources->GetD3DDevice()->CreateRenderTargetView(canvas, &rtvd, &RTV_canvas);
-
-		// create shader resource view so we can connect ps to canvas
-		SRV_canvas_desc.Format = td.Format;
-		SRV_canvas_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-		SRV_canvas_desc.Texture2D.MostDetailedMip = 0;
-		SRV_canvas_desc.Texture2D.MipLevels = 1;
-		m_deviceResources->GetD3DDevice()->CreateShaderResourceView(canvas, &SRV_canvas_desc, &SRV_canvas);
-
-		// finally, make texture sampler here
+		// the canvas and the other intermediate targets are created by m_postProcess (see BuildPostProcessChain)
+
+		// texture sampler for the screen pass
 		D3D11_SAMPLER_DESC sampDesc;
 		ZeroMemory(&sampDesc, sizeof(sampDesc));
 		sampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
@@ -636,6 +2135,22 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources()
 		sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
 		m_deviceResources->GetD3DDevice()->CreateSamplerState(&sampDesc, &m_sampler_screen);
 
+		// the blur clamps at the edges so it doesn't bleed the opposite side of the canvas in
+		sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+		sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+		sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+		m_deviceResources->GetD3DDevice()->CreateSamplerState(&sampDesc, &m_sampler_blur);
+
+		// the bloom upsamples add onto the level below instead of replacing it
+		CD3D11_BLEND_DESC blendDesc(D3D11_DEFAULT);
+		blendDesc.RenderTarget[0].BlendEnable = TRUE;
+		blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+		blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_ONE;
+		blendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+		DX::ThrowIfFailed(
+			m_deviceResources->GetD3DDevice()->CreateBlendState(&blendDesc, &m_blendState_additive)
+			);
+
 });
 
 	
@@ -650,8 +2165,48 @@ void Sample3DSceneRenderer::ReleaseDeviceDependentResources()
     m_loadingComplete = false;
     m_vertexShader_world.Reset();
     m_inputLayout.Reset();
+    m_vertexShader_compact.Reset();
+    m_inputLayout_compact.Reset();
+    m_vertexShader_instanced.Reset();
+    m_inputLayout_instanced.Reset();
+    m_instanceBuffer.Reset();
+    m_indexBuffer_clusters.Reset();
+    m_pixelShader_clustered.Reset();
+    m_pixelShader_gbuffer.Reset();
+    m_pixelShader_deferredLighting.Reset();
+    m_lightBuffer.Reset();
+    m_lightView.Reset();
+    m_lightClusterBuffer.Reset();
+    m_lightClusterView.Reset();
+    m_lightClusterCapacity = 0;
+    m_lightIndexBuffer.Reset();
+    m_lightIndexView.Reset();
+    m_lightIndexCapacity = 0;
+    m_meshletLods.clear();
     m_pixelShader_world.Reset();
-    m_constantBuffer.Reset();
-    m_vertexBuffer_world.Reset();
-    m_indexBuffer_world.Reset();
+    m_meshLods.clear();
+    m_meshLodLevels.clear();
+    m_pixelShader_blur.Reset();
+    m_pixelShader_upsample.Reset();
+    m_computeShader_blur.Reset();
+    m_pixelShader_bloomDownsample.Reset();
+    m_pixelShader_bloomUpsample.Reset();
+    m_pixelShader_aoDepth.Reset();
+    m_pixelShader_ao.Reset();
+    m_pixelShader_aoBlur.Reset();
+    m_pixelShader_aoTemporal.Reset();
+    m_blendState_additive.Reset();
+    m_computeShader_screen.Reset();
+    m_sampler_blur.Reset();
+    m_sampler_screen.Reset();
+    for (auto& shader : m_pixelShaders_screen)
+    {
+        shader.Reset();
+    }
+    m_vertexBuffer_screen.Reset();
+    m_indexBuffer_screen.Reset();
+    m_postProcess->ReleaseDeviceDependentResources();
+    m_renderTargetPool->ReleaseDeviceDependentResources();
+    m_constants->ReleaseDeviceDependentResources();
+    m_postProcessDirty = true;
 }
\ No newline at end of file
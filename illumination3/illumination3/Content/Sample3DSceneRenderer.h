@@ -10,9 +10,42 @@
 #include "..\Helpers\DeviceResources.h"
 #include "ShaderStructures.h"
 #include "..\Helpers\StepTimer.h"
+#include "..\Helpers\ConstantBufferRing.h"
+#include "PostProcessChain.h"
+#include "UpsampleCpu.h"
+#include "BloomCpu.h"
+#include "MeshIndexing.h"
+#include "MeshSimplifier.h"
+#include "CompactVertex.h"
+#include "InstanceAnimation.h"
+#include "FrustumCulling.h"
+#include "MeshCache.h"
+#include "Meshlets.h"
+#include "ScreenPermutations.h"
+#include "DynamicResolution.h"
+#include "LightCulling.h"
+#include "AmbientOcclusionCpu.h"
 
 namespace DirectXGame1
 {
+	// How the blur and screen passes run. Compute dispatches BlurCS.hlsl / ScreenCS.hlsl,
+	// which read each tile and its apron into shared memory once; passes the compute shaders
+	// cannot take (see BuildPostProcessChain) stay on the pixel shaders either way.
+	enum class ScreenEffectsPath
+	{
+		PixelShader,
+		Compute
+	};
+
+	// How the world pass lights the torus. Forward shades every fragment as it is drawn;
+	// Deferred writes albedo, normal and depth to a G-buffer and lights each pixel once in a
+	// full-screen pass, which can also outline edges from the normals and depths.
+	enum class WorldShadingPath
+	{
+		Forward,
+		Deferred
+	};
+
     // This sample renderer instantiates a basic rendering pipeline.
     class Sample3DSceneRenderer
     {
@@ -23,7 +56,107 @@ namespace DirectXGame1
         void ReleaseDeviceDependentResources();
         void Update(DX::StepTimer const& timer);
         void Render();
-		void RenderScreen();
+		void SetBlurRadius(int radius);
+		int GetBlurRadius() const { return m_blurRadius; }
+		// Storage format of the world-pass canvas and of the blur targets. Formats the device
+		// cannot render to, or the render target pool does not list, fall back to
+		// DXGI_FORMAT_R8G8B8A8_UNORM.
+		void SetCanvasFormat(DXGI_FORMAT format);
+		DXGI_FORMAT GetCanvasFormat() const { return m_canvasFormat; }
+		void SetBlurFormat(DXGI_FORMAT format);
+		DXGI_FORMAT GetBlurFormat() const { return m_blurFormat; }
+		// Run the screen effects or the blur at 1/divisor of the output size (1, 2 or 4). A
+		// reduced-resolution screen pass only reads the canvas; an upsample pass using filter
+		// brings that back up and applies the lines, threshold and wipe at full resolution.
+		void SetScreenResolution(unsigned int divisor, UpsampleFilter filter = UpsampleFilter::Bilateral);
+		unsigned int GetScreenDivisor() const { return m_screenDivisor; }
+		void SetBlurResolution(unsigned int divisor);
+		unsigned int GetBlurDivisor() const { return m_blurDivisor; }
+		// Glow around the parts of the canvas that pass the screen pass's threshold, added by the
+		// screen pass at intensity. 0 turns the bloom passes off.
+		void SetBloom(float intensity, unsigned int levels = DefaultBloomLevels);
+		float GetBloomIntensity() const { return m_bloomIntensity; }
+		// Screen-space ambient occlusion from the depth buffer: depth is brought down to half
+		// resolution, sampled over a hemisphere of radius world units around each texel and
+		// blurred without crossing depth edges, and the screen pass multiplies the canvas by
+		// it. Needs the readable depth buffer of feature level 10_0. 0 turns it off.
+		void SetAmbientOcclusion(float intensity, float radius = DefaultAmbientOcclusionRadius);
+		float GetAmbientOcclusionIntensity() const { return m_ambientOcclusion.intensity; }
+		// Spread the occlusion's samples over frames (a divisor of AmbientOcclusionSamples; 1
+		// turns it off): each frame takes its share and blends it with the previous frame's
+		// result, reprojected through the previous model matrix and clamped to the current
+		// neighbourhood. The history survives only while the chain and output size stay the same.
+		void SetTemporalAccumulation(unsigned int frames = DefaultAmbientOcclusionTemporalFrames);
+		unsigned int GetTemporalAccumulation() const { return m_ambientOcclusion.temporalFrames; }
+		// Grid of the torus: rows around the large loop, columns around the tube. Meshes past
+		// 65,535 vertices take 32-bit indices, or 16-bit chunks with IndexPolicy::Split16.
+		void SetMeshResolution(unsigned int rows, unsigned int columns, IndexPolicy policy = IndexPolicy::Automatic);
+		// Draw the torus from 20-byte CompactVertex data instead of 44-byte VertexPositionColor.
+		// Ignored on devices that cannot fetch the compact formats.
+		void SetCompactVertices(bool compact);
+		bool GetCompactVertices() const { return m_compactVertices; }
+		// Update draws the coarsest torus LOD whose geometric error projects to at most this
+		// many pixels. 0 keeps the full mesh.
+		void SetLodPixelError(float pixels) { m_lodPixelError = pixels; }
+		float GetLodPixelError() const { return m_lodPixelError; }
+		unsigned int GetCurrentLod() const { return m_currentLod; }
+		// Draw count animated copies of the torus, scattered behind it, with one
+		// DrawIndexedInstanced per mesh chunk. Needs feature level 9_3; the instances use the
+		// full vertices, so compact vertices are off while there are any. 0 turns them off.
+		void SetInstanceCount(uint32_t count);
+		uint32_t GetInstanceCount() const { return m_instances.count; }
+		// Instances left after frustum culling in the last Update; only these are uploaded and drawn.
+		uint32_t GetVisibleInstanceCount() const { return m_visibleInstanceCount; }
+		// How the last CreateWorldMesh went: mapped from the mesh cache or baked, and how long
+		// it took from settings to buffers.
+		bool GetWorldMeshCached() const { return m_worldMeshCached; }
+		// Split the torus into meshlets and, each frame, draw only those inside the frustum with
+		// some triangle facing the camera, from one index list rebuilt on the CPU.
+		void SetClusterCulling(bool enable);
+		bool GetClusterCulling() const { return m_clusterCulling; }
+		// Triangles the torus sent to the GPU last frame.
+		uint32_t GetWorldTrianglesDrawn() const { return m_worldTrianglesDrawn; }
+		double GetWorldMeshMilliseconds() const { return m_worldMeshMilliseconds; }
+		// ScreenFeature bits for the screen pass; bloom and ambient occlusion are added whenever
+		// SetBloom and SetAmbientOcclusion turn them on.
+		// Every combination is precompiled, so switching only picks another shader. The
+		// compute screen pass only has the default features and steps aside for any other set.
+		void SetScreenFeatures(uint32_t features);
+		uint32_t GetScreenFeatures() const { return m_screenFeatures; }
+		// Compute needs feature level 11_0; other devices keep ScreenEffectsPath::PixelShader.
+		void SetScreenEffectsPath(ScreenEffectsPath path);
+		ScreenEffectsPath GetScreenEffectsPath() const { return m_screenEffectsPath; }
+		// The G-buffer targets and the lighting pass's shader need feature level 11_0; other
+		// devices stay on WorldShadingPath::Forward.
+		void SetWorldShadingPath(WorldShadingPath path);
+		WorldShadingPath GetWorldShadingPath() const { return m_worldShadingPath; }
+		// Darkens pixels whose depth or normal breaks from a neighbour's by strength (0 to 1).
+		// Deferred path only; 0 turns it off.
+		void SetEdgeOutline(float strength) { m_edgeOutline = strength; }
+		float GetEdgeOutline() const { return m_edgeOutline; }
+		// Moving point lights on top of the main one, binned into clusters on the CPU every
+		// frame so each pixel shades only the lights listed for its cluster. The structured
+		// buffers need feature level 11_0; below it the lights are kept but not drawn.
+		void SetPointLightCount(uint32_t count);
+		uint32_t GetPointLightCount() const { return m_pointLights.count; }
+		// Light indices over all clusters last frame, and how long binning them took.
+		uint32_t GetLightIndicesBinned() const { return (uint32_t)m_lightGrid.indices.size(); }
+		double GetLightBinningMilliseconds() const { return m_lightBinningMilliseconds; }
+		// Draw the world pass into a top-left part of the canvas sized every frame by a
+		// DynamicResolutionController against the frame budget; the screen pass stretches that
+		// part over the back buffer. Only while the screen pass reads the canvas straight (no
+		// blur, bloom, ambient occlusion or reduced screen resolution); otherwise the world pass
+		// keeps full size.
+		void SetDynamicResolution(bool enable, double targetFramesPerSecond = 60.0);
+		bool GetDynamicResolution() const { return m_dynamicResolutionEnabled; }
+		// Fraction of the canvas width and height the world pass drew last frame.
+		float GetRenderScale() const { return m_renderScale; }
+		// Per-pass bytes read and written by the chain as last built, or with every
+		// intermediate target in formatOverride to compare format choices. An override the
+		// canvas could not use falls back to DXGI_FORMAT_R8G8B8A8_UNORM as SetCanvasFormat does.
+		PostProcessFrameTraffic GetPostProcessTraffic(DXGI_FORMAT formatOverride = DXGI_FORMAT_UNKNOWN) const;
+		// Constant data uploaded through the ring in the last complete frame.
+		uint64 GetConstantBytesUploaded() const { return m_constants->GetBytesUploadedLastFrame(); }
         void StartTracking();
         void TrackingUpdate(float positionX);
         void StopTracking();
@@ -32,40 +165,173 @@ namespace DirectXGame1
 
     private:
         void Rotate(float radians);
+		void BuildPostProcessChain();
+		void RenderWorld(const PostProcessPassContext& pass);
+		void RenderDeferredLighting(const PostProcessPassContext& pass);
+		void RenderBlurPass(const PostProcessPassContext& pass, float stepX, float stepY);
+		void RenderScreen(const PostProcessPassContext& pass, uint32_t features, bool canvasReadOnly);
+		void RenderUpsample(const PostProcessPassContext& pass, float guideScale, uint32_t features);
+		void RenderBloomDownsample(const PostProcessPassContext& pass, bool prefilter);
+		void RenderBloomUpsample(const PostProcessPassContext& pass);
+		void RenderAmbientOcclusionDepth(const PostProcessPassContext& pass);
+		void RenderAmbientOcclusion(const PostProcessPassContext& pass);
+		void RenderAmbientOcclusionTemporal(const PostProcessPassContext& pass);
+		void RenderAmbientOcclusionBlur(const PostProcessPassContext& pass, float stepX, float stepY);
+		void SetAmbientOcclusionConstants(float stepX, float stepY);
+		void BindScreenQuad();
+		void CreateWorldMesh();
+		void CreateInstanceBuffer();
+		void CreateMeshlets(const std::vector<MeshLodView>& lods);
+		void CreateLightBuffer();
+		void BindLightGrid(ID3D11DeviceContext* context, const D3D11_VIEWPORT& viewport);
+		bool UseClusterCulling() const;
+		bool UseInstancing() const;
+		bool UseCompactVertices() const;
+		bool UseDynamicResolution() const;
+		bool UseClusteredLights() const;
+		bool UseDeferredShading() const;
+		bool UseAmbientOcclusion() const;
+		bool UseTemporalAccumulation() const;
+		DXGI_FORMAT SupportedTargetFormat(DXGI_FORMAT format) const;
 
     private:
         // Cached pointer to device resources.
         std::shared_ptr<DX::DeviceResources> m_deviceResources;
 
-		// resources for render-to-texture
+		// render-to-texture: the world pass, blur and screen pass are declared in m_postProcess,
+		// which owns the canvas and every other intermediate target.
+		std::shared_ptr<DX::RenderTargetPool>	m_renderTargetPool;
+		std::unique_ptr<PostProcessChain>	m_postProcess;
+		bool								m_postProcessDirty;
+		DXGI_FORMAT							m_canvasFormat;
+		DXGI_FORMAT							m_blurFormat;
+		ScreenEffectsPath					m_screenEffectsPath;
+		WorldShadingPath					m_worldShadingPath;
+		float								m_edgeOutline;
+		uint32_t							m_screenFeatures;
+		DynamicResolutionController			m_dynamicResolution;
+		bool								m_dynamicResolutionEnabled;
+		float								m_renderScale;
+		double								m_frameSeconds;		// wall clock of the last Tick
+
+		// every constant block goes through the ring; see ShaderStructures.h for the slots
+		std::unique_ptr<DX::ConstantBufferRing>	m_constants;
+		PerFrameConstantBuffer					m_constantBufferData_frame;
+
+		Microsoft::WRL::ComPtr<ID3D11SamplerState> m_sampler_screen;
+		PerViewConstantBuffer    m_constantBufferData_screen;
+		PerObjectConstantBuffer  m_constantBufferData_quad;
+		ScreenConstantBuffer     m_constantBufferData_screenEffect;
 
-		ID3D11Texture2D* canvas;
-		ID3D11RenderTargetView* RTV_canvas;
-		ID3D11ShaderResourceView* SRV_canvas;
+		Microsoft::WRL::ComPtr<ID3D11SamplerState>			m_sampler_blur;
+		BlurConstantBuffer									m_constantBufferData_blur;
+		int													m_blurRadius;
+		unsigned int										m_blurDivisor;
 
-		D3D11_TEXTURE2D_DESC textureDesc;
-		D3D11_RENDER_TARGET_VIEW_DESC RTV_canvas_desc;
-		D3D11_SHADER_RESOURCE_VIEW_DESC SRV_canvas_desc;
-		ID3D11SamplerState* m_sampler_screen = NULL;
-		ModelViewProjectionConstantBuffer    m_constantBufferData_screen;
+		UpsampleConstantBuffer								m_constantBufferData_upsample;
+		unsigned int										m_screenDivisor;
+		UpsampleFilter										m_upsampleFilter;
+
+		BloomConstantBuffer									m_constantBufferData_bloom;
+		float												m_bloomIntensity;
+		unsigned int										m_bloomLevels;
+		Microsoft::WRL::ComPtr<ID3D11BlendState>			m_blendState_additive;
+
+		AmbientOcclusionConstantBuffer						m_constantBufferData_ambientOcclusion;
+		AmbientOcclusionSettings							m_ambientOcclusion;
+		// what the last frame was drawn with, for reprojection; transposed like the constant buffers
+		DirectX::XMFLOAT4X4									m_previousModel;
+		DirectX::XMFLOAT4X4									m_previousView;
+		DirectX::XMFLOAT4X4									m_previousProjection;
 
         // Direct3D resources for cube geometry.
         Microsoft::WRL::ComPtr<ID3D11InputLayout>   m_inputLayout;
-		Microsoft::WRL::ComPtr<ID3D11Buffer>        m_vertexBuffer_world;
-		Microsoft::WRL::ComPtr<ID3D11Buffer>        m_indexBuffer_world;
 		Microsoft::WRL::ComPtr<ID3D11Buffer>        m_vertexBuffer_screen;
 		Microsoft::WRL::ComPtr<ID3D11Buffer>        m_indexBuffer_screen;
 		Microsoft::WRL::ComPtr<ID3D11VertexShader>  m_vertexShader_world;
 		Microsoft::WRL::ComPtr<ID3D11PixelShader>   m_pixelShader_world;
-		Microsoft::WRL::ComPtr<ID3D11PixelShader>   m_pixelShader_screen;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>   m_pixelShaders_screen[ScreenPermutationCount];	// by ScreenFeature mask
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>   m_pixelShader_blur;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>   m_pixelShader_upsample;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>   m_pixelShader_bloomDownsample;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>   m_pixelShader_bloomUpsample;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>   m_pixelShader_aoDepth;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>   m_pixelShader_ao;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>   m_pixelShader_aoBlur;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>   m_pixelShader_aoTemporal;
+		Microsoft::WRL::ComPtr<ID3D11ComputeShader> m_computeShader_blur;
+		Microsoft::WRL::ComPtr<ID3D11ComputeShader> m_computeShader_screen;
+		Microsoft::WRL::ComPtr<ID3D11VertexShader>  m_vertexShader_compact;
+		Microsoft::WRL::ComPtr<ID3D11InputLayout>   m_inputLayout_compact;
+		Microsoft::WRL::ComPtr<ID3D11VertexShader>  m_vertexShader_instanced;
+		Microsoft::WRL::ComPtr<ID3D11InputLayout>   m_inputLayout_instanced;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>        m_instanceBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>        m_indexBuffer_clusters;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>   m_pixelShader_clustered;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>   m_pixelShader_gbuffer;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>   m_pixelShader_deferredLighting;
+		DeferredConstantBuffer						m_constantBufferData_deferred;
+
+		// ClusteredLightsPS.hlsl's and DeferredLightingPS.hlsl's inputs; the grid's two buffers grow as needed
+		PointLightSet										m_pointLights;
+		std::vector<PointLightData>							m_pointLightData;
+		CullingBounds										m_pointLightBounds;
+		LightGridDesc										m_lightGridDesc;
+		LightGrid											m_lightGrid;
+		LightGridConstantBuffer								m_constantBufferData_lightGrid;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_lightBuffer;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_lightView;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_lightClusterBuffer;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_lightClusterView;
+		uint32_t											m_lightClusterCapacity;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_lightIndexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_lightIndexView;
+		uint32_t											m_lightIndexCapacity;
+		double												m_lightBinningMilliseconds;
 
-		Microsoft::WRL::ComPtr<ID3D11Buffer>        m_constantBuffer;
 		
 		
 
+		// One per level of detail, each with its own vertices so the coarse ones fetch only
+		// what they use.
+		struct WorldMeshLod
+		{
+			Microsoft::WRL::ComPtr<ID3D11Buffer>	vertexBuffer;
+			Microsoft::WRL::ComPtr<ID3D11Buffer>	indexBuffer;
+			DXGI_FORMAT								indexFormat;
+			uint32_t								vertexCount;
+			std::vector<MeshChunk>					chunks;
+			CompactVertexBounds						bounds;
+		};
+
         // System resources for cube geometry.
-		ModelViewProjectionConstantBuffer    m_constantBufferData_world;
-		uint32    m_indexCount;
+		PerViewConstantBuffer    m_constantBufferData_world;
+		PerObjectConstantBuffer  m_constantBufferData_object;
+		unsigned int				m_meshRows;
+		unsigned int				m_meshColumns;
+		IndexPolicy					m_indexPolicy;
+		std::vector<WorldMeshLod>	m_meshLods;
+		std::vector<MeshLod>		m_meshLodLevels;
+		unsigned int				m_currentLod;
+		float						m_lodPixelError;
+		float						m_meshRadius;
+		float						m_fovAngleY;
+		bool						m_compactVertices;
+		UINT						m_vertexStride_world;
+		InstanceSet					m_instances;
+		std::vector<InstanceData>	m_instanceData;
+		unsigned int				m_instanceLod;
+		CullingBounds				m_instanceBounds;
+		std::vector<uint32_t>		m_visibleInstances;
+		uint32_t					m_visibleInstanceCount;
+		bool						m_worldMeshCached;
+		bool						m_clusterCulling;
+		std::vector<MeshletMesh>	m_meshletLods;
+		std::vector<uint32_t>		m_visibleMeshlets;
+		uint32_t					m_visibleMeshletCount;
+		unsigned int				m_clusterLod;
+		uint32_t					m_worldTrianglesDrawn;
+		double						m_worldMeshMilliseconds;
 
         // Variables used with the rendering loop.
         bool    m_loadingComplete;
@@ -4,12 +4,16 @@
 //// PARTICULAR PURPOSE.
 ////
 //// Copyright (c) Microsoft Corporation. All rights reserved
-cbuffer ModelViewProjectionConstantBuffer : register(b0)
+cbuffer PerFrameConstantBuffer : register(b0)
+{
+	float4 time;
+	float4 lightpos;
+};
+
+cbuffer PerViewConstantBuffer : register(b1)
 {
-	matrix model;
 	matrix view;
 	matrix projection;
-	float4 lightpos;
 	float4 eyepos;
 };
 
@@ -5,16 +5,20 @@
 ////
 //// Copyright (c) Microsoft Corporation. All rights reserved
 
-// A constant buffer that stores the three basic column-major matrices for composing geometry.
-cbuffer ModelViewProjectionConstantBuffer : register(b0)
+// The column-major matrices for composing geometry, split by how often they change
+// (see ShaderStructures.h).
+cbuffer PerViewConstantBuffer : register(b1)
 {
-	matrix model;
 	matrix view;
 	matrix projection;
-	float4 lightpos;
 	float4 eyepos;
 };
 
+cbuffer PerObjectConstantBuffer : register(b2)
+{
+	matrix model;
+};
+
 // Per-vertex data used as input to the vertex shader.
 struct VertexShaderInput
 {
@@ -0,0 +1,120 @@
+// Compute version of screenps.hlsl. A 16x16 group loads every canvas texel its 2x tiled
+// bilinear samples touch into shared memory once, then each thread runs the screen effects
+// from there. Writes the reduced-resolution effects target (the back buffer has no UAV).
+// Dispatch(ceil(width / 16), ceil(height / 16), 1). Same result as ApplyScreenEffectsTiledCpu;
+// the renderer only picks it when ScreenTilesFitCache holds. With time.y set it stops after
+// the canvas read, like screenps.hlsl, for the reduced-resolution pass.
+
+#define SCREEN_GROUP_SIZE 16
+#define SCREEN_CACHE_SIZE 40
+
+Texture2D<float4> canvas : register(t0);
+Texture2D<float4> bloom : register(t1);
+SamplerState bloomSampler : register(s0);
+RWTexture2D<float4> target : register(u0);
+
+cbuffer ScreenConstantBuffer : register(b3)
+{
+	float4 time; // use first element as timer; y: 1 to write only the canvas read
+	float4 bloomParams; // x: bloom intensity, 0 when no bloom is bound
+};
+
+groupshared float3 cache[SCREEN_CACHE_SIZE][SCREEN_CACHE_SIZE];
+
+// Where pixel i samples the canvas along one axis, in texels (tex * 2 with the half-texel shift).
+float TexelPosition(uint i, uint canvasSize, uint targetSize)
+{
+	float tex = (i + 0.5) / targetSize;
+	return tex * 2.0 * canvasSize - 0.5;
+}
+
+int Wrap(int i, int size)
+{
+	i %= size;
+	return i < 0 ? i + size : i;
+}
+
+[numthreads(SCREEN_GROUP_SIZE, SCREEN_GROUP_SIZE, 1)]
+void main(uint3 group : SV_GroupID, uint3 thread : SV_GroupThreadID, uint3 id : SV_DispatchThreadID)
+{
+	uint canvasWidth, canvasHeight, targetWidth, targetHeight;
+	canvas.GetDimensions(canvasWidth, canvasHeight);
+	target.GetDimensions(targetWidth, targetHeight);
+
+	// The group's footprint: from the first pixel's lower texel to the last pixel's upper one.
+	uint2 first = group.xy * SCREEN_GROUP_SIZE;
+	uint2 last = min(first + SCREEN_GROUP_SIZE, uint2(targetWidth, targetHeight)) - 1;
+	int2 origin = int2(floor(TexelPosition(first.x, canvasWidth, targetWidth)), floor(TexelPosition(first.y, canvasHeight, targetHeight)));
+	int2 end = int2(floor(TexelPosition(last.x, canvasWidth, targetWidth)), floor(TexelPosition(last.y, canvasHeight, targetHeight))) + 1;
+	int2 span = min(end - origin + 1, SCREEN_CACHE_SIZE);
+
+	for (int cy = thread.y; cy < span.y; cy += SCREEN_GROUP_SIZE)
+	{
+		for (int cx = thread.x; cx < span.x; cx += SCREEN_GROUP_SIZE)
+		{
+			int2 texel = int2(Wrap(origin.x + cx, canvasWidth), Wrap(origin.y + cy, canvasHeight));
+			cache[cy][cx] = canvas.Load(int3(texel, 0)).rgb;
+		}
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	if (id.x >= targetWidth || id.y >= targetHeight)
+	{
+		return;
+	}
+
+	float2 tex = (id.xy + 0.5) / float2(targetWidth, targetHeight);
+	float2 s = float2(TexelPosition(id.x, canvasWidth, targetWidth), TexelPosition(id.y, canvasHeight, targetHeight));
+	float2 fs = floor(s);
+	int2 c = clamp((int2)fs - origin, 0, span - 2);
+	float2 f = s - fs;
+
+	float t = time.r;
+	float3 wipreColour = { 1.0f, 0.0f, 0.5f };
+	bool isWiper = false;
+
+	// 2X2 tiling of the scene, bilinear from the cached texels.
+	float3 top = lerp(cache[c.y][c.x], cache[c.y][c.x + 1], f.x);
+	float3 bottom = lerp(cache[c.y + 1][c.x], cache[c.y + 1][c.x + 1], f.x);
+	float3 effect = lerp(top, bottom, f.y);
+
+	if (time.g > 0.5)
+	{
+		target[id.xy] = float4(effect, 1.0f);
+		return;
+	}
+
+	// "transmission" horizontal and vertical lines:
+	if (((int)(tex.r * 1920)) % 12 < 2)
+		effect = (float3)0;
+
+	if (((int)(tex.g * 1200)) % 12 < 2)
+		effect = effect * 0;
+
+	// threshold:
+	if (effect.r + effect.g + effect.b > 0.3) effect = (float3)1.0; else effect = (float3)0;
+
+	// horizontal wipe, as in screenps.hlsl
+	if (((int)((0 - tex.r) + t / 15)) % 20 > 15 && (effect.r + effect.g + effect.b > 0.3)){
+		isWiper = true;
+	}
+	if (isWiper && (t/15) % 20 >15){
+		effect = wipreColour;
+	}
+
+	// magnet: the loop adds the same (tex - 0.05) scaled offset every time
+	float3 result = effect;
+	for (int i = 1; i < 25; ++i) {
+		float2 offset = (tex - 0.05) * (float(i) / float(25 - 1) - 0.5);
+		float3 temp = { offset.r, offset.g, 0 };
+		result = result + temp;
+	}
+
+	float3 cr = effect / result;
+
+	// bloom: the glow of the bright parts, tiled the same way as the canvas
+	if (bloomParams.x > 0)
+		cr += bloom.SampleLevel(bloomSampler, tex * 2, 0).rgb * bloomParams.x;
+
+	target[id.xy] = float4(cr, 1.0f);
+}
@@ -0,0 +1,241 @@
+#include "ScreenEffectsCpu.h"
+#include "../Helpers/ParallelFor.h"
+
+#include <chrono>
+#include <cmath>
+
+using namespace DirectXGame1;
+using namespace DX;
+
+namespace
+{
+	// Constants baked into screenps.hlsl.
+	const float TilingFactor = 2.0f;
+	const float ScanlineWidth = 1920.0f;
+	const float ScanlineHeight = 1200.0f;
+	const int ScanlinePeriod = 12;
+	const int ScanlineThickness = 2;
+	const float Threshold = 0.3f;
+	const float WipeSpeed = 15.0f;
+	const int WipePeriod = 20;
+	const int WipeOn = 15;
+	const int MagnetTaps = 25;
+
+	// Sum of (i / 24 - 0.5) over the magnet loop. Every iteration adds the same
+	// (tex - 0.05) scaled by this term, so the loop folds to a single multiply.
+	float MagnetScale()
+	{
+		float k = 0.0f;
+		for (int i = 1; i < MagnetTaps; ++i)
+		{
+			k += float(i) / float(MagnetTaps - 1) - 0.5f;
+		}
+		return k;
+	}
+
+	// Folded once at start-up for the per-pixel entry points.
+	const float MagnetFolded = MagnetScale();
+
+	bool OnScanline(float texCoord, float lines)
+	{
+		return ((int)(texCoord * lines)) % ScanlinePeriod < ScanlineThickness;
+	}
+
+	// Per-column (or per-row) data that only depends on one axis, built once per frame.
+	struct AxisTap
+	{
+		float tex;		// input.tex for this pixel centre
+		int i0, i1;		// texels read by the 2x tiled bilinear sample
+		float frac;		// bilinear weight of i1
+		bool dark;		// covered by a transmission line
+	};
+
+	void BuildAxis(std::vector<AxisTap>& taps, unsigned int outputSize, unsigned int sourceSize, float lines)
+	{
+		taps.resize(outputSize);
+		for (unsigned int i = 0; i < outputSize; i++)
+		{
+			AxisTap& tap = taps[i];
+			tap.tex = (i + 0.5f) / outputSize;
+			float s = tap.tex * TilingFactor * sourceSize - 0.5f;
+			float fs = std::floor(s);
+			tap.i0 = WrapTexel((int)fs, (int)sourceSize);
+			tap.i1 = tap.i0 + 1 == (int)sourceSize ? 0 : tap.i0 + 1;
+			tap.frac = s - fs;
+			tap.dark = OnScanline(tap.tex, lines);
+		}
+	}
+
+	// Wipe test for one pixel; wipeActive is the per-frame half of the condition.
+	bool InWipe(float u, float time)
+	{
+		return ((int)((0 - u) + time / WipeSpeed)) % WipePeriod > WipeOn;
+	}
+}
+
+void DirectXGame1::ApplyScreenEffectsCpu(const CpuCanvas& source, CpuCanvas& target, float time, unsigned int tileSize)
+{
+	if (tileSize == 0)
+	{
+		throw std::invalid_argument("ApplyScreenEffectsCpu needs a tile size");
+	}
+	if (source.width == 0 || source.height == 0 || target.width == 0 || target.height == 0)
+	{
+		return;
+	}
+
+	std::vector<AxisTap> columns, rows;
+	BuildAxis(columns, target.width, source.width, ScanlineWidth);
+	BuildAxis(rows, target.height, source.height, ScanlineHeight);
+
+	const float magnet = MagnetScale();
+	const bool wipeActive = std::fmod(time / WipeSpeed, (float)WipePeriod) > WipeOn;
+	const SimdFloat4 one = SimdSplat(1.0f);
+	const SimdFloat4 black = SimdSet(0.0f, 0.0f, 0.0f, 1.0f);
+	const SimdFloat4 wipeColour = SimdSet(1.0f, 0.0f, 0.5f, 1.0f);
+
+	std::vector<Tile> tiles = MakeTiles(target.width, target.height, tileSize);
+	ParallelFor((unsigned int)tiles.size(), [&](unsigned int t)
+	{
+		const Tile& tile = tiles[t];
+		for (unsigned int y = tile.y0; y < tile.y1; y++)
+		{
+			const AxisTap& row = rows[y];
+			const float* src0 = source.Row(row.i0);
+			const float* src1 = source.Row(row.i1);
+			const SimdFloat4 ty = SimdSplat(row.frac);
+			const float offsetV = (row.tex - 0.05f) * magnet;
+			float* out = target.Row(y);
+
+			for (unsigned int x = tile.x0; x < tile.x1; x++)
+			{
+				const AxisTap& column = columns[x];
+				SimdFloat4 effect = black;
+
+				// Pixels under a transmission line are black whatever the canvas holds,
+				// so the texture read is skipped for them.
+				if (!row.dark && !column.dark)
+				{
+					const SimdFloat4 tx = SimdSplat(column.frac);
+					SimdFloat4 top = SimdLerp(SimdLoad(src0 + column.i0 * 4), SimdLoad(src0 + column.i1 * 4), tx);
+					SimdFloat4 bottom = SimdLerp(SimdLoad(src1 + column.i0 * 4), SimdLoad(src1 + column.i1 * 4), tx);
+					float texel[4];
+					SimdStore(texel, SimdLerp(top, bottom, ty));
+
+					if (texel[0] + texel[1] + texel[2] > Threshold)
+					{
+						effect = (wipeActive && InWipe(column.tex, time)) ? wipeColour : one;
+					}
+				}
+
+				// effect / (effect + magnet offset); alpha lanes are 1 / 1.
+				SimdFloat4 offset = SimdSet((column.tex - 0.05f) * magnet, offsetV, 0.0f, 0.0f);
+				SimdStore(out + x * 4, SimdDiv(effect, SimdAdd(effect, offset)));
+			}
+		}
+	});
+}
+
+void DirectXGame1::ShadeScreenTexel(const float texel[4], float u, float v, float time, float out[4])
+{
+	SimdFloat4 effect = SimdSet(0.0f, 0.0f, 0.0f, 1.0f);
+	if (!OnScanline(u, ScanlineWidth) && !OnScanline(v, ScanlineHeight) && texel[0] + texel[1] + texel[2] > Threshold)
+	{
+		bool wipeActive = std::fmod(time / WipeSpeed, (float)WipePeriod) > WipeOn;
+		effect = (wipeActive && InWipe(u, time)) ? SimdSet(1.0f, 0.0f, 0.5f, 1.0f) : SimdSplat(1.0f);
+	}
+
+	SimdFloat4 offset = SimdSet((u - 0.05f) * MagnetFolded, (v - 0.05f) * MagnetFolded, 0.0f, 0.0f);
+	SimdStore(out, SimdDiv(effect, SimdAdd(effect, offset)));
+}
+
+void DirectXGame1::ShadeScreenPixelReference(const CpuCanvas& source, float u, float v, float time, float out[4])
+{
+	float t = time;
+	float wipreColour[3] = { 1.0f, 0.0f, 0.5f };
+	bool isWiper = false;
+
+	float effect[3];
+	SimdFloat4 sample = SampleBilinearWrap(source, u * 2, v * 2);
+	float texel[4];
+	SimdStore(texel, sample);
+	effect[0] = texel[0]; effect[1] = texel[1]; effect[2] = texel[2];
+
+	// "transmission" horizontal and vertical lines:
+	if (((int)(u * 1920)) % 12 < 2)
+		effect[0] = effect[1] = effect[2] = 0;
+
+	if (((int)(v * 1200)) % 12 < 2)
+		effect[0] = effect[1] = effect[2] = 0;
+
+	// threshold:
+	float level = (effect[0] + effect[1] + effect[2] > 0.3f) ? 1.0f : 0.0f;
+	effect[0] = effect[1] = effect[2] = level;
+
+	if (((int)((0 - u) + t / 15)) % 20 > 15 && (effect[0] + effect[1] + effect[2] > 0.3f))
+		isWiper = true;
+	if (isWiper && std::fmod(t / 15, 20.0f) > 15)
+	{
+		effect[0] = wipreColour[0]; effect[1] = wipreColour[1]; effect[2] = wipreColour[2];
+	}
+
+	float result[3] = { effect[0], effect[1], effect[2] };
+	for (int i = 1; i < 25; ++i)
+	{
+		float scale = float(i) / float(25 - 1) - 0.5f;
+		result[0] += (u - 0.05f) * scale;
+		result[1] += (v - 0.05f) * scale;
+	}
+
+	out[0] = effect[0] / result[0];
+	out[1] = effect[1] / result[1];
+	out[2] = effect[2] / result[2];
+	out[3] = 1.0f;
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+std::vector<ScreenEffectsBenchmarkResult> DirectXGame1::BenchmarkScreenEffectsCpu(unsigned int frames)
+{
+	static const unsigned int sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+	std::vector<ScreenEffectsBenchmarkResult> results;
+
+	for (auto& size : sizes)
+	{
+		CpuCanvas source(size[0], size[1]);
+		CpuCanvas target(size[0], size[1]);
+
+		// Smooth colour ramps with some bright bands, so both sides of the threshold are hit.
+		for (unsigned int y = 0; y < source.height; y++)
+		{
+			for (unsigned int x = 0; x < source.width; x++)
+			{
+				float* texel = source.At(x, y);
+				texel[0] = 0.5f + 0.5f * std::sin(x * 0.013f);
+				texel[1] = 0.5f + 0.5f * std::sin(y * 0.021f);
+				texel[2] = 0.1f;
+				texel[3] = 1.0f;
+			}
+		}
+
+		// One untimed frame to fault in the target pages.
+		ApplyScreenEffectsCpu(source, target, 0.0f);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (unsigned int frame = 0; frame < frames; frame++)
+		{
+			ApplyScreenEffectsCpu(source, target, (float)frame);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		ScreenEffectsBenchmarkResult result;
+		result.width = size[0];
+		result.height = size[1];
+		result.millisecondsPerFrame = frames ? seconds * 1000.0 / frames : 0.0;
+		result.megapixelsPerSecond = seconds > 0.0 ? double(size[0]) * size[1] * frames / seconds / 1.0e6 : 0.0;
+		results.push_back(result);
+	}
+
+	return results;
+}
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include "CpuCanvas.h"
+
+namespace DirectXGame1
+{
+	// CPU version of screenps.hlsl main(): 2x tiling sample, "transmission" lines,
+	// threshold, horizontal wipe and the "magnet" offset. Needs no GPU, so the
+	// effect chain can be run and checked on headless build machines.
+	//
+	// source is the world-pass canvas, target receives the screen-pass output.
+	// Pixel (x, y) of target gets input.tex = ((x + 0.5) / width, (y + 0.5) / height),
+	// which is what the screen quad interpolates. time is the value the screen pass
+	// puts in time.r (the frame counter in RenderScreen).
+	//
+	// Work is split into tileSize x tileSize tiles spread over all cores. Throws
+	// std::invalid_argument for a zero tileSize.
+	void ApplyScreenEffectsCpu(const CpuCanvas& source, CpuCanvas& target, float time, unsigned int tileSize = 64);
+
+	// Everything screenps.hlsl does after its canvas read: transmission lines, threshold, wipe
+	// and the folded magnet term. texel is the 2x tiled bilinear sample for pixel centre (u, v).
+	// Gives the same bits as ApplyScreenEffectsCpu for the same texel.
+	void ShadeScreenTexel(const float texel[4], float u, float v, float time, float out[4]);
+
+	// Straight, single-pixel transcription of screenps.hlsl main() (including the
+	// 24-iteration magnet loop). Slow; used as the reference the fast path is checked against.
+	void ShadeScreenPixelReference(const CpuCanvas& source, float u, float v, float time, float out[4]);
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct ScreenEffectsBenchmarkResult
+	{
+		unsigned int width;
+		unsigned int height;
+		double millisecondsPerFrame;
+		double megapixelsPerSecond;
+	};
+
+	// Times ApplyScreenEffectsCpu at 1920x1080 and 3840x2160 over the given number of frames.
+	std::vector<ScreenEffectsBenchmarkResult> BenchmarkScreenEffectsCpu(unsigned int frames = 20);
+#endif
+}
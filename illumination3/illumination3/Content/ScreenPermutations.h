@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace DirectXGame1
+{
+	// Optional effects of screenps.hlsl, one bit each. Every combination is compiled ahead of
+	// time from Content\ScreenPermutations\screenps_XX.hlsl, where XX is the mask in hex, which
+	// sets the matching SCREEN_* defines and includes screenps.hlsl.
+	enum ScreenFeature
+	{
+		ScreenFeatureTvStatic = 1,
+		ScreenFeatureBlur = 2,
+		ScreenFeatureWipe = 4,
+		ScreenFeatureMagnet = 8,
+		ScreenFeatureBloom = 16,		// chosen by the renderer: set when the pass binds a bloom level
+		ScreenFeatureAmbientOcclusion = 32	// likewise, when it binds the ambient occlusion target
+	};
+
+	static const uint32_t ScreenPermutationCount = 64;
+
+	// The features SetScreenFeatures leaves to the renderer.
+	static const uint32_t RendererScreenFeatures = ScreenFeatureBloom | ScreenFeatureAmbientOcclusion;
+
+	// What screenps.hlsl has always drawn, and all ScreenCS.hlsl and ApplyScreenEffectsCpu
+	// implement (bloom aside).
+	static const uint32_t DefaultScreenFeatures = ScreenFeatureWipe | ScreenFeatureMagnet;
+
+	// "screenps_0c.cso" for the default features.
+	inline std::wstring ScreenPermutationFileName(uint32_t features)
+	{
+		static const wchar_t digits[] = L"0123456789abcdef";
+		std::wstring name = L"screenps_00.cso";
+		name[9] = digits[(features >> 4) & 15];
+		name[10] = digits[features & 15];
+		return name;
+	}
+}
@@ -0,0 +1,8 @@
+// screenps.hlsl with SCREEN_TV_STATIC, SCREEN_MAGNET.
+#define SCREEN_TV_STATIC 1
+#define SCREEN_BLUR 0
+#define SCREEN_WIPE 0
+#define SCREEN_MAGNET 1
+#define SCREEN_BLOOM 0
+#define SCREEN_AMBIENT_OCCLUSION 0
+#include "..\..\..\screenps.hlsl"
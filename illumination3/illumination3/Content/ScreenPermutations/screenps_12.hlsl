@@ -0,0 +1,8 @@
+// screenps.hlsl with SCREEN_BLUR, SCREEN_BLOOM.
+#define SCREEN_TV_STATIC 0
+#define SCREEN_BLUR 1
+#define SCREEN_WIPE 0
+#define SCREEN_MAGNET 0
+#define SCREEN_BLOOM 1
+#define SCREEN_AMBIENT_OCCLUSION 0
+#include "..\..\..\screenps.hlsl"
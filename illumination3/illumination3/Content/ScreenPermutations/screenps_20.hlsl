@@ -0,0 +1,8 @@
+// screenps.hlsl with SCREEN_AMBIENT_OCCLUSION.
+#define SCREEN_TV_STATIC 0
+#define SCREEN_BLUR 0
+#define SCREEN_WIPE 0
+#define SCREEN_MAGNET 0
+#define SCREEN_BLOOM 0
+#define SCREEN_AMBIENT_OCCLUSION 1
+#include "..\..\..\screenps.hlsl"
@@ -9,18 +9,120 @@
 
 namespace DirectXGame1
 {
-    // Constant buffer used to send MVP matrices to the vertex shader.
-    struct ModelViewProjectionConstantBuffer
+    // Constant blocks, grouped by how often they change. Every shader declares the ones it
+    // uses at these registers; ConstantBufferRing uploads and binds them.
+    static const UINT PerFrameSlot = 0;
+    static const UINT PerViewSlot = 1;
+    static const UINT PerObjectSlot = 2;
+    static const UINT PerEffectSlot = 3;
+
+    // Changes once per frame.
+    struct PerFrameConstantBuffer
+    {
+        DirectX::XMFLOAT4 time; // x: seconds since start, y: frame count
+        DirectX::XMFLOAT4 lightpos;
+    };
+
+    static_assert((sizeof(PerFrameConstantBuffer) % 16) == 0, "Constant Buffer size must be 16-byte aligned");
+
+    // Changes per camera: the world view, or the ortho view of the screen quad.
+    struct PerViewConstantBuffer
     {
-        DirectX::XMFLOAT4X4 model;
         DirectX::XMFLOAT4X4 view;
         DirectX::XMFLOAT4X4 projection;
-		DirectX::XMFLOAT4 lightpos;
-		DirectX::XMFLOAT4 eyepos;
+        DirectX::XMFLOAT4 eyepos;
+    };
+
+    static_assert((sizeof(PerViewConstantBuffer) % 16) == 0, "Constant Buffer size must be 16-byte aligned");
+
+    // Changes per draw. The scale/offset pairs undo the range mapping of CompactVertex
+    // (CompactVertexShader.hlsl); SampleVertexShader.hlsl ignores them.
+    struct PerObjectConstantBuffer
+    {
+        DirectX::XMFLOAT4X4 model;
+        DirectX::XMFLOAT4 positionScale;
+        DirectX::XMFLOAT4 positionOffset;
+        DirectX::XMFLOAT4 colorScale;
+        DirectX::XMFLOAT4 colorOffset;
+    };
+
+    static_assert((sizeof(PerObjectConstantBuffer) % 16) == 0, "Constant Buffer size must be 16-byte aligned");
+
+    // Per-effect block of screenps.hlsl.
+    struct ScreenConstantBuffer
+    {
+        DirectX::XMFLOAT4 time; // x: frame counter the effects animate with, y: 1 to stop after the canvas read
+        DirectX::XMFLOAT4 bloom; // x: intensity of the bloom added at the end, 0 when off
+        DirectX::XMFLOAT4 canvasRect; // xy: uv extent of the canvas the world pass drew, zw: half a canvas texel
+    };
+
+    static_assert((sizeof(ScreenConstantBuffer) % 16) == 0, "Constant Buffer size must be 16-byte aligned");
+
+    // Per-effect block of ClusteredLightsPS.hlsl and DeferredLightingPS.hlsl: how a pixel's
+    // cluster is found (see LightGrid). grid.w of 0 means no point lights.
+    struct LightGridConstantBuffer
+    {
+        DirectX::XMUINT4 grid; // x: tile size in pixels, y: tiles across, z: tiles down, w: depth slices
+        DirectX::XMFLOAT4 slicing; // x: depth where slice 0 starts, y: slices per unit of log(depth)
+    };
+
+    static_assert((sizeof(LightGridConstantBuffer) % 16) == 0, "Constant Buffer size must be 16-byte aligned");
+
+    // Per-object block of DeferredLightingPS.hlsl, in the pixel stage only: the quad's own
+    // stays bound for the vertex shader.
+    struct DeferredConstantBuffer
+    {
+        DirectX::XMFLOAT4X4 inverseViewProjection;
+        DirectX::XMFLOAT4 viewportSize; // xy: the world pass's viewport in pixels, zw: 1 / size
+        DirectX::XMFLOAT4 edges; // x: outline strength (0: off), y: relative depth jump, z: normal cosine
+    };
+
+    static_assert((sizeof(DeferredConstantBuffer) % 16) == 0, "Constant Buffer size must be 16-byte aligned");
+
+    // Number of taps BlurPS.hlsl can take; must match MAX_BLUR_TAPS there.
+    static const int MaxBlurTaps = 33;
+
+    // Per-effect block used by one axis of the separable blur.
+    struct BlurConstantBuffer
+    {
+        DirectX::XMFLOAT4 texelStep; // xy: one texel along the blur axis in uv units, z: tap count
+        DirectX::XMFLOAT4 taps[MaxBlurTaps]; // x: offset in texels, y: weight
+    };
+
+    static_assert((sizeof(BlurConstantBuffer) % 16) == 0, "Constant Buffer size must be 16-byte aligned");
+
+    // Per-effect block of BloomDownsamplePS.hlsl and BloomUpsamplePS.hlsl.
+    struct BloomConstantBuffer
+    {
+        DirectX::XMFLOAT4 texelSize; // xy: one source texel in uv units
+        DirectX::XMFLOAT4 params; // x: threshold, y: knee, z: 1 to apply the bright pass
+    };
+
+    static_assert((sizeof(BloomConstantBuffer) % 16) == 0, "Constant Buffer size must be 16-byte aligned");
+
+    // Per-effect block of the ambient occlusion passes (AmbientOcclusion.hlsli).
+    struct AmbientOcclusionConstantBuffer
+    {
+        DirectX::XMFLOAT4X4 projection;
+        DirectX::XMFLOAT4X4 inverseProjection;
+        DirectX::XMFLOAT4X4 reprojection; // view space of this frame to clip space of the previous one
+        DirectX::XMFLOAT4 depthTerms; // x, y: z / w = y / depth - x; z: depth from which a texel is background
+        DirectX::XMFLOAT4 params; // x: radius in world units, y: intensity, z: bias, w: samples skipped between those taken
+        DirectX::XMFLOAT4 blur; // xy: texel step along the pass axis, z: relative depth sigma, w: radius in texels
+        DirectX::XMFLOAT4 temporal; // x: first sample taken, y: weight of this frame against the history, z: relative depth tolerance, w: clamp margin
+    };
+
+    static_assert((sizeof(AmbientOcclusionConstantBuffer) % 16) == 0, "Constant Buffer size must be 16-byte aligned");
+
+    // Per-effect block used by UpsamplePS.hlsl.
+    struct UpsampleConstantBuffer
+    {
+        DirectX::XMFLOAT4 lowResSize; // xy: low-resolution size in texels, zw: 1 / size
+        DirectX::XMFLOAT4 params; // x: 0 bilinear, 1 bilateral; y: luminance sigma; z: guide uv scale; w: 1 when the occlusion is bound
+        DirectX::XMFLOAT4 screen; // x: frame counter, y: 1 for the wipe, z: 1 for the magnet, w: bloom intensity, 0 when off
     };
 
-    // Assert that the constant buffer remains 16-byte aligned.
-    static_assert((sizeof(ModelViewProjectionConstantBuffer) % 16) == 0, "Constant Buffer size must be 16-byte aligned");
+    static_assert((sizeof(UpsampleConstantBuffer) % 16) == 0, "Constant Buffer size must be 16-byte aligned");
 
     // Used to send per-vertex data to the vertex shader.
     struct VertexPositionColor
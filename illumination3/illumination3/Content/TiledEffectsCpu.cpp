@@ -0,0 +1,346 @@
+#include "TiledEffectsCpu.h"
+#include "ScreenEffectsCpu.h"
+#include "../Helpers/ParallelFor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+using namespace DirectXGame1;
+using namespace DX;
+
+namespace
+{
+	// One bilinear fetch along the blur axis, split into the whole and fractional part of its
+	// offset. Both versions take the fraction from the offset alone, so they agree to the bit
+	// however far along the line the pixel is.
+	struct AxisFetch
+	{
+		int base;
+		float frac;
+		float weight;
+	};
+
+	// Centre tap first, then +offset and -offset of every later tap, in BlurPS.hlsl's order.
+	std::vector<AxisFetch> MakeFetches(const std::vector<BlurTap>& taps)
+	{
+		std::vector<AxisFetch> fetches;
+		for (size_t i = 0; i < taps.size(); i++)
+		{
+			float offsets[2] = { taps[i].offset, -taps[i].offset };
+			for (int side = 0; side < (i == 0 ? 1 : 2); side++)
+			{
+				float base = std::floor(offsets[side]);
+				AxisFetch fetch = { (int)base, offsets[side] - base, taps[i].weight };
+				fetches.push_back(fetch);
+			}
+		}
+		return fetches;
+	}
+
+	unsigned int LineLength(const CpuCanvas& canvas, BlurAxis axis)
+	{
+		return axis == BlurAxis::Horizontal ? canvas.width : canvas.height;
+	}
+
+	unsigned int LineCount(const CpuCanvas& canvas, BlurAxis axis)
+	{
+		return axis == BlurAxis::Horizontal ? canvas.height : canvas.width;
+	}
+
+	const float* LineTexel(const CpuCanvas& canvas, BlurAxis axis, unsigned int line, int i)
+	{
+		return axis == BlurAxis::Horizontal ? canvas.At(i, line) : canvas.At(line, i);
+	}
+
+	float* LineTexel(CpuCanvas& canvas, BlurAxis axis, unsigned int line, int i)
+	{
+		return axis == BlurAxis::Horizontal ? canvas.At(i, line) : canvas.At(line, i);
+	}
+
+	void CheckBlurSizes(const CpuCanvas& source, CpuCanvas& target)
+	{
+		if (source.width != target.width || source.height != target.height)
+		{
+			throw std::invalid_argument("blur source and target differ in size");
+		}
+	}
+
+	// Where pixel i of the target samples the source along one axis, in texels; same
+	// arithmetic as BuildAxis in ScreenEffectsCpu.cpp and ScreenCS.hlsl.
+	float TiledTexelPosition(unsigned int i, unsigned int sourceSize, unsigned int targetSize)
+	{
+		float tex = (i + 0.5f) / targetSize;
+		return tex * 2.0f * sourceSize - 0.5f;
+	}
+
+	void AxisFootprint(unsigned int group, unsigned int sourceSize, unsigned int targetSize, int& first, unsigned int& span)
+	{
+		unsigned int i0 = group * ScreenGroupSize;
+		unsigned int i1 = std::min(i0 + ScreenGroupSize, targetSize) - 1;
+		first = (int)std::floor(TiledTexelPosition(i0, sourceSize, targetSize));
+		int last = (int)std::floor(TiledTexelPosition(i1, sourceSize, targetSize)) + 1;
+		span = (unsigned int)(last - first + 1);
+	}
+
+	bool AxisFitsCache(unsigned int sourceSize, unsigned int targetSize)
+	{
+		// floor() can add one texel at each end of the exact span; one more for rounding.
+		return (ScreenGroupSize - 1) * 2.0 * sourceSize / targetSize + 4.0 <= ScreenCacheSize;
+	}
+}
+
+int DirectXGame1::BlurApron(const std::vector<BlurTap>& taps)
+{
+	float largest = 0.0f;
+	for (const BlurTap& tap : taps)
+	{
+		largest = std::max(largest, std::fabs(tap.offset));
+	}
+	return std::min((int)std::floor(largest) + 1, BlurMaxApron);
+}
+
+void DirectXGame1::BlurAxisTiledCpu(const CpuCanvas& source, CpuCanvas& target, const std::vector<BlurTap>& taps, BlurAxis axis, ComputeTileCounters* counters)
+{
+	CheckBlurSizes(source, target);
+	if (source.width == 0 || source.height == 0 || taps.empty())
+	{
+		return;
+	}
+
+	const std::vector<AxisFetch> fetches = MakeFetches(taps);
+	const int apron = BlurApron(taps);
+	const int length = (int)LineLength(source, axis);
+	const unsigned int lines = LineCount(source, axis);
+	const unsigned int segments = (length + BlurGroupSize - 1) / BlurGroupSize;
+	const unsigned int cacheSize = BlurGroupSize + 2 * apron;
+
+	// One item per thread group, like the Dispatch(segments, lines, 1) of the compute pass.
+	ParallelFor(segments * lines, [&](unsigned int group)
+	{
+		const unsigned int line = group / segments;
+		const int start = (int)(group % segments) * BlurGroupSize;
+
+		// groupshared float3 cache[]: every "thread" loads its share, clamped to the edge.
+		SimdFloat4 cache[BlurGroupSize + 2 * BlurMaxApron];
+		for (unsigned int i = 0; i < cacheSize; i++)
+		{
+			int p = std::max(0, std::min(start - apron + (int)i, length - 1));
+			cache[i] = SimdLoad(LineTexel(source, axis, line, p));
+		}
+
+		const int count = std::min((int)BlurGroupSize, length - start);
+		for (int t = 0; t < count; t++)
+		{
+			const int c = t + apron;
+			SimdFloat4 sum = SimdZero();
+			for (const AxisFetch& fetch : fetches)
+			{
+				SimdFloat4 value = SimdLerp(cache[c + fetch.base], cache[c + fetch.base + 1], SimdSplat(fetch.frac));
+				sum = SimdAdd(sum, SimdMul(value, SimdSplat(fetch.weight)));
+			}
+			float* out = LineTexel(target, axis, line, start + t);
+			SimdStore(out, sum);
+			out[3] = 1.0f;
+		}
+	});
+
+	if (counters)
+	{
+		counters->groups += (uint64_t)segments * lines;
+		counters->texelLoads += (uint64_t)segments * lines * cacheSize;
+		counters->sharedReads += (uint64_t)length * lines * fetches.size() * 2;
+	}
+}
+
+void DirectXGame1::BlurAxisDirectCpu(const CpuCanvas& source, CpuCanvas& target, const std::vector<BlurTap>& taps, BlurAxis axis)
+{
+	CheckBlurSizes(source, target);
+	if (source.width == 0 || source.height == 0 || taps.empty())
+	{
+		return;
+	}
+
+	const std::vector<AxisFetch> fetches = MakeFetches(taps);
+	const int length = (int)LineLength(source, axis);
+
+	ParallelFor(LineCount(source, axis), [&](unsigned int line)
+	{
+		for (int x = 0; x < length; x++)
+		{
+			SimdFloat4 sum = SimdZero();
+			for (const AxisFetch& fetch : fetches)
+			{
+				int i0 = std::max(0, std::min(x + fetch.base, length - 1));
+				int i1 = std::max(0, std::min(x + fetch.base + 1, length - 1));
+				SimdFloat4 value = SimdLerp(SimdLoad(LineTexel(source, axis, line, i0)), SimdLoad(LineTexel(source, axis, line, i1)), SimdSplat(fetch.frac));
+				sum = SimdAdd(sum, SimdMul(value, SimdSplat(fetch.weight)));
+			}
+			float* out = LineTexel(target, axis, line, x);
+			SimdStore(out, sum);
+			out[3] = 1.0f;
+		}
+	});
+}
+
+ScreenTileFootprint DirectXGame1::GetScreenTileFootprint(unsigned int groupX, unsigned int groupY, unsigned int sourceWidth, unsigned int sourceHeight, unsigned int targetWidth, unsigned int targetHeight)
+{
+	ScreenTileFootprint footprint;
+	AxisFootprint(groupX, sourceWidth, targetWidth, footprint.x0, footprint.width);
+	AxisFootprint(groupY, sourceHeight, targetHeight, footprint.y0, footprint.height);
+	return footprint;
+}
+
+bool DirectXGame1::ScreenTilesFitCache(unsigned int sourceWidth, unsigned int sourceHeight, unsigned int targetWidth, unsigned int targetHeight)
+{
+	if (sourceWidth == 0 || sourceHeight == 0 || targetWidth == 0 || targetHeight == 0)
+	{
+		return false;
+	}
+	return AxisFitsCache(sourceWidth, targetWidth) && AxisFitsCache(sourceHeight, targetHeight);
+}
+
+void DirectXGame1::ApplyScreenEffectsTiledCpu(const CpuCanvas& source, CpuCanvas& target, float time, ComputeTileCounters* counters)
+{
+	if (source.width == 0 || source.height == 0 || target.width == 0 || target.height == 0)
+	{
+		return;
+	}
+	if (!ScreenTilesFitCache(source.width, source.height, target.width, target.height))
+	{
+		throw std::invalid_argument("screen tile footprint does not fit the shared cache");
+	}
+
+	const unsigned int groupsX = (target.width + ScreenGroupSize - 1) / ScreenGroupSize;
+	const unsigned int groupsY = (target.height + ScreenGroupSize - 1) / ScreenGroupSize;
+	std::vector<uint64_t> loads(groupsX * groupsY, 0);
+
+	ParallelFor(groupsX * groupsY, [&](unsigned int group)
+	{
+		const unsigned int gx = group % groupsX;
+		const unsigned int gy = group / groupsX;
+		const ScreenTileFootprint footprint = GetScreenTileFootprint(gx, gy, source.width, source.height, target.width, target.height);
+
+		// groupshared float3 cache[SCREEN_CACHE_SIZE][SCREEN_CACHE_SIZE], wrap addressing.
+		SimdFloat4 cache[ScreenCacheSize][ScreenCacheSize];
+		for (unsigned int cy = 0; cy < footprint.height; cy++)
+		{
+			const float* row = source.Row(WrapTexel(footprint.y0 + (int)cy, (int)source.height));
+			for (unsigned int cx = 0; cx < footprint.width; cx++)
+			{
+				cache[cy][cx] = SimdLoad(row + WrapTexel(footprint.x0 + (int)cx, (int)source.width) * 4);
+			}
+		}
+		loads[group] = (uint64_t)footprint.width * footprint.height;
+
+		const unsigned int x1 = std::min((gx + 1) * ScreenGroupSize, target.width);
+		const unsigned int y1 = std::min((gy + 1) * ScreenGroupSize, target.height);
+		float texel[4];
+		for (unsigned int y = gy * ScreenGroupSize; y < y1; y++)
+		{
+			const float sy = TiledTexelPosition(y, source.height, target.height);
+			const float fy = std::floor(sy);
+			const int r = (int)fy - footprint.y0;
+			const SimdFloat4 ty = SimdSplat(sy - fy);
+			const float v = (y + 0.5f) / target.height;
+
+			for (unsigned int x = gx * ScreenGroupSize; x < x1; x++)
+			{
+				const float sx = TiledTexelPosition(x, source.width, target.width);
+				const float fx = std::floor(sx);
+				const int c = (int)fx - footprint.x0;
+				const SimdFloat4 tx = SimdSplat(sx - fx);
+
+				SimdFloat4 top = SimdLerp(cache[r][c], cache[r][c + 1], tx);
+				SimdFloat4 bottom = SimdLerp(cache[r + 1][c], cache[r + 1][c + 1], tx);
+				SimdStore(texel, SimdLerp(top, bottom, ty));
+				ShadeScreenTexel(texel, (x + 0.5f) / target.width, v, time, target.At(x, y));
+			}
+		}
+	});
+
+	if (counters)
+	{
+		counters->groups += (uint64_t)groupsX * groupsY;
+		for (uint64_t groupLoads : loads)
+		{
+			counters->texelLoads += groupLoads;
+		}
+		counters->sharedReads += (uint64_t)target.width * target.height * 4;
+	}
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+TiledComputeReport DirectXGame1::ValidateTiledCompute(unsigned int width, unsigned int height, int blurRadius, float time)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// Soft gradients with hard-edged blocks, so the blur and the threshold both have edges to find.
+	CpuCanvas source(width, height);
+	for (unsigned int y = 0; y < height; y++)
+	{
+		for (unsigned int x = 0; x < width; x++)
+		{
+			float* texel = source.At(x, y);
+			bool inside = ((x / 97) + (y / 61)) % 3 == 0;
+			texel[0] = inside ? 0.6f : 0.05f + 0.05f * std::sin(x * 0.01f);
+			texel[1] = 0.1f + 0.1f * std::sin(y * 0.017f);
+			texel[2] = inside ? 0.2f : 0.0f;
+			texel[3] = 1.0f;
+		}
+	}
+
+	TiledComputeReport report;
+	report.width = width;
+	report.height = height;
+	report.blurRadius = blurRadius;
+
+	std::vector<BlurTap> taps = ComputeLinearBlurTaps(blurRadius);
+	CpuCanvas directTemp(width, height), direct(width, height);
+	CpuCanvas tiledTemp(width, height), tiled(width, height);
+
+	auto start = Clock::now();
+	BlurAxisDirectCpu(source, directTemp, taps, BlurAxis::Horizontal);
+	BlurAxisDirectCpu(directTemp, direct, taps, BlurAxis::Vertical);
+	report.blurDirectMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	ComputeTileCounters blurCounters;
+	start = Clock::now();
+	BlurAxisTiledCpu(source, tiledTemp, taps, BlurAxis::Horizontal, &blurCounters);
+	BlurAxisTiledCpu(tiledTemp, tiled, taps, BlurAxis::Vertical, &blurCounters);
+	report.blurTiledMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	report.blurMaxError = 0.0f;
+	for (size_t i = 0; i < direct.texels.size(); i++)
+	{
+		report.blurMaxError = std::max(report.blurMaxError, std::fabs(direct.texels[i] - tiled.texels[i]));
+	}
+
+	const double pixels = (double)width * height;
+	report.blurDirectFetches = 1.0 + 4.0 * (taps.size() - 1);
+	report.blurTiledFetches = blurCounters.texelLoads / (2.0 * pixels);
+
+	// The screen pass reads the blurred canvas, as it does in the renderer.
+	CpuCanvas screenDirect(width, height), screenTiled(width, height);
+	ComputeTileCounters screenCounters;
+	ApplyScreenEffectsCpu(tiled, screenDirect, time);
+	ApplyScreenEffectsTiledCpu(tiled, screenTiled, time, &screenCounters);
+	report.screenTiledFetches = screenCounters.texelLoads / pixels;
+
+	report.screenMismatch = 0;
+	for (size_t i = 0; i < screenDirect.texels.size(); i += 4)
+	{
+		for (size_t c = 0; c < 3; c++)
+		{
+			if (DisplayValue(screenDirect.texels[i + c]) != DisplayValue(screenTiled.texels[i + c]))
+			{
+				report.screenMismatch++;
+				break;
+			}
+		}
+	}
+
+	return report;
+}
+#endif
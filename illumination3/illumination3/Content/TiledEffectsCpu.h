@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "BlurCpu.h"
+#include "CpuCanvas.h"
+
+namespace DirectXGame1
+{
+	// Thread-group shapes of the compute path. Must match BLUR_GROUP_SIZE / BLUR_MAX_APRON in
+	// BlurCS.hlsl and SCREEN_GROUP_SIZE / SCREEN_CACHE_SIZE in ScreenCS.hlsl.
+	static const unsigned int BlurGroupSize = 128;
+	static const int BlurMaxApron = MaxBlurRadius + 1;
+	static const unsigned int ScreenGroupSize = 16;
+	static const unsigned int ScreenCacheSize = 40;
+
+	enum class BlurAxis
+	{
+		Horizontal,
+		Vertical
+	};
+
+	// What the groups of one dispatch did: texels loaded from the texture into shared memory,
+	// and reads the filter then made from shared memory instead of the texture.
+	struct ComputeTileCounters
+	{
+		ComputeTileCounters() : groups(0), texelLoads(0), sharedReads(0) {}
+
+		uint64_t groups;
+		uint64_t texelLoads;
+		uint64_t sharedReads;
+	};
+
+	// Texels a blur group loads past each end of its segment so every tap lands in shared
+	// memory: the largest tap offset plus the second texel of its bilinear pair.
+	int BlurApron(const std::vector<BlurTap>& taps);
+
+	// CPU version of BlurCS.hlsl. Each group takes BlurGroupSize pixels of one row (or column),
+	// loads them plus the apron once with clamp-to-edge addressing, then evaluates every tap
+	// from that copy. source and target must be the same size.
+	void BlurAxisTiledCpu(const CpuCanvas& source, CpuCanvas& target, const std::vector<BlurTap>& taps, BlurAxis axis, ComputeTileCounters* counters = nullptr);
+
+	// CPU version of BlurPS.hlsl: every tap is a clamped bilinear fetch from source. The tiled
+	// version has to give the same bits.
+	void BlurAxisDirectCpu(const CpuCanvas& source, CpuCanvas& target, const std::vector<BlurTap>& taps, BlurAxis axis);
+
+	// Source texels read by the 2x tiled sample of one ScreenGroupSize x ScreenGroupSize group:
+	// the first texel (before wrapping) and the span on each axis.
+	struct ScreenTileFootprint
+	{
+		int x0, y0;
+		unsigned int width, height;
+	};
+
+	ScreenTileFootprint GetScreenTileFootprint(unsigned int groupX, unsigned int groupY, unsigned int sourceWidth, unsigned int sourceHeight, unsigned int targetWidth, unsigned int targetHeight);
+
+	// Whether every group's footprint fits the shared cache. The tiled sample reads about
+	// 2 * source / target texels per pixel, so only sources up to ~1.2x the target size fit;
+	// the renderer keeps the pixel shader for anything larger.
+	bool ScreenTilesFitCache(unsigned int sourceWidth, unsigned int sourceHeight, unsigned int targetWidth, unsigned int targetHeight);
+
+	// CPU version of ScreenCS.hlsl: per group, loads the footprint with wrap addressing, then
+	// shades every pixel from it. Same output as ApplyScreenEffectsCpu. Throws
+	// std::invalid_argument when ScreenTilesFitCache is false.
+	void ApplyScreenEffectsTiledCpu(const CpuCanvas& source, CpuCanvas& target, float time, ComputeTileCounters* counters = nullptr);
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct TiledComputeReport
+	{
+		unsigned int width;
+		unsigned int height;
+		int blurRadius;
+		float blurMaxError;				// tiled against direct, both axes
+		uint32_t screenMismatch;		// pixels differing from ApplyScreenEffectsCpu
+		double blurDirectFetches;		// texel reads per pixel and axis, direct: 4 per bilinear tap
+		double blurTiledFetches;		// texture loads per pixel and axis, tiled
+		double screenTiledFetches;		// texture loads per pixel, tiled (4 per pixel direct)
+		double blurDirectMilliseconds;
+		double blurTiledMilliseconds;
+	};
+
+	// Runs both blur axes and the screen effects tiled and direct on a synthetic canvas and
+	// reports the differences, the texture traffic and the time of each blur version.
+	TiledComputeReport ValidateTiledCompute(unsigned int width = 1920, unsigned int height = 1080, int blurRadius = 16, float time = 300.0f);
+#endif
+}
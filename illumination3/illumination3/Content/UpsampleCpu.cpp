@@ -0,0 +1,307 @@
+#include "UpsampleCpu.h"
+#include "ScreenEffectsCpu.h"
+#include "../Helpers/ParallelFor.h"
+
+#include <chrono>
+#include <cmath>
+
+using namespace DirectXGame1;
+using namespace DX;
+
+namespace
+{
+	const unsigned int RowsPerBand = 16;
+
+	// Keeps a little of the bilinear weight when every guide sample disagrees with the centre,
+	// so the result falls back to bilinear instead of dividing by zero.
+	const float BilateralFloor = 1.0e-3f;
+
+	// One output row or column: the two low-resolution texels it reads and the weight of the second.
+	struct UpsampleTap
+	{
+		int i0, i1;
+		float frac;
+	};
+
+	void BuildUpsampleAxis(std::vector<UpsampleTap>& taps, unsigned int outputSize, unsigned int lowSize)
+	{
+		taps.resize(outputSize);
+		for (unsigned int i = 0; i < outputSize; i++)
+		{
+			float s = (i + 0.5f) * lowSize / outputSize - 0.5f;
+			float fs = std::floor(s);
+			int i0 = (int)fs;
+			UpsampleTap& tap = taps[i];
+			tap.frac = s - fs;
+			tap.i0 = i0 < 0 ? 0 : i0;
+			tap.i1 = i0 + 1 > (int)lowSize - 1 ? (int)lowSize - 1 : i0 + 1;
+		}
+	}
+
+	template <typename Func>
+	void ForEachBand(unsigned int height, const Func& func)
+	{
+		ParallelFor((height + RowsPerBand - 1) / RowsPerBand, [&](unsigned int band)
+		{
+			unsigned int y0 = band * RowsPerBand;
+			unsigned int y1 = y0 + RowsPerBand < height ? y0 + RowsPerBand : height;
+			func(y0, y1);
+		});
+	}
+
+#if defined(DX_HEADLESS_CHECKS)
+	// Compared as displayed, since that is all that reaches the screen.
+	double PeakSignalToNoise(const CpuCanvas& reference, const CpuCanvas& test, double& mismatch)
+	{
+		double squaredError = 0.0;
+		size_t mismatches = 0;
+		for (size_t i = 0; i < reference.texels.size(); i += 4)
+		{
+			bool differs = false;
+			for (int c = 0; c < 3; c++)
+			{
+				double d = (double)DisplayValue(reference.texels[i + c]) - DisplayValue(test.texels[i + c]);
+				squaredError += d * d;
+				differs = differs || std::fabs(d) > 0.5 / 255.0;
+			}
+			mismatches += differs ? 1 : 0;
+		}
+
+		size_t pixels = reference.texels.size() / 4;
+		mismatch = pixels ? double(mismatches) / pixels : 0.0;
+		double mse = pixels ? squaredError / (pixels * 3) : 0.0;
+		// Identical images get a finite, clearly-perfect score instead of infinity.
+		return mse > 0.0 ? 10.0 * std::log10(1.0 / mse) : 100.0;
+	}
+#endif
+}
+
+void DirectXGame1::DownsampleCpu(const CpuCanvas& source, CpuCanvas& target, unsigned int divisor)
+{
+	divisor = divisor < 1 ? 1 : divisor;
+	unsigned int width = source.width / divisor < 1 ? 1 : source.width / divisor;
+	unsigned int height = source.height / divisor < 1 ? 1 : source.height / divisor;
+	if (target.width != width || target.height != height)
+	{
+		target.Resize(width, height);
+	}
+
+	ForEachBand(height, [&](unsigned int y0, unsigned int y1)
+	{
+		SimdFloat4 scale = SimdSplat(1.0f / (divisor * divisor));
+		for (unsigned int y = y0; y < y1; y++)
+		{
+			float* out = target.Row(y);
+			for (unsigned int x = 0; x < width; x++)
+			{
+				SimdFloat4 sum = SimdZero();
+				for (unsigned int sy = y * divisor; sy < (y + 1) * divisor && sy < source.height; sy++)
+				{
+					const float* in = source.At(x * divisor, sy);
+					for (unsigned int sx = 0; sx < divisor && x * divisor + sx < source.width; sx++)
+					{
+						sum = SimdAdd(sum, SimdLoad(in + sx * 4));
+					}
+				}
+				SimdStore(out + x * 4, SimdMul(sum, scale));
+			}
+		}
+	});
+}
+
+void DirectXGame1::UpsampleBilinearCpu(const CpuCanvas& lowRes, CpuCanvas& target)
+{
+	std::vector<UpsampleTap> columns, rows;
+	BuildUpsampleAxis(columns, target.width, lowRes.width);
+	BuildUpsampleAxis(rows, target.height, lowRes.height);
+
+	ForEachBand(target.height, [&](unsigned int y0, unsigned int y1)
+	{
+		for (unsigned int y = y0; y < y1; y++)
+		{
+			const UpsampleTap& row = rows[y];
+			const float* top = lowRes.Row(row.i0);
+			const float* bottom = lowRes.Row(row.i1);
+			SimdFloat4 ty = SimdSplat(row.frac);
+			float* out = target.Row(y);
+
+			for (unsigned int x = 0; x < target.width; x++)
+			{
+				const UpsampleTap& column = columns[x];
+				SimdFloat4 tx = SimdSplat(column.frac);
+				SimdFloat4 upper = SimdLerp(SimdLoad(top + column.i0 * 4), SimdLoad(top + column.i1 * 4), tx);
+				SimdFloat4 lower = SimdLerp(SimdLoad(bottom + column.i0 * 4), SimdLoad(bottom + column.i1 * 4), tx);
+				SimdStore(out + x * 4, SimdLerp(upper, lower, ty));
+			}
+		}
+	});
+}
+
+void DirectXGame1::UpsampleBilateralCpu(const CpuCanvas& lowRes, const CpuCanvas& guide, float guideScale, float luminanceSigma, CpuCanvas& target)
+{
+	std::vector<UpsampleTap> columns, rows;
+	BuildUpsampleAxis(columns, target.width, lowRes.width);
+	BuildUpsampleAxis(rows, target.height, lowRes.height);
+
+	// Guide luminance at every low-resolution texel centre, read once instead of four times per output pixel.
+	std::vector<float> lowLuminance((size_t)lowRes.width * lowRes.height);
+	ForEachBand(lowRes.height, [&](unsigned int y0, unsigned int y1)
+	{
+		float texel[4];
+		for (unsigned int y = y0; y < y1; y++)
+		{
+			for (unsigned int x = 0; x < lowRes.width; x++)
+			{
+				float u = (x + 0.5f) / lowRes.width * guideScale;
+				float v = (y + 0.5f) / lowRes.height * guideScale;
+				SimdStore(texel, SampleBilinearWrap(guide, u, v));
+				lowLuminance[(size_t)y * lowRes.width + x] = Luminance(texel);
+			}
+		}
+	});
+
+	float inverseTwoSigmaSquared = 1.0f / (2.0f * luminanceSigma * luminanceSigma);
+	ForEachBand(target.height, [&](unsigned int y0, unsigned int y1)
+	{
+		float texel[4];
+		for (unsigned int y = y0; y < y1; y++)
+		{
+			const UpsampleTap& row = rows[y];
+			const float* lumTop = &lowLuminance[(size_t)row.i0 * lowRes.width];
+			const float* lumBottom = &lowLuminance[(size_t)row.i1 * lowRes.width];
+			float v = (y + 0.5f) / target.height * guideScale;
+			float* out = target.Row(y);
+
+			for (unsigned int x = 0; x < target.width; x++)
+			{
+				const UpsampleTap& column = columns[x];
+				SimdStore(texel, SampleBilinearWrap(guide, (x + 0.5f) / target.width * guideScale, v));
+				float centre = Luminance(texel);
+
+				const float bilinear[4] = {
+					(1.0f - column.frac) * (1.0f - row.frac), column.frac * (1.0f - row.frac),
+					(1.0f - column.frac) * row.frac, column.frac * row.frac };
+				const float lum[4] = { lumTop[column.i0], lumTop[column.i1], lumBottom[column.i0], lumBottom[column.i1] };
+				const float* samples[4] = {
+					lowRes.At(column.i0, row.i0), lowRes.At(column.i1, row.i0),
+					lowRes.At(column.i0, row.i1), lowRes.At(column.i1, row.i1) };
+
+				SimdFloat4 sum = SimdZero();
+				float weightSum = 0.0f;
+				for (int i = 0; i < 4; i++)
+				{
+					float d = lum[i] - centre;
+					float weight = bilinear[i] * (std::exp(-d * d * inverseTwoSigmaSquared) + BilateralFloor);
+					sum = SimdMulAdd(SimdLoad(samples[i]), SimdSplat(weight), sum);
+					weightSum += weight;
+				}
+				SimdStore(out + x * 4, SimdMul(sum, SimdSplat(1.0f / weightSum)));
+			}
+		}
+	});
+}
+
+void DirectXGame1::SampleScreenCanvasCpu(const CpuCanvas& source, CpuCanvas& target)
+{
+	ForEachBand(target.height, [&](unsigned int y0, unsigned int y1)
+	{
+		for (unsigned int y = y0; y < y1; y++)
+		{
+			float v = (y + 0.5f) / target.height * 2.0f;
+			float* out = target.Row(y);
+			for (unsigned int x = 0; x < target.width; x++)
+			{
+				SimdStore(out + x * 4, SampleBilinearWrap(source, (x + 0.5f) / target.width * 2.0f, v));
+			}
+		}
+	});
+}
+
+void DirectXGame1::ShadeScreenTexelsCpu(const CpuCanvas& texels, CpuCanvas& target, float time)
+{
+	ForEachBand(target.height, [&](unsigned int y0, unsigned int y1)
+	{
+		for (unsigned int y = y0; y < y1; y++)
+		{
+			float v = (y + 0.5f) / target.height;
+			const float* in = texels.Row(y);
+			float* out = target.Row(y);
+			for (unsigned int x = 0; x < target.width; x++)
+			{
+				ShadeScreenTexel(in + x * 4, (x + 0.5f) / target.width, v, time, out + x * 4);
+			}
+		}
+	});
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+ReducedResolutionReport DirectXGame1::CompareReducedResolution(const CpuCanvas& source, float time, unsigned int divisor, UpsampleFilter filter)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	ReducedResolutionReport report;
+	report.divisor = divisor < 1 ? 1 : divisor;
+	report.filter = filter;
+
+	CpuCanvas full(source.width, source.height);
+	auto start = Clock::now();
+	ApplyScreenEffectsCpu(source, full, time);
+	report.fullMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	unsigned int lowWidth = source.width / report.divisor < 1 ? 1 : source.width / report.divisor;
+	unsigned int lowHeight = source.height / report.divisor < 1 ? 1 : source.height / report.divisor;
+	CpuCanvas low(lowWidth, lowHeight);
+	CpuCanvas upsampled(source.width, source.height);
+	CpuCanvas reduced(source.width, source.height);
+
+	// Only the canvas read runs at reduced resolution. The transmission lines, threshold and
+	// wipe are hard edges in screen space, which no upsample filter can rebuild from a
+	// quarter or a sixteenth of the pixels, so they are applied after it.
+	start = Clock::now();
+	SampleScreenCanvasCpu(source, low);
+	if (filter == UpsampleFilter::Bilateral)
+	{
+		// The screen pass reads the canvas tiled 2x2, so that is where the guide's edges are.
+		UpsampleBilateralCpu(low, source, 2.0f, DefaultUpsampleLuminanceSigma, upsampled);
+	}
+	else
+	{
+		UpsampleBilinearCpu(low, upsampled);
+	}
+	ShadeScreenTexelsCpu(upsampled, reduced, time);
+	report.reducedMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	report.psnr = PeakSignalToNoise(full, reduced, report.mismatch);
+	return report;
+}
+
+std::vector<ReducedResolutionReport> DirectXGame1::ValidateReducedResolution(unsigned int width, unsigned int height)
+{
+	// Soft gradients with a few hard-edged shapes, so both filters have something to lose.
+	CpuCanvas source(width, height);
+	for (unsigned int y = 0; y < height; y++)
+	{
+		for (unsigned int x = 0; x < width; x++)
+		{
+			float* texel = source.At(x, y);
+			bool inside = ((x / 97) + (y / 61)) % 3 == 0;
+			texel[0] = inside ? 0.6f : 0.05f + 0.05f * std::sin(x * 0.01f);
+			texel[1] = 0.1f + 0.1f * std::sin(y * 0.017f);
+			texel[2] = inside ? 0.2f : 0.0f;
+			texel[3] = 1.0f;
+		}
+	}
+
+	std::vector<ReducedResolutionReport> reports;
+	static const unsigned int divisors[] = { 2, 4 };
+	static const UpsampleFilter filters[] = { UpsampleFilter::Bilinear, UpsampleFilter::Bilateral };
+	for (unsigned int divisor : divisors)
+	{
+		for (UpsampleFilter filter : filters)
+		{
+			reports.push_back(CompareReducedResolution(source, 0.0f, divisor, filter));
+		}
+	}
+	return reports;
+}
+#endif
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include "CpuCanvas.h"
+
+namespace DirectXGame1
+{
+	// How a pass rendered at reduced resolution is brought back to the output size.
+	// Bilinear is a plain filtered read. Bilateral also weights each low-resolution texel by how
+	// close the full-resolution guide's luminance is at that texel and at the output pixel, so
+	// hard edges in the guide stay hard instead of being smeared over 2 or 4 output pixels.
+	enum class UpsampleFilter
+	{
+		Bilinear,
+		Bilateral
+	};
+
+	// Luminance difference at which the bilateral weight has fallen to exp(-0.5).
+	static const float DefaultUpsampleLuminanceSigma = 0.1f;
+
+	inline float Luminance(const float* rgb)
+	{
+		return 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2];
+	}
+
+	// Box-filters divisor x divisor blocks of source into target, which is resized to
+	// source / divisor (at least 1x1).
+	void DownsampleCpu(const CpuCanvas& source, CpuCanvas& target, unsigned int divisor);
+
+	// Fills target from lowRes with a clamp-to-edge bilinear read at each target texel centre.
+	// Same result as the GPU upsample pass with UpsampleFilter::Bilinear.
+	void UpsampleBilinearCpu(const CpuCanvas& lowRes, CpuCanvas& target);
+
+	// Joint bilateral upsample of the four lowRes texels around each target texel. The guide is
+	// read with wrap addressing at uv * guideScale, so a guide of 2 follows the screen pass's 2x2
+	// tiling of the canvas. Same result as the GPU upsample pass with UpsampleFilter::Bilateral.
+	void UpsampleBilateralCpu(const CpuCanvas& lowRes, const CpuCanvas& guide, float guideScale, float luminanceSigma, CpuCanvas& target);
+
+	// What the screen pass writes at reduced resolution: the 2x tiled canvas read at each target
+	// texel centre, with wrap addressing, ahead of the transmission lines and the threshold.
+	// Same result as screenps.hlsl (default features) with time.y set.
+	void SampleScreenCanvasCpu(const CpuCanvas& source, CpuCanvas& target);
+
+	// The rest of the screen pass at full resolution: ShadeScreenTexel for every texel of
+	// texels, an upsampled SampleScreenCanvasCpu the size of target. Same result as the
+	// shading UpsamplePS.hlsl does after its filter.
+	void ShadeScreenTexelsCpu(const CpuCanvas& texels, CpuCanvas& target, float time);
+
+#if defined(DX_HEADLESS_CHECKS)
+	// Screen effects at full resolution against the canvas read at 1/divisor resolution,
+	// upsampled with filter and shaded at full resolution.
+	struct ReducedResolutionReport
+	{
+		unsigned int divisor;
+		UpsampleFilter filter;
+		double psnr;					// dB over displayed rgb, against the full-resolution output
+		double mismatch;				// fraction of pixels off by more than half an 8-bit step
+		double fullMilliseconds;		// ApplyScreenEffectsCpu at full resolution
+		double reducedMilliseconds;		// reduced-resolution canvas read, upsample and full-resolution shading
+	};
+
+	ReducedResolutionReport CompareReducedResolution(const CpuCanvas& source, float time, unsigned int divisor, UpsampleFilter filter);
+
+	// CompareReducedResolution at 1/2 and 1/4 with both filters, on a synthetic canvas of the given size.
+	std::vector<ReducedResolutionReport> ValidateReducedResolution(unsigned int width = 1920, unsigned int height = 1080);
+#endif
+}
@@ -0,0 +1,112 @@
+// Brings a pass rendered at 1/2 or 1/4 resolution back up to the size of the target.
+// Bilinear mode is one filtered read. Bilateral mode reads the four nearest low-resolution
+// texels and weights each one by how close the full-resolution guide's luminance is at that
+// texel and at this pixel, so edges in the guide do not get blurred across.
+// The low-resolution pass is screenps.hlsl's canvas read only; the transmission lines, the
+// threshold, the wipe, the magnet, the occlusion and the bloom follow here at full resolution,
+// as in screenps.hlsl (ShadeScreenTexelsCpu on the CPU).
+
+Texture2D lowRes : register(t0);
+Texture2D guide : register(t1);
+Texture2D bloom : register(t2);
+Texture2D ambientOcclusion : register(t3);
+SamplerState clampSampler : register(s0);
+SamplerState guideSampler : register(s1);
+
+cbuffer UpsampleConstantBuffer : register(b3)
+{
+	float4 lowResSize;		// xy: low-resolution size in texels, zw: 1 / size
+	float4 params;			// x: 0 bilinear, 1 bilateral; y: luminance sigma; z: guide uv scale; w: 1 when t3 is bound
+	float4 screen;			// x: frame counter; y: 1 for the wipe; z: 1 for the magnet; w: bloom intensity, 0 when t2 is not bound
+};
+
+struct PixelShaderInput
+{
+	float4 pos : SV_POSITION;
+	float3 color : COLOR0;
+	float3 normal : NORMAL0;
+	float4 surfpos : POSITION0;
+	float2 tex : TEXCOORD0;
+};
+
+// Matches the floor in UpsampleCpu.cpp, so the GPU and CPU versions weight the same.
+#define BILATERAL_FLOOR 0.001
+
+float Luminance(float3 rgb)
+{
+	return dot(rgb, float3(0.2126, 0.7152, 0.0722));
+}
+
+float3 Upsample(float2 tex)
+{
+	if (params.x < 0.5)
+	{
+		return lowRes.Sample(clampSampler, tex).rgb;
+	}
+
+	float2 p = tex * lowResSize.xy - 0.5;
+	float2 base = floor(p);
+	float2 f = p - base;
+	float centre = Luminance(guide.Sample(guideSampler, tex * params.z).rgb);
+	float inverseTwoSigmaSquared = 1.0 / (2.0 * params.y * params.y);
+
+	float3 sum = 0;
+	float weightSum = 0;
+	[unroll]
+	for (int i = 0; i < 4; i++)
+	{
+		float2 offset = float2(i & 1, i >> 1);
+		int2 texel = clamp((int2)(base + offset), int2(0, 0), (int2)lowResSize.xy - 1);
+		float2 uv = (texel + 0.5) * lowResSize.zw;
+
+		float2 bilinear2 = lerp(1.0 - f, f, offset);
+		float d = Luminance(guide.SampleLevel(guideSampler, uv * params.z, 0).rgb) - centre;
+		float weight = bilinear2.x * bilinear2.y * (exp(-d * d * inverseTwoSigmaSquared) + BILATERAL_FLOOR);
+
+		sum += lowRes.Load(int3(texel, 0)).rgb * weight;
+		weightSum += weight;
+	}
+
+	return sum / weightSum;
+}
+
+float4 main(PixelShaderInput input) : SV_TARGET
+{
+	float t = screen.x;
+	float3 wipreColour = { 1.0f, 0.0f, 0.5f };
+	float3 effect = Upsample(input.tex);
+
+	// "transmission" horizontal and vertical lines:
+	if (((int)(input.tex.r * 1920)) % 12 < 2)
+		effect = (float3)0;
+
+	if (((int)(input.tex.g * 1200)) % 12 < 2)
+		effect = effect * 0;
+
+	// threshold:
+	if (effect.r + effect.g + effect.b > 0.3) effect = (float3)1.0; else effect = (float3)0;
+
+	// horizontal wipe, as in screenps.hlsl
+	if (screen.y > 0.5 && ((int)((0 - input.tex.r) + t / 15)) % 20 > 15 && (effect.r + effect.g + effect.b > 0.3) && (t/15) % 20 > 15)
+		effect = wipreColour;
+
+	// magnet: the loop adds the same (tex - 0.05) scaled offset every time
+	if (screen.z > 0.5)
+	{
+		float3 result = effect;
+		for (int i = 1; i < 25; ++i) {
+			float2 offset = (input.tex - 0.05) * (float(i) / float(25 - 1) - 0.5);
+			float3 temp = { offset.r, offset.g, 0 };
+			result = result + temp;
+		}
+		effect = effect / result;
+	}
+
+	// occlusion and bloom, tiled the same way as the canvas (and the guide)
+	if (params.w > 0.5)
+		effect *= ambientOcclusion.Sample(guideSampler, input.tex * params.z).r;
+	if (screen.w > 0)
+		effect += bloom.Sample(guideSampler, input.tex * params.z).rgb * screen.w;
+
+	return float4(effect, 1.0f);
+}
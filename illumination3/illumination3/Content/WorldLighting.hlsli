@@ -0,0 +1,64 @@
+// The world pass's lighting, shared by ClusteredLightsPS.hlsl (forward) and
+// DeferredLightingPS.hlsl. The including shader declares PerFrameConstantBuffer and
+// PerViewConstantBuffer.
+
+cbuffer LightGridConstantBuffer : register(b3)
+{
+	uint4 grid;			// x: tile size in pixels, y: tiles across, z: tiles down, w: depth slices (0: no point lights)
+	float4 slicing;		// x: depth where slice 0 starts, y: slices per unit of log(depth)
+};
+
+struct PointLight
+{
+	float3 position;
+	float radius;
+	float3 color;
+	float padding;
+};
+
+// t0..t2 are left for the deferred pass's G-buffer.
+StructuredBuffer<PointLight> lights : register(t3);
+StructuredBuffer<uint2> clusters : register(t4);	// offset into lightIndices, count
+StructuredBuffer<uint> lightIndices : register(t5);
+
+// The one light every pixel gets, exactly as SamplePixelShader.hlsl has it.
+float MainLight(float3 N, float3 V, float3 surfpos)
+{
+	float3 L = normalize(lightpos.xyz - surfpos);
+	float3 H = normalize(0.5*(V + L));
+	float diffuse = dot(N, L);
+	float spec = pow(dot(N, H), 275);
+	float amb = 0.1;
+	return 0.5*diffuse + 1.3*spec + 0.1*amb;
+}
+
+// The point lights binned into the cluster under pixel at view depth (clip w). The cluster is
+// the tile under the pixel and the slice the depth falls in, found the way
+// LightGrid::FindCluster does. Each light fades to nothing at its radius; negative terms are
+// clamped so a light behind the surface adds nothing.
+float3 PointLights(float3 N, float3 V, float3 surfpos, float2 pixel, float depth)
+{
+	float3 lit = (float3)0;
+	if (grid.w == 0)
+	{
+		return lit;
+	}
+
+	uint2 tile = min((uint2)pixel / grid.x, grid.yz - 1);
+	uint slice = (uint)clamp(floor(log(depth / slicing.x) * slicing.y), 0.0f, (float)(grid.w - 1));
+	uint2 cluster = clusters[(slice * grid.z + tile.y) * grid.y + tile.x];
+
+	for (uint i = 0; i < cluster.y; i++)
+	{
+		PointLight light = lights[lightIndices[cluster.x + i]];
+		float3 toLight = light.position - surfpos;
+		float distanceSquared = dot(toLight, toLight);
+		float falloff = saturate(1.0f - distanceSquared / (light.radius * light.radius));
+		falloff *= falloff;
+
+		float3 L = toLight * rsqrt(max(distanceSquared, 1e-8f));
+		float3 H = normalize(V + L);
+		lit += light.color * falloff * (0.5*saturate(dot(N, L)) + 1.3*pow(saturate(dot(N, H)), 275));
+	}
+	return lit;
+}
@@ -253,8 +253,8 @@ bool DirectXGame1Main::Render()
 	*/
     // Render the scene objects.
     // Note to developer: Replace this with your app's content rendering functions.
+    // The pass order (world, blur, screen) is declared by the renderer's post-process chain.
     m_sceneRenderer->Render();
-	m_sceneRenderer->RenderScreen();
 
     m_overlayManager->Render();
 
@@ -0,0 +1,456 @@
+// Runs the CPU versions of the renderer's passes through their Validate*, Benchmark* and
+// Simulate* reports on a machine with no GPU, prints each report's key numbers and fails when
+// a report's own pass condition does not hold. With a check name as the argument only that
+// check runs (ctest runs each as its own test); with none, all of them.
+
+#include "Content/AmbientOcclusionCpu.h"
+#include "Content/BloomCpu.h"
+#include "Content/BlurCpu.h"
+#include "Content/CanvasPrecision.h"
+#include "Content/CompactVertex.h"
+#include "Content/DynamicResolution.h"
+#include "Content/FrustumCulling.h"
+#include "Content/GBufferPacking.h"
+#include "Content/InstanceAnimation.h"
+#include "Content/LightCulling.h"
+#include "Content/MeshCache.h"
+#include "Content/MeshGenerator.h"
+#include "Content/MeshIndexing.h"
+#include "Content/MeshOptimizer.h"
+#include "Content/MeshSimplifier.h"
+#include "Content/Meshlets.h"
+#include "Content/PostProcessPlan.h"
+#include "Content/RasterizerCpu.h"
+#include "Content/ScreenEffectsCpu.h"
+#include "Content/TiledEffectsCpu.h"
+#include "Content/UpsampleCpu.h"
+#include "Helpers/ConstantRingAllocator.h"
+#include "Helpers/ParallelFor.h"
+#include "Helpers/ResourcePool.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+using namespace DirectXGame1;
+
+namespace
+{
+	bool Check(bool condition, const char* what)
+	{
+		if (!condition)
+		{
+			std::printf("    FAILED: %s\n", what);
+		}
+		return condition;
+	}
+
+	bool CheckAmbientOcclusion()
+	{
+		AmbientOcclusionReport report = ValidateAmbientOcclusion();
+		std::printf("    flat %.4f, background %.4f, torus %.4f, half vs full %.5f, leak %.5f, displayed %.4f (%.4f darker), %.1f ms half vs %.1f ms full\n",
+			report.flatMinimum, report.backgroundMinimum, report.torusMeanOcclusion, report.halfVersusFullError, report.backgroundLeak,
+			report.displayedDifference, report.displayedDarkening, report.halfMilliseconds, report.fullMilliseconds);
+		bool ok = Check(report.flatMinimum > 0.99f, "a flat wall is occluded");
+		ok &= Check(report.backgroundMinimum > 0.99f, "the background is occluded");
+		ok &= Check(report.torusMeanOcclusion > 0.0, "the torus is not occluded at all");
+		ok &= Check(report.halfVersusFullError < 0.02, "half resolution is far from full resolution");
+		ok &= Check(report.backgroundLeak < 0.01, "the blur leaks onto the background");
+		ok &= Check(report.displayedDifference > 0.001, "the occlusion does not reach the displayed image");
+		return ok;
+	}
+
+	bool CheckTemporalAmbientOcclusion()
+	{
+		TemporalAmbientOcclusionReport report = ValidateTemporalAmbientOcclusion();
+		std::printf("    %u samples a frame: subset %.5f, static %.5f, moving %.5f, rejected %.4f, %.1f ms full vs %.1f ms temporal\n",
+			report.samplesPerFrame, report.subsetError, report.staticError, report.movingError, report.rejectedFraction,
+			report.fullMilliseconds, report.temporalMilliseconds);
+		bool ok = Check(report.staticError < report.subsetError, "the history does not help a still torus");
+		ok &= Check(report.movingError < report.subsetError, "the history does not help a spinning torus");
+		return ok;
+	}
+
+	bool CheckBloom()
+	{
+		BloomReport report = ValidateBloom();
+		std::printf("    %ux%u, %u levels: uniform error %g, below threshold %g, %.1f vs %.1f samples a pixel, %.1f ms vs %.1f ms wide blur\n",
+			report.width, report.height, report.levels, report.uniformError, report.belowThresholdMax,
+			report.bloomSamplesPerPixel, report.wideBlurSamplesPerPixel, report.bloomMilliseconds, report.wideBlurMilliseconds);
+		bool ok = Check(report.uniformError < 1.0e-4f, "a flat canvas does not bloom evenly");
+		ok &= Check(report.belowThresholdMax == 0.0f, "a canvas under the threshold blooms");
+		return ok;
+	}
+
+	bool CheckBlur()
+	{
+		BlurReport report = ValidateBlur();
+		std::printf("    %u box cases: max error %g; gaussian sigma off by %.4f, mass off by %g\n",
+			report.boxCases, report.boxMaxError, report.gaussianMaxSigmaError, report.gaussianMaxMassError);
+		bool ok = Check(report.boxMaxError < 1.0e-5f, "the sliding window differs from a direct box");
+		ok &= Check(report.gaussianMaxSigmaError < 0.1f, "the box passes miss the Gaussian's width");
+		ok &= Check(report.gaussianMaxMassError < 1.0e-4f, "the box passes gain or lose brightness");
+		return ok;
+	}
+
+	bool CheckCanvasPrecisions()
+	{
+		bool ok = true;
+		for (const CanvasPrecisionReport& report : ValidateCanvasPrecisions())
+		{
+			std::printf("    format %d: max %g, mean %g, relative %g, screen mismatch %.5f\n",
+				(int)report.precision, report.maxAbsError, report.meanAbsError, report.maxRelError, report.screenMismatch);
+			ok &= Check(report.withinTolerance, "a texel is off by more than the format's rounding");
+		}
+		return ok;
+	}
+
+	bool CheckCompactVertices()
+	{
+		CompactVertexReport report = ValidateCompactVertices();
+		std::printf("    %u vertices: position %g (bound %g), normal %g deg (bound %g), colour %g, tex %g; %llu -> %llu bytes\n",
+			report.vertices, report.maxPositionError, report.positionBound, report.maxNormalErrorDegrees, report.normalBoundDegrees,
+			report.maxColorError, report.maxTexError, (unsigned long long)report.fullBytes, (unsigned long long)report.compactBytes);
+		return Check(report.withinBounds, "an attribute is off by more than its bound");
+	}
+
+	bool CheckDynamicResolution()
+	{
+		DynamicResolutionReport report = ValidateDynamicResolution();
+		std::printf("    spike: %u late fixed, %u late controlled, settles in %u, recovers in %u; vsync %u late; noisy %u changes\n",
+			report.spikeFixed.lateFrames, report.spikeControlled.lateFrames, report.spikeSettleFrames, report.recoverFrames,
+			report.vsyncControlled.lateFrames, report.noisyControlled.scaleChanges);
+		bool ok = Check(report.boundsHold, "a scale is off the step grid or out of range");
+		ok &= Check(report.replayMatches, "a replayed trace gives other scales");
+		ok &= Check(report.spikeControlled.lateFrames < report.spikeFixed.lateFrames, "the controller does not cut late frames");
+		return ok;
+	}
+
+	bool CheckCulling()
+	{
+		CullingBenchmark report = BenchmarkCulling();
+		std::printf("    %u objects on %u workers: %.2f ms reference, %.2f ms simd, %.2f ms parallel\n",
+			report.objects, report.workers, report.referenceMilliseconds, report.simdMilliseconds, report.parallelMilliseconds);
+		return Check(report.mismatches == 0, "a visible list differs from the reference");
+	}
+
+	bool CheckGBufferPacking()
+	{
+		GBufferPackingReport report = ValidateGBufferPacking();
+		std::printf("    %u normals: max %.4f deg, mean %.4f deg; %u positions: max %g (relative %g); %u bytes a pixel\n",
+			report.normals, report.maxNormalDegrees, report.meanNormalDegrees, report.positions, report.maxPositionError,
+			report.maxRelativePositionError, report.bytesPerPixel);
+		bool ok = Check(report.maxNormalDegrees < 0.05, "a packed normal is off by more than 16-bit octahedral allows");
+		ok &= Check(report.maxRelativePositionError < 1.0e-3, "a reconstructed position is off");
+		return ok;
+	}
+
+	bool CheckInstanceUpdate()
+	{
+		InstanceUpdateBenchmark report = BenchmarkInstanceUpdate();
+		std::printf("    %u instances on %u workers: %.0f reference, %.0f simd, %.0f parallel a ms; max error %g\n",
+			report.instances, report.workers, report.referenceInstancesPerMillisecond, report.simdInstancesPerMillisecond,
+			report.parallelInstancesPerMillisecond, report.maxError);
+		return Check(report.maxError < 1.0e-3f, "an instance is off the reference");
+	}
+
+	bool CheckLightBinning()
+	{
+		LightBinningBenchmark report = BenchmarkLightBinning();
+		std::printf("    %u lights, %u clusters, %u entries: %.2f ms reference, %.2f ms simd, %.2f ms parallel; %.1f touching, %.1f listed\n",
+			report.lights, report.clusters, report.entries, report.referenceMilliseconds, report.simdMilliseconds,
+			report.parallelMilliseconds, report.meanTouchingLights, report.meanClusterLights);
+		bool ok = Check(report.mismatches == 0, "a grid differs from the reference");
+		ok &= Check(report.missedLights == 0, "a light reaching a point is missing from its cluster");
+		return ok;
+	}
+
+	bool CheckMeshCache()
+	{
+		MeshCacheReport report = ValidateMeshCache(L"headless_mesh_cache.bin");
+		std::printf("    %llu bytes: bake %.2f ms, write %.2f ms, open %.3f ms, touch %.2f ms\n",
+			(unsigned long long)report.fileBytes, report.bakeMilliseconds, report.writeMilliseconds, report.openMilliseconds,
+			report.touchMilliseconds);
+		bool ok = Check(report.roundTrip, "the cache does not read back as baked");
+		ok &= Check(report.rejectsHash && report.rejectsVersion && report.rejectsTruncated, "a stale cache is accepted");
+		return ok;
+	}
+
+	bool CheckMeshGenerator()
+	{
+		MeshGeneratorReport report = BenchmarkMeshGenerator();
+		std::printf("    %u vertices: %.1f ms reference, %.1f ms one thread, %.1f ms parallel; %u meshes in %.1f ms\n",
+			report.vertices, report.referenceMilliseconds, report.singleThreadMilliseconds, report.parallelMilliseconds,
+			report.batchMeshes, report.batchMilliseconds);
+		bool ok = Check(report.maxPositionError < 1.0e-4f, "a position is off the reference");
+		ok &= Check(report.maxNormalError < 1.0e-4f, "a normal is off the reference");
+		ok &= Check(report.maxNormalLengthError < 1.0e-4f, "a normal is not unit length");
+		return ok;
+	}
+
+	bool CheckMeshIndexing()
+	{
+		MeshIndexingReport report = ValidateMeshIndexing();
+		std::printf("    %u meshes; large: %u vertices in %u chunks, %llu bytes 32-bit vs %llu split\n",
+			report.meshesChecked, report.largeVertices, report.largeChunks, (unsigned long long)report.bytes32,
+			(unsigned long long)report.bytesSplit16);
+		bool ok = Check(report.mismatchedTriangles == 0, "a triangle does not come back as the source's");
+		ok &= Check(report.chunkLimitViolations == 0, "a chunk breaks its limit");
+		ok &= Check(report.wrongFormats == 0, "Automatic picks the wrong index format");
+		return ok;
+	}
+
+	bool CheckMeshOptimization()
+	{
+		MeshOptimizationReport report = ReportMeshOptimization();
+		std::printf("    %u triangles: fifo acmr %.3f -> %.3f, lru %.3f -> %.3f, overfetch %.3f -> %.3f\n",
+			report.triangles, report.fifoBefore.acmr, report.fifoAfter.acmr, report.lruBefore.acmr, report.lruAfter.acmr,
+			report.overfetchBefore, report.overfetchAfter);
+		bool ok = Check(report.trianglesPreserved, "the optimized mesh has other triangles");
+		ok &= Check(report.fifoAfter.acmr <= report.fifoBefore.acmr, "the cache order is worse than the grid's");
+		return ok;
+	}
+
+	bool CheckMeshLods()
+	{
+		MeshLodReport report = ValidateMeshLods();
+		std::printf("    %u torus levels in %.1f ms; %u switches with hysteresis, %u without\n",
+			(unsigned int)report.torus.size(), report.buildMilliseconds, report.hysteresisSwitches, report.instantSwitches);
+		bool ok = Check(report.boundsHold, "a level strays further than its error bound");
+		ok &= Check(report.reductionsMet, "a level misses its triangle target");
+		ok &= Check(report.hysteresisSwitches <= report.instantSwitches, "hysteresis adds switches");
+		return ok;
+	}
+
+	bool CheckMeshlets()
+	{
+		MeshletReport report = ValidateMeshlets();
+		std::printf("    %u meshlets of %.1f vertices, %.1f triangles; side view culls %.3f of meshlets, %.3f of triangles (%.3f face away)\n",
+			report.meshlets, report.averageVertices, report.averageTriangles, report.sideViewCulledMeshlets,
+			report.sideViewCulledTriangles, report.backFacingTriangles);
+		bool ok = Check(report.everyTriangleOnce, "the meshlets do not cover the mesh exactly");
+		ok &= Check(report.boundsHold, "a vertex or face is outside its meshlet's bounds");
+		ok &= Check(report.cullingConservative, "a culled meshlet had a visible triangle");
+		return ok;
+	}
+
+	bool CheckPostProcessPlan()
+	{
+		PostProcessPlanReport report = ValidatePostProcessPlan();
+		std::printf("    blur chain: 3 targets in %u textures\n", report.blurTextures);
+		bool ok = Check(report.sharesEqualDescs, "canvas and blurred do not share a texture");
+		ok &= Check(report.separatesOtherDescs, "targets of another format or scale share a texture");
+		ok &= Check(report.separatesReadAndWrite, "a pass reads and writes the same texture");
+		ok &= Check(report.rejectsReadBeforeWrite, "a read before any write is accepted");
+		ok &= Check(report.rejectsReadOfOwnWrite, "a pass reading its own output is accepted");
+		ok &= Check(report.keepsHistoryApart, "a history target shares a texture");
+		return ok;
+	}
+
+	bool CheckRasterizer()
+	{
+		RasterizerCpuReport report = ValidateRasterizerCpu();
+		RasterizerCpuBenchmark benchmark = BenchmarkRasterizerCpu();
+		std::printf("    mismatched %u (max %g), gaps %u, overlaps %u; %ux%u, %u triangles: %.2f ms one worker, %.2f ms on %u\n",
+			report.mismatchedPixels, report.maxDifference, report.gapPixels, report.overlapPixels, benchmark.width, benchmark.height,
+			benchmark.triangles, benchmark.singleMilliseconds, benchmark.parallelMilliseconds, benchmark.workers);
+		bool ok = Check(report.mismatchedPixels == 0, "the tiled rasterizer differs from the reference");
+		ok &= Check(report.gapPixels == 0 && report.overlapPixels == 0, "a mesh covering the target leaves gaps or overlaps");
+		return ok;
+	}
+
+	// ApplyScreenEffectsCpu folds the magnet loop and skips the canvas read under the lines, so
+	// it is held against the straight transcription of screenps.hlsl at every pixel, with and
+	// without the wipe.
+	bool CheckScreenEffects()
+	{
+		const unsigned int width = 640, height = 400;
+		CpuCanvas source(width, height), target(width, height);
+		for (unsigned int y = 0; y < height; y++)
+		{
+			for (unsigned int x = 0; x < width; x++)
+			{
+				float* texel = source.At(x, y);
+				texel[0] = 0.5f + 0.5f * std::sin(x * 0.037f);
+				texel[1] = 0.5f + 0.5f * std::sin(y * 0.053f);
+				texel[2] = 0.1f;
+				texel[3] = 1.0f;
+			}
+		}
+
+		float maxDifference = 0.0f;
+		unsigned int mismatches = 0;
+		static const float times[] = { 0.0f, 250.0f };
+		for (float time : times)
+		{
+			ApplyScreenEffectsCpu(source, target, time);
+			for (unsigned int y = 0; y < height; y++)
+			{
+				for (unsigned int x = 0; x < width; x++)
+				{
+					float reference[4];
+					ShadeScreenPixelReference(source, (x + 0.5f) / width, (y + 0.5f) / height, time, reference);
+					const float* fast = target.At(x, y);
+					for (int c = 0; c < 4; c++)
+					{
+						if (std::isnan(reference[c]) && std::isnan(fast[c]))
+						{
+							continue;
+						}
+						float difference = std::fabs(reference[c] - fast[c]);
+						if (!(difference <= 1.0e-5f * std::fmax(1.0f, std::fabs(reference[c]))))
+						{
+							mismatches++;
+						}
+						if (difference > maxDifference)
+						{
+							maxDifference = difference;
+						}
+					}
+				}
+			}
+		}
+
+		std::printf("    against ShadeScreenPixelReference: max difference %g, %u channels out\n", maxDifference, mismatches);
+		for (const ScreenEffectsBenchmarkResult& result : BenchmarkScreenEffectsCpu())
+		{
+			std::printf("    %ux%u: %.2f ms, %.0f Mpixels/s\n", result.width, result.height, result.millisecondsPerFrame, result.megapixelsPerSecond);
+		}
+		return Check(mismatches == 0, "the fast path differs from the reference");
+	}
+
+	bool CheckTiledCompute()
+	{
+		TiledComputeReport report = ValidateTiledCompute();
+		std::printf("    blur radius %d: max error %g, %.2f vs %.2f fetches, %.2f ms direct vs %.2f ms tiled; screen %.2f fetches\n",
+			report.blurRadius, report.blurMaxError, report.blurDirectFetches, report.blurTiledFetches, report.blurDirectMilliseconds,
+			report.blurTiledMilliseconds, report.screenTiledFetches);
+		bool ok = Check(report.blurMaxError < 1.0e-5f, "the tiled blur differs from the direct one");
+		ok &= Check(report.screenMismatch == 0, "the tiled screen pass differs from ApplyScreenEffectsCpu");
+		return ok;
+	}
+
+	bool CheckReducedResolution()
+	{
+		std::vector<ReducedResolutionReport> reports = ValidateReducedResolution();
+		bool ok = true;
+		for (size_t i = 0; i < reports.size(); i++)
+		{
+			const ReducedResolutionReport& report = reports[i];
+			bool bilateral = report.filter == UpsampleFilter::Bilateral;
+			std::printf("    1/%u %s: %.2f dB, %.4f mismatch, %.1f ms vs %.1f ms full\n",
+				report.divisor, bilateral ? "bilateral" : "bilinear", report.psnr, report.mismatch, report.reducedMilliseconds,
+				report.fullMilliseconds);
+			ok &= Check(report.mismatch < 0.05, "more than 5% of pixels are off");
+			// reports come in bilinear, bilateral pairs for each divisor
+			if (bilateral && i > 0)
+			{
+				ok &= Check(report.psnr >= reports[i - 1].psnr, "the bilateral guide does worse than bilinear");
+			}
+		}
+		return ok;
+	}
+
+	bool CheckParallelFor()
+	{
+		DX::ParallelForReport report = DX::ValidateParallelFor();
+		std::printf("    %u pool threads: %.2f us a loop through the pool, %.2f us starting threads\n",
+			report.threads, report.poolMicroseconds, report.spawnMicroseconds);
+		bool ok = Check(report.everyItemOnce, "an item ran twice or not at all");
+		ok &= Check(report.exceptionPropagates, "a throw from a loop is lost or leaves the pool stuck");
+		return ok;
+	}
+
+	bool CheckResourcePool()
+	{
+		DX::ResourcePoolReport report = DX::ValidateResourcePool();
+		std::printf("    %u targets: a resize replaced %u and created %u (expected %u), resizing back created %u\n",
+			report.targets, report.resizeRefilled, report.resizeCreated, report.expectedResizeCreated, report.resizeBackCreated);
+		bool ok = Check(report.reusesReleased, "a released resource is not reused, or a busy one is");
+		ok &= Check(report.keysApart, "resources with different keys are shared");
+		ok &= Check(report.trimsIdle, "idle resources are not dropped after the idle limit, or dropped early");
+		ok &= Check(report.resizeCreated == report.expectedResizeCreated, "a resize creates more than the targets whose size changed need");
+		ok &= Check(report.resizeRefilled == 4 && report.keepsUnchanged, "a resize replaces targets whose size did not change");
+		ok &= Check(report.keysMatch, "a slot keeps a target of the old size");
+		ok &= Check(report.resizeBackCreated == 0, "resizing back does not reuse the released targets");
+		return ok;
+	}
+
+	bool CheckConstantUploads()
+	{
+		// A ring small enough to run full mid-frame several times a frame.
+		DX::ConstantUploadWorkload workload = { 64, 192, 128, 48, 512, 2, 50, 12, 20, 16 * 1024, 3 };
+		DX::ConstantUploadReport report = DX::SimulateConstantUploads(workload);
+		std::printf("    %llu bytes a frame split vs %llu monolithic; %u discards, %u reuploads\n",
+			(unsigned long long)report.splitBytesPerFrame, (unsigned long long)report.monolithicBytesPerFrame, report.discards, report.reuploads);
+		bool ok = Check(report.discards > workload.frames, "the ring never ran full mid-frame");
+		ok &= Check(report.overwriteErrors == 0, "a block an in-flight frame reads was overwritten");
+		ok &= Check(report.staleReads == 0, "a draw read a block lost to a discard");
+		ok &= Check(report.reuploads > 0, "no block bound before a discard was uploaded again");
+		ok &= Check(report.countersMatch, "the allocator and the device disagree");
+		return ok;
+	}
+
+	struct HeadlessCheck
+	{
+		const char* name;
+		bool (*run)();
+	};
+
+	const HeadlessCheck Checks[] =
+	{
+		{ "AmbientOcclusion", CheckAmbientOcclusion },
+		{ "TemporalAmbientOcclusion", CheckTemporalAmbientOcclusion },
+		{ "Bloom", CheckBloom },
+		{ "Blur", CheckBlur },
+		{ "CanvasPrecisions", CheckCanvasPrecisions },
+		{ "CompactVertices", CheckCompactVertices },
+		{ "DynamicResolution", CheckDynamicResolution },
+		{ "Culling", CheckCulling },
+		{ "GBufferPacking", CheckGBufferPacking },
+		{ "InstanceUpdate", CheckInstanceUpdate },
+		{ "LightBinning", CheckLightBinning },
+		{ "MeshCache", CheckMeshCache },
+		{ "MeshGenerator", CheckMeshGenerator },
+		{ "MeshIndexing", CheckMeshIndexing },
+		{ "MeshOptimization", CheckMeshOptimization },
+		{ "MeshLods", CheckMeshLods },
+		{ "Meshlets", CheckMeshlets },
+		{ "PostProcessPlan", CheckPostProcessPlan },
+		{ "Rasterizer", CheckRasterizer },
+		{ "ScreenEffects", CheckScreenEffects },
+		{ "TiledCompute", CheckTiledCompute },
+		{ "ReducedResolution", CheckReducedResolution },
+		{ "ConstantUploads", CheckConstantUploads },
+		{ "ParallelFor", CheckParallelFor },
+		{ "ResourcePool", CheckResourcePool },
+	};
+}
+
+int main(int argc, char** argv)
+{
+	const char* only = argc > 1 ? argv[1] : nullptr;
+	unsigned int run = 0, failed = 0;
+	for (const HeadlessCheck& check : Checks)
+	{
+		if (only && std::strcmp(only, check.name) != 0)
+		{
+			continue;
+		}
+		std::printf("%s\n", check.name);
+		run++;
+		if (!check.run())
+		{
+			failed++;
+		}
+	}
+
+	if (run == 0)
+	{
+		std::printf("no check named %s\n", only);
+		return 2;
+	}
+	std::printf("%u of %u checks passed\n", run - failed, run);
+	return failed ? 1 : 0;
+}
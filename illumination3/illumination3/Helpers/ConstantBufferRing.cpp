@@ -0,0 +1,150 @@
+#include "pch.h"
+#include "ConstantBufferRing.h"
+#include "DirectXHelper.h"
+
+using namespace DX;
+
+namespace
+{
+	// Frames whose constants the GPU may still read: DeviceResources allows up to two queued
+	// frames, plus the one being recorded.
+	const uint32 FramesInFlight = 3;
+
+	// Per-slot buffer size when blocks cannot be bound at an offset; fits the largest block.
+	const UINT SlotBufferSize = 4096;
+}
+
+DynamicConstantBuffer::DynamicConstantBuffer(ID3D11Device* device, ID3D11DeviceContext* context, UINT size) :
+	m_context(context)
+{
+	CD3D11_BUFFER_DESC desc(size, D3D11_BIND_CONSTANT_BUFFER, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+	DX::ThrowIfFailed(device->CreateBuffer(&desc, nullptr, &m_buffer));
+}
+
+void DynamicConstantBuffer::Write(uint32_t offset, const void* data, uint32_t size, bool discard)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	DX::ThrowIfFailed(m_context->Map(m_buffer.Get(), 0, discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped));
+	memcpy((byte*)mapped.pData + offset, data, size);
+	m_context->Unmap(m_buffer.Get(), 0);
+}
+
+ConstantBufferRing::ConstantBufferRing(const std::shared_ptr<DeviceResources>& deviceResources, UINT capacity) :
+	m_deviceResources(deviceResources),
+	m_capacity(capacity),
+	m_offsetBinding(false)
+{
+}
+
+void ConstantBufferRing::CreateDeviceDependentResources()
+{
+	auto device = m_deviceResources->GetD3DDevice();
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	m_offsetBinding =
+		SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) &&
+		options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer;
+
+	m_slots.reset();
+	m_rings.clear();
+	m_buffers.clear();
+	UINT ringCount = m_offsetBinding ? 1 : SlotCount;
+	for (UINT i = 0; i < ringCount; i++)
+	{
+		UINT size = m_offsetBinding ? m_capacity : SlotBufferSize;
+		m_buffers.push_back(std::unique_ptr<DynamicConstantBuffer>(new DynamicConstantBuffer(device, context, size)));
+		m_rings.push_back(std::unique_ptr<ConstantRingAllocator>(new ConstantRingAllocator(*m_buffers.back(), size, FramesInFlight, m_offsetBinding)));
+	}
+	if (m_offsetBinding)
+	{
+		m_slots = std::unique_ptr<ConstantSlotBindings>(new ConstantSlotBindings(*m_rings[0], SlotCount));
+	}
+}
+
+void ConstantBufferRing::ReleaseDeviceDependentResources()
+{
+	m_slots.reset();
+	m_rings.clear();
+	m_buffers.clear();
+}
+
+void ConstantBufferRing::Set(UINT slot, UINT stages, const void* data, UINT size)
+{
+	if (slot >= SlotCount)
+	{
+		throw ref new Platform::InvalidArgumentException();
+	}
+
+	if (m_offsetBinding)
+	{
+		m_slots->Set(slot, stages, data, size, [this](const ConstantBinding& binding) { BindAtOffset(binding); });
+		return;
+	}
+
+	m_rings[slot]->Upload(data, size);
+	ID3D11Buffer* buffer = m_buffers[slot]->GetBuffer();
+	auto context = m_deviceResources->GetD3DDeviceContext();
+	if (stages & ConstantStageVertex)
+	{
+		context->VSSetConstantBuffers(slot, 1, &buffer);
+	}
+	if (stages & ConstantStagePixel)
+	{
+		context->PSSetConstantBuffers(slot, 1, &buffer);
+	}
+	if (stages & ConstantStageCompute)
+	{
+		context->CSSetConstantBuffers(slot, 1, &buffer);
+	}
+}
+
+void ConstantBufferRing::BindAtOffset(const ConstantBinding& binding)
+{
+	ID3D11Buffer* buffer = m_buffers[0]->GetBuffer();
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	// Offsets and sizes are in 16-byte constants, both multiples of 16 constants.
+	UINT firstConstant = binding.offset / 16;
+	UINT constantCount = ConstantRingAllocator::AlignedSize(binding.size) / 16;
+	if (binding.stages & ConstantStageVertex)
+	{
+		context->VSSetConstantBuffers1(binding.slot, 1, &buffer, &firstConstant, &constantCount);
+	}
+	if (binding.stages & ConstantStagePixel)
+	{
+		context->PSSetConstantBuffers1(binding.slot, 1, &buffer, &firstConstant, &constantCount);
+	}
+	if (binding.stages & ConstantStageCompute)
+	{
+		context->CSSetConstantBuffers1(binding.slot, 1, &buffer, &firstConstant, &constantCount);
+	}
+}
+
+void ConstantBufferRing::EndFrame()
+{
+	for (auto& ring : m_rings)
+	{
+		ring->EndFrame();
+	}
+}
+
+uint64 ConstantBufferRing::GetBytesUploadedThisFrame() const
+{
+	uint64 bytes = 0;
+	for (const auto& ring : m_rings)
+	{
+		bytes += ring->GetBytesUploadedThisFrame();
+	}
+	return bytes;
+}
+
+uint64 ConstantBufferRing::GetBytesUploadedLastFrame() const
+{
+	uint64 bytes = 0;
+	for (const auto& ring : m_rings)
+	{
+		bytes += ring->GetBytesUploadedLastFrame();
+	}
+	return bytes;
+}
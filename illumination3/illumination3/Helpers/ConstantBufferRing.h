@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include "DeviceResources.h"
+#include "ConstantRingAllocator.h"
+
+namespace DX
+{
+	// ConstantUploadDevice over a D3D11 dynamic constant buffer.
+	class DynamicConstantBuffer : public ConstantUploadDevice
+	{
+	public:
+		DynamicConstantBuffer(ID3D11Device* device, ID3D11DeviceContext* context, UINT size);
+
+		virtual void Write(uint32_t offset, const void* data, uint32_t size, bool discard);
+
+		ID3D11Buffer* GetBuffer() const { return m_buffer.Get(); }
+
+	private:
+		Microsoft::WRL::ComPtr<ID3D11Buffer>		m_buffer;
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext>	m_context;
+	};
+
+	// Shader stages a constant block is bound to.
+	enum ConstantStage
+	{
+		ConstantStageVertex = 1,
+		ConstantStagePixel = 2,
+		ConstantStageCompute = 4
+	};
+
+	// Uploads constant blocks and binds them by slot. On devices that can bind part of a
+	// constant buffer (D3D11.1 offsetting plus no-overwrite maps) every block goes into one
+	// shared ring and is bound at its offset; when the ring runs full mid-frame, the blocks
+	// still bound from before the discard are uploaded and bound again. Otherwise each slot gets
+	// its own small buffer, rewritten with discard for every block.
+	class ConstantBufferRing
+	{
+	public:
+		// b0 per frame, b1 per view, b2 per object, b3 per effect pass.
+		static const UINT SlotCount = 4;
+
+		ConstantBufferRing(const std::shared_ptr<DeviceResources>& deviceResources, UINT capacity = 64 * 1024);
+
+		void CreateDeviceDependentResources();
+		void ReleaseDeviceDependentResources();
+
+		// Uploads size bytes and binds them to slot for the given ConstantStage bits.
+		void Set(UINT slot, UINT stages, const void* data, UINT size);
+
+		template <typename Block>
+		void Set(UINT slot, UINT stages, const Block& block) { Set(slot, stages, &block, (UINT)sizeof(Block)); }
+
+		// Call once per frame, after the frame's last Set.
+		void EndFrame();
+
+		bool UsesOffsetBinding() const { return m_offsetBinding; }
+		uint64 GetBytesUploadedThisFrame() const;
+		uint64 GetBytesUploadedLastFrame() const;
+
+	private:
+		void BindAtOffset(const ConstantBinding& binding);
+
+		std::shared_ptr<DeviceResources> m_deviceResources;
+		UINT m_capacity;
+		bool m_offsetBinding;
+
+		// One shared ring with offset binding, one per slot without.
+		std::vector<std::unique_ptr<DynamicConstantBuffer>> m_buffers;
+		std::vector<std::unique_ptr<ConstantRingAllocator>> m_rings;
+		std::unique_ptr<ConstantSlotBindings> m_slots;	// with offset binding only
+	};
+}
@@ -0,0 +1,305 @@
+#include "ConstantRingAllocator.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace DX;
+
+ConstantRingAllocator::ConstantRingAllocator(ConstantUploadDevice& device, uint32_t capacity, uint32_t framesInFlight, bool offsetBinding) :
+	m_device(device),
+	m_capacity(capacity & ~(Alignment - 1)),
+	m_framesInFlight(framesInFlight < 1 ? 1 : framesInFlight),
+	m_offsetBinding(offsetBinding),
+	m_head(0),
+	m_used(0),
+	m_frameUsed(0),
+	m_needsDiscard(true),
+	m_bytesThisFrame(0),
+	m_bytesLastFrame(0),
+	m_bytesTotal(0),
+	m_uploads(0),
+	m_discards(0)
+{
+	if (m_capacity == 0)
+	{
+		throw std::invalid_argument("constant ring capacity below one block");
+	}
+}
+
+uint32_t ConstantRingAllocator::Upload(const void* data, uint32_t size)
+{
+	uint32_t aligned = AlignedSize(size);
+	if (aligned > m_capacity || size == 0)
+	{
+		throw std::invalid_argument("constant block does not fit the ring");
+	}
+
+	m_uploads++;
+	m_bytesThisFrame += size;
+	m_bytesTotal += size;
+
+	if (!m_offsetBinding)
+	{
+		m_device.Write(0, data, size, true);
+		m_discards++;
+		return 0;
+	}
+
+	// Skip the tail end of the buffer if the block does not fit before it.
+	uint32_t skipped = m_head + aligned > m_capacity ? m_capacity - m_head : 0;
+	if (m_needsDiscard || m_used + skipped + aligned > m_capacity)
+	{
+		// Full (or never written): let the driver hand us fresh memory and start over. Blocks
+		// bound from the old memory have to be uploaded again (ConstantSlotBindings does that).
+		Reset();
+		m_needsDiscard = false;
+		m_device.Write(0, data, size, true);
+		m_discards++;
+		m_head = aligned;
+		m_used = aligned;
+		m_frameUsed = aligned;
+		return 0;
+	}
+
+	if (skipped)
+	{
+		m_head = 0;
+		m_used += skipped;
+		m_frameUsed += skipped;
+	}
+
+	uint32_t offset = m_head;
+	m_device.Write(offset, data, size, false);
+	m_head = offset + aligned == m_capacity ? 0 : offset + aligned;
+	m_used += aligned;
+	m_frameUsed += aligned;
+	return offset;
+}
+
+void ConstantRingAllocator::EndFrame()
+{
+	m_frameSizes.push_back(m_frameUsed);
+	m_frameUsed = 0;
+
+	// The current frame plus framesInFlight - 1 earlier ones may still be read by the GPU.
+	while (m_frameSizes.size() > m_framesInFlight - 1)
+	{
+		m_used -= m_frameSizes.front();
+		m_frameSizes.pop_front();
+	}
+
+	m_bytesLastFrame = m_bytesThisFrame;
+	m_bytesThisFrame = 0;
+}
+
+void ConstantRingAllocator::Reset()
+{
+	m_head = 0;
+	m_used = 0;
+	m_frameUsed = 0;
+	m_frameSizes.clear();
+	m_needsDiscard = true;
+}
+
+ConstantSlotBindings::ConstantSlotBindings(ConstantRingAllocator& ring, uint32_t slotCount) :
+	m_ring(ring),
+	m_slots(slotCount),
+	m_reuploads(0)
+{
+}
+
+void ConstantSlotBindings::Set(uint32_t slot, uint32_t stages, const void* data, uint32_t size, const BindFunction& bind)
+{
+	if (slot >= m_slots.size())
+	{
+		throw std::invalid_argument("constant slot out of range");
+	}
+
+	uint32_t discards = m_ring.GetDiscardCount();
+	ConstantBinding binding = { slot, stages, m_ring.Upload(data, size), size };
+	bind(binding);
+
+	// The new block takes these stages over from whatever the slot held; a copy with the same
+	// stages is rewritten in place, so the common case allocates nothing.
+	std::vector<Block>& blocks = m_slots[slot];
+	Block* copy = nullptr;
+	for (auto it = blocks.begin(); it != blocks.end();)
+	{
+		if (it->stages == stages)
+		{
+			copy = &*it;
+			++it;
+			continue;
+		}
+		it->stages &= ~stages;
+		it = it->stages ? it + 1 : blocks.erase(it);
+	}
+	if (!copy)
+	{
+		blocks.push_back(Block());
+		copy = &blocks.back();
+		copy->stages = stages;
+	}
+	copy->discards = m_ring.GetDiscardCount();
+	copy->data.assign((const uint8_t*)data, (const uint8_t*)data + size);
+
+	uint32_t current = m_ring.GetDiscardCount();
+	if (current == discards)
+	{
+		return;
+	}
+
+	// The ring started over: every other block still bound lives in the memory it gave up.
+	for (uint32_t s = 0; s < (uint32_t)m_slots.size(); s++)
+	{
+		for (Block& block : m_slots[s])
+		{
+			if (block.discards == current)
+			{
+				continue;
+			}
+			uint32_t blockSize = (uint32_t)block.data.size();
+			ConstantBinding rebinding = { s, block.stages, m_ring.Upload(&block.data[0], blockSize), blockSize };
+			if (m_ring.GetDiscardCount() != current)
+			{
+				throw std::invalid_argument("constant ring cannot hold one block per slot");
+			}
+			block.discards = current;
+			m_reuploads++;
+			bind(rebinding);
+		}
+	}
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+MemoryConstantUploadDevice::MemoryConstantUploadDevice(uint32_t capacity, uint32_t framesInFlight) :
+	m_memory(capacity),
+	m_slotFrame((capacity + ConstantRingAllocator::Alignment - 1) / ConstantRingAllocator::Alignment, -1),
+	m_slotWrite(m_slotFrame.size(), 0),
+	m_framesInFlight(framesInFlight < 1 ? 1 : framesInFlight),
+	m_frame(0),
+	m_bytesWritten(0),
+	m_writes(0),
+	m_discards(0),
+	m_overwriteErrors(0),
+	m_staleReads(0)
+{
+}
+
+void MemoryConstantUploadDevice::Write(uint32_t offset, const void* data, uint32_t size, bool discard)
+{
+	if ((uint64_t)offset + size > m_memory.size())
+	{
+		throw std::out_of_range("constant write past the end of the buffer");
+	}
+
+	if (discard)
+	{
+		// Renaming: whatever the GPU still reads lives in the old copy.
+		m_discards++;
+		std::fill(m_slotFrame.begin(), m_slotFrame.end(), -1);
+		std::fill(m_slotWrite.begin(), m_slotWrite.end(), 0);
+	}
+
+	m_writes++;
+
+	uint32_t first = offset / ConstantRingAllocator::Alignment;
+	uint32_t last = (offset + size - 1) / ConstantRingAllocator::Alignment;
+	for (uint32_t slot = first; slot <= last; slot++)
+	{
+		int64_t writer = m_slotFrame[slot];
+		if (!discard && writer >= 0 && writer + (int64_t)m_framesInFlight > (int64_t)m_frame)
+		{
+			m_overwriteErrors++;
+		}
+		m_slotFrame[slot] = m_frame;
+		m_slotWrite[slot] = m_writes;
+	}
+
+	std::memcpy(&m_memory[offset], data, size);
+	m_bytesWritten += size;
+}
+
+void MemoryConstantUploadDevice::Read(uint32_t offset, uint32_t size, uint64_t write)
+{
+	if ((uint64_t)offset + size > m_memory.size() || size == 0)
+	{
+		throw std::out_of_range("constant read past the end of the buffer");
+	}
+
+	uint32_t first = offset / ConstantRingAllocator::Alignment;
+	uint32_t last = (offset + size - 1) / ConstantRingAllocator::Alignment;
+	for (uint32_t slot = first; slot <= last; slot++)
+	{
+		if (m_slotWrite[slot] != write)
+		{
+			m_staleReads++;
+			return;
+		}
+	}
+}
+
+ConstantUploadReport DX::SimulateConstantUploads(const ConstantUploadWorkload& workload)
+{
+	MemoryConstantUploadDevice device(workload.ringCapacity, workload.framesInFlight);
+	ConstantRingAllocator ring(device, workload.ringCapacity, workload.framesInFlight);
+
+	uint32_t largest = workload.frameBlockSize;
+	largest = workload.viewBlockSize > largest ? workload.viewBlockSize : largest;
+	largest = workload.objectBlockSize > largest ? workload.objectBlockSize : largest;
+	largest = workload.effectBlockSize > largest ? workload.effectBlockSize : largest;
+	std::vector<uint8_t> block(largest, 0);
+
+	// What each slot is bound to, and which write put it there.
+	enum { FrameSlot, ViewSlot, ObjectSlot, EffectSlot, SlotCount };
+	ConstantBinding bound[SlotCount] = {};
+	uint64_t boundWrite[SlotCount] = {};
+	ConstantSlotBindings slots(ring, SlotCount);
+	ConstantSlotBindings::BindFunction bind = [&](const ConstantBinding& binding)
+	{
+		bound[binding.slot] = binding;
+		boundWrite[binding.slot] = device.GetWriteCount();
+	};
+	auto read = [&](uint32_t slot) { device.Read(bound[slot].offset, bound[slot].size, boundWrite[slot]); };
+
+	for (uint32_t frame = 0; frame < workload.frames; frame++)
+	{
+		device.SetFrame(frame);
+		std::fill(block.begin(), block.end(), (uint8_t)frame);
+
+		slots.Set(FrameSlot, 1, &block[0], workload.frameBlockSize, bind);
+		for (uint32_t view = 0; view < workload.views; view++)
+		{
+			slots.Set(ViewSlot, 1, &block[0], workload.viewBlockSize, bind);
+			for (uint32_t object = 0; object < workload.objects; object++)
+			{
+				slots.Set(ObjectSlot, 1, &block[0], workload.objectBlockSize, bind);
+				read(FrameSlot);
+				read(ViewSlot);
+				read(ObjectSlot);
+			}
+		}
+		for (uint32_t pass = 0; pass < workload.effectPasses; pass++)
+		{
+			slots.Set(EffectSlot, 1, &block[0], workload.effectBlockSize, bind);
+			read(FrameSlot);
+			read(EffectSlot);
+		}
+		ring.EndFrame();
+	}
+
+	ConstantUploadReport report;
+	report.splitBytesPerFrame = ring.GetBytesUploadedLastFrame();
+	report.monolithicBytesPerFrame = (uint64_t)workload.monolithicBlockSize * (workload.views * workload.objects + workload.effectPasses) +
+		(uint64_t)workload.effectBlockSize * workload.effectPasses;
+	report.deviceBytes = device.GetBytesWritten();
+	report.allocatorBytes = ring.GetBytesUploadedTotal();
+	report.discards = ring.GetDiscardCount();
+	report.overwriteErrors = device.GetOverwriteErrors();
+	report.staleReads = device.GetStaleReads();
+	report.reuploads = slots.GetReuploadCount();
+	report.countersMatch = report.deviceBytes == report.allocatorBytes && report.discards == device.GetDiscards();
+	return report;
+}
+#endif
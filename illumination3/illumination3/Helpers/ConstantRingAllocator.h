@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace DX
+{
+	// The one buffer operation the ring needs. DynamicConstantBuffer implements it with
+	// ID3D11DeviceContext::Map; MemoryConstantUploadDevice implements it in plain memory, so the
+	// allocator can be run and checked without a GPU.
+	class ConstantUploadDevice
+	{
+	public:
+		virtual ~ConstantUploadDevice() {}
+
+		// Copies size bytes to offset. With discard the previous contents may be thrown away
+		// (D3D11_MAP_WRITE_DISCARD); without it the caller promises not to touch anything the GPU
+		// may still be reading (D3D11_MAP_WRITE_NO_OVERWRITE).
+		virtual void Write(uint32_t offset, const void* data, uint32_t size, bool discard) = 0;
+	};
+
+	// Sub-allocates constant blocks from one dynamic buffer. Each block lands on a 256-byte
+	// boundary (what *SetConstantBuffers1 offsets need) and is written with no-overwrite, so
+	// there is no driver renaming per block. Space written in a frame is reused once
+	// framesInFlight frames have ended. If the ring runs full, the next write discards and
+	// the ring starts over.
+	//
+	// Without offset binding every upload discards and lands at offset 0: one block per
+	// buffer, bound whole, for devices that cannot bind a buffer at an offset.
+	class ConstantRingAllocator
+	{
+	public:
+		static const uint32_t Alignment = 256;
+
+		ConstantRingAllocator(ConstantUploadDevice& device, uint32_t capacity, uint32_t framesInFlight = 3, bool offsetBinding = true);
+
+		// Copies a block into the ring and returns its offset in bytes.
+		uint32_t Upload(const void* data, uint32_t size);
+
+		template <typename Block>
+		uint32_t Upload(const Block& block) { return Upload(&block, (uint32_t)sizeof(Block)); }
+
+		// Call once per frame, after the frame's last upload.
+		void EndFrame();
+
+		// Drops all in-flight bookkeeping; the next upload discards.
+		void Reset();
+
+		// Bytes of constant data copied (without alignment padding).
+		uint64_t GetBytesUploadedThisFrame() const	{ return m_bytesThisFrame; }
+		uint64_t GetBytesUploadedLastFrame() const	{ return m_bytesLastFrame; }
+		uint64_t GetBytesUploadedTotal() const		{ return m_bytesTotal; }
+		uint32_t GetUploadCount() const				{ return m_uploads; }
+		uint32_t GetDiscardCount() const			{ return m_discards; }
+		uint32_t GetCapacity() const				{ return m_capacity; }
+
+		static uint32_t AlignedSize(uint32_t size) { return (size + Alignment - 1) & ~(Alignment - 1); }
+
+	private:
+		ConstantUploadDevice& m_device;
+		uint32_t m_capacity;
+		uint32_t m_framesInFlight;
+		bool m_offsetBinding;
+
+		uint32_t m_head;					// where the next block goes
+		uint32_t m_used;					// bytes the GPU may still read, padding included
+		uint32_t m_frameUsed;				// bytes taken by the current frame
+		std::deque<uint32_t> m_frameSizes;	// bytes taken by each earlier frame still in flight
+		bool m_needsDiscard;
+
+		uint64_t m_bytesThisFrame;
+		uint64_t m_bytesLastFrame;
+		uint64_t m_bytesTotal;
+		uint32_t m_uploads;
+		uint32_t m_discards;
+	};
+
+	// A block as bound to a slot: where it sits in the ring and the ConstantStage bits it is
+	// bound for.
+	struct ConstantBinding
+	{
+		uint32_t slot;
+		uint32_t stages;
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	// Keeps a copy of the block each slot was last given, per stage, for a ring shared by all
+	// slots. A discard hands the ring fresh memory, so a block bound before it (the per-frame
+	// block, say) would be read from undefined contents by every later draw. When an upload
+	// discards, every block bound before the discard is uploaded again and bound anew.
+	class ConstantSlotBindings
+	{
+	public:
+		typedef std::function<void(const ConstantBinding&)> BindFunction;
+
+		ConstantSlotBindings(ConstantRingAllocator& ring, uint32_t slotCount);
+
+		// Uploads size bytes for slot and calls bind for it, then for each block uploaded
+		// again after a discard.
+		void Set(uint32_t slot, uint32_t stages, const void* data, uint32_t size, const BindFunction& bind);
+
+		// Blocks uploaded again after a discard, since construction.
+		uint32_t GetReuploadCount() const { return m_reuploads; }
+
+	private:
+		struct Block
+		{
+			uint32_t stages;
+			uint32_t discards;		// the ring's discard count once the block was written
+			std::vector<uint8_t> data;
+		};
+
+		ConstantRingAllocator& m_ring;
+		std::vector<std::vector<Block>> m_slots;	// per slot, one block per distinct set of stages
+		uint32_t m_reuploads;
+	};
+
+#if defined(DX_HEADLESS_CHECKS)
+	// ConstantUploadDevice over plain memory. Remembers which frame wrote every 256-byte slot
+	// and counts no-overwrite writes that land on a slot an in-flight frame wrote, which on a
+	// GPU would be a race. Read stands in for a draw: it counts blocks that a discard, or a
+	// later write to the same place, has taken away since they were written.
+	class MemoryConstantUploadDevice : public ConstantUploadDevice
+	{
+	public:
+		MemoryConstantUploadDevice(uint32_t capacity, uint32_t framesInFlight = 3);
+
+		virtual void Write(uint32_t offset, const void* data, uint32_t size, bool discard);
+
+		// A draw reading size bytes at offset, expecting what write number write put there
+		// (GetWriteCount() just after that write).
+		void Read(uint32_t offset, uint32_t size, uint64_t write);
+
+		// The frame the GPU is pretending to run; frames before frame - framesInFlight + 1 are done.
+		void SetFrame(uint32_t frame) { m_frame = frame; }
+
+		uint64_t GetBytesWritten() const		{ return m_bytesWritten; }
+		uint64_t GetWriteCount() const			{ return m_writes; }
+		uint32_t GetDiscards() const			{ return m_discards; }
+		uint32_t GetOverwriteErrors() const		{ return m_overwriteErrors; }
+		uint32_t GetStaleReads() const			{ return m_staleReads; }
+		const std::vector<uint8_t>& GetMemory() const { return m_memory; }
+
+	private:
+		std::vector<uint8_t> m_memory;
+		std::vector<int64_t> m_slotFrame;	// frame that last wrote each slot, -1 if none since the last discard
+		std::vector<uint64_t> m_slotWrite;	// write that last touched each slot, 0 if none since the last discard
+		uint32_t m_framesInFlight;
+		uint32_t m_frame;
+		uint64_t m_bytesWritten;
+		uint64_t m_writes;
+		uint32_t m_discards;
+		uint32_t m_overwriteErrors;
+		uint32_t m_staleReads;
+	};
+
+	// What a frame uploads: a per-frame block, one per view, one per object per view and one
+	// per effect pass.
+	struct ConstantUploadWorkload
+	{
+		uint32_t frameBlockSize;
+		uint32_t viewBlockSize;
+		uint32_t objectBlockSize;
+		uint32_t effectBlockSize;
+		uint32_t monolithicBlockSize;	// the old all-in-one buffer, rewritten for every draw
+		uint32_t views;
+		uint32_t objects;
+		uint32_t effectPasses;
+		uint32_t frames;
+		uint32_t ringCapacity;
+		uint32_t framesInFlight;
+	};
+
+	struct ConstantUploadReport
+	{
+		uint64_t splitBytesPerFrame;		// counted by the allocator, last frame
+		uint64_t monolithicBytesPerFrame;	// one full monolithic block per draw, plus the effect blocks
+		uint64_t deviceBytes;				// seen by the mock device over all frames
+		uint64_t allocatorBytes;			// counted by the allocator over all frames
+		uint32_t discards;
+		uint32_t overwriteErrors;
+		uint32_t staleReads;				// draws that would have read a block lost to a discard
+		uint32_t reuploads;					// blocks uploaded again after a discard
+		bool countersMatch;
+	};
+
+	// Runs the workload through a ConstantRingAllocator on a MemoryConstantUploadDevice, bound
+	// through ConstantSlotBindings the way ConstantBufferRing binds it (b0 frame, b1 view, b2
+	// object, b3 effect). Every object draw reads b0 to b2 and every effect pass b0 and b3.
+	// Per-frame and per-view blocks go up once per frame however many objects and passes use
+	// them; the monolithic scheme repeats them for every draw.
+	ConstantUploadReport SimulateConstantUploads(const ConstantUploadWorkload& workload);
+#endif
+}
@@ -222,6 +222,7 @@ void DX::DeviceResources::CreateWindowSizeDependentResources()
 	m_d2dContext->SetTarget(nullptr);
 	m_d2dTargetBitmap = nullptr;
 	m_d3dDepthStencilView = nullptr;
+	m_d3dDepthShaderResourceView = nullptr;
 	m_d3dContext->Flush();
 
     if (m_swapChainPanel != nullptr)
@@ -603,14 +604,16 @@ void DX::DeviceResources::CreateWindowSizeDependentResources()
 			);
 	}
 	
-	// Create a depth stencil view for use with 3D rendering if needed.
+	// Create a depth stencil view for use with 3D rendering if needed. From feature level 10_0
+	// the texture is typeless so that a shader resource view can read the depth as well.
+	bool readableDepth = m_d3dFeatureLevel >= D3D_FEATURE_LEVEL_10_0;
 	CD3D11_TEXTURE2D_DESC depthStencilDesc(
-		DXGI_FORMAT_D24_UNORM_S8_UINT,
+		readableDepth ? DXGI_FORMAT_R24G8_TYPELESS : DXGI_FORMAT_D24_UNORM_S8_UINT,
 		static_cast<UINT>(m_d3dRenderTargetSize.Width),
 		static_cast<UINT>(m_d3dRenderTargetSize.Height),
 		1, // This depth stencil view has only one texture.
 		1, // Use a single mipmap level.
-		D3D11_BIND_DEPTH_STENCIL
+		D3D11_BIND_DEPTH_STENCIL | (readableDepth ? D3D11_BIND_SHADER_RESOURCE : 0)
 		);
 
 	ComPtr<ID3D11Texture2D> depthStencil;
@@ -622,7 +625,7 @@ void DX::DeviceResources::CreateWindowSizeDependentResources()
 		)
 		);
 
-	CD3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc(D3D11_DSV_DIMENSION_TEXTURE2D);
+	CD3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc(D3D11_DSV_DIMENSION_TEXTURE2D, DXGI_FORMAT_D24_UNORM_S8_UINT);
 	DX::ThrowIfFailed(
 		m_d3dDevice->CreateDepthStencilView(
 		depthStencil.Get(),
@@ -631,6 +634,18 @@ void DX::DeviceResources::CreateWindowSizeDependentResources()
 		)
 		);
 
+	if (readableDepth)
+	{
+		CD3D11_SHADER_RESOURCE_VIEW_DESC depthViewDesc(D3D11_SRV_DIMENSION_TEXTURE2D, DXGI_FORMAT_R24_UNORM_X8_TYPELESS);
+		DX::ThrowIfFailed(
+			m_d3dDevice->CreateShaderResourceView(
+			depthStencil.Get(),
+			&depthViewDesc,
+			&m_d3dDepthShaderResourceView
+			)
+			);
+	}
+
 	// Set the 3D rendering viewport to target the entire window.
 	m_screenViewport = CD3D11_VIEWPORT(
 		0.0f,
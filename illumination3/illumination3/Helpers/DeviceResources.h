@@ -46,6 +46,9 @@ namespace DX
 		ID3D11RenderTargetView*	GetBackBufferRenderTargetView() const	{ return m_d3dRenderTargetView.Get(); }
 		ID3D11RenderTargetView*	GetForegroundRenderTargetView() const	{ return m_d3dForegroundRenderTargetView.Get(); }
 		ID3D11DepthStencilView* GetDepthStencilView() const				{ return m_d3dDepthStencilView.Get(); }
+		// The same depth as a texture (R24_UNORM_X8_TYPELESS), readable while the depth-stencil
+		// view is not bound. Null below feature level 10_0, which cannot sample depth.
+		ID3D11ShaderResourceView* GetDepthShaderResourceView() const	{ return m_d3dDepthShaderResourceView.Get(); }
 		D3D11_VIEWPORT			GetScreenViewport() const				{ return m_screenViewport; }
 		DirectX::XMFLOAT4X4		GetOrientationTransform3D() const		{ return m_orientationTransform3D; }
 
@@ -75,6 +78,7 @@ namespace DX
 		Microsoft::WRL::ComPtr<ID3D11RenderTargetView> m_d3dForegroundRenderTargetView;
 
 		Microsoft::WRL::ComPtr<ID3D11DepthStencilView>	m_d3dDepthStencilView;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_d3dDepthShaderResourceView;
 		D3D11_VIEWPORT									m_screenViewport;
 
 		// Direct2D drawing components.
@@ -0,0 +1,77 @@
+#include "LinearArena.h"
+
+#include <stdexcept>
+
+using namespace DX;
+
+LinearArena::LinearArena(size_t blockSize) :
+	m_blockSize(blockSize),
+	m_current(0),
+	m_bytesAllocated(0),
+	m_bytesReserved(0)
+{
+	if (m_blockSize == 0)
+	{
+		throw std::invalid_argument("arena block size of zero");
+	}
+}
+
+void* LinearArena::Allocate(size_t size, size_t alignment)
+{
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+	{
+		throw std::invalid_argument("arena alignment must be a power of two");
+	}
+
+	// Blocks before m_current are full enough that earlier requests moved on; later ones are
+	// either untouched since the last reset or were skipped for a larger request.
+	for (size_t b = m_current; b < m_blocks.size(); b++)
+	{
+		Block& block = m_blocks[b];
+		uintptr_t base = reinterpret_cast<uintptr_t>(block.memory.get());
+		uintptr_t start = (base + block.used + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		if (start + size <= base + block.size)
+		{
+			block.used = start + size - base;
+			m_bytesAllocated += size;
+			if (block.used == block.size)
+			{
+				m_current = b + 1;
+			}
+			return reinterpret_cast<void*>(start);
+		}
+	}
+
+	// New block, with room for the alignment padding.
+	Block block;
+	block.size = (size + alignment > m_blockSize ? size + alignment : m_blockSize);
+	block.memory.reset(new uint8_t[block.size]);
+	block.used = 0;
+	m_bytesReserved += block.size;
+	m_blocks.push_back(std::move(block));
+
+	Block& added = m_blocks.back();
+	uintptr_t base = reinterpret_cast<uintptr_t>(added.memory.get());
+	uintptr_t start = (base + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	added.used = start + size - base;
+	m_bytesAllocated += size;
+	return reinterpret_cast<void*>(start);
+}
+
+void LinearArena::Reset()
+{
+	for (auto& block : m_blocks)
+	{
+		block.used = 0;
+	}
+	m_current = 0;
+	m_bytesAllocated = 0;
+}
+
+void LinearArena::Release()
+{
+	m_blocks.clear();
+	m_current = 0;
+	m_bytesAllocated = 0;
+	m_bytesReserved = 0;
+}
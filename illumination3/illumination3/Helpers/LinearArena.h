@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace DX
+{
+	// Bump allocator for data that is built, used and thrown away together, such as the
+	// geometry generated at load time before it goes into vertex buffers. Memory comes in
+	// blocks of blockSize bytes (an allocation larger than that gets a block of its own);
+	// Reset rewinds every block without freeing it, so the next batch reuses the memory.
+	// Allocation is not thread-safe; filling what was allocated from many threads is fine.
+	class LinearArena
+	{
+	public:
+		static const size_t DefaultBlockSize = 4 << 20;
+		static const size_t DefaultAlignment = 16;
+
+		explicit LinearArena(size_t blockSize = DefaultBlockSize);
+
+		// size bytes aligned to alignment (a power of two). Never returns null; the memory is
+		// not cleared.
+		void* Allocate(size_t size, size_t alignment = DefaultAlignment);
+
+		template <typename T>
+		T* Allocate(size_t count) { return static_cast<T*>(Allocate(count * sizeof(T), alignof(T) > DefaultAlignment ? alignof(T) : DefaultAlignment)); }
+
+		// Makes all the memory available again. Pointers handed out before are dangling.
+		void Reset();
+
+		// Drops every block.
+		void Release();
+
+		size_t GetBytesAllocated() const	{ return m_bytesAllocated; }
+		size_t GetBytesReserved() const		{ return m_bytesReserved; }
+		size_t GetBlockCount() const		{ return m_blocks.size(); }
+
+	private:
+		struct Block
+		{
+			std::unique_ptr<uint8_t[]> memory;
+			size_t size;
+			size_t used;
+		};
+
+		size_t m_blockSize;
+		std::vector<Block> m_blocks;
+		size_t m_current;			// first block that may still have room
+		size_t m_bytesAllocated;	// handed out since the last reset, without alignment padding
+		size_t m_bytesReserved;
+	};
+}
@@ -0,0 +1,162 @@
+#include "MappedFile.h"
+
+#include <cstdio>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace DX;
+
+namespace
+{
+#if !defined(_WIN32)
+	// Cache paths are plain ASCII off Windows.
+	std::string Narrow(const std::wstring& path)
+	{
+		return std::string(path.begin(), path.end());
+	}
+#endif
+}
+
+MappedFile::MappedFile() :
+	m_data(nullptr),
+	m_size(0),
+	m_file(nullptr),
+	m_mapping(nullptr)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::wstring& path)
+{
+	Close();
+#if defined(_WIN32)
+	HANDLE file = CreateFile2(path.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	m_file = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || (unsigned long long)size.QuadPart > (size_t)-1)
+	{
+		Close();
+		return false;
+	}
+	m_mapping = CreateFileMappingFromApp(file, nullptr, PAGE_READONLY, 0, nullptr);
+	if (!m_mapping)
+	{
+		Close();
+		return false;
+	}
+	m_data = MapViewOfFileFromApp(m_mapping, FILE_MAP_READ, 0, 0);
+	if (!m_data)
+	{
+		Close();
+		return false;
+	}
+	m_size = (size_t)size.QuadPart;
+#else
+	int file = open(Narrow(path).c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		return false;
+	}
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0)
+	{
+		close(file);
+		return false;
+	}
+	void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	// The mapping keeps the file alive on its own.
+	close(file);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+	m_data = data;
+	m_size = (size_t)info.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::Close()
+{
+#if defined(_WIN32)
+	if (m_data)
+	{
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping)
+	{
+		CloseHandle(m_mapping);
+	}
+	if (m_file)
+	{
+		CloseHandle(m_file);
+	}
+#else
+	if (m_data)
+	{
+		munmap(const_cast<void*>(m_data), m_size);
+	}
+#endif
+	m_data = nullptr;
+	m_size = 0;
+	m_file = nullptr;
+	m_mapping = nullptr;
+}
+
+bool DX::WriteFileAtomically(const std::wstring& path, const void* data, size_t size)
+{
+	std::wstring temporary = path + L".tmp";
+#if defined(_WIN32)
+	HANDLE file = CreateFile2(temporary.c_str(), GENERIC_WRITE, 0, CREATE_ALWAYS, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	bool written = true;
+	const char* bytes = static_cast<const char*>(data);
+	for (size_t offset = 0; written && offset < size;)
+	{
+		DWORD chunk = (DWORD)(size - offset < 0x40000000 ? size - offset : 0x40000000);
+		DWORD done = 0;
+		written = WriteFile(file, bytes + offset, chunk, &done, nullptr) && done == chunk;
+		offset += done;
+	}
+	CloseHandle(file);
+	if (!written || !MoveFileExW(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileW(temporary.c_str());
+		return false;
+	}
+#else
+	std::string narrowTemporary = Narrow(temporary);
+	FILE* file = std::fopen(narrowTemporary.c_str(), "wb");
+	if (!file)
+	{
+		return false;
+	}
+	bool written = std::fwrite(data, 1, size, file) == size;
+	written = std::fclose(file) == 0 && written;
+	if (!written || std::rename(narrowTemporary.c_str(), Narrow(path).c_str()) != 0)
+	{
+		std::remove(narrowTemporary.c_str());
+		return false;
+	}
+#endif
+	return true;
+}
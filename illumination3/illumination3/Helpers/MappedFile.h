@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace DX
+{
+	// A whole file mapped read-only into memory. The pages are the file's own, so nothing is
+	// copied until something touches them. Windows uses the *FromApp mapping functions, which
+	// Store apps may call; elsewhere mmap.
+	class MappedFile
+	{
+	public:
+		MappedFile();
+		~MappedFile();
+
+		// False if the file does not exist, is empty or cannot be mapped; the file is closed
+		// either way first.
+		bool Open(const std::wstring& path);
+		void Close();
+
+		const void* GetData() const { return m_data; }
+		size_t GetSize() const { return m_size; }
+
+	private:
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+
+		const void* m_data;
+		size_t m_size;
+		void* m_file;
+		void* m_mapping;
+	};
+
+	// Writes data to path + ".tmp" and renames it over path, so a reader never maps a half
+	// written file. False if either step fails.
+	bool WriteFileAtomically(const std::wstring& path, const void* data, size_t size);
+}
@@ -0,0 +1,207 @@
+#include "ParallelFor.h"
+
+#if defined(DX_HEADLESS_CHECKS)
+#include <chrono>
+#endif
+
+using namespace DX;
+
+WorkerPool::WorkerPool(unsigned int threads) :
+	m_generation(0),
+	m_stopping(false),
+	m_helpers(0),
+	m_active(0),
+	m_call(nullptr),
+	m_func(nullptr),
+	m_count(0),
+	m_next(0)
+{
+	m_threads.reserve(threads);
+	for (unsigned int t = 0; t < threads; t++)
+	{
+		m_threads.push_back(std::thread(&WorkerPool::WorkerLoop, this, t));
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+		m_generation++;
+	}
+	m_wake.notify_all();
+	for (auto& thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+WorkerPool& WorkerPool::Get()
+{
+	// Never destroyed: joining the threads from a static destructor would race the runtime
+	// tearing them down at exit.
+	static std::once_flag created;
+	static WorkerPool* pool = nullptr;
+	std::call_once(created, []() { pool = new WorkerPool(GetWorkerCount() - 1); });
+	return *pool;
+}
+
+void WorkerPool::Dispatch(unsigned int count, unsigned int workers, void (*call)(const void*, unsigned int), const void* func)
+{
+	std::unique_lock<std::mutex> running(m_running, std::try_to_lock);
+	unsigned int helpers = std::min(workers - 1, (unsigned int)m_threads.size());
+	if (!running.owns_lock() || helpers == 0)
+	{
+		for (unsigned int i = 0; i < count; i++)
+		{
+			call(func, i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_call = call;
+		m_func = func;
+		m_count = count;
+		m_next = 0;
+		m_helpers = helpers;
+		m_active = helpers;
+		m_generation++;
+	}
+	m_wake.notify_all();
+
+	RunItems();
+
+	// The helpers read func off this caller's stack, so they have to be finished with it
+	// before an exception from func, on whichever thread, leaves here.
+	std::exception_ptr error;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this]() { return m_active == 0; });
+		std::swap(error, m_error);
+	}
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
+
+void WorkerPool::RunItems()
+{
+	try
+	{
+		for (unsigned int i = m_next++; i < m_count; i = m_next++)
+		{
+			m_call(m_func, i);
+		}
+	}
+	catch (...)
+	{
+		// The first throw wins; the items nobody has taken yet are skipped.
+		m_next = m_count;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_error)
+		{
+			m_error = std::current_exception();
+		}
+	}
+}
+
+void WorkerPool::WorkerLoop(unsigned int index)
+{
+	uint64_t seen = 0;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		m_wake.wait(lock, [&]() { return m_generation != seen; });
+		seen = m_generation;
+		if (m_stopping)
+		{
+			return;
+		}
+		if (index >= m_helpers)
+		{
+			continue;
+		}
+
+		lock.unlock();
+		RunItems();
+		lock.lock();
+		if (--m_active == 0)
+		{
+			m_done.notify_one();
+		}
+	}
+}
+
+#if defined(DX_HEADLESS_CHECKS)
+ParallelForReport DX::ValidateParallelFor(unsigned int threads, unsigned int calls)
+{
+	ParallelForReport report = {};
+	WorkerPool pool(threads);
+	const unsigned int workers = threads + 1;
+	report.threads = pool.GetThreadCount();
+
+	// Flat, then 64 loops of 64 started from inside a loop, which run on their callers.
+	const unsigned int items = 64 * 64;
+	std::vector<std::atomic<unsigned int>> hits(items);
+	pool.Run(items, workers, [&](unsigned int i) { hits[i]++; });
+	pool.Run(64, workers, [&](unsigned int outer)
+	{
+		pool.Run(64, workers, [&](unsigned int inner) { hits[outer * 64 + inner]++; });
+	});
+	std::atomic<unsigned int> total(0);
+	for (unsigned int call = 0; call < calls; call++)
+	{
+		pool.Run(workers, workers, [&](unsigned int) { total++; });
+	}
+	report.everyItemOnce = total == calls * workers;
+	for (unsigned int i = 0; i < items; i++)
+	{
+		report.everyItemOnce &= hits[i] == 2;
+	}
+
+	try
+	{
+		pool.Run(items, workers, [](unsigned int i)
+		{
+			if (i == items / 2)
+			{
+				throw std::out_of_range("ValidateParallelFor");
+			}
+		});
+	}
+	catch (const std::out_of_range&)
+	{
+		total = 0;
+		pool.Run(items, workers, [&](unsigned int) { total++; });
+		report.exceptionPropagates = total == items;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int call = 0; call < calls; call++)
+	{
+		pool.Run(workers, workers, [](unsigned int) {});
+	}
+	auto pooled = std::chrono::high_resolution_clock::now();
+	for (unsigned int call = 0; call < calls; call++)
+	{
+		std::vector<std::thread> spawned;
+		for (unsigned int t = 0; t < threads; t++)
+		{
+			spawned.push_back(std::thread([]() {}));
+		}
+		for (auto& thread : spawned)
+		{
+			thread.join();
+		}
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	report.poolMicroseconds = std::chrono::duration<double, std::micro>(pooled - start).count() / calls;
+	report.spawnMicroseconds = std::chrono::duration<double, std::micro>(end - pooled).count() / calls;
+	return report;
+}
+#endif
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+// Portable work splitting for the CPU versions of the renderer. Uses std::thread
+// rather than the PPL so the same code runs on headless Linux boxes.
+namespace DX
+{
+	// Number of workers used by ParallelFor; at least one.
+	inline unsigned int GetWorkerCount()
+	{
+		unsigned int n = std::thread::hardware_concurrency();
+		return n == 0 ? 1 : n;
+	}
+
+	// Threads that wait for loops to help with, so ParallelFor on the per-frame path costs a
+	// wake-up rather than creating and joining threads on every call. One loop runs at a
+	// time; a loop issued while another is running (from inside its func, or from a second
+	// thread) runs on its caller alone.
+	class WorkerPool
+	{
+	public:
+		explicit WorkerPool(unsigned int threads);
+		~WorkerPool();
+
+		// The pool ParallelFor uses: GetWorkerCount() - 1 threads, started on first use and
+		// kept for the life of the process.
+		static WorkerPool& Get();
+
+		unsigned int GetThreadCount() const { return (unsigned int)m_threads.size(); }
+
+		// Calls func(i) for every i in [0, count) on the caller and up to workers - 1 pool
+		// threads, and returns once every item is done. The first exception func throws, on
+		// any thread, is rethrown here after the items not yet started are dropped.
+		template <typename Func>
+		void Run(unsigned int count, unsigned int workers, const Func& func)
+		{
+			struct Thunk
+			{
+				static void Call(const void* f, unsigned int i) { (*static_cast<const Func*>(f))(i); }
+			};
+			Dispatch(count, workers, &Thunk::Call, &func);
+		}
+
+	private:
+		WorkerPool(const WorkerPool&);
+		WorkerPool& operator=(const WorkerPool&);
+
+		void Dispatch(unsigned int count, unsigned int workers, void (*call)(const void*, unsigned int), const void* func);
+		void WorkerLoop(unsigned int index);
+		void RunItems();
+
+		std::vector<std::thread> m_threads;
+		std::mutex m_running;				// held by the caller for a whole loop
+		std::mutex m_mutex;					// guards everything below
+		std::condition_variable m_wake;
+		std::condition_variable m_done;
+		uint64_t m_generation;
+		bool m_stopping;
+		unsigned int m_helpers;				// pool threads taking part in the current loop
+		unsigned int m_active;				// of those, the ones not finished yet
+		void (*m_call)(const void*, unsigned int);
+		const void* m_func;
+		unsigned int m_count;
+		std::atomic<unsigned int> m_next;
+		std::exception_ptr m_error;
+	};
+
+	// Calls func(i) for every i in [0, count). Items are handed out through an
+	// atomic counter, so uneven items (e.g. tiles that hit an early-out) balance
+	// themselves across the workers. The calling thread takes part in the work.
+	template <typename Func>
+	void ParallelFor(unsigned int count, const Func& func, unsigned int maxWorkers = 0)
+	{
+		unsigned int workers = maxWorkers == 0 ? GetWorkerCount() : maxWorkers;
+		workers = std::min(workers, count);
+		if (workers <= 1)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				func(i);
+			}
+			return;
+		}
+
+		WorkerPool::Get().Run(count, workers, func);
+	}
+
+	// A rectangle of pixels handed to one worker.
+	struct Tile
+	{
+		unsigned int x0, y0, x1, y1;
+	};
+
+	// Splits a width x height image into tileSize x tileSize tiles, row-major. Throws
+	// std::invalid_argument for a zero tileSize.
+	inline std::vector<Tile> MakeTiles(unsigned int width, unsigned int height, unsigned int tileSize)
+	{
+		if (tileSize == 0)
+		{
+			throw std::invalid_argument("tiles of size zero");
+		}
+
+		std::vector<Tile> tiles;
+		for (unsigned int y = 0; y < height; y += std::min(tileSize, height - y))
+		{
+			for (unsigned int x = 0; x < width; x += std::min(tileSize, width - x))
+			{
+				Tile tile = { x, y, x + std::min(tileSize, width - x), y + std::min(tileSize, height - y) };
+				tiles.push_back(tile);
+			}
+		}
+		return tiles;
+	}
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct ParallelForReport
+	{
+		unsigned int threads;			// pool threads helping the caller
+		bool everyItemOnce;				// flat, nested and back-to-back loops each ran every item once
+		bool exceptionPropagates;		// a throw from func reaches the caller and the pool still works
+		double poolMicroseconds;		// one loop of threads + 1 empty items through the pool
+		double spawnMicroseconds;		// the same creating and joining the threads for the loop
+	};
+
+	// Runs loops on a pool of the given number of threads, so the hand-off is exercised even
+	// on a single-core machine, and times calls loops each way.
+	ParallelForReport ValidateParallelFor(unsigned int threads = 3, unsigned int calls = 2000);
+#endif
+}
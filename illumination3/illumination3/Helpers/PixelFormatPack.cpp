@@ -0,0 +1,336 @@
+#include "PixelFormatPack.h"
+#include "SimdFloat4.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace DX;
+
+namespace
+{
+	inline uint32_t AsUint(float f)		{ uint32_t u; std::memcpy(&u, &f, 4); return u; }
+	inline float AsFloat(uint32_t u)	{ float f; std::memcpy(&f, &u, 4); return f; }
+
+	// Float bit pattern of the largest finite 11-bit (M = 6) or 10-bit (M = 5) float.
+	inline uint32_t SmallFloatMaxBits(int mantissaBits)
+	{
+		return (142u << 23) | (((1u << mantissaBits) - 1) << (23 - mantissaBits));
+	}
+
+	inline float Clamp01(float v)
+	{
+		// Written so NaN ends up as 0, like the GPU's UNORM conversion.
+		return v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f;
+	}
+
+#if defined(DX_SIMD_SSE2)
+	inline __m128i Select(__m128i a, __m128i b, __m128i mask)
+	{
+		return _mm_or_si128(_mm_andnot_si128(mask, a), _mm_and_si128(mask, b));
+	}
+
+	// Four floats to four halves in the low 16 bits of each lane (sign-extended, ready for _mm_packs_epi32).
+	inline __m128i FloatToHalfSse2(__m128 f)
+	{
+		const __m128i f16Max = _mm_set1_epi32((127 + 16) << 23);
+		const __m128i minNormal = _mm_set1_epi32((127 - 14) << 23);
+		const __m128i subnormalMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+		const __m128i normalBias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+
+		__m128 justSign = _mm_and_ps(f, _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000)));
+		__m128 absF = _mm_xor_ps(f, justSign);
+		__m128i absBits = _mm_castps_si128(absF);
+
+		__m128 isNaN = _mm_cmpunord_ps(absF, absF);
+		__m128i isRegular = _mm_cmpgt_epi32(f16Max, absBits);
+		__m128i infOrNaN = _mm_or_si128(_mm_and_si128(_mm_castps_si128(isNaN), _mm_set1_epi32(0x200)), _mm_set1_epi32(0x7c00));
+
+		// Subnormal results: let the FPU round by adding a magic number.
+		__m128i isSubnormal = _mm_cmpgt_epi32(minNormal, absBits);
+		__m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absF, _mm_castsi128_ps(subnormalMagic))), subnormalMagic);
+
+		// Normal results: rebias the exponent and round to nearest even.
+		__m128i mantissaOdd = _mm_srai_epi32(_mm_slli_epi32(absBits, 31 - 13), 31);
+		__m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absBits, normalBias), mantissaOdd), 13);
+
+		__m128i finite = Select(normal, subnormal, isSubnormal);
+		__m128i joined = Select(infOrNaN, finite, isRegular);
+		return _mm_or_si128(joined, _mm_srai_epi32(_mm_castps_si128(justSign), 16));
+	}
+
+	// Four halves (zero-extended to 32 bits) to four floats.
+	inline __m128 HalfToFloatSse2(__m128i h)
+	{
+		const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+		__m128i expMantissa = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+		__m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expMantissa), 16);
+		__m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMantissa, 13)), magic);
+		__m128i wasInfNaN = _mm_cmpgt_epi32(expMantissa, _mm_set1_epi32(0x7bff));
+		__m128 infNaNExponent = _mm_and_ps(_mm_castsi128_ps(wasInfNaN), _mm_castsi128_ps(_mm_set1_epi32(255 << 23)));
+		return _mm_or_ps(scaled, _mm_or_ps(_mm_castsi128_ps(sign), infNaNExponent));
+	}
+
+	// Four floats to unsigned small floats with M mantissa bits and a 5-bit exponent.
+	template <int M>
+	inline __m128i FloatToSmallFloatSse2(__m128 f)
+	{
+		const int shift = 23 - M;
+		__m128i bits = _mm_castps_si128(f);
+		__m128i magnitude = _mm_and_si128(bits, _mm_set1_epi32(0x7fffffff));
+		__m128i negative = _mm_cmplt_epi32(bits, _mm_setzero_si128());
+
+		__m128i rebased = _mm_sub_epi32(magnitude, _mm_set1_epi32(112 << 23));
+		__m128i odd = _mm_and_si128(_mm_srli_epi32(rebased, shift), _mm_set1_epi32(1));
+		__m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(rebased, _mm_set1_epi32((1 << (shift - 1)) - 1)), odd), shift);
+		__m128i subnormal = _mm_cvtps_epi32(_mm_mul_ps(_mm_castsi128_ps(magnitude), _mm_set1_ps((float)(1 << (14 + M)))));
+		__m128i result = Select(normal, subnormal, _mm_cmplt_epi32(magnitude, _mm_set1_epi32(0x38800000)));
+
+		result = Select(result, _mm_set1_epi32((30 << M) | ((1 << M) - 1)), _mm_cmpgt_epi32(magnitude, _mm_set1_epi32((int)SmallFloatMaxBits(M))));
+		result = Select(result, _mm_set1_epi32(31 << M), _mm_cmpeq_epi32(magnitude, _mm_set1_epi32(0x7f800000)));
+		__m128i isNaN = _mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x7f800000));
+		result = Select(result, _mm_set1_epi32((31 << M) | ((1 << M) - 1)), isNaN);
+		return _mm_andnot_si128(_mm_andnot_si128(isNaN, negative), result);
+	}
+
+	template <int M>
+	inline __m128 SmallFloatToFloatSse2(__m128i v)
+	{
+		const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+		__m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(v, 23 - M)), magic);
+		__m128i wasInfNaN = _mm_cmpgt_epi32(v, _mm_set1_epi32((31 << M) - 1));
+		return _mm_or_ps(scaled, _mm_and_ps(_mm_castsi128_ps(wasInfNaN), _mm_castsi128_ps(_mm_set1_epi32(255 << 23))));
+	}
+#endif
+}
+
+uint16_t DX::FloatToHalf(float value)
+{
+	uint32_t f = AsUint(value);
+	uint32_t sign = f & 0x80000000u;
+	f ^= sign;
+
+	uint32_t o;
+	if (f >= 0x47800000u)
+	{
+		o = f > 0x7f800000u ? 0x7e00u : 0x7c00u;
+	}
+	else if (f < 0x38800000u)
+	{
+		const uint32_t magic = ((127 - 15) + (23 - 10) + 1) << 23;
+		o = AsUint(AsFloat(f) + AsFloat(magic)) - magic;
+	}
+	else
+	{
+		uint32_t mantissaOdd = (f >> 13) & 1;
+		f += ((uint32_t)(15 - 127) << 23) + 0xfff;
+		f += mantissaOdd;
+		o = f >> 13;
+	}
+	return (uint16_t)(o | (sign >> 16));
+}
+
+float DX::HalfToFloat(uint16_t value)
+{
+	uint32_t expMantissa = value & 0x7fffu;
+	uint32_t o = AsUint(AsFloat(expMantissa << 13) * AsFloat((254 - 15) << 23));
+	if (expMantissa > 0x7bffu)
+	{
+		o |= 255u << 23;
+	}
+	return AsFloat(o | ((uint32_t)(value & 0x8000u) << 16));
+}
+
+uint32_t DX::FloatToSmallFloat(float value, int mantissaBits)
+{
+	const int shift = 23 - mantissaBits;
+	uint32_t bits = AsUint(value);
+	uint32_t magnitude = bits & 0x7fffffffu;
+
+	if (magnitude > 0x7f800000u)
+	{
+		return (31u << mantissaBits) | ((1u << mantissaBits) - 1);
+	}
+	if (bits & 0x80000000u)
+	{
+		return 0;
+	}
+	if (magnitude == 0x7f800000u)
+	{
+		return 31u << mantissaBits;
+	}
+	if (magnitude > SmallFloatMaxBits(mantissaBits))
+	{
+		return (30u << mantissaBits) | ((1u << mantissaBits) - 1);
+	}
+	if (magnitude < 0x38800000u)
+	{
+		// Below the smallest normal: the value is a plain fixed-point count of 2^-(14 + M).
+		return (uint32_t)std::lrint(AsFloat(magnitude) * (float)(1 << (14 + mantissaBits)));
+	}
+
+	uint32_t rebased = magnitude - (112u << 23);
+	return (rebased + ((1u << (shift - 1)) - 1) + ((rebased >> shift) & 1)) >> shift;
+}
+
+float DX::SmallFloatToFloat(uint32_t value, int mantissaBits)
+{
+	uint32_t o = AsUint(AsFloat(value << (23 - mantissaBits)) * AsFloat((254 - 15) << 23));
+	if (value >= (31u << mantissaBits))
+	{
+		o |= 255u << 23;
+	}
+	return AsFloat(o);
+}
+
+void DX::PackHalf4(const float* src, uint16_t* dst, size_t pixels)
+{
+	size_t i = 0;
+#if defined(DX_SIMD_SSE2)
+	for (; i + 2 <= pixels; i += 2)
+	{
+		__m128i a = FloatToHalfSse2(_mm_loadu_ps(src + i * 4));
+		__m128i b = FloatToHalfSse2(_mm_loadu_ps(src + i * 4 + 4));
+		_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_packs_epi32(a, b));
+	}
+#endif
+	for (; i < pixels; i++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			dst[i * 4 + c] = FloatToHalf(src[i * 4 + c]);
+		}
+	}
+}
+
+void DX::UnpackHalf4(const uint16_t* src, float* dst, size_t pixels)
+{
+	size_t i = 0;
+#if defined(DX_SIMD_SSE2)
+	for (; i + 2 <= pixels; i += 2)
+	{
+		__m128i h = _mm_loadu_si128((const __m128i*)(src + i * 4));
+		_mm_storeu_ps(dst + i * 4, HalfToFloatSse2(_mm_unpacklo_epi16(h, _mm_setzero_si128())));
+		_mm_storeu_ps(dst + i * 4 + 4, HalfToFloatSse2(_mm_unpackhi_epi16(h, _mm_setzero_si128())));
+	}
+#endif
+	for (; i < pixels; i++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			dst[i * 4 + c] = HalfToFloat(src[i * 4 + c]);
+		}
+	}
+}
+
+void DX::PackR11G11B10(const float* src, uint32_t* dst, size_t pixels)
+{
+	size_t i = 0;
+#if defined(DX_SIMD_SSE2)
+	// Four pixels at a time, transposed so each channel is one vector.
+	for (; i + 4 <= pixels; i += 4)
+	{
+		__m128 r = _mm_loadu_ps(src + i * 4);
+		__m128 g = _mm_loadu_ps(src + i * 4 + 4);
+		__m128 b = _mm_loadu_ps(src + i * 4 + 8);
+		__m128 a = _mm_loadu_ps(src + i * 4 + 12);
+		_MM_TRANSPOSE4_PS(r, g, b, a);
+
+		__m128i packed = _mm_or_si128(
+			_mm_or_si128(FloatToSmallFloatSse2<6>(r), _mm_slli_epi32(FloatToSmallFloatSse2<6>(g), 11)),
+			_mm_slli_epi32(FloatToSmallFloatSse2<5>(b), 22));
+		_mm_storeu_si128((__m128i*)(dst + i), packed);
+	}
+#endif
+	for (; i < pixels; i++)
+	{
+		const float* p = src + i * 4;
+		dst[i] = FloatToSmallFloat(p[0], 6) | (FloatToSmallFloat(p[1], 6) << 11) | (FloatToSmallFloat(p[2], 5) << 22);
+	}
+}
+
+void DX::UnpackR11G11B10(const uint32_t* src, float* dst, size_t pixels)
+{
+	size_t i = 0;
+#if defined(DX_SIMD_SSE2)
+	for (; i + 4 <= pixels; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i mask11 = _mm_set1_epi32(0x7ff);
+		__m128 r = SmallFloatToFloatSse2<6>(_mm_and_si128(v, mask11));
+		__m128 g = SmallFloatToFloatSse2<6>(_mm_and_si128(_mm_srli_epi32(v, 11), mask11));
+		__m128 b = SmallFloatToFloatSse2<5>(_mm_srli_epi32(v, 22));
+		__m128 a = _mm_set1_ps(1.0f);
+		_MM_TRANSPOSE4_PS(r, g, b, a);
+		_mm_storeu_ps(dst + i * 4, r);
+		_mm_storeu_ps(dst + i * 4 + 4, g);
+		_mm_storeu_ps(dst + i * 4 + 8, b);
+		_mm_storeu_ps(dst + i * 4 + 12, a);
+	}
+#endif
+	for (; i < pixels; i++)
+	{
+		float* p = dst + i * 4;
+		p[0] = SmallFloatToFloat(src[i] & 0x7ff, 6);
+		p[1] = SmallFloatToFloat((src[i] >> 11) & 0x7ff, 6);
+		p[2] = SmallFloatToFloat(src[i] >> 22, 5);
+		p[3] = 1.0f;
+	}
+}
+
+void DX::PackRGBA8(const float* src, uint32_t* dst, size_t pixels)
+{
+	size_t i = 0;
+#if defined(DX_SIMD_SSE2)
+	const __m128 scale = _mm_set1_ps(255.0f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	for (; i + 4 <= pixels; i += 4)
+	{
+		__m128i p[4];
+		for (int k = 0; k < 4; k++)
+		{
+			// max(x, 0) returns 0 for NaN.
+			__m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + (i + k) * 4), zero), one);
+			p[k] = _mm_cvtps_epi32(_mm_mul_ps(v, scale));
+		}
+		__m128i packed = _mm_packus_epi16(_mm_packs_epi32(p[0], p[1]), _mm_packs_epi32(p[2], p[3]));
+		_mm_storeu_si128((__m128i*)(dst + i), packed);
+	}
+#endif
+	for (; i < pixels; i++)
+	{
+		const float* p = src + i * 4;
+		uint32_t packed = 0;
+		for (int c = 0; c < 4; c++)
+		{
+			packed |= (uint32_t)std::lrint(Clamp01(p[c]) * 255.0f) << (c * 8);
+		}
+		dst[i] = packed;
+	}
+}
+
+void DX::UnpackRGBA8(const uint32_t* src, float* dst, size_t pixels)
+{
+	size_t i = 0;
+#if defined(DX_SIMD_SSE2)
+	const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 4 <= pixels; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i lo = _mm_unpacklo_epi8(v, zero);
+		__m128i hi = _mm_unpackhi_epi8(v, zero);
+		_mm_storeu_ps(dst + i * 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dst + i * 4 + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dst + i * 4 + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+		_mm_storeu_ps(dst + i * 4 + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+	}
+#endif
+	for (; i < pixels; i++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			dst[i * 4 + c] = ((src[i] >> (c * 8)) & 0xff) * (1.0f / 255.0f);
+		}
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// CPU conversions between float4 pixels (the CpuCanvas layout) and the packed render target
+// formats the canvas can use. Bit layouts match the DXGI formats, so packed rows can be uploaded
+// to or read back from a texture of that format directly. Rounding is round-to-nearest-even.
+namespace DX
+{
+	// DXGI_FORMAT_R16G16B16A16_FLOAT: four halves per pixel. Overflow becomes infinity.
+	void PackHalf4(const float* src, uint16_t* dst, size_t pixels);
+	void UnpackHalf4(const uint16_t* src, float* dst, size_t pixels);
+
+	// DXGI_FORMAT_R11G11B10_FLOAT: unsigned 11/11/10-bit floats in one 32-bit word, R in the low bits.
+	// Alpha is dropped on pack and comes back as 1. Negative values clamp to 0 and values past the
+	// largest finite one clamp to it, as DirectXMath's XMStoreFloat3PK does.
+	void PackR11G11B10(const float* src, uint32_t* dst, size_t pixels);
+	void UnpackR11G11B10(const uint32_t* src, float* dst, size_t pixels);
+
+	// DXGI_FORMAT_R8G8B8A8_UNORM: clamps to [0, 1], R in the low byte.
+	void PackRGBA8(const float* src, uint32_t* dst, size_t pixels);
+	void UnpackRGBA8(const uint32_t* src, float* dst, size_t pixels);
+
+	// Single-value conversions, used for the leftover pixels and by the scalar builds.
+	uint16_t FloatToHalf(float value);
+	float HalfToFloat(uint16_t value);
+	uint32_t FloatToSmallFloat(float value, int mantissaBits);	// 6 for R and G, 5 for B
+	float SmallFloatToFloat(uint32_t value, int mantissaBits);
+}
@@ -0,0 +1,137 @@
+#include "pch.h"
+#include "RenderTargetPool.h"
+#include "DirectXHelper.h"
+
+using namespace DX;
+
+namespace
+{
+	// 0 for a format the pool does not account for.
+	uint32 FormatBytes(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_R32G32B32A32_FLOAT:
+			return 16;
+		case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		case DXGI_FORMAT_R16G16B16A16_UNORM:
+			return 8;
+		case DXGI_FORMAT_R11G11B10_FLOAT:
+		case DXGI_FORMAT_R10G10B10A2_UNORM:
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_UNORM:
+		case DXGI_FORMAT_R16G16_FLOAT:
+		case DXGI_FORMAT_R16G16_SNORM:
+		case DXGI_FORMAT_R32_FLOAT:
+			return 4;
+		case DXGI_FORMAT_R16_FLOAT:
+		case DXGI_FORMAT_R16_UNORM:
+			return 2;
+		case DXGI_FORMAT_R8_UNORM:
+			return 1;
+		default:
+			return 0;
+		}
+	}
+}
+
+RenderTargetPool::RenderTargetPool(const std::shared_ptr<DeviceResources>& deviceResources) :
+	m_deviceResources(deviceResources),
+	m_factory(deviceResources),
+	m_targets(m_factory)
+{
+}
+
+RenderTargetHandle RenderTargetPool::TextureFactory::Create(const RenderTargetKey& key)
+{
+	auto device = m_deviceResources->GetD3DDevice();
+	bool multisampled = key.sampleCount > 1;
+
+	// every format the pool hands out has to be accounted for in BytesPerPixel
+	BytesPerPixel(key.format);
+
+	RenderTargetHandle target = std::make_shared<PooledRenderTarget>();
+	target->key = key;
+
+	CD3D11_TEXTURE2D_DESC textureDesc(
+		key.format,
+		key.width,
+		key.height,
+		1,
+		1,
+		key.bindFlags,
+		D3D11_USAGE_DEFAULT,
+		0,
+		key.sampleCount
+		);
+	DX::ThrowIfFailed(device->CreateTexture2D(&textureDesc, nullptr, &target->texture));
+
+	if (key.bindFlags & D3D11_BIND_RENDER_TARGET)
+	{
+		CD3D11_RENDER_TARGET_VIEW_DESC rtvDesc(multisampled ? D3D11_RTV_DIMENSION_TEXTURE2DMS : D3D11_RTV_DIMENSION_TEXTURE2D, key.format);
+		DX::ThrowIfFailed(device->CreateRenderTargetView(target->texture.Get(), &rtvDesc, &target->rtv));
+	}
+
+	if (key.bindFlags & D3D11_BIND_SHADER_RESOURCE)
+	{
+		CD3D11_SHADER_RESOURCE_VIEW_DESC srvDesc(multisampled ? D3D11_SRV_DIMENSION_TEXTURE2DMS : D3D11_SRV_DIMENSION_TEXTURE2D, key.format, 0, 1);
+		DX::ThrowIfFailed(device->CreateShaderResourceView(target->texture.Get(), &srvDesc, &target->srv));
+	}
+
+	if (key.bindFlags & D3D11_BIND_UNORDERED_ACCESS)
+	{
+		CD3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc(D3D11_UAV_DIMENSION_TEXTURE2D, key.format);
+		DX::ThrowIfFailed(device->CreateUnorderedAccessView(target->texture.Get(), &uavDesc, &target->uav));
+	}
+
+	return target;
+}
+
+uint64 RenderTargetPool::GetPooledBytes() const
+{
+	uint64 bytes = 0;
+	m_targets.ForEach([&bytes](const PooledRenderTarget& target)
+	{
+		const RenderTargetKey& key = target.key;
+		bytes += (uint64)key.width * key.height * key.sampleCount * BytesPerPixel(key.format);
+	});
+	return bytes;
+}
+
+bool RenderTargetPool::IsFormatSupported(DXGI_FORMAT format) const
+{
+	const UINT required = D3D11_FORMAT_SUPPORT_TEXTURE2D | D3D11_FORMAT_SUPPORT_RENDER_TARGET | D3D11_FORMAT_SUPPORT_SHADER_SAMPLE;
+	UINT support = 0;
+	if (FAILED(m_deviceResources->GetD3DDevice()->CheckFormatSupport(format, &support)))
+	{
+		return false;
+	}
+	return (support & required) == required;
+}
+
+bool RenderTargetPool::IsUnorderedAccessSupported(DXGI_FORMAT format) const
+{
+	const UINT required = D3D11_FORMAT_SUPPORT_TYPED_UNORDERED_ACCESS_VIEW;
+	UINT support = 0;
+	if (FAILED(m_deviceResources->GetD3DDevice()->CheckFormatSupport(format, &support)))
+	{
+		return false;
+	}
+	return (support & required) == required;
+}
+
+uint32 RenderTargetPool::BytesPerPixel(DXGI_FORMAT format)
+{
+	uint32 bytes = FormatBytes(format);
+	if (bytes == 0)
+	{
+		// a guess here would skew every byte count the chain reports
+		throw ref new Platform::InvalidArgumentException();
+	}
+	return bytes;
+}
+
+bool RenderTargetPool::IsAccountedFormat(DXGI_FORMAT format)
+{
+	return FormatBytes(format) != 0;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+#include "DeviceResources.h"
+#include "ResourcePool.h"
+
+namespace DX
+{
+	// Everything that decides whether two render targets are interchangeable.
+	struct RenderTargetKey
+	{
+		RenderTargetKey() : width(0), height(0), format(DXGI_FORMAT_UNKNOWN), bindFlags(0), sampleCount(1) {}
+		RenderTargetKey(UINT w, UINT h, DXGI_FORMAT f, UINT bind = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE, UINT samples = 1) :
+			width(w), height(h), format(f), bindFlags(bind), sampleCount(samples) {}
+
+		bool operator==(const RenderTargetKey& other) const
+		{
+			return width == other.width && height == other.height && format == other.format &&
+				bindFlags == other.bindFlags && sampleCount == other.sampleCount;
+		}
+		bool operator!=(const RenderTargetKey& other) const { return !(*this == other); }
+
+		UINT width;
+		UINT height;
+		DXGI_FORMAT format;
+		UINT bindFlags;
+		UINT sampleCount;
+	};
+
+	// A texture with the views its bind flags call for.
+	struct PooledRenderTarget
+	{
+		RenderTargetKey key;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D>				texture;
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView>		rtv;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	srv;
+		Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>	uav;
+	};
+
+	// Reference-counted handle. A pooled target is free again once every handle to it is gone.
+	typedef std::shared_ptr<PooledRenderTarget> RenderTargetHandle;
+
+	// Hands out render targets by key and keeps released ones around for reuse, so a window
+	// resize only creates the targets whose size actually changed and going back to an earlier
+	// size costs nothing. Targets that stay unused for a while are dropped by EndFrame().
+	// The bookkeeping is a ResourcePool; this class makes the textures.
+	class RenderTargetPool
+	{
+	public:
+		RenderTargetPool(const std::shared_ptr<DeviceResources>& deviceResources);
+
+		// Returns a free target matching key, creating one only when none is available.
+		RenderTargetHandle Acquire(const RenderTargetKey& key) { return m_targets.Acquire(key); }
+
+		// Gives each slot a target for its key, replacing only the slots whose key changed.
+		// Returns how many were replaced.
+		unsigned int Refill(std::vector<RenderTargetHandle>& slots, const std::vector<RenderTargetKey>& keys) { return m_targets.Refill(slots, keys); }
+
+		// Call once per frame. Marks handed-out targets as used and drops free ones that have
+		// been idle for more than maxIdleFrames.
+		void EndFrame(uint32 maxIdleFrames = 120) { m_targets.EndFrame(maxIdleFrames); }
+
+		// Drops every pooled target (device lost). Outstanding handles keep their own references.
+		void ReleaseDeviceDependentResources() { m_targets.Clear(); }
+
+		uint32 GetTexturesCreated() const	{ return m_targets.GetCreated(); }
+		uint32 GetTexturesReused() const	{ return m_targets.GetReused(); }
+		size_t GetPooledCount() const		{ return m_targets.GetCount(); }
+		uint64 GetPooledBytes() const;
+
+		// Whether the device can render to, and filter, a 2D texture of this format.
+		bool IsFormatSupported(DXGI_FORMAT format) const;
+
+		// Whether a compute shader can write the format through a typed UAV.
+		bool IsUnorderedAccessSupported(DXGI_FORMAT format) const;
+
+		// Throws Platform::InvalidArgumentException for a format not listed, so a target format
+		// new to the renderer has to be added; Acquire checks it before creating a texture.
+		static uint32 BytesPerPixel(DXGI_FORMAT format);
+
+		// Whether BytesPerPixel lists the format, i.e. whether Acquire will take it.
+		static bool IsAccountedFormat(DXGI_FORMAT format);
+
+	private:
+		class TextureFactory : public ResourcePool<RenderTargetKey, PooledRenderTarget>::Factory
+		{
+		public:
+			explicit TextureFactory(const std::shared_ptr<DeviceResources>& deviceResources) : m_deviceResources(deviceResources) {}
+			virtual RenderTargetHandle Create(const RenderTargetKey& key);
+
+		private:
+			std::shared_ptr<DeviceResources> m_deviceResources;
+		};
+
+		std::shared_ptr<DeviceResources> m_deviceResources;
+		TextureFactory m_factory;
+		ResourcePool<RenderTargetKey, PooledRenderTarget> m_targets;
+	};
+}
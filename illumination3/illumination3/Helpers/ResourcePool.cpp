@@ -0,0 +1,151 @@
+#include "ResourcePool.h"
+
+#if defined(DX_HEADLESS_CHECKS)
+using namespace DX;
+
+namespace
+{
+	// RenderTargetKey without the D3D types.
+	struct CheckKey
+	{
+		uint32_t width, height, format, bindFlags, sampleCount;
+
+		bool operator==(const CheckKey& other) const
+		{
+			return width == other.width && height == other.height && format == other.format &&
+				bindFlags == other.bindFlags && sampleCount == other.sampleCount;
+		}
+	};
+
+	struct CheckResource
+	{
+		CheckKey key;
+	};
+
+	typedef ResourcePool<CheckKey, CheckResource> CheckPool;
+
+	class CountingFactory : public CheckPool::Factory
+	{
+	public:
+		CountingFactory() : created(0) {}
+
+		virtual CheckPool::Handle Create(const CheckKey& key)
+		{
+			created++;
+			CheckPool::Handle resource = std::make_shared<CheckResource>();
+			resource->key = key;
+			return resource;
+		}
+
+		unsigned int created;
+	};
+
+	// A target as PostProcessChain sizes it: a fraction of the output, or fixed.
+	struct CheckTarget
+	{
+		float scale;
+		uint32_t fixedSize;
+		uint32_t format;
+	};
+
+	std::vector<CheckKey> KeysFor(const std::vector<CheckTarget>& targets, uint32_t width, uint32_t height)
+	{
+		std::vector<CheckKey> keys;
+		for (const CheckTarget& target : targets)
+		{
+			CheckKey key = { target.fixedSize, target.fixedSize, target.format, 0x28, 1 };
+			if (target.fixedSize == 0)
+			{
+				key.width = (uint32_t)(width * target.scale);
+				key.height = (uint32_t)(height * target.scale);
+			}
+			keys.push_back(key);
+		}
+		return keys;
+	}
+}
+
+ResourcePoolReport DX::ValidateResourcePool()
+{
+	ResourcePoolReport report = {};
+	const uint32_t maxIdleFrames = 120;
+
+	{
+		CountingFactory factory;
+		CheckPool pool(factory);
+		CheckKey key = { 640, 360, 10, 0x28, 1 };
+		CheckPool::Handle first = pool.Acquire(key);
+		CheckResource* resource = first.get();
+		bool busyNotShared = pool.Acquire(key).get() != resource;
+		first.reset();
+		report.reusesReleased = busyNotShared && pool.Acquire(key).get() == resource && pool.GetReused() == 1;
+
+		// every field of the key on its own; the handles are dropped, so any match would be reused
+		unsigned int before = factory.created;
+		CheckKey variants[5] = { key, key, key, key, key };
+		variants[0].width = 641;
+		variants[1].height = 361;
+		variants[2].format = 28;
+		variants[3].bindFlags |= 0x80;
+		variants[4].sampleCount = 4;
+		for (const CheckKey& variant : variants)
+		{
+			pool.Acquire(variant);
+		}
+		report.keysApart = factory.created == before + 5;
+	}
+
+	{
+		CountingFactory factory;
+		CheckPool pool(factory);
+		CheckKey key = { 64, 64, 28, 0x28, 1 };
+		CheckPool::Handle held = pool.Acquire(key);
+		pool.Acquire(key);	// dropped at once
+		bool kept = true;
+		for (uint32_t frame = 0; frame <= maxIdleFrames; frame++)
+		{
+			pool.EndFrame(maxIdleFrames);
+			kept &= pool.GetCount() == 2;
+		}
+		pool.EndFrame(maxIdleFrames);
+		report.trimsIdle = kept && pool.GetCount() == 1 && pool.Acquire(key).get() != held.get() && factory.created == 3;
+	}
+
+	{
+		// Canvas, effects, a half-size blur, a quarter-size bloom level and two fixed-size
+		// targets; the window halves and then goes back. After halving, the canvas fits the
+		// blur's old texture and the blur the bloom level's, which they only get if those are
+		// handed back first; the effects target and the bloom level need new ones.
+		static const CheckTarget targets[] =
+		{
+			{ 1.0f, 0, 10 }, { 1.0f, 0, 28 }, { 0.5f, 0, 10 }, { 0.25f, 0, 10 }, { 1.0f, 256, 10 }, { 1.0f, 64, 41 }
+		};
+		std::vector<CheckTarget> chain(targets, targets + sizeof(targets) / sizeof(targets[0]));
+		report.targets = (unsigned int)chain.size();
+		report.expectedResizeCreated = 2;
+
+		CountingFactory factory;
+		CheckPool pool(factory);
+		std::vector<CheckPool::Handle> slots;
+		pool.Refill(slots, KeysFor(chain, 1920, 1080));
+
+		CheckResource* fixed[2] = { slots[4].get(), slots[5].get() };
+		unsigned int before = factory.created;
+		std::vector<CheckKey> halved = KeysFor(chain, 960, 540);
+		report.resizeRefilled = pool.Refill(slots, halved);
+		report.resizeCreated = factory.created - before;
+		report.keepsUnchanged = slots[4].get() == fixed[0] && slots[5].get() == fixed[1];
+		report.keysMatch = true;
+		for (size_t i = 0; i < slots.size(); i++)
+		{
+			report.keysMatch &= slots[i]->key == halved[i];
+		}
+
+		before = factory.created;
+		pool.Refill(slots, KeysFor(chain, 1920, 1080));
+		report.resizeBackCreated = factory.created - before;
+	}
+
+	return report;
+}
+#endif
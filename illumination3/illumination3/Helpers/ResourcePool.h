@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace DX
+{
+	// The bookkeeping behind RenderTargetPool, apart from anything that talks to a device:
+	// resources handed out by key, reused once every handle to them is gone, and dropped after
+	// sitting unused for a while. Key needs operator==; Resource needs a key member that the
+	// factory sets to the key it was created for.
+	template <typename Key, typename Resource>
+	class ResourcePool
+	{
+	public:
+		typedef std::shared_ptr<Resource> Handle;
+
+		// Makes the resource for a key: textures for RenderTargetPool, stand-ins in the checks.
+		class Factory
+		{
+		public:
+			virtual Handle Create(const Key& key) = 0;
+
+		protected:
+			~Factory() {}
+		};
+
+		explicit ResourcePool(Factory& factory) : m_factory(&factory), m_frame(0), m_created(0), m_reused(0) {}
+
+		// Returns a free resource matching key, creating one only when none is available.
+		Handle Acquire(const Key& key)
+		{
+			// The pool's own reference is the only one on a free resource.
+			for (auto& entry : m_entries)
+			{
+				if (entry.resource.use_count() == 1 && entry.resource->key == key)
+				{
+					entry.lastUsedFrame = m_frame;
+					m_reused++;
+					return entry.resource;
+				}
+			}
+
+			Entry entry;
+			entry.resource = m_factory->Create(key);
+			entry.lastUsedFrame = m_frame;
+			m_entries.push_back(entry);
+			m_created++;
+			return entry.resource;
+		}
+
+		// Points slots[i] at a resource for keys[i]. Slots that already hold a match keep it; the
+		// others are handed back before any is filled, so one slot can pick up what another let
+		// go, and a resize only creates the resources whose key changed. Returns how many slots
+		// got a different resource.
+		unsigned int Refill(std::vector<Handle>& slots, const std::vector<Key>& keys)
+		{
+			slots.resize(keys.size());
+			for (size_t i = 0; i < slots.size(); i++)
+			{
+				if (slots[i] && !(slots[i]->key == keys[i]))
+				{
+					slots[i].reset();
+				}
+			}
+
+			unsigned int refilled = 0;
+			for (size_t i = 0; i < slots.size(); i++)
+			{
+				if (!slots[i])
+				{
+					slots[i] = Acquire(keys[i]);
+					refilled++;
+				}
+			}
+			return refilled;
+		}
+
+		// Call once per frame. Marks handed-out resources as used and drops free ones that have
+		// been idle for more than maxIdleFrames.
+		void EndFrame(uint32_t maxIdleFrames)
+		{
+			for (auto it = m_entries.begin(); it != m_entries.end();)
+			{
+				if (it->resource.use_count() > 1)
+				{
+					it->lastUsedFrame = m_frame;
+					++it;
+				}
+				else if (m_frame - it->lastUsedFrame > maxIdleFrames)
+				{
+					it = m_entries.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
+			m_frame++;
+		}
+
+		// Drops every pooled resource. Outstanding handles keep their own references.
+		void Clear() { m_entries.clear(); }
+
+		template <typename Func>
+		void ForEach(const Func& func) const
+		{
+			for (const auto& entry : m_entries)
+			{
+				func(*entry.resource);
+			}
+		}
+
+		uint32_t GetCreated() const	{ return m_created; }
+		uint32_t GetReused() const	{ return m_reused; }
+		size_t GetCount() const		{ return m_entries.size(); }
+
+	private:
+		struct Entry
+		{
+			Handle resource;
+			uint32_t lastUsedFrame;
+		};
+
+		Factory* m_factory;
+		std::vector<Entry> m_entries;
+		uint32_t m_frame;
+		uint32_t m_created;
+		uint32_t m_reused;
+	};
+
+#if defined(DX_HEADLESS_CHECKS)
+	struct ResourcePoolReport
+	{
+		bool reusesReleased;		// a dropped handle's resource comes back for the same key
+		bool keysApart;				// width, height, format, bind flags and samples each get their own
+		bool trimsIdle;				// a free resource lasts maxIdleFrames and no longer
+		unsigned int targets;			// in the resize check, 4 of them sized by the window
+		unsigned int resizeRefilled;	// slots Refill replaced when the window halved
+		unsigned int resizeCreated;		// resources created for them
+		unsigned int expectedResizeCreated;
+		bool keepsUnchanged;			// the fixed-size targets keep their resources through it
+		bool keysMatch;					// and every slot ends up with its new key
+		unsigned int resizeBackCreated;		// back to the first size: the released ones are reused
+	};
+
+	// Runs the pool over a stand-in factory that counts what it makes.
+	ResourcePoolReport ValidateResourcePool();
+#endif
+}
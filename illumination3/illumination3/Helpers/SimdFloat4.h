@@ -0,0 +1,247 @@
+#pragma once
+
+// Minimal four-wide float vector used by the CPU versions of the effects.
+// Maps to SSE2 on x86/x64 and NEON on ARM, with a scalar fallback so the
+// same kernels build on headless Linux boxes that have no DirectXMath.
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define DX_SIMD_SSE2 1
+#include <emmintrin.h>
+#elif defined(_M_ARM) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DX_SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#include <cmath>
+#endif
+
+#include <cstdint>
+
+namespace DX
+{
+#if defined(DX_SIMD_SSE2)
+	typedef __m128 SimdFloat4;
+
+	inline SimdFloat4 SimdLoad(const float* p)							{ return _mm_loadu_ps(p); }
+	inline void SimdStore(float* p, SimdFloat4 v)						{ _mm_storeu_ps(p, v); }
+	inline SimdFloat4 SimdSet(float x, float y, float z, float w)		{ return _mm_setr_ps(x, y, z, w); }
+	inline SimdFloat4 SimdSplat(float s)								{ return _mm_set1_ps(s); }
+	inline SimdFloat4 SimdZero()										{ return _mm_setzero_ps(); }
+	inline SimdFloat4 SimdAdd(SimdFloat4 a, SimdFloat4 b)				{ return _mm_add_ps(a, b); }
+	inline SimdFloat4 SimdSub(SimdFloat4 a, SimdFloat4 b)				{ return _mm_sub_ps(a, b); }
+	inline SimdFloat4 SimdMul(SimdFloat4 a, SimdFloat4 b)				{ return _mm_mul_ps(a, b); }
+	inline SimdFloat4 SimdDiv(SimdFloat4 a, SimdFloat4 b)				{ return _mm_div_ps(a, b); }
+	inline SimdFloat4 SimdSqrt(SimdFloat4 a)							{ return _mm_sqrt_ps(a); }
+	inline SimdFloat4 SimdMin(SimdFloat4 a, SimdFloat4 b)				{ return _mm_min_ps(a, b); }
+	inline SimdFloat4 SimdMax(SimdFloat4 a, SimdFloat4 b)				{ return _mm_max_ps(a, b); }
+	inline SimdFloat4 SimdCmpGt(SimdFloat4 a, SimdFloat4 b)				{ return _mm_cmpgt_ps(a, b); }
+	inline SimdFloat4 SimdCmpLt(SimdFloat4 a, SimdFloat4 b)				{ return _mm_cmplt_ps(a, b); }
+	inline SimdFloat4 SimdAnd(SimdFloat4 a, SimdFloat4 b)				{ return _mm_and_ps(a, b); }
+	inline SimdFloat4 SimdOr(SimdFloat4 a, SimdFloat4 b)				{ return _mm_or_ps(a, b); }
+	// Picks b where mask is set, a elsewhere.
+	inline SimdFloat4 SimdSelect(SimdFloat4 a, SimdFloat4 b, SimdFloat4 mask)
+	{
+		return _mm_or_ps(_mm_andnot_ps(mask, a), _mm_and_ps(mask, b));
+	}
+	inline int SimdMoveMask(SimdFloat4 mask)							{ return _mm_movemask_ps(mask); }
+	inline float SimdGetX(SimdFloat4 v)									{ return _mm_cvtss_f32(v); }
+	// Rounds to the nearest integer, ties to even.
+	inline void SimdStoreRounded(int32_t* p, SimdFloat4 v)				{ _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_cvtps_epi32(v)); }
+	inline SimdFloat4 SimdLoadInt(const int32_t* p)						{ return _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))); }
+	// Rows a..d become the columns: a = (a.x, b.x, c.x, d.x) and so on.
+	inline void SimdTranspose4(SimdFloat4& a, SimdFloat4& b, SimdFloat4& c, SimdFloat4& d)	{ _MM_TRANSPOSE4_PS(a, b, c, d); }
+#elif defined(DX_SIMD_NEON)
+	typedef float32x4_t SimdFloat4;
+
+	inline SimdFloat4 SimdLoad(const float* p)							{ return vld1q_f32(p); }
+	inline void SimdStore(float* p, SimdFloat4 v)						{ vst1q_f32(p, v); }
+	inline SimdFloat4 SimdSet(float x, float y, float z, float w)
+	{
+		float v[4] = { x, y, z, w };
+		return vld1q_f32(v);
+	}
+	inline SimdFloat4 SimdSplat(float s)								{ return vdupq_n_f32(s); }
+	inline SimdFloat4 SimdZero()										{ return vdupq_n_f32(0.0f); }
+	inline SimdFloat4 SimdAdd(SimdFloat4 a, SimdFloat4 b)				{ return vaddq_f32(a, b); }
+	inline SimdFloat4 SimdSub(SimdFloat4 a, SimdFloat4 b)				{ return vsubq_f32(a, b); }
+	inline SimdFloat4 SimdMul(SimdFloat4 a, SimdFloat4 b)				{ return vmulq_f32(a, b); }
+	inline SimdFloat4 SimdDiv(SimdFloat4 a, SimdFloat4 b)
+	{
+		// Two Newton steps on the reciprocal estimate; close enough to IEEE divide for colour work.
+		float32x4_t r = vrecpeq_f32(b);
+		r = vmulq_f32(vrecpsq_f32(b, r), r);
+		r = vmulq_f32(vrecpsq_f32(b, r), r);
+		return vmulq_f32(a, r);
+	}
+	inline SimdFloat4 SimdSqrt(SimdFloat4 a)
+	{
+#if defined(__aarch64__) || defined(_M_ARM64)
+		return vsqrtq_f32(a);
+#else
+		// a * 1 / sqrt(a) from two Newton steps on the estimate; 0 stays 0.
+		float32x4_t r = vrsqrteq_f32(a);
+		r = vmulq_f32(vrsqrtsq_f32(vmulq_f32(a, r), r), r);
+		r = vmulq_f32(vrsqrtsq_f32(vmulq_f32(a, r), r), r);
+		uint32x4_t zero = vceqq_f32(a, vdupq_n_f32(0.0f));
+		return vbslq_f32(zero, a, vmulq_f32(a, r));
+#endif
+	}
+	inline SimdFloat4 SimdMin(SimdFloat4 a, SimdFloat4 b)				{ return vminq_f32(a, b); }
+	inline SimdFloat4 SimdMax(SimdFloat4 a, SimdFloat4 b)				{ return vmaxq_f32(a, b); }
+	inline SimdFloat4 SimdCmpGt(SimdFloat4 a, SimdFloat4 b)				{ return vreinterpretq_f32_u32(vcgtq_f32(a, b)); }
+	inline SimdFloat4 SimdCmpLt(SimdFloat4 a, SimdFloat4 b)				{ return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+	inline SimdFloat4 SimdAnd(SimdFloat4 a, SimdFloat4 b)
+	{
+		return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+	}
+	inline SimdFloat4 SimdOr(SimdFloat4 a, SimdFloat4 b)
+	{
+		return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+	}
+	inline SimdFloat4 SimdSelect(SimdFloat4 a, SimdFloat4 b, SimdFloat4 mask)
+	{
+		return vbslq_f32(vreinterpretq_u32_f32(mask), b, a);
+	}
+	inline int SimdMoveMask(SimdFloat4 mask)
+	{
+		uint32x4_t m = vshrq_n_u32(vreinterpretq_u32_f32(mask), 31);
+		return (int)(vgetq_lane_u32(m, 0) | (vgetq_lane_u32(m, 1) << 1) | (vgetq_lane_u32(m, 2) << 2) | (vgetq_lane_u32(m, 3) << 3));
+	}
+	inline float SimdGetX(SimdFloat4 v)									{ return vgetq_lane_f32(v, 0); }
+	inline void SimdStoreRounded(int32_t* p, SimdFloat4 v)
+	{
+#if defined(__aarch64__) || defined(_M_ARM64)
+		vst1q_s32(p, vcvtnq_s32_f32(v));
+#else
+		// vcvtq truncates; add half away from zero first (ties round away rather than to even).
+		float32x4_t half = vbslq_f32(vcltq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f));
+		vst1q_s32(p, vcvtq_s32_f32(vaddq_f32(v, half)));
+#endif
+	}
+	inline SimdFloat4 SimdLoadInt(const int32_t* p)						{ return vcvtq_f32_s32(vld1q_s32(p)); }
+	inline void SimdTranspose4(SimdFloat4& a, SimdFloat4& b, SimdFloat4& c, SimdFloat4& d)
+	{
+		float32x4x2_t ab = vtrnq_f32(a, b);
+		float32x4x2_t cd = vtrnq_f32(c, d);
+		a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+		b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+		c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+		d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+	}
+#else
+	struct SimdFloat4 { float v[4]; };
+
+	inline SimdFloat4 SimdLoad(const float* p)							{ SimdFloat4 r = { { p[0], p[1], p[2], p[3] } }; return r; }
+	inline void SimdStore(float* p, SimdFloat4 v)						{ p[0] = v.v[0]; p[1] = v.v[1]; p[2] = v.v[2]; p[3] = v.v[3]; }
+	inline SimdFloat4 SimdSet(float x, float y, float z, float w)		{ SimdFloat4 r = { { x, y, z, w } }; return r; }
+	inline SimdFloat4 SimdSplat(float s)								{ return SimdSet(s, s, s, s); }
+	inline SimdFloat4 SimdZero()										{ return SimdSplat(0.0f); }
+
+#define DX_SIMD_SCALAR_OP(name, expr) \
+	inline SimdFloat4 name(SimdFloat4 a, SimdFloat4 b) \
+	{ SimdFloat4 r; for (int i = 0; i < 4; i++) { float x = a.v[i], y = b.v[i]; r.v[i] = (expr); } return r; }
+
+	DX_SIMD_SCALAR_OP(SimdAdd, x + y)
+	DX_SIMD_SCALAR_OP(SimdSub, x - y)
+	DX_SIMD_SCALAR_OP(SimdMul, x * y)
+	DX_SIMD_SCALAR_OP(SimdDiv, x / y)
+	DX_SIMD_SCALAR_OP(SimdMin, y < x ? y : x)
+	DX_SIMD_SCALAR_OP(SimdMax, y > x ? y : x)
+#undef DX_SIMD_SCALAR_OP
+
+	inline SimdFloat4 SimdSqrt(SimdFloat4 a)
+	{
+		SimdFloat4 r; for (int i = 0; i < 4; i++) r.v[i] = std::sqrt(a.v[i]); return r;
+	}
+
+	inline float SimdMaskBits(bool b)									{ union { unsigned int u; float f; } m; m.u = b ? 0xFFFFFFFFu : 0u; return m.f; }
+	inline unsigned int SimdBits(float f)								{ union { unsigned int u; float f; } m; m.f = f; return m.u; }
+	inline float SimdFromBits(unsigned int u)							{ union { unsigned int u; float f; } m; m.u = u; return m.f; }
+
+	inline SimdFloat4 SimdCmpGt(SimdFloat4 a, SimdFloat4 b)
+	{
+		SimdFloat4 r; for (int i = 0; i < 4; i++) r.v[i] = SimdMaskBits(a.v[i] > b.v[i]); return r;
+	}
+	inline SimdFloat4 SimdCmpLt(SimdFloat4 a, SimdFloat4 b)
+	{
+		SimdFloat4 r; for (int i = 0; i < 4; i++) r.v[i] = SimdMaskBits(a.v[i] < b.v[i]); return r;
+	}
+	inline SimdFloat4 SimdAnd(SimdFloat4 a, SimdFloat4 b)
+	{
+		SimdFloat4 r; for (int i = 0; i < 4; i++) r.v[i] = SimdFromBits(SimdBits(a.v[i]) & SimdBits(b.v[i])); return r;
+	}
+	inline SimdFloat4 SimdOr(SimdFloat4 a, SimdFloat4 b)
+	{
+		SimdFloat4 r; for (int i = 0; i < 4; i++) r.v[i] = SimdFromBits(SimdBits(a.v[i]) | SimdBits(b.v[i])); return r;
+	}
+	inline SimdFloat4 SimdSelect(SimdFloat4 a, SimdFloat4 b, SimdFloat4 mask)
+	{
+		SimdFloat4 r; for (int i = 0; i < 4; i++) r.v[i] = SimdBits(mask.v[i]) ? b.v[i] : a.v[i]; return r;
+	}
+	inline int SimdMoveMask(SimdFloat4 mask)
+	{
+		int m = 0; for (int i = 0; i < 4; i++) m |= (SimdBits(mask.v[i]) >> 31) << i; return m;
+	}
+	inline float SimdGetX(SimdFloat4 v)									{ return v.v[0]; }
+	inline void SimdStoreRounded(int32_t* p, SimdFloat4 v)
+	{
+		for (int i = 0; i < 4; i++) p[i] = (int32_t)std::floor(v.v[i] + 0.5f);
+	}
+	inline SimdFloat4 SimdLoadInt(const int32_t* p)						{ return SimdSet((float)p[0], (float)p[1], (float)p[2], (float)p[3]); }
+	inline void SimdTranspose4(SimdFloat4& a, SimdFloat4& b, SimdFloat4& c, SimdFloat4& d)
+	{
+		SimdFloat4 r[4] = { a, b, c, d };
+		a = SimdSet(r[0].v[0], r[1].v[0], r[2].v[0], r[3].v[0]);
+		b = SimdSet(r[0].v[1], r[1].v[1], r[2].v[1], r[3].v[1]);
+		c = SimdSet(r[0].v[2], r[1].v[2], r[2].v[2], r[3].v[2]);
+		d = SimdSet(r[0].v[3], r[1].v[3], r[2].v[3], r[3].v[3]);
+	}
+#endif
+
+	// a + (b - a) * t, the building block of every bilinear tap.
+	inline SimdFloat4 SimdLerp(SimdFloat4 a, SimdFloat4 b, SimdFloat4 t)
+	{
+		return SimdAdd(a, SimdMul(SimdSub(b, a), t));
+	}
+
+	inline SimdFloat4 SimdAbs(SimdFloat4 a)
+	{
+		return SimdMax(a, SimdSub(SimdZero(), a));
+	}
+
+	// a * b + c.
+	inline SimdFloat4 SimdMulAdd(SimdFloat4 a, SimdFloat4 b, SimdFloat4 c)
+	{
+		return SimdAdd(SimdMul(a, b), c);
+	}
+
+	// sin(x) to about 1e-6 for |x| below a few thousand: reduced to [-pi, pi] by whole turns,
+	// folded onto [-pi/2, pi/2], then a degree 11 Taylor polynomial.
+	inline SimdFloat4 SimdSin(SimdFloat4 x)
+	{
+		int32_t turns[4];
+		SimdStoreRounded(turns, SimdMul(x, SimdSplat(0.159154943f)));
+		SimdFloat4 k = SimdLoadInt(turns);
+		// 2 pi in two parts so the reduction keeps the low bits.
+		x = SimdSub(x, SimdMul(k, SimdSplat(6.28318548f)));
+		x = SimdAdd(x, SimdMul(k, SimdSplat(1.74845553e-7f)));
+
+		const SimdFloat4 halfPi = SimdSplat(1.57079633f);
+		const SimdFloat4 pi = SimdSplat(3.14159265f);
+		x = SimdSelect(x, SimdSub(pi, x), SimdCmpGt(x, halfPi));
+		x = SimdSelect(x, SimdSub(SimdSub(SimdZero(), pi), x), SimdCmpLt(x, SimdSub(SimdZero(), halfPi)));
+
+		SimdFloat4 x2 = SimdMul(x, x);
+		SimdFloat4 p = SimdSplat(-2.50521084e-8f);
+		p = SimdMulAdd(p, x2, SimdSplat(2.75573192e-6f));
+		p = SimdMulAdd(p, x2, SimdSplat(-1.98412698e-4f));
+		p = SimdMulAdd(p, x2, SimdSplat(8.33333333e-3f));
+		p = SimdMulAdd(p, x2, SimdSplat(-1.66666667e-1f));
+		p = SimdMulAdd(p, x2, SimdSplat(1.0f));
+		return SimdMul(p, x);
+	}
+
+	inline SimdFloat4 SimdCos(SimdFloat4 x)
+	{
+		return SimdSin(SimdAdd(x, SimdSplat(1.57079633f)));
+	}
+}
@@ -17,6 +17,7 @@ namespace DX
     public:
         StepTimer() : 
             m_elapsedTicks(0),
+            m_frameTicks(0),
             m_totalTicks(0),
             m_leftOverTicks(0),
             m_frameCount(0),
@@ -44,6 +45,10 @@ namespace DX
         uint64 GetElapsedTicks() const                      { return m_elapsedTicks; }
         double GetElapsedSeconds() const                    { return TicksToSeconds(m_elapsedTicks); }
 
+        // Get wall-clock time between the last two Tick calls, whatever the timestep mode.
+        uint64 GetFrameTicks() const                        { return m_frameTicks; }
+        double GetFrameSeconds() const                      { return TicksToSeconds(m_frameTicks); }
+
         // Get total time since the start of the program.
         uint64 GetTotalTicks() const                        { return m_totalTicks; }
         double GetTotalSeconds() const                      { return TicksToSeconds(m_totalTicks); }
@@ -110,6 +115,7 @@ namespace DX
             // Convert QPC units into a canonical tick format. This cannot overflow due to the previous clamp.
             timeDelta *= TicksPerSecond;
             timeDelta /= m_qpcFrequency.QuadPart;
+            m_frameTicks = timeDelta;
 
             uint32 lastFrameCount = m_frameCount;
 
@@ -174,6 +180,7 @@ namespace DX
 
         // Derived timing data uses a canonical tick format.
         uint64 m_elapsedTicks;
+        uint64 m_frameTicks;
         uint64 m_totalTicks;
         uint64 m_leftOverTicks;
 
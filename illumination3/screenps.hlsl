@@ -1,16 +1,54 @@
 
+// Each optional effect is a compile-time switch, so a permutation without it carries none of
+// its instructions or registers. Content\ScreenPermutations holds one file per combination the
+// renderer can ask for (see ScreenPermutations.h); compiled on its own, this file is the
+// default set.
+#ifndef SCREEN_TV_STATIC
+#define SCREEN_TV_STATIC 0		// Part 2: wobbling rows
+#endif
+#ifndef SCREEN_BLUR
+#define SCREEN_BLUR 0			// Part 1D: 25 taps along the diagonal
+#endif
+#ifndef SCREEN_WIPE
+#define SCREEN_WIPE 1			// Part 1A
+#endif
+#ifndef SCREEN_MAGNET
+#define SCREEN_MAGNET 1			// Part 2
+#endif
+#ifndef SCREEN_BLOOM
+#define SCREEN_BLOOM 0			// adds t1; only for passes that bind a bloom level
+#endif
+#ifndef SCREEN_AMBIENT_OCCLUSION
+#define SCREEN_AMBIENT_OCCLUSION 0	// adds t2; only for passes that bind the occlusion target
+#endif
+#ifndef SCREEN_TILING_FACTOR
+#define SCREEN_TILING_FACTOR 2	// Part 1B: copies of the scene across each axis
+#endif
+
 Texture2D canvas : register(t0);
+Texture2D bloom : register(t1);
+Texture2D ambientOcclusion : register(t2);
 SamplerState mysampler : register(s0);
 
-cbuffer ModelViewProjectionConstantBuffer : register(b0)
+cbuffer ScreenConstantBuffer : register(b3)
 {
-	matrix model;
-	matrix view;
-	matrix projection;
-	float4 time; // use first element as timer
-	float4 eyepos;
+	float4 time; // use first element as timer; y: 1 when only the canvas read is wanted (reduced resolution)
+	float4 bloomParams; // x: bloom intensity
+	float4 canvasRect; // xy: uv extent the world pass drew into (dynamic resolution), zw: half a canvas texel
 };
 
+// Canvas coordinates as if the world pass filled the canvas. When it drew into a smaller
+// top-left rectangle, the wrapped coordinate is scaled into that rectangle and kept half a
+// texel inside it, so filtering never pulls in the stale pixels around it.
+float2 CanvasUV(float2 uv)
+{
+	if (canvasRect.x < 1 || canvasRect.y < 1)
+	{
+		uv = clamp(frac(uv) * canvasRect.xy, canvasRect.zw, canvasRect.xy - canvasRect.zw);
+	}
+	return uv;
+}
+
 // Per-pixel color data passed through the pixel shader.
 struct PixelShaderInput
 {
@@ -31,22 +69,32 @@ float4 main(PixelShaderInput input) : SV_TARGET
 	float2 tv = input.tex;
 	bool isWiper = false;
 
+#if SCREEN_TV_STATIC
 	//Part 2. TV static effect
-	//tv.r = tv.r + 0.05*(tan(t / 10. + 8 * tv.g));
+	tv.r = tv.r + 0.05*(tan(t / 10. + 8 * tv.g));
+#endif
 		
 	float3 effect;
 
-	//effect = canvas.Sample(mysampler, tv);
+	//Part 1B. Show a 2X2 tiling of the scene over the image plane.
+	effect = canvas.Sample(mysampler, CanvasUV(tv*SCREEN_TILING_FACTOR));
 
-	//Multiply by two for Part 1B. Show a 2X2 tiling of the scene over the image plane.
-	effect = canvas.Sample(mysampler, tv*2);
-
-	//Part 1D. Make a strong blur effect. (Suggestion: average at least 25 texture reads. Use a for loop or nested for loops.)
-	/*for (int blur = 0; blur < 25; blur++){
-		effect += canvas.Sample(mysampler, (tv.xy - blur/100) );
-	//	effect += canvas.Sample(mysampler, (tv.xy + blur / 100));
+#if SCREEN_BLUR
+	//Part 1D. Make a strong blur effect by averaging 25 reads, 0.01 uv apart along the
+	// diagonal (0.24 uv end to end), as the original design had it. The separable passes in
+	// BlurPS.hlsl (Sample3DSceneRenderer::RenderBlurPass) are the cheap way to get a blur;
+	// this one smears along the diagonal instead.
+	effect = (float3)0;
+	for (int blur = 0; blur < 25; blur++){
+		effect += canvas.Sample(mysampler, CanvasUV(tv*SCREEN_TILING_FACTOR - blur / 100.0)).rgb;
 	}
-	effect /= 25;*/
+	effect /= 25;
+#endif
+
+	// reduced resolution: this pass stops at the canvas read, and UpsamplePS.hlsl does the
+	// rest at full resolution, where the lines and the threshold's edges stay sharp
+	if (time.g > 0.5)
+		return float4(effect, 1.0f);
 
 	// "transmission" horizontal and vertical lines:
 	if (((int)(input.tex.r * 1920)) % 12 < 2)
@@ -58,6 +106,7 @@ float4 main(PixelShaderInput input) : SV_TARGET
 	// threshold:
 	if (effect.r + effect.g + effect.b > 0.3) effect = (float3)1.0; else effect = (float3)0;
 
+#if SCREEN_WIPE
 	/*Part 1A. A horizontal wipe, where the screen turns 
 	(say) blue beginning from the left and progressing 
 	to the right. When the wipe is done the screen should 
@@ -72,7 +121,9 @@ float4 main(PixelShaderInput input) : SV_TARGET
 	if (isWiper && (t/15) % 20 >15){
 		effect = wipreColour;
 	}
+#endif
 	
+#if SCREEN_MAGNET
 	//Part 2. add magnet on screen effect to go with static
 	float3 result = effect;
 	for (int i = 1; i < 25; ++i) {
@@ -83,8 +134,21 @@ float4 main(PixelShaderInput input) : SV_TARGET
 			result = result + temp;
 	}
 	effect = effect/result;
+#endif
 	
 	cr = effect;
 
+#if SCREEN_AMBIENT_OCCLUSION
+	// half-resolution ambient occlusion, tiled the same way as the canvas. It darkens the
+	// shaded result: before the threshold, which turns the canvas into black and white, all
+	// but the deepest of it would be rounded away.
+	cr *= ambientOcclusion.Sample(mysampler, tv*SCREEN_TILING_FACTOR).r;
+#endif
+
+#if SCREEN_BLOOM
+	// bloom: the glow of the bright parts, tiled the same way as the canvas
+	cr += bloom.Sample(mysampler, tv*SCREEN_TILING_FACTOR).rgb * bloomParams.x;
+#endif
+
 	return float4(cr, 1.0f);
 }
\ No newline at end of file